@@ -1,14 +1,41 @@
 #include "myapp.h"
 #include "common.h"
 #include "job.h"
+#include "launch.h"
+#include "reader.h"
 #include "shell.h"
+#include "siolog.h"
 #include <signal.h>
 #include <stdio.h>
 
 char prompt[] = "mini> ";
+char prompt2[] = "> "; /* for the lines a command goes on over */
+
+// add lines to the *len bytes of a command left open at *cmdline, the last
+// ones the reader handed out, until one of them may end it as more tells
+// return 0 at end of file
+static int read_more(struct reader_t *in, const char **cmdline, size_t *len,
+                     const struct pending_t *more, int emit_prompt) {
+  for (;;) {
+    if (emit_prompt) {
+      printf("%s", prompt2);
+      fflush(stdout);
+    }
+    ssize_t n = reader_extend(in, cmdline, *len);
+    if (n < 0)
+      unix_error("read error");
+    if (n == 0)
+      return 0;
+    size_t added = *len;
+    *len = n;
+    if (pending_check(more, *cmdline + added, n - added))
+      return 1;
+  }
+}
 
 int main(int argc, char *argv[]) {
   int emit_prompt = 1; /* emit prompt (default) */
+  int async = 0;       /* use signal handlers instead of the event loop */
 
   /* Redirect stderr to stdout (so that driver will get all output
   │* on the pipe connected to stdout) */
@@ -16,7 +43,7 @@ int main(int argc, char *argv[]) {
 
   /* Parse the command line */
   char o;
-  while ((o = getopt(argc, argv, "hvp")) != EOF) {
+  while ((o = getopt(argc, argv, "+hvps:ta")) != EOF) {
     switch (o) {
     case 'h': /* print help message */
       usage();
@@ -27,39 +54,79 @@ int main(int argc, char *argv[]) {
     case 'p':          /* don't print a prompt */
       emit_prompt = 0; /* handy for automatic testing */
       break;
+    case 's': /* select the spawn backend */
+      if ((launch_backend = launch_parse_backend(optarg)) < 0)
+        usage();
+      break;
+    case 't': /* report per-launch latency */
+      launch_timing = 1;
+      break;
+    case 'a': /* asynchronous signal handlers */
+      async = 1;
+      break;
     default:
       usage();
     }
   }
 
-  /* Install the signal handlers */
-  Signal(SIGINT, sigint_handler);   /* ctrl-c */
-  Signal(SIGTSTP, sigtstp_handler); /* ctrl-z */
-  Signal(SIGCHLD, sigchld_handler); /* Terminated or stopped child */
+  /* Take signals through the event loop, or install the signal handlers */
+  if (async || init_events() < 0) {
+    Signal(SIGINT, sigint_handler);   /* ctrl-c */
+    Signal(SIGTSTP, sigtstp_handler); /* ctrl-z */
+    Signal(SIGCHLD, sigchld_handler); /* Terminated or stopped child */
+  }
   Signal(SIGQUIT, sigquit_handler); /* Kill the shell */
 
   /* Initialize the job list */
-  initjobs(jobs);
+  initjobs(&jobs);
+
+  /* Logged messages still in the ring are written on exit */
+  atexit(siolog_flush);
+
+  /* myapp script [args] runs the script instead of reading commands */
+  if (optind < argc)
+    exit(source_file(argv[optind], argc - optind, argv + optind));
+
+  /* Without a terminal there is no one to prompt, and stdout is flushed
+   * only when the shell has to, like before it starts a job */
+  int interactive = isatty(STDIN_FILENO);
+  if (!interactive)
+    emit_prompt = 0;
 
   /* Execute the shell's read/eval loop */
-  char cmdline[MAXLINE];
-  
+  struct reader_t in;
+  reader_init(&in, STDIN_FILENO);
+
   while (1) {
+    /* Report what happened to the jobs since the last command */
+    drain_events();
+    siolog_flush();
     if (emit_prompt) {
       printf("%s", prompt);
       fflush(stdout);
     }
-    /* Read command line */
-    if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
-      app_error("fgets error");
-    if (feof(stdin)) { /* End of file (ctrl-d) */
+    /* Read command line, a slice of the reader's buffer */
+    const char *cmdline;
+    ssize_t n = reader_next(&in, &cmdline);
+    if (n < 0)
+      unix_error("read error");
+    if (n == 0) { /* End of file (ctrl-d) */
       fflush(stdout);
       exit(0);
     }
-
-    eval(cmdline);
-    fflush(stdout);
-    fflush(stdout);
+    /* A command left open, like in a quote, waits for the next lines */
+    size_t len = n, used;
+    struct pending_t more;
+    while ((used = eval(cmdline, len, &more)) < len) {
+      cmdline += used;
+      len -= used;
+      if (!read_more(&in, &cmdline, &len, &more, emit_prompt)) {
+        eval(cmdline, len, NULL); /* reports what is left open */
+        break;
+      }
+    }
+    if (interactive)
+      fflush(stdout);
   }
 
   /* control should never reach here */
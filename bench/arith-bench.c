@@ -0,0 +1,57 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "arith.h"
+#include "var.h"
+
+#define NOPS 1000000
+#define NLAUNCHES 200
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  const char *expr = "i = (i + 3) * 2 % 1000";
+  long value;
+  var_set("i", "0", 0);
+
+  // the expression of a loop body, the same text every time
+  long start = now();
+  for (int i = 0; i < NOPS; i++)
+    arith_eval(expr, strlen(expr), &value);
+  long cached = now() - start;
+
+  // a different text every time, so that each is compiled
+  char text[64];
+  start = now();
+  for (int i = 0; i < NOPS; i++) {
+    int len = snprintf(text, sizeof(text), "i = (i + %d) * 2 %% 1000", i);
+    arith_eval(text, len, &value);
+  }
+  long compiled = now() - start;
+
+  fflush(stdout);
+  start = now();
+  for (int i = 0; i < NLAUNCHES; i++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      dup2(open("/dev/null", O_WRONLY), STDOUT_FILENO);
+      execlp("expr", "expr", "3", "*", "2", "%", "1000", (char *)NULL);
+      _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+  }
+  long launched = now() - start;
+
+  printf("%s\n", expr);
+  printf("cached    %8.1f ns\n", (double)cached / NOPS);
+  printf("compiled  %8.1f ns\n", (double)compiled / NOPS);
+  printf("expr      %8.1f ns\n", (double)launched / NLAUNCHES);
+  return 0;
+}
@@ -0,0 +1,99 @@
+#include "reader.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NLINES 1000000
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void report(const char *what, long ns, long n) {
+  printf("%-36s %9.1f ns/line %12.0f lines/s\n", what, (double)ns / n,
+         n * 1e9 / ns);
+}
+
+static char path[] = "/tmp/batch-benchXXXXXX";
+
+// write nlines copies of line to the file at path
+// return descriptor of the file, at its start
+static int make_input(const char *line, long nlines) {
+  int fd = mkstemp(path);
+  FILE *f = fdopen(dup(fd), "w");
+  for (long i = 0; i < nlines; i++)
+    fputs(line, f);
+  fclose(f);
+  return fd;
+}
+
+static void remove_input(int fd) {
+  close(fd);
+  unlink(path);
+  strcpy(path + strlen(path) - 6, "XXXXXX");
+}
+
+// the reader against the fgets loop it replaced
+static void bench_reader(int fd) {
+  char buf[MAXLINE];
+  long n = 0;
+  lseek(fd, 0, SEEK_SET);
+  FILE *f = fdopen(dup(fd), "r");
+  long start = now();
+  while (fgets(buf, MAXLINE, f))
+    n++;
+  report("fgets", now() - start, n);
+  fclose(f);
+
+  struct reader_t r;
+  const char *line;
+  lseek(fd, 0, SEEK_SET);
+  reader_init(&r, fd);
+  n = 0;
+  start = now();
+  while (reader_next(&r, &line) > 0)
+    n++;
+  report("reader_next", now() - start, n);
+  reader_free(&r);
+}
+
+// the whole shell with stdout to /dev/null, reading from fd in batch mode
+// or running the file as a script
+static void bench_shell(int fd, const char *what, long nlines, int script) {
+  lseek(fd, 0, SEEK_SET);
+  long start = now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(fd, STDIN_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    if (script)
+      execl(MYAPP, MYAPP, path, (char *)NULL);
+    else
+      execl(MYAPP, MYAPP, "-p", (char *)NULL);
+    _exit(127);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  report(what, now() - start, nlines);
+}
+
+int main(int argc, char *argv[]) {
+  int fd = make_input("set notify=off\n", NLINES);
+  bench_reader(fd);
+  bench_shell(fd, "myapp -p, set notify=off", NLINES, 0);
+  bench_shell(fd, "myapp script, set notify=off", NLINES, 1);
+  remove_input(fd);
+
+  fd = make_input("# a comment line\n", NLINES);
+  bench_shell(fd, "myapp -p, comment", NLINES, 0);
+  bench_shell(fd, "myapp script, comment", NLINES, 1);
+  remove_input(fd);
+  return 0;
+}
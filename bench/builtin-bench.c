@@ -0,0 +1,94 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NBLOCKS 200
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// a block of the commands scripts are made of, %s being where the programs
+// are taken from: "" for the builtins, /usr/bin/ for the programs they
+// replace. cd and export have no program and are builtins in both.
+static const char *block[] = {
+    "%secho processing item\n",
+    "%stest -d /tmp && %secho is a dir\n",
+    "%s[ a = b ] || %sprintf '%%s %%d\\n' item 3\n",
+    "%strue\n",
+    "%sfalse || %strue\n",
+    "%spwd\n",
+    "cd /tmp\n",
+    "export STEP=1\n",
+};
+
+// write NBLOCKS copies of the block, then set to list the launches
+static void make_script(const char *path, const char *prefix) {
+  FILE *f = fopen(path, "w");
+  for (int i = 0; i < NBLOCKS; i++) {
+    for (size_t j = 0; j < sizeof(block) / sizeof(block[0]); j++)
+      fprintf(f, block[j], prefix, prefix, prefix);
+  }
+  fputs("set\n", f);
+  fclose(f);
+}
+
+// run the script at path with the shell, its output going to out
+// return time it took
+static long run_script(const char *path, int out) {
+  long start = now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(out, STDOUT_FILENO);
+    execl(MYAPP, MYAPP, path, (char *)NULL);
+    _exit(127);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return now() - start;
+}
+
+// return launches set listed in the output at out, of every backend
+static long count_launches(int out) {
+  char line[256];
+  long total = 0, n;
+  lseek(out, 0, SEEK_SET);
+  FILE *f = fdopen(dup(out), "r");
+  while (fgets(line, sizeof(line), f)) {
+    char *p = strstr(line, ": ");
+    if (p && sscanf(p, ": %ld launches,", &n) == 1)
+      total += n;
+  }
+  fclose(f);
+  return total;
+}
+
+static void bench(const char *what, const char *prefix, long *launches,
+                  long *ns) {
+  char path[] = "/tmp/builtin-benchXXXXXX";
+  char outpath[] = "/tmp/builtin-benchXXXXXX";
+  close(mkstemp(path));
+  int out = mkstemp(outpath);
+  make_script(path, prefix);
+  *ns = run_script(path, out);
+  *launches = count_launches(out);
+  printf("%-24s %8ld launches %10.1f ms\n", what, *launches, *ns / 1e6);
+  close(out);
+  unlink(outpath);
+  unlink(path);
+}
+
+int main(int argc, char *argv[]) {
+  long ext_launches, ext_ns, bi_launches, bi_ns;
+  bench("programs", "/usr/bin/", &ext_launches, &ext_ns);
+  bench("builtins", "", &bi_launches, &bi_ns);
+  printf("%ld launches avoided, %.1f%% of the time saved\n",
+         ext_launches - bi_launches, 100.0 * (ext_ns - bi_ns) / ext_ns);
+  return 0;
+}
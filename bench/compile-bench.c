@@ -0,0 +1,91 @@
+#include "compile.h"
+#include "shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NLINES 20000
+#define NRUNS 50
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void report(const char *what, long ns, long n) {
+  printf("%-36s %9.1f ns/cmd %12.0f cmds/s\n", what, (double)ns / n,
+         n * 1e9 / ns);
+}
+
+static void set(const char *option) {
+  char line[64];
+  snprintf(line, sizeof(line), "set %s\n", option);
+  eval(line, strlen(line), NULL);
+}
+
+// a script of builtins and variables, so that what is measured is the shell
+// and not the programs it would launch
+static void make_script(const char *path) {
+  static const char *cmds[] = {
+      "set notify=off\n",
+      "set spawnstat=off && set allocstat=off || set notify=on\n",
+      "# a comment line\n",
+      "jobs\n",
+      "set 'notify=off'; jobs -l\n",
+      "n=off; m=\"$n\"\n",
+      "set notify=\"$m\" spawnstat=$n\n",
+  };
+  int ncmds = sizeof(cmds) / sizeof(cmds[0]);
+  FILE *f = fopen(path, "w");
+  for (int i = 0; i < NLINES; i++)
+    fputs(cmds[i % ncmds], f);
+  fclose(f);
+}
+
+// source the script at path runs times
+static void bench_source(const char *what, char *path, int runs) {
+  long start = now();
+  for (int i = 0; i < runs; i++)
+    source_file(path, 1, &path);
+  report(what, now() - start, (long)runs * NLINES);
+}
+
+int main(int argc, char *argv[]) {
+  char dir[] = "/tmp/compile-benchXXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  char path[64], cache[64], cmd[64];
+  snprintf(path, sizeof(path), "%s/script.sh", dir);
+  make_script(path);
+  initjobs(&jobs);
+
+  set("compile=off");
+  bench_source("interpreted", path, NRUNS);
+
+  // the first run compiles, the others run the code kept in memory
+  set("compile=on");
+  bench_source("compiled, first run", path, 1);
+  bench_source("compiled, kept in memory", path, NRUNS);
+
+  // code read back from the cache file, as a new shell would
+  snprintf(cache, sizeof(cache), "%s/cache", dir);
+  code_cache_dir(cache);
+  code_cache_clear();
+  bench_source("compiled, writing the cache file", path, 1);
+  long start = now();
+  char *args[] = {path, NULL};
+  for (int i = 0; i < NRUNS; i++) {
+    code_cache_clear();
+    source_file(path, 1, args);
+  }
+  report("compiled, read from the cache file", now() - start,
+         (long)NRUNS * NLINES);
+
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  return system(cmd);
+}
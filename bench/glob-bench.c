@@ -0,0 +1,64 @@
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pathglob.h"
+
+#define NFILES 100000
+#define NRUNS 10
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// patterns a script takes files of a large directory with: all of them, by a
+// prefix, by a suffix, and by their length
+static const char *patterns[] = {"*", "f1234*", "*7.log", "f????.log"};
+
+int main(int argc, char *argv[]) {
+  char dir[] = "/tmp/glob-benchXXXXXX";
+  if (!mkdtemp(dir))
+    return 1;
+  char path[64];
+  for (int i = 0; i < NFILES; i++) {
+    snprintf(path, sizeof(path), "%s/f%d.log", dir, i);
+    close(open(path, O_CREAT | O_WRONLY, 0644));
+  }
+
+  struct arena_t arena;
+  arena_init(&arena);
+  printf("%-12s %8s %12s %12s\n", "", "paths", "pathglob", "glob(3)");
+  for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "%s/%s", dir, patterns[i]);
+    int n = 0;
+    long start = now();
+    for (int j = 0; j < NRUNS; j++) {
+      struct arena_mark_t mark = arena_mark(&arena);
+      char **paths;
+      n = pathglob(&arena, pattern, strlen(pattern), &paths);
+      arena_release(&arena, mark);
+    }
+    long ours = (now() - start) / NRUNS;
+
+    start = now();
+    for (int j = 0; j < NRUNS; j++) {
+      glob_t g;
+      glob(pattern, 0, NULL, &g);
+      globfree(&g);
+    }
+    long libc = (now() - start) / NRUNS;
+    printf("%-12s %8d %9.2f ms %9.2f ms\n", patterns[i], n, ours / 1e6,
+           libc / 1e6);
+  }
+  arena_free(&arena);
+
+  char cmd[64];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  return system(cmd);
+}
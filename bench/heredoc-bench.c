@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NCMDS 500
+#define BODY (256 * 1024)
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// the ways the shell hands a command text it has: a here-document in a
+// memfd, a temp file it writes and the command reads, and a pipe fed by a
+// child shell. %s stands for the temp file.
+static const struct {
+  const char *what;
+  const char *line;
+} cases[] = {
+    {"here-document", "wc -c <<EOF >/dev/null\n$b\nEOF\n"},
+    {"temp file", "echo \"$b\" >%s\nwc -c <%s >/dev/null\n"},
+    {"pipe", "wc -c < <(echo \"$b\") >/dev/null\n"},
+};
+
+// write a script that sets b to the text of the file body and runs NCMDS
+// commands made like line, tmp being what %s stands for
+static void make_script(const char *path, const char *line, const char *body,
+                        const char *tmp) {
+  FILE *f = fopen(path, "w");
+  fprintf(f, "b=$(< %s)\n", body);
+  for (int i = 0; i < NCMDS; i++)
+    fprintf(f, line, tmp, tmp);
+  fclose(f);
+}
+
+// run the script at path with the shell
+// return time it took
+static long run_script(const char *path) {
+  long start = now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    execl(MYAPP, MYAPP, path, (char *)NULL);
+    _exit(127);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return now() - start;
+}
+
+int main(int argc, char *argv[]) {
+  char body[] = "/tmp/heredoc-benchXXXXXX";
+  int fd = mkstemp(body);
+  char line[64];
+  memset(line, 'x', sizeof(line) - 1);
+  line[sizeof(line) - 1] = '\n';
+  for (int i = 0; i < BODY / (int)sizeof(line); i++) {
+    if (write(fd, line, sizeof(line)) != sizeof(line))
+      return 1;
+  }
+  close(fd);
+
+  char tmp[] = "/tmp/heredoc-benchXXXXXX";
+  close(mkstemp(tmp));
+  char path[] = "/tmp/heredoc-benchXXXXXX";
+  close(mkstemp(path));
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    make_script(path, cases[i].line, body, tmp);
+    long ns = run_script(path);
+    printf("%-14s %8.1f us per command\n", cases[i].what, ns / 1e3 / NCMDS);
+  }
+  unlink(path);
+  unlink(tmp);
+  unlink(body);
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "expand.h"
+#include "var.h"
+
+#define NOPS 100000
+#define NLAUNCHES 200
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// the operators scripts use instead of the programs they launch for it
+static const struct {
+  const char *word;
+  const char *program[4];
+} ops[] = {
+    {"${f##*/}", {"basename", "/usr/local/lib/libfoo.so.1.2"}},
+    {"${f%/*}", {"dirname", "/usr/local/lib/libfoo.so.1.2"}},
+    {"${f%%.*}", {"sed", "s/\\..*//", "/dev/null"}},
+    {"${f//\\//:}", {"sed", "s|/|:|g", "/dev/null"}},
+    {"${f:11:3}", {"cut", "-c12-14", "/dev/null"}},
+    {"${#f}", {"true"}},
+};
+
+// return ns a launch of the program and a wait for it take
+static long launch(char *const argv[]) {
+  fflush(stdout);
+  long start = now();
+  for (int i = 0; i < NLAUNCHES; i++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      dup2(open("/dev/null", O_WRONLY), STDOUT_FILENO);
+      execvp(argv[0], argv);
+      _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+  }
+  return (now() - start) / NLAUNCHES;
+}
+
+int main(int argc, char *argv[]) {
+  struct arena_t arena;
+  arena_init(&arena);
+  char *params[] = {"bench"};
+  struct expand_t x = {&arena, 0, getpid(), 1, params};
+  var_set("f", "/usr/local/lib/libfoo.so.1.2", 0);
+
+  printf("%-14s %10s %12s\n", "", "in-process", "launch");
+  for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+    const char *word = ops[i].word;
+    long start = now();
+    for (int j = 0; j < NOPS; j++) {
+      struct arena_mark_t mark = arena_mark(&arena);
+      expand_str(&x, word, strlen(word));
+      arena_release(&arena, mark);
+    }
+    double ns = (double)(now() - start) / NOPS;
+    long fork_ns = launch((char *const *)ops[i].program);
+    printf("%-14s %7.0f ns %9.0f us  (%s)\n", word, ns, fork_ns / 1e3,
+           ops[i].program[0]);
+  }
+  arena_free(&arena);
+  return 0;
+}
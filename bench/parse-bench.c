@@ -0,0 +1,123 @@
+#include "arena.h"
+#include "parse.h"
+#include "shell.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// append words of the form argN to buf until it holds about size bytes,
+// ending with a newline
+static size_t fill_line(char *buf, size_t size) {
+  size_t len = snprintf(buf, size, "echo");
+  for (int i = 0; len + 16 < size; i++)
+    len += snprintf(buf + len, size - len, " arg%d", i);
+  buf[len++] = '\n';
+  buf[len] = '\0';
+  return len;
+}
+
+static void report(const char *what, long ns, long n, size_t bytes) {
+  printf("%-36s %9.1f ns/cmd %9.1f MB/s\n", what, (double)ns / n,
+         bytes * 1e3 / ns);
+}
+
+// parse src with parse_next until it is done, releasing the arena after
+// every complete command like eval does
+// return number of complete commands
+static long parse_all(struct arena_t *arena, const char *src, size_t len) {
+  struct parser_t p;
+  struct node_t *list;
+  struct arena_mark_t mark = arena_mark(arena);
+  long n = 0;
+  parser_init(&p, arena, src, len);
+  while (parse_next(&p, &list) != 0) {
+    n++;
+    arena_release(arena, mark);
+  }
+  return n;
+}
+
+// the longest line parseline can take, over and over
+static void bench_line(struct arena_t *arena, int iters) {
+  static char line[MAXLINE];
+  char *argv[MAXARGS];
+  size_t len = fill_line(line, 640); /* stays below MAXARGS words */
+
+  long start = now();
+  for (int i = 0; i < iters; i++)
+    parseline(line, argv);
+  report("parseline, 640 B line", now() - start, iters, len * iters);
+
+  start = now();
+  for (int i = 0; i < iters; i++)
+    parse_all(arena, line, len);
+  report("parse_next, 640 B line", now() - start, iters, len * iters);
+}
+
+// a line parseline cannot take at all
+static void bench_long_line(struct arena_t *arena, int iters) {
+  size_t size = 1 << 20;
+  char *line = malloc(size);
+  size_t len = fill_line(line, size);
+
+  long start = now();
+  for (int i = 0; i < iters; i++)
+    parse_all(arena, line, len);
+  report("parse_next, 1 MB line", now() - start, iters, len * iters);
+  free(line);
+}
+
+// a script of short commands, read line by line by parseline and as a whole
+// by the parser
+static void bench_script(struct arena_t *arena, int nlines) {
+  static const char *cmds[] = {
+      "ls -l /tmp\n",
+      "grep -v 'foo bar' input.txt > out.txt\n",
+      "cat a b c | sort | uniq -c\n",
+      "make -j8 all 2> errors.log\n",
+      "sleep 10 &\n",
+  };
+  int ncmds = sizeof(cmds) / sizeof(cmds[0]);
+  size_t size = 0;
+  for (int i = 0; i < nlines; i++)
+    size += strlen(cmds[i % ncmds]);
+  char *script = malloc(size + 1);
+  char *end = script;
+  for (int i = 0; i < nlines; i++)
+    end = stpcpy(end, cmds[i % ncmds]);
+
+  char *argv[MAXARGS];
+  char line[MAXLINE];
+  long start = now();
+  for (const char *p = script; p < end;) {
+    const char *nl = strchr(p, '\n') + 1;
+    memcpy(line, p, nl - p);
+    line[nl - p] = '\0';
+    parseline(line, argv);
+    p = nl;
+  }
+  report("parseline, script", now() - start, nlines, size);
+
+  start = now();
+  long n = parse_all(arena, script, size);
+  report("parse_next, script", now() - start, n, size);
+  free(script);
+}
+
+int main(int argc, char *argv[]) {
+  struct arena_t arena;
+  arena_init(&arena);
+
+  bench_line(&arena, 100000);
+  bench_long_line(&arena, 20);
+  bench_script(&arena, 1000000);
+
+  arena_free(&arena);
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSUBST 2000
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// the ways a command substitution is run: a builtin in the shell, a file
+// read by the shell, a program started without a child shell, and a list
+// that needs one
+static const struct {
+  const char *what;
+  const char *line;
+} cases[] = {
+    {"builtin", "x=$(echo item)\n"},
+    {"file", "x=$(< %s)\n"},
+    {"program", "x=$(/bin/echo item)\n"},
+    {"child shell", "x=$(echo item; true)\n"},
+};
+
+// write a script of NSUBST substitutions made like line, file being what
+// %s stands for
+static void make_script(const char *path, const char *line,
+                        const char *file) {
+  FILE *f = fopen(path, "w");
+  for (int i = 0; i < NSUBST; i++)
+    fprintf(f, line, file);
+  fclose(f);
+}
+
+// run the script at path with the shell
+// return time it took
+static long run_script(const char *path) {
+  long start = now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    execl(MYAPP, MYAPP, path, (char *)NULL);
+    _exit(127);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return now() - start;
+}
+
+int main(int argc, char *argv[]) {
+  char file[] = "/tmp/subst-benchXXXXXX";
+  int fd = mkstemp(file);
+  if (write(fd, "item\n", 5) != 5)
+    return 1;
+  close(fd);
+
+  char path[] = "/tmp/subst-benchXXXXXX";
+  close(mkstemp(path));
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    make_script(path, cases[i].line, file);
+    long ns = run_script(path);
+    printf("%-12s %8.1f us per substitution\n", cases[i].what,
+           ns / 1e3 / NSUBST);
+  }
+  unlink(path);
+  unlink(file);
+  return 0;
+}
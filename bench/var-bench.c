@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "var.h"
+
+#define NVARS 1000
+#define NOPS 1000000
+#define NRUNS 10000
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  static char names[NVARS][16];
+  for (int i = 0; i < NVARS; i++) {
+    snprintf(names[i], sizeof(names[i]), "VAR_%d", i);
+    var_set(names[i], "initial value", i % 4 ? 0 : VAR_EXPORT);
+  }
+
+  long start = now();
+  long sum = 0;
+  for (int i = 0; i < NOPS; i++)
+    sum += *var_get(names[i % NVARS]);
+  long get = now() - start;
+
+  start = now();
+  for (int i = 0; i < NOPS; i++)
+    var_set(names[i % NVARS], i % 2 ? "odd value" : "even", 0);
+  long set = now() - start;
+  printf("%d variables\n", NVARS);
+  printf("var_get %8.1f ns/op\n", (double)get / NOPS);
+  printf("var_set %8.1f ns/op (string compaction included)\n",
+         (double)set / NOPS);
+
+  // the environment of a command, when no exported variable changed between
+  // two commands and when one did before each of them
+  start = now();
+  for (int i = 0; i < NRUNS; i++)
+    sum += var_environ()[0] != NULL;
+  long cached = now() - start;
+  start = now();
+  for (int i = 0; i < NRUNS; i++) {
+    var_set("VAR_0", i % 2 ? "odd value" : "even", 0);
+    sum += var_environ()[0] != NULL;
+  }
+  long rebuilt = now() - start;
+  printf("var_environ %8.1f ns/command unchanged\n", (double)cached / NRUNS);
+  printf("var_environ %8.1f ns/command after an export changed\n",
+         (double)rebuilt / NRUNS);
+  return sum == 0;
+}
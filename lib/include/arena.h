@@ -0,0 +1,46 @@
+#pragma once
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include "common.h"
+#include <stddef.h>
+
+#define ARENA_CHUNK 4096 /* size of a chunk unless an allocation needs more */
+
+struct chunk_t {
+  struct chunk_t *next;
+  size_t size; /* bytes in data */
+  char data[];
+};
+
+// bump allocator for memory that lives only as long as one command line.
+// Chunks are kept when the arena is released, so a warm arena does not call
+// malloc at all.
+struct arena_t {
+  struct chunk_t *chunks; /* every chunk in use order */
+  struct chunk_t *cur;    /* chunk allocations are taken from */
+  size_t used;            /* bytes taken from cur */
+  long nallocs;           /* calls to arena_alloc since arena_init */
+  long nmallocs;          /* calls to malloc for new chunks since then */
+  size_t reserved;        /* bytes in all chunks */
+};
+
+// position of an arena to release it back to
+struct arena_mark_t {
+  struct chunk_t *cur;
+  size_t used;
+};
+
+void arena_init(struct arena_t *arena);
+void arena_free(struct arena_t *arena);
+
+// return size bytes aligned for any scalar, exits if memory runs out
+void *arena_alloc(struct arena_t *arena, size_t size);
+// return a copy of the first len bytes of s, terminated
+char *arena_strndup(struct arena_t *arena, const char *s, size_t len);
+
+struct arena_mark_t arena_mark(struct arena_t *arena);
+// free everything allocated since mark in constant time
+void arena_release(struct arena_t *arena, struct arena_mark_t mark);
+
+#endif // ARENA_H_
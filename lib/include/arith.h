@@ -0,0 +1,22 @@
+#pragma once
+#ifndef ARITH_H_
+#define ARITH_H_
+
+#include "common.h"
+#include <stddef.h>
+
+// Arithmetic of $((...)) and let, on 64-bit integers with the operators and
+// precedence of C, ** for powers, and variables named without a '$'. An
+// expression is compiled once into code for a small stack machine and kept
+// in a cache by its text, so an expression that runs again is not parsed
+// again. A variable whose value is not a number is evaluated as an
+// expression in turn, one that is not set or empty is 0.
+
+// return 0 with the value of the expression of len bytes at s in *value, -1
+// after reporting an error. The variables it assigns are set.
+int arith_eval(const char *s, size_t len, long *value);
+
+// return number of expressions in the cache
+int arith_cachesize(void);
+
+#endif // ARITH_H_
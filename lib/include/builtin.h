@@ -0,0 +1,53 @@
+#pragma once
+#ifndef BUILTIN_H_
+#define BUILTIN_H_
+
+#include "common.h"
+
+// Builtin commands are listed in src/builtins.txt. gen-builtins turns the
+// list into an enum of ids (builtin-ids.h) and a perfect hash of the names
+// at build time, so that finding a builtin hashes its name once and
+// compares it with a single candidate.
+#ifndef GEN_BUILTINS
+#include "builtin-ids.h"
+#endif
+
+/* flags of a builtin */
+enum {
+  BUILTIN_JOBCTL = 1, /* needs job control, which a background list lacks */
+  BUILTIN_STATE = 2,  /* changes the shell, so $(...) runs it in a child */
+};
+
+struct builtin_t {
+  int (*run)(int argc, char *argv[]); /* return exit status */
+  int minargs;                        /* arguments after the name */
+  int maxargs;                        /* -1 for any number */
+  int flags;
+  const char *usage;                  /* arguments, for usage errors and help */
+  const char *help;                   /* one line */
+};
+
+// registry of the handlers, indexed by id and defined by the shell
+extern const struct builtin_t builtins[];
+
+// hash of the perfect hash table, seeded so that no two names collide
+static inline unsigned long builtin_hash(const char *s, unsigned long seed) {
+  unsigned long h = 14695981039346656037UL ^ seed; /* FNV-1a */
+  while (*s) {
+    h ^= (unsigned char)*s++;
+    h *= 1099511628211UL;
+  }
+  return h ^ (h >> 29);
+}
+
+// return id of the builtin called name, -1 if there is none
+int builtin_find(const char *name);
+
+// return name of the builtin id
+const char *builtin_name(int id);
+
+// return the first builtin from id on whose name starts with prefix, -1 if
+// there is none left. Completion walks them with id = last + 1.
+int builtin_complete(const char *prefix, int id);
+
+#endif // BUILTIN_H_
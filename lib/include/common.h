@@ -16,4 +16,9 @@
 
 int verbose = 0;
 
+// print a message to stderr like fprintf, flushing stdout first: the shell
+// sends stderr to stdout, and the output of the commands before the message
+// may still be in the buffer of stdout
+void errorf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
 #endif  // COMMON_H_
@@ -0,0 +1,79 @@
+#pragma once
+#ifndef COMPILE_H_
+#define COMPILE_H_
+
+#include "common.h"
+#include <stdint.h>
+#include <sys/stat.h>
+
+// A script is lowered once into code, a flat array of 32-bit words with its
+// strings after it. Words are stored as the values the shell passes to
+// programs, and builtins are resolved, so running the code again needs
+// neither the source nor the parser. Code refers to its strings by offset
+// only, which lets it be written to a cache file as is.
+
+/* operations, followed by their operands */
+enum {
+  OP_PIPE,     /* nstages bg timed builtin text, then every stage */
+  OP_AND,      /* target: go on if the status is 0, jump otherwise */
+  OP_OR,       /* target: go on if the status is not 0, jump otherwise */
+  OP_SUBSHELL, /* end text: run up to end in a background child shell */
+  OP_ERROR,    /* line msg: report a syntax error, line 0 if it has none */
+  OP_END,      /* the complete command is done */
+};
+
+// a stage is nwords nredirs nassigns, a string per word, type fd arg per
+// redirection where arg is the descriptor copied for REDIR_DUP, the body as
+// it was written for REDIR_HEREDOC, and the path or here-string otherwise,
+// and a string per name=value assignment. builtin is the id the
+// resolver of compile returned for the only stage, -1 if it is not a builtin
+// or if its name has to be expanded.
+
+// a string of a word, path or assignment with CODE_EXPAND is the text of it
+// in the source, which is expanded when it runs
+#define CODE_EXPAND 0x80000000u
+// one that is plain text followed by a single variable that is not split,
+// like "$name", B=${x} or the path of >$out, is resolved instead to that
+// text and $name with CODE_VAR, and its value is the text followed by the
+// value of the variable, read when it runs without expanding anything
+#define CODE_VAR 0x40000000u
+
+struct code_t {
+  int refs;             /* holders of the code, the cache being one */
+  uint32_t ncode;       /* words of code */
+  uint32_t nstrings;    /* bytes of strings, each ending with a '\0' */
+  const uint32_t *code;
+  const char *strings;
+};
+
+// return the id of the builtin argv runs, -1 if it is not a builtin
+typedef int (*builtin_resolver_t)(char *argv[], int argc);
+
+// compile the commands of src, syntax errors included, resolving builtins
+// with builtin
+// return code held once
+struct code_t *compile(const char *src, size_t len, builtin_resolver_t builtin);
+
+void code_hold(struct code_t *code);
+// free code once it has no holders left
+void code_release(struct code_t *code);
+
+// return code of the script at path that is stat'ed as st, held once, from
+// memory or else from the cache directory. NULL if it has not been compiled
+// since it was last modified.
+struct code_t *code_cache_get(const char *path, const struct stat *st);
+
+// keep code of the script at path in memory, and in the cache directory if
+// there is one
+void code_cache_put(const char *path, const struct stat *st,
+                    struct code_t *code);
+
+// drop every compiled script kept in memory
+void code_cache_clear(void);
+
+// keep compiled scripts in dir as well, created if needed, or in memory only
+// if dir is NULL
+// return 0 on success, -1 if dir cannot be created
+int code_cache_dir(const char *dir);
+
+#endif // COMPILE_H_
@@ -0,0 +1,29 @@
+#pragma once
+#ifndef COREUTILS_H_
+#define COREUTILS_H_
+
+#include "common.h"
+
+// Utilities that scripts run all the time, as builtins so that they cost
+// neither a fork nor an exec. They take the arguments and return the exit
+// statuses of the programs they replace, and write through stdio, whose
+// stdout the shell flushes around redirections.
+
+int do_echo(int argc, char *argv[]);
+int do_printf(int argc, char *argv[]);
+// test and [, which wants ] as its last argument
+// return 0 if the expression is true, 1 if it is false, 2 on an error
+int do_test(int argc, char *argv[]);
+int do_true(int argc, char *argv[]);
+int do_false(int argc, char *argv[]);
+int do_cd(int argc, char *argv[]);
+int do_pwd(int argc, char *argv[]);
+// export marks variables to be passed to commands, read sets variables
+int do_export(int argc, char *argv[]);
+int do_unset(int argc, char *argv[]);
+int do_read(int argc, char *argv[]);
+// let evaluates arithmetic expressions
+// return 0 if the value of the last one is not 0, 1 if it is or on an error
+int do_let(int argc, char *argv[]);
+
+#endif // COREUTILS_H_
@@ -95,6 +95,8 @@ int Sigsuspend(const sigset_t *set);
 ssize_t sio_puts(char s[]);
 ssize_t sio_putl(long v);
 void sio_error(char s[]);
+ssize_t sio_vsnprintf(char *buf, size_t size, const char *fmt, va_list ap);
+ssize_t sio_printf(const char *fmt, ...);
 
 /* Sio wrappers */
 ssize_t Sio_puts(char s[]);
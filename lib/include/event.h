@@ -0,0 +1,51 @@
+#pragma once
+#ifndef EVENT_H_
+#define EVENT_H_
+
+#include "common.h"
+#include <signal.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/* kinds of events */
+enum { EVENT_SIGNAL, EVENT_EXIT };
+
+struct event_t {
+  int type;   /* EVENT_SIGNAL or EVENT_EXIT */
+  int signo;  /* EVENT_SIGNAL: signal received */
+  pid_t pid;  /* EVENT_EXIT: child that terminated, reaped already */
+  int status; /* EVENT_EXIT: wait status of the child */
+  struct rusage rusage; /* EVENT_EXIT: resources used by the child */
+  long rbytes;          /* EVENT_EXIT: bytes read by the child, 0 if unknown */
+  long wbytes;          /* EVENT_EXIT: bytes written by the child */
+  long notified; /* CLOCK_MONOTONIC ns the event was seen by the loop */
+  long reaped;   /* EVENT_EXIT: CLOCK_MONOTONIC ns the child was reaped */
+};
+
+// block signals and receive them through a signalfd, polled in one epoll set
+// with the pidfds of the watched children
+// return 0 on success, -1 with errno set
+int event_init(const sigset_t *signals);
+// close the event sources and restore the signal mask
+void event_close(void);
+// return 1 if event_init succeeded and event_close was not called since
+int event_active(void);
+// return signal mask before event_init, to be given to children
+const sigset_t *event_sigmask(void);
+
+// report the termination of pid, whose pidfd is owned by the event loop from
+// now on. A negative pidfd is opened here.
+// return 0 on success, -1 with errno set if pid cannot be watched
+int event_watch(pid_t pid, int pidfd);
+
+// wait at most timeout ms (-1 for ever, 0 to poll) for the next event. A
+// terminated child is reaped before it is reported.
+// return 1 if ev is filled, 0 on timeout, -1 with errno set on failure
+int event_next(struct event_t *ev, int timeout);
+
+// read the I/O counters of pid from /proc/pid/io, which is gone once the
+// child is reaped. Async-signal-safe.
+// return 0 on success, -1 if they cannot be read
+int event_procio(pid_t pid, long *rbytes, long *wbytes);
+
+#endif // EVENT_H_
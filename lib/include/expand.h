@@ -0,0 +1,74 @@
+#pragma once
+#ifndef EXPAND_H_
+#define EXPAND_H_
+
+#include "arena.h"
+#include "common.h"
+#include <sys/types.h>
+
+// Words are expanded when the command they belong to runs: parameters are
+// replaced by their values and quotes are removed, and what unquoted
+// expansions produced is split into fields at the characters of IFS.
+// Operators in braces, like ${name#pattern}, edit a value in the shell,
+// with patterns compiled by match.h. The text of a word is the slice of the
+// source the parser gave it, quotes included. Commands of $(...) and `...`
+// are run by the shell, through the hook it passes in, and so are those of
+// <(...) and >(...), which expand to a path the command line can open. A
+// field that is a pattern is replaced by the paths it matches, found by
+// pathglob.h, unless none does.
+
+struct expand_t;
+
+// run the command of len bytes at text of a $(...) or `...`, with what it
+// writes in *out and its length in *outlen, allocated in the arena of x
+// return exit status of the command, -1 after reporting that it could not
+// be run
+typedef int (*command_t)(struct expand_t *x, const char *text, int len,
+                         char **out, size_t *outlen);
+
+// start the command of len bytes at text of a <(...), or of a >(...) if
+// input is set, with a pipe from or to it
+// return path of the shell's end of the pipe, like /dev/fd/63, NULL after
+// reporting an error
+typedef char *(*process_t)(struct expand_t *x, const char *text, int len,
+                           int input);
+
+// the special parameters, which the shell keeps
+struct expand_t {
+  struct arena_t *arena; /* fields are allocated here */
+  int status;            /* $?, which a command substitution sets */
+  pid_t pid;             /* $$ */
+  int nparams;           /* $0 and the positional parameters in params */
+  char **params;
+  command_t command;     /* NULL if commands expand to nothing */
+  process_t process;     /* <(...) and >(...), NULL for nothing as well */
+  int glob;              /* fields with '*', '?' or '[' not quoted are
+                            replaced by the paths they match */
+};
+
+// fields of the words of a command, growing as needed
+struct fields_t {
+  char **v;
+  int n;
+  int cap;
+};
+
+void fields_add(struct fields_t *fields, struct arena_t *arena, char *field);
+
+// append the fields the word of len bytes at text expands to to fields,
+// which are paths for a pattern that matches any if x->glob is set
+// return 0 on success, -1 after reporting an error of the expansion
+int expand_fields(struct expand_t *x, const char *text, int len,
+                  struct fields_t *fields);
+
+// return word of len bytes at text expanded to one string, without
+// splitting, as the value of an assignment or the file of a redirection
+// is. NULL after reporting an error of the expansion.
+char *expand_str(struct expand_t *x, const char *text, int len);
+
+// return body of a here-document of len bytes at text expanded the way text
+// in double quotes is, except that its quotes are kept. NULL after
+// reporting an error of the expansion.
+char *expand_heredoc(struct expand_t *x, const char *text, int len);
+
+#endif // EXPAND_H_
@@ -3,38 +3,139 @@
 #define JOB_H_
 
 #include "common.h"
+#include <sys/resource.h>
 #include <unistd.h>
 
-#define MAXJOBS 16     /* max jobs at any time point */
-#define MAXJID 1 << 16 /* max job id */
+#define INITJOBS 64    /* initial capacity of the job list, multiple of 64 */
+#define MAXJID (1 << 16) /* job ids are 1 .. MAXJID - 1 */
 
 enum { UNDEF, FG, BG, ST, STATE_SIZE }; /* define job states */
 
+struct proc_t {
+  pid_t pid;  /* process id */
+  int status; /* wait status, valid once the process is reaped */
+  int reaped; /* 1 if the process has terminated and been reaped */
+};
+
+// resources used by the reaped processes of a job
+struct usage_t {
+  long utime;  /* user CPU time, us */
+  long stime;  /* system CPU time, us */
+  long maxrss; /* peak resident set of the largest process, KB */
+  long nvcsw;  /* voluntary context switches */
+  long nivcsw; /* involuntary context switches */
+  long rbytes; /* bytes read, rchar of /proc/pid/io */
+  long wbytes; /* bytes written, wchar of /proc/pid/io */
+};
+
+// CLOCK_MONOTONIC ns at the phases of a job run under time
+struct phases_t {
+  long parse;    /* the shell started to parse the line */
+  long spawn;    /* the first process is about to be spawned */
+  long forked;   /* the last process was created */
+  long execed;   /* the last process was seen to exec */
+  long notified; /* the shell learned that the job is done */
+  long reaped;   /* the process finishing the job was reaped */
+};
+
 struct job_t {
-  pid_t pid;             /* process id */
+  pid_t pid;             /* process group id, pid of the first process */
   int jid;               /* job id */
   int state;             /* UNDEF, FG, BG, RUN */
-  char cmdline[MAXLINE]; /* command line string */
+  int slot;              /* index of the job in the job list */
+  int nprocs;            /* number of processes in the pipeline */
+  int nlive;             /* processes not reaped yet */
+  int maxprocs;          /* capacity of procs, kept when the slot is reused */
+  struct proc_t *procs;  /* processes of the pipeline in order */
+  char *cmdline;         /* command line string, kept in the cmdline pool */
+  struct usage_t usage;  /* resources of the processes reaped so far */
+  long start;            /* CLOCK_MONOTONIC ns when the job was added */
+  long end;              /* CLOCK_MONOTONIC ns when it was done, 0 before */
+  int timed;             /* 1 if the job runs under the time builtin */
+  struct phases_t phases; /* phases of a timed job */
+};
+
+// open addressing map from a positive id to a job, 0 marks an empty entry
+struct jobindex_t {
+  int *keys;
+  struct job_t **jobs;
+  int size; /* capacity, a power of two */
+  int used; /* number of keys */
 };
 
-void initjobs(struct job_t *jobs);
-void listjobs(struct job_t *jobs);
+// set of free job ids: bit i of free is set if jid i is free, and bit w of
+// summary is set if free[w] has any bit set. The lowest free jid is found
+// with two find-first-set steps.
+struct jidmap_t {
+  uint64_t free[MAXJID / 64];
+  uint64_t summary[MAXJID / 64 / 64];
+};
+
+// command lines of the jobs, stored back to back, each one behind a header
+// naming the slot of its job. Deleting a job only marks its command line as
+// garbage, which is squeezed out when a new command line needs the room.
+struct strpool_t {
+  char *buf;
+  size_t size;    /* capacity of buf */
+  size_t used;    /* bytes taken by live and dead entries */
+  size_t garbage; /* bytes taken by dead entries */
+};
+
+struct joblist_t {
+  struct job_t **slots;         /* records, allocated once and then reused */
+  int nslots;                   /* capacity of slots */
+  int njobs;                    /* number of jobs */
+  uint64_t *states[STATE_SIZE]; /* slots of every state, UNDEF for free */
+  struct jobindex_t pids;       /* pid of every process -> job */
+  struct jobindex_t jids;       /* jid -> job */
+  struct job_t *fg;             /* foreground job, NULL if there is none */
+  struct jidmap_t freejids;     /* job ids available to new jobs */
+  struct strpool_t cmdlines;    /* command lines of the jobs */
+};
+
+void initjobs(struct joblist_t *jobs);
+void freejobs(struct joblist_t *jobs);
+void listjobs(struct joblist_t *jobs);
+// list the jobs with their resources, like jobs -l
+void listjobsl(struct joblist_t *jobs);
 
 // return max job id in the job list
-int maxJID(struct job_t *jobs);
-int getNextJID();
+int maxJID(struct joblist_t *jobs);
+// return job id the next job will get, the lowest one not in use
+int getNextJID(struct joblist_t *jobs);
+
+int addjob(struct joblist_t *jobs, pid_t pid, int state, char *cmdline);
+// add a pipeline of npids processes as one job, pids[0] leads the group
+int addjobv(struct joblist_t *jobs, pid_t *pids, int npids, int state,
+            char *cmdline);
+// delete the job that pid is a member of
+int deletejob(struct joblist_t *jobs, pid_t pid);
+void clearjob(struct job_t *job);
+// change the state of a job, which must go through here to keep the state
+// bitmaps and the foreground job up to date
+void setjobstate(struct joblist_t *jobs, struct job_t *job, int state);
 
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline);
-int deletejob(struct job_t *jobs, pid_t pid);
-void clearjob(struct job_t *jobs);
+// record the wait status of a terminated member of job
+// return number of members still alive
+int reapmember(struct job_t *job, pid_t pid, int status);
+// add the resources of a reaped member to job, async-signal-safe
+void addusage(struct job_t *job, const struct rusage *ru, long rbytes,
+              long wbytes);
+// format the wall time and resources of job into buf, async-signal-safe
+// return length of the result
+int formatusage(char *buf, size_t size, struct job_t *job);
+
+// iterate over the jobs in slot order, starting with prev == NULL
+// return next job after prev, null at the end of the list
+struct job_t *nextjob(struct joblist_t *jobs, struct job_t *prev);
 
 // return pid of currrent foreground job, 0 if no foreground job
-pid_t fgPID(struct job_t *jobs);
-// return null on failure
-struct job_t *getjobPID(struct job_t *jobs, pid_t pid);
+pid_t fgPID(struct joblist_t *jobs);
+// return job that pid is a member of, null on failure
+struct job_t *getjobPID(struct joblist_t *jobs, pid_t pid);
 // return null on failure
-struct job_t *getjobJID(struct job_t *jobs, int jid);
+struct job_t *getjobJID(struct joblist_t *jobs, int jid);
 // return 0 if pid does not exist
-int PID2JID(struct job_t *jobs, pid_t pid);
+int PID2JID(struct joblist_t *jobs, pid_t pid);
 
 #endif // JOB_H_
@@ -0,0 +1,71 @@
+#pragma once
+#ifndef LAUNCH_H_
+#define LAUNCH_H_
+
+#include "common.h"
+#include <signal.h>
+#include <unistd.h>
+
+/* spawn backends */
+enum { LAUNCH_FORK, LAUNCH_VFORK, LAUNCH_POSIX_SPAWN, LAUNCH_CLONE, LAUNCH_SIZE };
+
+/* file actions applied in the child before exec */
+enum { LAUNCH_DUP2, LAUNCH_OPEN };
+
+struct launch_action_t {
+  int type;         /* LAUNCH_DUP2 or LAUNCH_OPEN */
+  int fd;           /* descriptor of the child to set up */
+  int src;          /* LAUNCH_DUP2: descriptor copied to fd */
+  const char *path; /* LAUNCH_OPEN: file opened on fd */
+  int flags;        /* LAUNCH_OPEN: flags of open(2) */
+  mode_t mode;      /* LAUNCH_OPEN: mode of a created file */
+};
+
+struct launch_t {
+  const char *path;            /* program to run, NULL to run argv[0] */
+  int execfd;                  /* O_PATH descriptor of path, 0 if none */
+  char **argv;                 /* argument vector of the program */
+  char **envp;                 /* environment of the program */
+  pid_t pgid;                  /* process group to join, 0 for a new group */
+  const sigset_t *sigmask;     /* mask of the child, NULL keeps the caller's */
+  const sigset_t *sigdefault;  /* caught signals reset to SIG_DFL in child */
+  const struct launch_action_t *actions; /* applied in order */
+  int nactions;
+  int failed; /* set by launch(): index of the failed action, -1 if none */
+  int *pidfd; /* if not NULL, set by launch(): pidfd of the child, -1 if none */
+  long forked; /* set by launch(): CLOCK_MONOTONIC ns the child was created */
+  long execed; /* set by launch(): CLOCK_MONOTONIC ns its exec was seen */
+};
+
+struct launch_stat_t {
+  long count;    /* number of successful launches */
+  long total_ns; /* accumulated latency */
+  long min_ns;
+  long max_ns;
+};
+
+extern int launch_backend; /* backend used by launch() */
+extern int launch_timing;  /* report latency of every launch if set */
+
+// return backend id of name, -1 if there is no such backend
+int launch_parse_backend(const char *name);
+const char *launch_backend_name(int backend);
+const struct launch_stat_t *launch_stats(int backend);
+
+// apply file actions to the calling process, leaving no other descriptor
+// open. On failure *failed is the index of the action that failed.
+// return 0 on success, errno of the failure otherwise
+int launch_apply(const struct launch_action_t *actions, int nactions,
+                 int *failed);
+
+// start spec->argv[0] in a child process with the current backend. The child
+// has joined its process group and either exec'd or failed when this returns.
+// return pid of the child, -1 with errno set if it cannot be executed. The
+// posix_spawn backend cannot tell a failed action from a failed exec. A pidfd
+// is asked for through spec->pidfd, the clone backend gets it from clone
+// itself and the others open it right after the launch. Only the fork
+// backend can tell the creation of the child from its exec, the others
+// suspend the caller until the exec and report the same time for both.
+pid_t launch(struct launch_t *spec);
+
+#endif // LAUNCH_H_
@@ -0,0 +1,55 @@
+#pragma once
+#ifndef MATCH_H_
+#define MATCH_H_
+
+#include "arena.h"
+#include "common.h"
+
+// Glob patterns: '*' matches any string, '?' any byte, "[...]" any byte of a
+// set, which "[!...]" or "[^...]" inverts and which may hold ranges "a-z" and
+// classes "[:alpha:]", and a backslash makes the next byte literal. A pattern
+// is compiled once into a list of steps, and the literal it starts with, the
+// literal it ends with and the least length of a match are kept aside, so
+// most strings that do not match are turned down without running the steps.
+
+enum { STEP_LIT, STEP_ANY, STEP_SET, STEP_STAR };
+
+struct step_t {
+  int type;
+  size_t len;              /* bytes of lit */
+  const char *lit;
+  const unsigned char *set; /* 256 bits, one per byte */
+};
+
+struct match_t {
+  struct step_t *steps;
+  int nsteps;
+  int first;               /* step after the prefix */
+  int nstars;
+  size_t minlen;           /* bytes of the shortest string that can match */
+  const char *prefix;      /* literal every match starts with */
+  size_t nprefix;
+  const char *suffix;      /* literal every match ends with */
+  size_t nsuffix;
+};
+
+// return pattern of len bytes compiled into arena. A '[' without a ']' is
+// literal.
+struct match_t *match_compile(struct arena_t *arena, const char *pattern,
+                              size_t len);
+
+// return whether all of the len bytes at s match
+int match(const struct match_t *m, const char *s, size_t len);
+// return length of the shortest or the longest prefix of s that matches, -1
+// if none does
+long match_prefix(const struct match_t *m, const char *s, size_t len,
+                  int longest);
+// return offset of the shortest or the longest suffix of s that matches, -1
+// if none does
+long match_suffix(const struct match_t *m, const char *s, size_t len,
+                  int longest);
+
+// return whether the pattern is a literal, which matches only itself
+int match_isliteral(const struct match_t *m);
+
+#endif // MATCH_H_
@@ -0,0 +1,119 @@
+#pragma once
+#ifndef PARSE_H_
+#define PARSE_H_
+
+#include "arena.h"
+#include "common.h"
+
+/* flags of a word, telling what has to be undone to get its value */
+enum { WORD_QUOTED = 1, WORD_ESCAPED = 2, WORD_EXPAND = 4, WORD_GLOB = 8 };
+
+struct word_t {
+  const char *text;     /* slice of the source, quotes included */
+  int len;
+  int flags;            /* WORD_QUOTED, WORD_ESCAPED, WORD_EXPAND if it has
+                           parameters, which word_str leaves as they are,
+                           WORD_GLOB if it has a '*', '?' or '[' that is not
+                           quoted */
+  struct word_t *next;
+};
+
+// return whether word, which may be NULL, is a time without quotes, which
+// times the pipeline it starts
+int word_istime(const struct word_t *word);
+
+/* redirections */
+enum {
+  REDIR_IN,
+  REDIR_OUT,
+  REDIR_APPEND,
+  REDIR_DUP,
+  REDIR_HEREDOC,    /* <<word and <<-word */
+  REDIR_HERESTRING, /* <<<word */
+};
+
+struct redir_t {
+  int type;             /* REDIR_IN, REDIR_OUT, ... */
+  int fd;               /* descriptor redirected */
+  struct word_t target; /* file, descriptor copied for REDIR_DUP, or the
+                           text a here-string or here-document reads. The
+                           body of a here-document is not a word: it has no
+                           quotes to remove, and WORD_EXPAND means it is
+                           expanded with expand_heredoc. */
+  struct redir_t *next;
+};
+
+// a simple command, one stage of a pipeline
+struct cmd_t {
+  struct word_t *assigns; /* name=value words before the command name */
+  int nassigns;
+  struct word_t *words;
+  int nwords;
+  struct redir_t *redirs; /* in order */
+  int nredirs;
+  struct cmd_t *next;     /* next stage of the pipeline */
+};
+
+/* nodes */
+enum { NODE_PIPE, NODE_AND, NODE_OR };
+
+struct node_t {
+  int type;              /* NODE_PIPE, NODE_AND or NODE_OR */
+  int bg;                /* 1 if the item of a list ends with & */
+  const char *text;      /* slice of the source the node was parsed from */
+  int len;
+  struct cmd_t *cmds;    /* NODE_PIPE: stages in order */
+  int ncmds;
+  struct node_t *left;   /* NODE_AND, NODE_OR: runs first */
+  struct node_t *right;  /* NODE_AND, NODE_OR: runs depending on left */
+  struct node_t *next;   /* next item of a list */
+};
+
+// what a source that ends inside a command waits for. A reader of lines
+// checks the lines it adds against it with pending_check, and parses the
+// command again only once one of them may end it.
+struct pending_t {
+  int incomplete; /* 1 if the source ended inside a command: in a quote, a
+                     $(...), a here-document or after an operator or an
+                     escaped newline */
+  char close;     /* the byte that ends the innermost quote, $(...), ${...}
+                     or backquote left open, '\0' if any line may end it */
+  int ndelim;     /* length of the delimiter of the here-document waiting
+                     for its body, 0 if none, -1 if it is longer than delim */
+  int strip;      /* 1 if that here-document is <<- */
+  char delim[64];
+};
+
+// reads complete commands from a source that stays in place, so words can
+// point into it. Nothing is shared between parsers.
+struct parser_t {
+  struct arena_t *arena; /* nodes and words are allocated here */
+  const char *pos;       /* next byte to read */
+  const char *end;
+  int line;              /* line of pos, from 1 */
+  int errline;           /* line of the last syntax error */
+  char error[96];        /* message of the last syntax error */
+  struct pending_t more;  /* what the source waits for if it ended inside
+                            the command parse_next returned */
+};
+
+void parser_init(struct parser_t *p, struct arena_t *arena, const char *src,
+                 size_t len);
+
+// parse the next complete command, which ends at a newline that is not
+// inside quotes or after an operator, into a list of and-or nodes. The
+// bodies of its here-documents follow that newline, and are read with it.
+// After a syntax error the rest of the line is skipped.
+// return 1 with *list set (NULL for a blank line), 0 at the end of the
+// source, -1 on a syntax error described in p->error
+int parse_next(struct parser_t *p, struct node_t **list);
+
+// return whether the line of len bytes, added to a source that ended inside
+// a command as more tells, may end that command
+int pending_check(const struct pending_t *more, const char *line,
+                  size_t len);
+
+// return value of word with its quotes and escapes removed
+char *word_str(struct arena_t *arena, const struct word_t *word);
+
+#endif // PARSE_H_
@@ -0,0 +1,33 @@
+#pragma once
+#ifndef PATHCACHE_H_
+#define PATHCACHE_H_
+
+#include "common.h"
+
+#define PATHCACHE_HOT 2 /* lookups before a binary keeps an O_PATH descriptor */
+
+struct pathent_t {
+  char *name;              /* command name as typed */
+  char *path;              /* resolved path, NULL if not found in PATH */
+  int dir;                 /* index of the PATH directory, -1 if not found */
+  int fd;                  /* O_PATH descriptor of a hot binary, -1 if none */
+  long hits;               /* number of lookups */
+  struct pathent_t *next;  /* next entry in the same bucket */
+};
+
+// resolve name through PATH. The result is cached, including a negative
+// entry for a name that is not found, until PATH or a directory changes.
+// return entry of name, NULL if it is not found
+struct pathent_t *pathcache_lookup(const char *name);
+// resolve name and open its descriptor right away
+// return entry of name, NULL if it is not found
+struct pathent_t *pathcache_prewarm(const char *name);
+void pathcache_clear(void);
+// tell the cache the working directory changed, which moves the directories
+// of PATH that are relative
+void pathcache_chdir(void);
+void pathcache_list(void);
+// return number of cached entries, negative ones included
+int pathcache_size(void);
+
+#endif // PATHCACHE_H_
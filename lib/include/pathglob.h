@@ -0,0 +1,27 @@
+#pragma once
+#ifndef PATHGLOB_H_
+#define PATHGLOB_H_
+
+#include "arena.h"
+#include "common.h"
+#include <stddef.h>
+
+// Pathname expansion: a pattern is split at '/' into parts, each compiled
+// once by match.h. A part that is a literal is taken as it is, the others are
+// matched against the names of their directory, which is read with
+// getdents64 into a large buffer. The type of an entry comes with its name,
+// so only symbolic links, and entries of file systems that do not tell, cost
+// a stat. A name that starts with '.' only matches a part that does too, and
+// "." and ".." never do. Paths are sorted by their bytes.
+
+// return number of paths that match the pattern of len bytes, with the paths
+// allocated in arena in *paths. 0 if nothing matches, and without reading
+// anything if every part of the pattern is a literal.
+int pathglob(struct arena_t *arena, const char *pattern, size_t len,
+             char ***paths);
+
+// sort the n strings of v by their bytes, with a radix sort that works on
+// the first byte they differ in
+void pathglob_sort(struct arena_t *arena, char **v, size_t n);
+
+#endif // PATHGLOB_H_
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef READER_H_
+#define READER_H_
+
+#include "common.h"
+#include <sys/types.h>
+
+#define READER_BUFSIZE 65536 /* initial buffer, doubled for longer lines */
+
+// buffered line reader in the way of rio_t, but with a buffer that grows to
+// the longest line and lines handed out in place instead of copied
+struct reader_t {
+  int fd;
+  char *buf;
+  size_t size;  /* capacity of buf */
+  size_t start; /* first byte not handed out yet */
+  size_t end;   /* end of the bytes read */
+  int eof;      /* 1 once read returned 0 */
+};
+
+void reader_init(struct reader_t *r, int fd);
+void reader_free(struct reader_t *r);
+
+// set *line to the next line, newline included if there is one. The slice
+// stays valid until the next call.
+// return its length, 0 at end of file, -1 with errno set on a read error
+ssize_t reader_next(struct reader_t *r, const char **line);
+// set *text to the len bytes handed out last, which must be *text, with the
+// next line after them, as one slice that stays valid until the next call.
+// A command that goes on over several lines is read this way without a copy.
+// return its length, 0 at end of file and -1 with errno set on a read error,
+// with *text then set to the len bytes alone
+ssize_t reader_extend(struct reader_t *r, const char **text, size_t len);
+
+#endif // READER_H_
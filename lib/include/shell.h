@@ -4,11 +4,12 @@
 
 #include "common.h"
 #include "job.h"
+#include "parse.h"
 
 #define MAXARGS 128
 
 extern char **environ;
-struct job_t jobs[MAXJOBS];
+struct joblist_t jobs;
 
 typedef void (*handler_t)(int);
 handler_t Signal(int signum, handler_t handler);
@@ -18,13 +19,41 @@ void sigchld_handler(int sig);
 void sigtstp_handler(int sig);
 void sigint_handler(int sig);
 
-void eval(char *cmdline);
-int builtin_cmd(char *argv[]);
-void do_bgfg(char *argv[]);
+// take SIGINT, SIGTSTP and SIGCHLD through the event loop instead of the
+// handlers, which stay as a fallback
+// return 0 on success, -1 if the event loop is not available
+int init_events(void);
+// handle every pending event without blocking, like jobs done in background
+void drain_events(void);
+
+// parse and run the complete commands in the len bytes at cmdline, which
+// need not be terminated. With more, a command the bytes end inside of,
+// like in a quote, is not run but left for the next lines, with what they
+// have to hold to end it in *more.
+// return number of bytes used, len unless a command is left
+size_t eval(const char *cmdline, size_t len, struct pending_t *more);
+// run the script at path with the positional parameters argv, path first.
+// The script is mapped, not read, and may be of any size.
+// return exit status of its last command
+int source_file(const char *path, int argc, char *argv[]);
+// run the builtin of id in builtin.h after checking its arguments
+// return exit status of the builtin, 2 on a usage error
+int builtin_cmd(int builtin, int argc, char *argv[]);
+int do_quit(int argc, char *argv[]);
+int do_jobs(int argc, char *argv[]);
+int do_fg(int argc, char *argv[]);
+int do_bg(int argc, char *argv[]);
+int do_set(int argc, char *argv[]);
+int do_hash(int argc, char *argv[]);
+int do_source(int argc, char *argv[]);
+int do_help(int argc, char *argv[]);
+int do_compgen(int argc, char *argv[]);
 void waitfg(pid_t pid);
 
 /* helper functions */
 
+// split a line of at most MAXLINE bytes into argv, the way the shell did
+// before parse.h. It remains as the baseline of bench/parse-bench.
 // return 1 if a bg job is requested, 0 otherwise
 int parseline(const char *cmdline, char *argv[]);
 void usage(void);
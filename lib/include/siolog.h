@@ -0,0 +1,29 @@
+#pragma once
+#ifndef SIOLOG_H_
+#define SIOLOG_H_
+
+#include <stdarg.h>
+#include <sys/types.h>
+
+#define SIOLOG_SLOTS 256   /* messages the ring holds, a power of two */
+#define SIOLOG_SLOTSIZE 256 /* longest message, longer ones are cut off */
+
+// format a message into the log ring without allocating or locking, so it
+// may be called from a signal handler. A message is dropped when the ring is
+// full.
+void siolog_printf(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
+// format into buf like siolog_printf, async-signal-safe as well
+// return length of the result, which is cut off at size - 1 bytes
+int siolog_snprintf(char *buf, size_t size, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// write the logged messages to stdout in one batch, after whatever stdio
+// holds. Not async-signal-safe, called from the main loop.
+void siolog_flush(void);
+
+// return number of messages dropped since the start
+long siolog_dropped(void);
+
+#endif // SIOLOG_H_
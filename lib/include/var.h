@@ -0,0 +1,53 @@
+#pragma once
+#ifndef VAR_H_
+#define VAR_H_
+
+#include "arena.h"
+#include "common.h"
+
+// Shell variables, the environment included. They live in an open-addressing
+// hash table whose slots point at "name=value" strings bump-allocated from an
+// arena of their own, so that the environment of a command is a vector of
+// pointers to those strings and nothing is copied to build it. The table is
+// filled from environ the first time it is used, and environ is not read or
+// written after that.
+
+/* flags of a variable */
+enum { VAR_EXPORT = 1 };
+
+// return value of name, NULL if it is not set. It stays valid until a
+// variable is set or unset.
+const char *var_get(const char *name);
+// return value of the len bytes at name, NULL if it is not set
+const char *var_getn(const char *name, size_t len);
+
+// set name to value, adding flags to the ones it has
+// return 0 on success, -1 if name is not a variable name
+int var_set(const char *name, const char *value, int flags);
+// set a variable from an assignment "name=value"
+// return 0 on success, -1 if there is no valid name before the '='
+int var_assign(const char *assignment, int flags);
+// mark name to be exported, before it is set or after
+// return 0 on success, -1 if name is not a variable name
+int var_export(const char *name);
+void var_unset(const char *name);
+
+// return flags of name, -1 if it is not a variable
+int var_flags(const char *name);
+
+// go through the variables in no particular order, *pos starting at 0
+// return "name=value" of the next one with its flags in *flags, NULL at the
+// end. A variable exported before it was set has no "=value".
+const char *var_next(int *pos, int *flags);
+
+// return environment of commands, "name=value" of every exported variable
+// and NULL. It is built again only after an exported variable changed.
+char **var_environ(void);
+// return environment of a command with the assignments "name=value" of its
+// prefix on top of the exported variables, allocated in arena
+char **var_environ_with(struct arena_t *arena, char **assigns, int nassigns);
+
+// return length of the variable name at the start of s, 0 if there is none
+size_t var_namelen(const char *s, size_t len);
+
+#endif // VAR_H_
@@ -0,0 +1,80 @@
+#include "arena.h"
+#include <stdio.h>
+#include <string.h>
+
+#define ALIGN 16
+
+static struct chunk_t *newchunk(size_t size) {
+  struct chunk_t *chunk = malloc(sizeof(struct chunk_t) + size);
+  if (!chunk) {
+    fprintf(stderr, "arena: out of memory\n");
+    exit(1);
+  }
+  chunk->next = NULL;
+  chunk->size = size;
+  return chunk;
+}
+
+void arena_init(struct arena_t *arena) {
+  arena->chunks = NULL;
+  arena->cur = NULL;
+  arena->used = 0;
+  arena->nallocs = 0;
+  arena->nmallocs = 0;
+  arena->reserved = 0;
+}
+
+void arena_free(struct arena_t *arena) {
+  struct chunk_t *chunk = arena->chunks;
+  while (chunk) {
+    struct chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  arena_init(arena);
+}
+
+void *arena_alloc(struct arena_t *arena, size_t size) {
+  size = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+  arena->nallocs++;
+
+  struct chunk_t *cur = arena->cur;
+  if (!cur || arena->used + size > cur->size) {
+    // move on to a kept chunk that is big enough, or put a new one in front
+    // of the kept ones
+    struct chunk_t *next = cur ? cur->next : arena->chunks;
+    if (!next || next->size < size) {
+      struct chunk_t *chunk = newchunk(size > ARENA_CHUNK ? size : ARENA_CHUNK);
+      arena->nmallocs++;
+      arena->reserved += chunk->size;
+      chunk->next = next;
+      if (cur)
+        cur->next = chunk;
+      else
+        arena->chunks = chunk;
+      next = chunk;
+    }
+    arena->cur = cur = next;
+    arena->used = 0;
+  }
+
+  void *p = cur->data + arena->used;
+  arena->used += size;
+  return p;
+}
+
+char *arena_strndup(struct arena_t *arena, const char *s, size_t len) {
+  char *copy = arena_alloc(arena, len + 1);
+  memcpy(copy, s, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+struct arena_mark_t arena_mark(struct arena_t *arena) {
+  return (struct arena_mark_t){arena->cur, arena->used};
+}
+
+void arena_release(struct arena_t *arena, struct arena_mark_t mark) {
+  arena->cur = mark.cur;
+  arena->used = mark.used;
+}
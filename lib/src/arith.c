@@ -0,0 +1,637 @@
+#include "arith.h"
+#include "arena.h"
+#include "var.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHESLOTS 1024 /* a power of two, emptied once it is half full */
+#define MAXDEPTH 32     /* variables whose values are expressions, nested */
+
+/* instructions of the stack machine */
+enum {
+  A_NUM,     /* push n */
+  A_LOAD,    /* push the variable var */
+  A_STORE,   /* set var to the top, which stays */
+  A_PRE,     /* add n to var and push the sum */
+  A_POST,    /* push var and add n to it */
+  A_POP,
+  A_AND,     /* if the top is 0 jump to n, keeping it, else pop it */
+  A_OR,      /* if the top is not 0 make it 1 and jump to n, else pop it */
+  A_JZ,      /* pop, and jump to n if it was 0 */
+  A_JMP,
+  A_BOOL,    /* make the top 0 or 1 */
+  A_NEG,
+  A_NOT,
+  A_BNOT,
+  /* binary operators, on the two values on top */
+  A_MUL,
+  A_DIV,
+  A_MOD,
+  A_POW,
+  A_ADD,
+  A_SUB,
+  A_SHL,
+  A_SHR,
+  A_LT,
+  A_LE,
+  A_GT,
+  A_GE,
+  A_EQ,
+  A_NE,
+  A_BAND,
+  A_BXOR,
+  A_BOR,
+};
+
+struct ins_t {
+  int op;
+  int var;   /* index in names */
+  long n;
+};
+
+struct arith_t {
+  const char *text; /* the expression, for errors */
+  size_t len;
+  struct ins_t *code;
+  int ncode;
+  char **names;     /* variables it uses */
+  int nnames;
+  int depth;        /* values on the stack at most */
+};
+
+// binary operators by precedence, the higher the tighter. && and || jump
+// over their right operand.
+static const struct {
+  const char *tok;
+  int prec;
+  int op;
+} binops[] = {
+    {"||", 1, A_OR},  {"&&", 2, A_AND}, {"==", 6, A_EQ},  {"!=", 6, A_NE},
+    {"<=", 7, A_LE},  {">=", 7, A_GE},  {"<<", 8, A_SHL}, {">>", 8, A_SHR},
+    {"**", 11, A_POW}, {"|", 3, A_BOR}, {"^", 4, A_BXOR}, {"&", 5, A_BAND},
+    {"<", 7, A_LT},   {">", 7, A_GT},   {"+", 9, A_ADD},  {"-", 9, A_SUB},
+    {"*", 10, A_MUL}, {"/", 10, A_DIV}, {"%", 10, A_MOD},
+};
+
+// assignment operators, and the operator each applies before it stores
+static const struct {
+  const char *tok;
+  int op;
+} assignops[] = {
+    {"<<=", A_SHL}, {">>=", A_SHR}, {"+=", A_ADD}, {"-=", A_SUB},
+    {"*=", A_MUL},  {"/=", A_DIV},  {"%=", A_MOD}, {"&=", A_BAND},
+    {"^=", A_BXOR}, {"|=", A_BOR},  {"=", -1},
+};
+
+struct compiler_t {
+  struct arena_t *arena;
+  const char *p;
+  const char *end;
+  struct arith_t *a;
+  int cap;
+  int depth;
+  const char *error;
+};
+
+static void blanks(struct compiler_t *c) {
+  while (c->p < c->end && isspace((unsigned char)*c->p))
+    c->p++;
+}
+
+// return length of the operator at the next token. An operator is the
+// longest one there is, so "|" is not the start of "||".
+static size_t optok(struct compiler_t *c) {
+  blanks(c);
+  size_t left = c->end - c->p;
+  if (left == 0)
+    return 0;
+  char a = c->p[0], b = left > 1 ? c->p[1] : 0;
+  if ((a == '<' || a == '>') && b == a)
+    return left > 2 && c->p[2] == '=' ? 3 : 2;
+  if (b == '=' && a && strchr("+-*/%&^|<>=!", a))
+    return 2;
+  if (b == a && a && strchr("*+-&|", a))
+    return 2;
+  return 1;
+}
+
+// return whether the next token is tok, taking it if it is
+static int take(struct compiler_t *c, const char *tok) {
+  size_t n = optok(c);
+  if (n == 0 || strlen(tok) != n || memcmp(c->p, tok, n) != 0)
+    return 0;
+  c->p += n;
+  return 1;
+}
+
+static void emit(struct compiler_t *c, int op, int var, long n) {
+  struct arith_t *a = c->a;
+  if (a->ncode == c->cap) {
+    c->cap = c->cap ? c->cap * 2 : 16;
+    struct ins_t *code = arena_alloc(c->arena, c->cap * sizeof(*code));
+    if (a->ncode)
+      memcpy(code, a->code, a->ncode * sizeof(*code));
+    a->code = code;
+  }
+  a->code[a->ncode++] = (struct ins_t){op, var, n};
+  if (op == A_NUM || op == A_LOAD || op == A_PRE || op == A_POST)
+    c->depth++;
+  else if (op >= A_MUL || op == A_POP || op == A_AND || op == A_OR ||
+           op == A_JZ)
+    c->depth--;
+  if (c->depth > a->depth)
+    a->depth = c->depth;
+}
+
+// return index of the variable name of len bytes in the names of a
+static int name(struct compiler_t *c, const char *s, size_t len) {
+  struct arith_t *a = c->a;
+  for (int i = 0; i < a->nnames; i++) {
+    if (strlen(a->names[i]) == len && memcmp(a->names[i], s, len) == 0)
+      return i;
+  }
+  if ((a->nnames & (a->nnames - 1)) == 0) {
+    char **names = arena_alloc(c->arena, (a->nnames ? a->nnames * 2 : 1) *
+                                             sizeof(char *));
+    if (a->nnames)
+      memcpy(names, a->names, a->nnames * sizeof(char *));
+    a->names = names;
+  }
+  a->names[a->nnames] = arena_strndup(c->arena, s, len);
+  return a->nnames++;
+}
+
+// return length of the variable name at the next token, 0 if there is none
+static size_t next_name(struct compiler_t *c) {
+  blanks(c);
+  return var_namelen(c->p, c->end - c->p);
+}
+
+// parse an integer constant: decimal, octal with a leading 0, hexadecimal
+// with 0x, or base#digits for a base up to 64
+// return 0 on success, -1 if s is not one
+static int constant(const char *s, const char *end, const char **stop,
+                    long *value) {
+  unsigned long v = 0, base = 10;
+  const char *p = s;
+  if (p < end && *p == '0') {
+    base = 8;
+    if (p + 1 < end && (p[1] == 'x' || p[1] == 'X')) {
+      base = 16;
+      p += 2;
+    }
+  } else {
+    const char *q = p;
+    while (q < end && isdigit((unsigned char)*q))
+      q++;
+    if (q < end && *q == '#' && q > p) {
+      base = strtoul(p, NULL, 10);
+      if (base < 2 || base > 64)
+        return -1;
+      p = q + 1;
+    }
+  }
+  const char *digits = p;
+  for (; p < end; p++) {
+    unsigned long d;
+    if (isdigit((unsigned char)*p))
+      d = *p - '0';
+    else if (*p >= 'a' && *p <= 'z')
+      d = *p - 'a' + 10;
+    else if (*p >= 'A' && *p <= 'Z')
+      d = *p - 'A' + (base <= 36 ? 10 : 36);
+    else if (*p == '@')
+      d = 62;
+    else if (*p == '_')
+      d = 63;
+    else
+      break;
+    if (d >= base)
+      return -1;
+    v = v * base + d;
+  }
+  if (p == digits && base != 8)
+    return -1;
+  *stop = p;
+  *value = (long)v;
+  return 0;
+}
+
+static int comma(struct compiler_t *c);
+static int assign(struct compiler_t *c);
+
+static int fail(struct compiler_t *c, const char *error) {
+  if (!c->error)
+    c->error = error;
+  return -1;
+}
+
+static int primary(struct compiler_t *c) {
+  blanks(c);
+  if (c->p == c->end)
+    return fail(c, "syntax error: operand expected");
+  if (isdigit((unsigned char)*c->p)) {
+    long value;
+    if (constant(c->p, c->end, &c->p, &value) < 0 ||
+        (c->p < c->end && (isalnum((unsigned char)*c->p) || *c->p == '_')))
+      return fail(c, "value too great for base");
+    emit(c, A_NUM, 0, value);
+    return 0;
+  }
+  if (take(c, "(")) {
+    if (comma(c) < 0)
+      return -1;
+    if (!take(c, ")"))
+      return fail(c, "syntax error: missing ')'");
+    return 0;
+  }
+  size_t len = next_name(c);
+  if (len == 0)
+    return fail(c, "syntax error: operand expected");
+  int var = name(c, c->p, len);
+  c->p += len;
+  if (take(c, "++"))
+    emit(c, A_POST, var, 1);
+  else if (take(c, "--"))
+    emit(c, A_POST, var, -1);
+  else
+    emit(c, A_LOAD, var, 0);
+  return 0;
+}
+
+static int unary(struct compiler_t *c) {
+  if (take(c, "++") || take(c, "--")) {
+    long delta = c->p[-1] == '+' ? 1 : -1;
+    size_t len = next_name(c);
+    if (len == 0)
+      return fail(c, "syntax error: variable expected");
+    emit(c, A_PRE, name(c, c->p, len), delta);
+    c->p += len;
+    return 0;
+  }
+  static const struct {
+    const char *tok;
+    int op;
+  } ops[] = {{"-", A_NEG}, {"+", -1}, {"!", A_NOT}, {"~", A_BNOT}};
+  for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+    if (take(c, ops[i].tok)) {
+      if (unary(c) < 0)
+        return -1;
+      if (ops[i].op >= 0)
+        emit(c, ops[i].op, 0, 0);
+      return 0;
+    }
+  }
+  return primary(c);
+}
+
+// parse operators of precedence prec and higher
+static int binary(struct compiler_t *c, int prec) {
+  if (unary(c) < 0)
+    return -1;
+  for (;;) {
+    size_t i, n = optok(c);
+    for (i = 0; i < sizeof(binops) / sizeof(binops[0]); i++) {
+      if (n > 0 && strlen(binops[i].tok) == n &&
+          memcmp(c->p, binops[i].tok, n) == 0)
+        break;
+    }
+    if (i == sizeof(binops) / sizeof(binops[0]) || binops[i].prec < prec)
+      return 0;
+    c->p += n;
+    int op = binops[i].op;
+    if (op == A_AND || op == A_OR) {
+      int jump = c->a->ncode;
+      emit(c, op, 0, 0);
+      if (binary(c, binops[i].prec + 1) < 0)
+        return -1;
+      emit(c, A_BOOL, 0, 0);
+      c->a->code[jump].n = c->a->ncode;
+      continue;
+    }
+    // ** groups to the right
+    if (binary(c, binops[i].prec + (op != A_POW)) < 0)
+      return -1;
+    emit(c, op, 0, 0);
+  }
+}
+
+static int ternary(struct compiler_t *c) {
+  if (binary(c, 1) < 0)
+    return -1;
+  if (!take(c, "?"))
+    return 0;
+  int jz = c->a->ncode;
+  emit(c, A_JZ, 0, 0);
+  if (assign(c) < 0)
+    return -1;
+  if (!take(c, ":"))
+    return fail(c, "syntax error: missing ':'");
+  int jmp = c->a->ncode;
+  emit(c, A_JMP, 0, 0);
+  c->a->code[jz].n = c->a->ncode;
+  // one of the two branches runs, and leaves one value
+  c->depth--;
+  if (assign(c) < 0)
+    return -1;
+  c->a->code[jmp].n = c->a->ncode;
+  return 0;
+}
+
+static int assign(struct compiler_t *c) {
+  size_t len = next_name(c);
+  if (len > 0) {
+    const char *save = c->p;
+    c->p += len;
+    for (size_t i = 0; i < sizeof(assignops) / sizeof(assignops[0]); i++) {
+      if (!take(c, assignops[i].tok))
+        continue;
+      int var = name(c, save, len);
+      if (assignops[i].op >= 0)
+        emit(c, A_LOAD, var, 0);
+      if (assign(c) < 0)
+        return -1;
+      if (assignops[i].op >= 0)
+        emit(c, assignops[i].op, 0, 0);
+      emit(c, A_STORE, var, 0);
+      return 0;
+    }
+    c->p = save;
+  }
+  return ternary(c);
+}
+
+static int comma(struct compiler_t *c) {
+  if (assign(c) < 0)
+    return -1;
+  while (take(c, ",")) {
+    emit(c, A_POP, 0, 0);
+    if (assign(c) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// return expression of len bytes at s compiled into arena, NULL after
+// reporting an error
+static struct arith_t *compile(struct arena_t *arena, const char *s,
+                               size_t len) {
+  struct arith_t *a = arena_alloc(arena, sizeof(struct arith_t));
+  *a = (struct arith_t){.text = arena_strndup(arena, s, len), .len = len};
+  struct compiler_t c = {arena, a->text, a->text + len, a};
+  blanks(&c);
+  // an empty expression is 0
+  if (c.p == c.end)
+    emit(&c, A_NUM, 0, 0);
+  else if (comma(&c) == 0 && (blanks(&c), c.p < c.end))
+    fail(&c, "syntax error: invalid arithmetic operator");
+  if (c.error) {
+    errorf("%.*s: %s (error token is \"%.*s\")\n", (int)len, s,
+           c.error, (int)(c.end - c.p), c.p);
+    return NULL;
+  }
+  return a;
+}
+
+static int error(const struct arith_t *a, const char *msg) {
+  errorf("%.*s: %s\n", (int)a->len, a->text, msg);
+  return -1;
+}
+
+static int depth = 0;
+
+// return 0 with the value of a variable in *value, -1 after reporting an
+// error of the expression it holds
+static int get(const char *name, long *value) {
+  const char *s = var_get(name);
+  *value = 0;
+  if (!s)
+    return 0;
+  const char *end = s + strlen(s), *stop;
+  while (s < end && isspace((unsigned char)*s))
+    s++;
+  if (s == end)
+    return 0;
+  int neg = s < end && *s == '-';
+  if (s < end && (*s == '-' || *s == '+'))
+    s++;
+  if (constant(s, end, &stop, value) == 0) {
+    while (stop < end && isspace((unsigned char)*stop))
+      stop++;
+    if (stop == end) {
+      if (neg)
+        *value = (long)(0UL - (unsigned long)*value);
+      return 0;
+    }
+  }
+  s = var_get(name);
+  if (depth == MAXDEPTH) {
+    errorf("%s: expression recursion level exceeded\n", name);
+    return -1;
+  }
+  return arith_eval(s, strlen(s), value);
+}
+
+static void set(const char *name, long value) {
+  char num[24];
+  snprintf(num, sizeof(num), "%ld", value);
+  var_set(name, num, 0);
+}
+
+// return 0 with the value of a in *value, -1 after reporting an error
+static int run(const struct arith_t *a, long *value) {
+  long stack[a->depth + 1];
+  int sp = 0;
+  for (int pc = 0; pc < a->ncode;) {
+    const struct ins_t *ins = &a->code[pc++];
+    long v;
+    switch (ins->op) {
+    case A_NUM:
+      stack[sp++] = ins->n;
+      continue;
+    case A_LOAD:
+      if (get(a->names[ins->var], &stack[sp++]) < 0)
+        return -1;
+      continue;
+    case A_STORE:
+      set(a->names[ins->var], stack[sp - 1]);
+      continue;
+    case A_PRE:
+    case A_POST:
+      if (get(a->names[ins->var], &v) < 0)
+        return -1;
+      set(a->names[ins->var], v + ins->n);
+      stack[sp++] = ins->op == A_PRE ? v + ins->n : v;
+      continue;
+    case A_POP:
+      sp--;
+      continue;
+    case A_AND:
+      if (stack[sp - 1] == 0)
+        pc = ins->n;
+      else
+        sp--;
+      continue;
+    case A_OR:
+      if (stack[sp - 1] != 0) {
+        stack[sp - 1] = 1;
+        pc = ins->n;
+      } else {
+        sp--;
+      }
+      continue;
+    case A_JZ:
+      if (stack[--sp] == 0)
+        pc = ins->n;
+      continue;
+    case A_JMP:
+      pc = ins->n;
+      continue;
+    case A_BOOL:
+      stack[sp - 1] = stack[sp - 1] != 0;
+      continue;
+    case A_NEG:
+      stack[sp - 1] = (long)(0UL - (unsigned long)stack[sp - 1]);
+      continue;
+    case A_NOT:
+      stack[sp - 1] = !stack[sp - 1];
+      continue;
+    case A_BNOT:
+      stack[sp - 1] = ~stack[sp - 1];
+      continue;
+    }
+
+    // the rest are binary, they wrap around instead of overflowing
+    long r = stack[--sp];
+    long l = stack[sp - 1];
+    unsigned long ul = l, ur = r;
+    switch (ins->op) {
+    case A_MUL:
+      v = (long)(ul * ur);
+      break;
+    case A_DIV:
+    case A_MOD:
+      if (r == 0)
+        return error(a, "division by 0");
+      if (r == -1)
+        v = ins->op == A_DIV ? (long)(0UL - ul) : 0;
+      else
+        v = ins->op == A_DIV ? l / r : l % r;
+      break;
+    case A_POW:
+      if (r < 0)
+        return error(a, "exponent less than 0");
+      for (v = 1; r; r >>= 1, ul *= ul) {
+        if (r & 1)
+          v = (long)((unsigned long)v * ul);
+      }
+      break;
+    case A_ADD:
+      v = (long)(ul + ur);
+      break;
+    case A_SUB:
+      v = (long)(ul - ur);
+      break;
+    case A_SHL:
+      v = (long)(ul << (r & 63));
+      break;
+    case A_SHR:
+      v = l >> (r & 63);
+      break;
+    case A_LT:
+      v = l < r;
+      break;
+    case A_LE:
+      v = l <= r;
+      break;
+    case A_GT:
+      v = l > r;
+      break;
+    case A_GE:
+      v = l >= r;
+      break;
+    case A_EQ:
+      v = l == r;
+      break;
+    case A_NE:
+      v = l != r;
+      break;
+    case A_BAND:
+      v = l & r;
+      break;
+    case A_BXOR:
+      v = l ^ r;
+      break;
+    default:
+      v = l | r;
+      break;
+    }
+    stack[sp - 1] = v;
+  }
+  *value = stack[sp - 1];
+  return 0;
+}
+
+// expressions by their text, in an arena that is let go as a whole
+struct entry_t {
+  unsigned long hash;
+  struct arith_t *a;
+};
+
+static struct entry_t cache[CACHESLOTS];
+static int ncached = 0;
+static struct arena_t arena;
+static int ready = 0;
+
+static unsigned long hash(const char *s, size_t len) {
+  unsigned long h = 14695981039346656037UL; /* FNV-1a */
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211UL;
+  }
+  return h;
+}
+
+int arith_cachesize(void) {
+  return ncached;
+}
+
+int arith_eval(const char *s, size_t len, long *value) {
+  if (!ready) {
+    arena_init(&arena);
+    ready = 1;
+  }
+  // nothing of the cache runs while an outer expression does
+  if (depth == 0 && ncached >= CACHESLOTS / 2) {
+    arena_free(&arena);
+    arena_init(&arena);
+    memset(cache, 0, sizeof(cache));
+    ncached = 0;
+  }
+
+  unsigned long h = hash(s, len);
+  size_t i = h & (CACHESLOTS - 1);
+  for (; cache[i].a; i = (i + 1) & (CACHESLOTS - 1)) {
+    if (cache[i].hash == h && cache[i].a->len == len &&
+        memcmp(cache[i].a->text, s, len) == 0)
+      break;
+  }
+  struct arith_t *a = cache[i].a;
+  if (!a) {
+    if (!(a = compile(&arena, s, len)))
+      return -1;
+    // variables that hold expressions can fill the cache before it is
+    // emptied, those are compiled each time
+    if (ncached < CACHESLOTS * 3 / 4) {
+      cache[i] = (struct entry_t){h, a};
+      ncached++;
+    }
+  }
+
+  depth++;
+  int r = run(a, value);
+  depth--;
+  return r;
+}
@@ -0,0 +1,21 @@
+#include "builtin.h"
+#include "builtin-table.h"
+#include <string.h>
+
+int builtin_find(const char *name) {
+  int id = builtin_slots[builtin_hash(name, BUILTIN_SEED) & (BUILTIN_SLOTS - 1)];
+  if (id < 0 || strcmp(builtin_names[id], name) != 0)
+    return -1;
+  return id;
+}
+
+const char *builtin_name(int id) { return builtin_names[id]; }
+
+int builtin_complete(const char *prefix, int id) {
+  size_t len = strlen(prefix);
+  for (; id < NBUILTINS; id++) {
+    if (strncmp(builtin_names[id], prefix, len) == 0)
+      return id;
+  }
+  return -1;
+}
@@ -1 +1,11 @@
 #include "common.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+void errorf(const char *fmt, ...) {
+  fflush(stdout);
+  va_list ap;
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+  va_end(ap);
+}
@@ -0,0 +1,474 @@
+#define _GNU_SOURCE
+#include "compile.h"
+#include "arena.h"
+#include "builtin.h"
+#include "parse.h"
+#include "var.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NBUCKETS 256
+
+#define CACHE_MAGIC 0x65646f63 /* "code" */
+// bump whenever the code changes. A new list of builtins changes
+// BUILTIN_DIGEST instead.
+#define CACHE_VERSION 7
+
+// code and strings being compiled, both growing as needed
+struct builder_t {
+  uint32_t *code;
+  size_t ncode;
+  size_t capcode;
+  char *strings;
+  size_t nstrings;
+  size_t capstrings;
+  struct arena_t arena;         /* words of the command being compiled */
+  builtin_resolver_t builtin;
+};
+
+// a compiled script kept in memory
+struct entry_t {
+  char *path;
+  dev_t dev;                    /* of the script when it was compiled */
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  struct code_t *code;
+  struct entry_t *next;
+};
+
+// header of a cache file, followed by the path of the script, the code and
+// the strings
+struct cachefile_t {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t dev;
+  uint64_t ino;
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint32_t pathlen;
+  uint32_t ncode;
+  uint32_t nstrings;
+  uint32_t builtins;            /* BUILTIN_DIGEST, builtins are ids */
+};
+
+static struct entry_t *buckets[NBUCKETS];
+static char *cachedir = NULL;
+
+static void *grow(void *p, size_t *cap, size_t need, size_t size) {
+  if (need <= *cap)
+    return p;
+  size_t cap2 = *cap ? *cap : 256;
+  while (cap2 < need)
+    cap2 *= 2;
+  p = realloc(p, cap2 * size);
+  if (!p) {
+    errorf("compile: out of memory\n");
+    exit(1);
+  }
+  *cap = cap2;
+  return p;
+}
+
+static void emit(struct builder_t *b, uint32_t word) {
+  b->code = grow(b->code, &b->capcode, b->ncode + 1, sizeof(uint32_t));
+  b->code[b->ncode++] = word;
+}
+
+// return offset of a copy of s among the strings
+static uint32_t addstr(struct builder_t *b, const char *s, size_t len) {
+  b->strings = grow(b->strings, &b->capstrings, b->nstrings + len + 1, 1);
+  uint32_t off = b->nstrings;
+  memcpy(b->strings + off, s, len);
+  b->strings[off + len] = '\0';
+  b->nstrings += len + 1;
+  return off;
+}
+
+static void compile_error(struct builder_t *b, int line, const char *msg) {
+  emit(b, OP_ERROR);
+  emit(b, line);
+  emit(b, addstr(b, msg, strlen(msg)));
+}
+
+// store a word that is plain text followed by one variable, $name or
+// ${name} in double quotes or, unless split is set, out of them, as that
+// text and $name with CODE_VAR
+// return 0 if the word is not like that
+static int emit_var(struct builder_t *b, const struct word_t *word,
+                    int split) {
+  const char *p = word->text, *end = p + word->len;
+  while (p < end && (isalnum((unsigned char)*p) || strchr("_-./:=,+%@", *p)))
+    p++;
+  int nprefix = p - word->text;
+  int quoted = p < end && *p == '"';
+  p += quoted;
+  if (p == end || *p++ != '$')
+    return 0;
+  int brace = p < end && *p == '{';
+  p += brace;
+  size_t n = var_namelen(p, end - p);
+  const char *name = p;
+  p += n;
+  if (n == 0 || (brace && (p == end || *p++ != '}')) ||
+      (quoted && (p == end || *p++ != '"')) || p != end || (split && !quoted))
+    return 0;
+
+  char *text = arena_alloc(&b->arena, nprefix + n + 1);
+  memcpy(text, word->text, nprefix);
+  text[nprefix] = '$';
+  memcpy(text + nprefix + 1, name, n);
+  emit(b, addstr(b, text, nprefix + n + 1) | CODE_VAR);
+  return 1;
+}
+
+// store a word as its value, or as its text if it has to be expanded when
+// it runs. split tells whether it is split into fields.
+static void emit_word(struct builder_t *b, const struct word_t *word,
+                      int split) {
+  if ((word->flags & WORD_GLOB) == 0 && (word->flags & WORD_EXPAND) &&
+      emit_var(b, word, split))
+    return;
+  if (word->flags & (WORD_EXPAND | WORD_GLOB)) {
+    emit(b, addstr(b, word->text, word->len) | CODE_EXPAND);
+  } else {
+    char *value = word_str(&b->arena, word);
+    emit(b, addstr(b, value, strlen(value)));
+  }
+}
+
+static void compile_pipeline(struct builder_t *b, const struct node_t *node) {
+  // time is taken off the first stage when the pipeline is compiled
+  const struct word_t *first = node->cmds->words;
+  int timed = word_istime(first);
+
+  int i = 0;
+  for (const struct cmd_t *cmd = node->cmds; cmd; cmd = cmd->next, i++) {
+    if (node->ncmds > 1 && cmd->nwords - (i == 0 ? timed : 0) == 0) {
+      compile_error(b, 0, "syntax error near unexpected token '|'");
+      return;
+    }
+  }
+
+  // a command of redirections only is not a builtin, it runs in the shell
+  // all the same. A command name with parameters or a pattern is looked up
+  // when it runs.
+  int builtin = -1;
+  const struct word_t *name = timed ? first->next : first;
+  if (node->ncmds == 1 && name &&
+      !(name->flags & (WORD_EXPAND | WORD_GLOB))) {
+    const struct cmd_t *cmd = node->cmds;
+    int argc = cmd->nwords - timed;
+    char **argv = arena_alloc(&b->arena, (argc + 1) * sizeof(char *));
+    const struct word_t *word = timed ? first->next : first;
+    for (i = 0; word; word = word->next)
+      argv[i++] = word_str(&b->arena, word);
+    argv[argc] = NULL;
+    builtin = b->builtin(argv, argc);
+  }
+
+  emit(b, OP_PIPE);
+  emit(b, node->ncmds);
+  emit(b, node->bg);
+  emit(b, timed);
+  emit(b, builtin);
+  emit(b, addstr(b, node->text, node->len));
+
+  i = 0;
+  for (const struct cmd_t *cmd = node->cmds; cmd; cmd = cmd->next, i++) {
+    const struct word_t *word = cmd->words;
+    if (i == 0 && timed)
+      word = word->next;
+    emit(b, cmd->nwords - (i == 0 ? timed : 0));
+    emit(b, cmd->nredirs);
+    emit(b, cmd->nassigns);
+    for (; word; word = word->next)
+      emit_word(b, word, 1);
+    for (const struct redir_t *r = cmd->redirs; r; r = r->next) {
+      emit(b, r->type);
+      emit(b, r->fd);
+      if (r->type == REDIR_DUP)
+        emit(b, (uint32_t)strtol(r->target.text, NULL, 10));
+      else if (r->type == REDIR_HEREDOC)
+        emit(b, addstr(b, r->target.text, r->target.len) |
+                    (r->target.flags & WORD_EXPAND ? CODE_EXPAND : 0));
+      else
+        emit_word(b, &r->target, 0);
+    }
+    for (const struct word_t *a = cmd->assigns; a; a = a->next)
+      emit_word(b, a, 0);
+  }
+}
+
+// an and-or list turns into its pipelines, each followed by a jump over the
+// right side of the && or || it is the left side of
+static void compile_andor(struct builder_t *b, const struct node_t *node) {
+  if (node->type == NODE_PIPE) {
+    compile_pipeline(b, node);
+    return;
+  }
+
+  compile_andor(b, node->left);
+  emit(b, node->type == NODE_AND ? OP_AND : OP_OR);
+  size_t target = b->ncode;
+  emit(b, 0);
+  compile_andor(b, node->right);
+  b->code[target] = b->ncode;
+}
+
+struct code_t *compile(const char *src, size_t len,
+                       builtin_resolver_t builtin) {
+  struct builder_t b = {.builtin = builtin};
+  struct parser_t parser;
+  struct node_t *list;
+  int rc;
+
+  arena_init(&b.arena);
+  struct arena_mark_t mark = arena_mark(&b.arena);
+  parser_init(&parser, &b.arena, src, len);
+  while ((rc = parse_next(&parser, &list)) != 0) {
+    if (rc < 0)
+      compile_error(&b, parser.errline, parser.error);
+    for (struct node_t *node = list; node; node = node->next) {
+      if (node->bg && node->type != NODE_PIPE) {
+        emit(&b, OP_SUBSHELL);
+        size_t end = b.ncode;
+        emit(&b, 0);
+        emit(&b, addstr(&b, node->text, node->len));
+        compile_andor(&b, node);
+        b.code[end] = b.ncode;
+      } else {
+        compile_andor(&b, node);
+      }
+    }
+    if (list)
+      emit(&b, OP_END);
+    arena_release(&b.arena, mark);
+  }
+  arena_free(&b.arena);
+
+  struct code_t *code = malloc(sizeof(struct code_t) +
+                               b.ncode * sizeof(uint32_t) + b.nstrings);
+  if (!code) {
+    errorf("compile: out of memory\n");
+    exit(1);
+  }
+  uint32_t *words = (uint32_t *)(code + 1);
+  char *strings = (char *)(words + b.ncode);
+  if (b.ncode)
+    memcpy(words, b.code, b.ncode * sizeof(uint32_t));
+  if (b.nstrings)
+    memcpy(strings, b.strings, b.nstrings);
+  *code = (struct code_t){1, b.ncode, b.nstrings, words, strings};
+  free(b.code);
+  free(b.strings);
+  return code;
+}
+
+void code_hold(struct code_t *code) { code->refs++; }
+
+void code_release(struct code_t *code) {
+  if (--code->refs == 0)
+    free(code);
+}
+
+static unsigned long hash(const char *s) {
+  unsigned long h = 14695981039346656037UL; /* FNV-1a */
+  while (*s) {
+    h ^= (unsigned char)*s++;
+    h *= 1099511628211UL;
+  }
+  return h;
+}
+
+// a relative path names another file in another directory, which the
+// device and inode tell apart
+static int same_stat(const struct entry_t *e, const struct stat *st) {
+  return e->dev == st->st_dev && e->ino == st->st_ino &&
+         e->size == st->st_size && e->mtime.tv_sec == st->st_mtim.tv_sec &&
+         e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// return path of the cache file of the script at path in buf
+static char *cachefile(char *buf, const char *path) {
+  snprintf(buf, PATH_MAX, "%s/%016lx.code", cachedir, hash(path));
+  return buf;
+}
+
+// return code of the script at path read from its cache file, NULL if there
+// is none or it is out of date
+static struct code_t *load(const char *path, const struct stat *st) {
+  char file[PATH_MAX];
+  int fd = open(cachefile(file, path), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+
+  struct cachefile_t h;
+  struct stat fst;
+  struct code_t *code = NULL;
+  size_t pathlen = strlen(path);
+  if (read(fd, &h, sizeof(h)) != sizeof(h) || fstat(fd, &fst) < 0 ||
+      h.magic != CACHE_MAGIC || h.version != CACHE_VERSION ||
+      h.builtins != BUILTIN_DIGEST ||
+      h.pathlen != pathlen || h.dev != st->st_dev || h.ino != st->st_ino ||
+      h.size != st->st_size ||
+      h.mtime_sec != st->st_mtim.tv_sec ||
+      h.mtime_nsec != st->st_mtim.tv_nsec ||
+      (size_t)fst.st_size != sizeof(h) + pathlen +
+                                 h.ncode * sizeof(uint32_t) + h.nstrings) {
+    close(fd);
+    return NULL;
+  }
+
+  // the path is read into the strings first, a hash may be shared
+  size_t size = h.ncode * sizeof(uint32_t) + h.nstrings;
+  code = malloc(sizeof(struct code_t) + size + pathlen);
+  if (!code) {
+    close(fd);
+    return NULL;
+  }
+  uint32_t *words = (uint32_t *)(code + 1);
+  char *strings = (char *)(words + h.ncode);
+  char *p = strings + h.nstrings;
+  if (read(fd, p, pathlen) != (ssize_t)pathlen ||
+      memcmp(p, path, pathlen) != 0 ||
+      read(fd, words, size) != (ssize_t)size) {
+    free(code);
+    close(fd);
+    return NULL;
+  }
+  close(fd);
+  *code = (struct code_t){1, h.ncode, h.nstrings, words, strings};
+  return code;
+}
+
+// write code of the script at path to its cache file, which is replaced at
+// once so that no reader sees it half written
+static void store(const char *path, const struct stat *st,
+                  const struct code_t *code) {
+  char file[PATH_MAX], tmp[PATH_MAX + 8];
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", cachefile(file, path));
+  int fd = mkstemp(tmp);
+  if (fd < 0)
+    return;
+
+  struct cachefile_t h = {.magic = CACHE_MAGIC,
+                          .version = CACHE_VERSION,
+                          .dev = st->st_dev,
+                          .ino = st->st_ino,
+                          .size = st->st_size,
+                          .mtime_sec = st->st_mtim.tv_sec,
+                          .mtime_nsec = st->st_mtim.tv_nsec,
+                          .pathlen = strlen(path),
+                          .ncode = code->ncode,
+                          .nstrings = code->nstrings,
+                          .builtins = BUILTIN_DIGEST};
+  size_t ncode = code->ncode * sizeof(uint32_t);
+  int ok = write(fd, &h, sizeof(h)) == sizeof(h) &&
+           write(fd, path, h.pathlen) == (ssize_t)h.pathlen &&
+           write(fd, code->code, ncode) == (ssize_t)ncode &&
+           write(fd, code->strings, code->nstrings) == (ssize_t)code->nstrings;
+  if (close(fd) < 0 || !ok || rename(tmp, file) < 0)
+    unlink(tmp);
+}
+
+// return entry of path in memory, removing it if it is out of date
+static struct entry_t **lookup(const char *path, const struct stat *st) {
+  struct entry_t **e = &buckets[hash(path) % NBUCKETS];
+  for (; *e; e = &(*e)->next) {
+    if (strcmp((*e)->path, path) != 0)
+      continue;
+    if (same_stat(*e, st))
+      return e;
+    struct entry_t *stale = *e;
+    *e = stale->next;
+    code_release(stale->code);
+    free(stale->path);
+    free(stale);
+    break;
+  }
+  return NULL;
+}
+
+static void keep(const char *path, const struct stat *st,
+                 struct code_t *code) {
+  struct entry_t *e = malloc(sizeof(struct entry_t));
+  char *copy = strdup(path);
+  if (!e || !copy) {
+    free(e);
+    free(copy);
+    return;
+  }
+  unsigned long h = hash(path) % NBUCKETS;
+  code_hold(code);
+  *e = (struct entry_t){copy,        st->st_dev,  st->st_ino, st->st_size,
+                        st->st_mtim, code, buckets[h]};
+  buckets[h] = e;
+}
+
+struct code_t *code_cache_get(const char *path, const struct stat *st) {
+  struct entry_t **e = lookup(path, st);
+  if (e) {
+    code_hold((*e)->code);
+    return (*e)->code;
+  }
+  if (!cachedir)
+    return NULL;
+
+  struct code_t *code = load(path, st);
+  if (code)
+    keep(path, st, code);
+  return code;
+}
+
+void code_cache_put(const char *path, const struct stat *st,
+                    struct code_t *code) {
+  if (!lookup(path, st))
+    keep(path, st, code);
+  if (cachedir)
+    store(path, st, code);
+}
+
+void code_cache_clear(void) {
+  for (int i = 0; i < NBUCKETS; i++) {
+    struct entry_t *e = buckets[i];
+    while (e) {
+      struct entry_t *next = e->next;
+      code_release(e->code);
+      free(e->path);
+      free(e);
+      e = next;
+    }
+    buckets[i] = NULL;
+  }
+}
+
+int code_cache_dir(const char *dir) {
+  free(cachedir);
+  cachedir = NULL;
+  if (!dir)
+    return 0;
+
+  // create the parents of dir as well, like mkdir -p
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s", dir);
+  for (char *p = path + 1;; p++) {
+    if (*p != '/' && *p != '\0')
+      continue;
+    char c = *p;
+    *p = '\0';
+    if (mkdir(path, 0700) < 0 && errno != EEXIST)
+      return -1;
+    *p = c;
+    if (c == '\0')
+      break;
+  }
+  cachedir = strdup(dir);
+  return cachedir ? 0 : -1;
+}
@@ -0,0 +1,840 @@
+#define _GNU_SOURCE
+#include "coreutils.h"
+#include "arith.h"
+#include "pathcache.h"
+#include "var.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* escapes of echo -e and %b take octal as \0nnn, those of a format \nnn */
+enum { ESC_ECHO, ESC_FORMAT };
+
+// return status of a utility that wrote to stdout, 1 if writing failed
+static int written(const char *name) {
+  if (!ferror(stdout))
+    return 0;
+  errorf("%s: write error: %s\n", name, strerror(errno));
+  clearerr(stdout);
+  return 1;
+}
+
+static int hexval(int c) {
+  return isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+}
+
+// write the escape sequence at s, which follows a backslash
+// return number of characters of s it took, -1 for \c which ends the output
+static int put_escape(const char *s, int mode, FILE *out) {
+  int c = 0, n = 1;
+  switch (*s) {
+  case 'a': c = '\a'; break;
+  case 'b': c = '\b'; break;
+  case 'c': return -1;
+  case 'e': case 'E': c = 033; break;
+  case 'f': c = '\f'; break;
+  case 'n': c = '\n'; break;
+  case 'r': c = '\r'; break;
+  case 't': c = '\t'; break;
+  case 'v': c = '\v'; break;
+  case '\\': c = '\\'; break;
+  case '"': case '\'':
+    if (mode == ESC_ECHO) {
+      putc('\\', out);
+      return 0;
+    }
+    c = *s;
+    break;
+  case 'x':
+    if (!isxdigit((unsigned char)s[1])) {
+      putc('\\', out);
+      return 0;
+    }
+    for (; n < 3 && isxdigit((unsigned char)s[n]); n++)
+      c = c * 16 + hexval((unsigned char)s[n]);
+    break;
+  case '0': case '1': case '2': case '3':
+  case '4': case '5': case '6': case '7': {
+    if (mode == ESC_ECHO && *s != '0') {
+      putc('\\', out);
+      return 0;
+    }
+    int start = mode == ESC_ECHO ? 1 : 0;
+    for (n = start; n < start + 3 && s[n] >= '0' && s[n] <= '7'; n++)
+      c = c * 8 + s[n] - '0';
+    break;
+  }
+  default:
+    // anything else, the end of the string included, is no escape
+    putc('\\', out);
+    return 0;
+  }
+  putc(c, out);
+  return n;
+}
+
+// write s with its escapes replaced
+// return -1 if \c ended the output, 0 otherwise
+static int put_escaped(const char *s, int mode, FILE *out) {
+  while (*s) {
+    if (*s != '\\') {
+      putc(*s++, out);
+      continue;
+    }
+    int n = put_escape(s + 1, mode, out);
+    if (n < 0)
+      return -1;
+    s += 1 + n;
+  }
+  return 0;
+}
+
+int do_echo(int argc, char *argv[]) {
+  int newline = 1, escapes = 0, i;
+
+  // options are words made of n, e and E only, up to the first other word
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    const char *p = argv[i] + 1;
+    if (p[strspn(p, "neE")] != '\0')
+      break;
+    for (; *p; p++) {
+      if (*p == 'n')
+        newline = 0;
+      else
+        escapes = *p == 'e';
+    }
+  }
+
+  for (; i < argc; i++) {
+    if (escapes) {
+      if (put_escaped(argv[i], ESC_ECHO, stdout) < 0)
+        return written("echo");
+    } else {
+      fputs(argv[i], stdout);
+    }
+    if (i < argc - 1)
+      putchar(' ');
+  }
+  if (newline)
+    putchar('\n');
+  return written("echo");
+}
+
+// arguments of printf, taken by the conversions of its format in turn
+struct args_t {
+  char **argv;
+  int argc;
+  int next;
+  int status; /* 1 once an argument was not a number */
+};
+
+static const char *next_arg(struct args_t *a) {
+  return a->next < a->argc ? a->argv[a->next++] : NULL;
+}
+
+// return whether the number arg was parsed up to end, reporting it if not
+static void check_number(struct args_t *a, const char *arg, const char *end) {
+  if (*end || errno) {
+    errorf("printf: %s: %s\n", arg,
+           errno == ERANGE ? strerror(errno) : "invalid number");
+    a->status = 1;
+  }
+}
+
+// return value of a numeric argument, the code of the character after a
+// leading quote, 0 if it is missing
+static intmax_t arg_int(struct args_t *a, const char *arg) {
+  if (!arg || !*arg)
+    return 0;
+  if (*arg == '\'' || *arg == '"')
+    return (unsigned char)arg[1];
+  char *end;
+  errno = 0;
+  intmax_t v = strtoimax(arg, &end, 0);
+  check_number(a, arg, end);
+  return v;
+}
+
+static uintmax_t arg_uint(struct args_t *a, const char *arg) {
+  if (!arg || !*arg)
+    return 0;
+  if (*arg == '\'' || *arg == '"')
+    return (unsigned char)arg[1];
+  char *end;
+  errno = 0;
+  uintmax_t v = strtoumax(arg, &end, 0);
+  check_number(a, arg, end);
+  return v;
+}
+
+static long double arg_float(struct args_t *a, const char *arg) {
+  if (!arg || !*arg)
+    return 0;
+  if (*arg == '\'' || *arg == '"')
+    return (unsigned char)arg[1];
+  char *end;
+  errno = 0;
+  long double v = strtold(arg, &end);
+  check_number(a, arg, end);
+  return v;
+}
+
+// append the digits at *f, or a number taken from the arguments for a *, to
+// spec
+static void take_digits(const char **f, char *spec, size_t *len,
+                        struct args_t *a) {
+  if (**f == '*') {
+    *len += snprintf(spec + *len, 64 - *len, "%d",
+                     (int)arg_int(a, next_arg(a)));
+    (*f)++;
+    return;
+  }
+  while (isdigit((unsigned char)**f)) {
+    if (*len < 40)
+      spec[(*len)++] = **f;
+    (*f)++;
+  }
+}
+
+// write format once, taking its conversions from the arguments
+// return -1 if the output has to end, 0 otherwise
+static int format_once(const char *f, struct args_t *a) {
+  while (*f) {
+    if (*f == '\\') {
+      int n = put_escape(f + 1, ESC_FORMAT, stdout);
+      if (n < 0)
+        return -1;
+      f += 1 + n;
+      continue;
+    }
+    if (*f != '%') {
+      putchar(*f++);
+      continue;
+    }
+    if (f[1] == '%') {
+      putchar('%');
+      f += 2;
+      continue;
+    }
+
+    // flags, width and precision are handed to printf as they are, with the
+    // length modifier of the type an argument is converted to
+    const char *start = f++;
+    char spec[64] = "%";
+    size_t len = 1;
+    while (*f && strchr("-+ #0", *f)) {
+      if (len < 40)
+        spec[len++] = *f;
+      f++;
+    }
+    take_digits(&f, spec, &len, a);
+    if (*f == '.') {
+      spec[len++] = *f++;
+      take_digits(&f, spec, &len, a);
+    }
+    char conv = *f;
+    if (!conv || !strchr("diouxXcsbeEfFgGaA", conv)) {
+      errorf("printf: %.*s: invalid format character\n",
+             (int)(f - start) + (conv != 0), start);
+      a->status = 1;
+      return -1;
+    }
+    f++;
+
+    const char *arg = next_arg(a);
+    switch (conv) {
+    case 'd': case 'i':
+      snprintf(spec + len, sizeof(spec) - len, "j%c", conv);
+      printf(spec, arg_int(a, arg));
+      break;
+    case 'o': case 'u': case 'x': case 'X':
+      snprintf(spec + len, sizeof(spec) - len, "j%c", conv);
+      printf(spec, arg_uint(a, arg));
+      break;
+    case 'c':
+      spec[len] = 'c';
+      printf(spec, arg && *arg ? *arg : '\0');
+      break;
+    case 's':
+      spec[len] = 's';
+      printf(spec, arg ? arg : "");
+      break;
+    case 'b': {
+      // the escapes are replaced first, so that width and precision count
+      // what is written
+      char *buf = NULL;
+      size_t size = 0;
+      FILE *m = open_memstream(&buf, &size);
+      int rc = put_escaped(arg ? arg : "", ESC_ECHO, m);
+      fclose(m);
+      spec[len] = 's';
+      printf(spec, buf);
+      free(buf);
+      if (rc < 0)
+        return -1;
+      break;
+    }
+    default:
+      snprintf(spec + len, sizeof(spec) - len, "L%c", conv);
+      printf(spec, arg_float(a, arg));
+      break;
+    }
+  }
+  return 0;
+}
+
+int do_printf(int argc, char *argv[]) {
+  struct args_t a = {argv + 2, argc - 2, 0, 0};
+
+  // the format is used again for as long as it takes arguments
+  do {
+    int next = a.next;
+    if (format_once(argv[1], &a) < 0 || a.next == next)
+      break;
+  } while (a.next < a.argc);
+  return written("printf") ? 1 : a.status;
+}
+
+// expression of test, with the argument being looked at
+struct test_t {
+  char **argv;
+  int argc;
+  int pos;
+  int error;        /* set once an error has been reported */
+  const char *name; /* test or [ */
+};
+
+static int is_unary(const char *s) {
+  return s[0] == '-' && s[1] && !s[2] && strchr("bcdefghkLnprsStuwxzOGN", s[1]);
+}
+
+static int is_binary(const char *s) {
+  static const char *ops[] = {"=",   "==",  "!=",  "<",   ">",
+                              "-eq", "-ne", "-lt", "-le", "-gt",
+                              "-ge", "-nt", "-ot", "-ef"};
+  for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+    if (strcmp(s, ops[i]) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+// report the first error of an expression, about arg if it is not NULL
+// return 0, the value of a broken expression
+static int test_error(struct test_t *t, const char *arg, const char *msg) {
+  if (!t->error) {
+    if (arg)
+      errorf("%s: %s: %s\n", t->name, arg, msg);
+    else
+      errorf("%s: %s\n", t->name, msg);
+  }
+  t->error = 1;
+  return 0;
+}
+
+// return 1 with the integer s in *v, blanks around it allowed
+static int test_int(struct test_t *t, const char *s, long long *v) {
+  char *end;
+  errno = 0;
+  *v = strtoll(s, &end, 10);
+  while (isspace((unsigned char)*end))
+    end++;
+  if (end == s || *end || errno)
+    return test_error(t, s, "integer expression expected");
+  return 1;
+}
+
+static int newer(const struct timespec *a, const struct timespec *b) {
+  return a->tv_sec > b->tv_sec ||
+         (a->tv_sec == b->tv_sec && a->tv_nsec > b->tv_nsec);
+}
+
+static int unary(struct test_t *t, const char *op, const char *arg) {
+  struct stat st;
+  long long fd;
+  switch (op[1]) {
+  case 'n': return *arg != '\0';
+  case 'z': return *arg == '\0';
+  case 't': return test_int(t, arg, &fd) && isatty(fd);
+  case 'h': case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+  case 'r': return faccessat(AT_FDCWD, arg, R_OK, AT_EACCESS) == 0;
+  case 'w': return faccessat(AT_FDCWD, arg, W_OK, AT_EACCESS) == 0;
+  case 'x': return faccessat(AT_FDCWD, arg, X_OK, AT_EACCESS) == 0;
+  }
+
+  if (stat(arg, &st) < 0)
+    return 0;
+  switch (op[1]) {
+  case 'b': return S_ISBLK(st.st_mode);
+  case 'c': return S_ISCHR(st.st_mode);
+  case 'd': return S_ISDIR(st.st_mode);
+  case 'f': return S_ISREG(st.st_mode);
+  case 'p': return S_ISFIFO(st.st_mode);
+  case 'S': return S_ISSOCK(st.st_mode);
+  case 'g': return (st.st_mode & S_ISGID) != 0;
+  case 'u': return (st.st_mode & S_ISUID) != 0;
+  case 'k': return (st.st_mode & S_ISVTX) != 0;
+  case 's': return st.st_size > 0;
+  case 'O': return st.st_uid == geteuid();
+  case 'G': return st.st_gid == getegid();
+  case 'N': return newer(&st.st_mtim, &st.st_atim);
+  }
+  return 1; /* -e */
+}
+
+static int binary(struct test_t *t, const char *a, const char *op,
+                  const char *b) {
+  if (op[0] != '-') {
+    int cmp = strcmp(a, b);
+    return op[0] == '!' ? cmp != 0
+           : op[0] == '<' ? cmp < 0
+           : op[0] == '>' ? cmp > 0
+                          : cmp == 0;
+  }
+
+  if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 ||
+      strcmp(op, "-ef") == 0) {
+    // -nt, -ot and -ef compare files, a missing one is older than any
+    struct stat sa, sb;
+    int ha = stat(a, &sa) == 0, hb = stat(b, &sb) == 0;
+    if (strcmp(op, "-nt") == 0)
+      return ha && (!hb || newer(&sa.st_mtim, &sb.st_mtim));
+    if (strcmp(op, "-ot") == 0)
+      return hb && (!ha || newer(&sb.st_mtim, &sa.st_mtim));
+    return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+  }
+
+  long long x, y;
+  if (!test_int(t, a, &x) || !test_int(t, b, &y))
+    return 0;
+  switch (op[1] * 256 + op[2]) {
+  case 'e' * 256 + 'q': return x == y;
+  case 'n' * 256 + 'e': return x != y;
+  case 'l' * 256 + 't': return x < y;
+  case 'l' * 256 + 'e': return x <= y;
+  case 'g' * 256 + 't': return x > y;
+  }
+  return x >= y; /* -ge */
+}
+
+static const char *peek(struct test_t *t) {
+  return t->pos < t->argc ? t->argv[t->pos] : NULL;
+}
+
+static int test_or(struct test_t *t);
+
+// a parenthesized expression, a unary or binary operation, or a string
+static int test_primary(struct test_t *t) {
+  const char *s = peek(t);
+  int left = t->argc - t->pos;
+  if (!s)
+    return test_error(t, NULL, "argument expected");
+
+  if (strcmp(s, "(") == 0) {
+    t->pos++;
+    int v = test_or(t);
+    if (!peek(t) || strcmp(peek(t), ")") != 0)
+      return test_error(t, NULL, "')' expected");
+    t->pos++;
+    return v;
+  }
+  if (left >= 3 && is_binary(t->argv[t->pos + 1])) {
+    t->pos += 3;
+    return binary(t, s, t->argv[t->pos - 2], t->argv[t->pos - 1]);
+  }
+  if (left >= 2 && is_unary(s)) {
+    t->pos += 2;
+    return unary(t, s, t->argv[t->pos - 1]);
+  }
+  t->pos++;
+  return *s != '\0';
+}
+
+static int test_not(struct test_t *t) {
+  if (peek(t) && strcmp(peek(t), "!") == 0) {
+    t->pos++;
+    return !test_not(t);
+  }
+  return test_primary(t);
+}
+
+static int test_and(struct test_t *t) {
+  int v = test_not(t);
+  while (peek(t) && strcmp(peek(t), "-a") == 0) {
+    t->pos++;
+    v = test_not(t) && v;
+  }
+  return v;
+}
+
+static int test_or(struct test_t *t) {
+  int v = test_and(t);
+  while (peek(t) && strcmp(peek(t), "-o") == 0) {
+    t->pos++;
+    v = test_and(t) || v;
+  }
+  return v;
+}
+
+// evaluate the next n arguments the way POSIX has it for up to 4 of them,
+// by the grammar above for more
+static int test_n(struct test_t *t, int n) {
+  char **a = t->argv + t->pos;
+  switch (n) {
+  case 0:
+    return 0;
+  case 1:
+    t->pos++;
+    return *a[0] != '\0';
+  case 2:
+    if (strcmp(a[0], "!") == 0) {
+      t->pos += 2;
+      return *a[1] == '\0';
+    }
+    if (is_unary(a[0])) {
+      t->pos += 2;
+      return unary(t, a[0], a[1]);
+    }
+    break;
+  case 3:
+    if (is_binary(a[1])) {
+      t->pos += 3;
+      return binary(t, a[0], a[1], a[2]);
+    }
+    if (strcmp(a[0], "!") == 0) {
+      t->pos++;
+      return !test_n(t, 2);
+    }
+    if (strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0) {
+      t->pos += 3;
+      return *a[1] != '\0';
+    }
+    break;
+  case 4:
+    if (strcmp(a[0], "!") == 0) {
+      t->pos++;
+      return !test_n(t, 3);
+    }
+    if (strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0) {
+      t->pos++;
+      int v = test_n(t, 2);
+      t->pos++;
+      return v;
+    }
+    break;
+  }
+  return test_or(t);
+}
+
+int do_test(int argc, char *argv[]) {
+  struct test_t t = {argv + 1, argc - 1, 0, 0, argv[0]};
+  if (strcmp(argv[0], "[") == 0) {
+    if (argc < 2 || strcmp(argv[argc - 1], "]") != 0) {
+      errorf("[: missing ']'\n");
+      return 2;
+    }
+    t.argc--;
+  }
+
+  int v = test_n(&t, t.argc);
+  if (t.pos < t.argc)
+    test_error(&t, t.argv[t.pos], "unexpected argument");
+  return t.error ? 2 : !v;
+}
+
+int do_true(int argc, char *argv[]) { return 0; }
+
+int do_false(int argc, char *argv[]) { return 1; }
+
+int do_cd(int argc, char *argv[]) {
+  const char *dir = argc > 1 ? argv[1] : var_get("HOME");
+  int print = 0;
+  if (!dir) {
+    errorf("cd: HOME not set\n");
+    return 1;
+  }
+  if (strcmp(dir, "-") == 0) {
+    dir = var_get("OLDPWD");
+    if (!dir) {
+      errorf("cd: OLDPWD not set\n");
+      return 1;
+    }
+    print = 1;
+  }
+
+  char old[PATH_MAX], cwd[PATH_MAX];
+  if (!getcwd(old, sizeof(old)))
+    old[0] = '\0';
+  if (chdir(dir) < 0) {
+    errorf("cd: %s: %s\n", dir, strerror(errno));
+    return 1;
+  }
+  if (old[0])
+    var_set("OLDPWD", old, 0);
+  if (getcwd(cwd, sizeof(cwd))) {
+    var_set("PWD", cwd, 0);
+    if (print)
+      puts(cwd);
+  }
+  pathcache_chdir();
+  return written("cd");
+}
+
+int do_pwd(int argc, char *argv[]) {
+  int logical = 1;
+  if (argc == 2) {
+    if (strcmp(argv[1], "-P") == 0) {
+      logical = 0;
+    } else if (strcmp(argv[1], "-L") != 0) {
+      errorf("pwd: %s: invalid option\n", argv[1]);
+      return 2;
+    }
+  }
+
+  // $PWD keeps the symbolic links cd went through, as long as it is right
+  const char *pwd = var_get("PWD");
+  struct stat a, b;
+  if (logical && pwd && pwd[0] == '/' && stat(pwd, &a) == 0 &&
+      stat(".", &b) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino) {
+    puts(pwd);
+    return written("pwd");
+  }
+
+  char cwd[PATH_MAX];
+  if (!getcwd(cwd, sizeof(cwd))) {
+    errorf("pwd: %s\n", strerror(errno));
+    return 1;
+  }
+  puts(cwd);
+  return written("pwd");
+}
+
+// return 1 if the len bytes at s are a variable name
+static int is_name(const char *s, size_t len) {
+  return len > 0 && var_namelen(s, len) == len;
+}
+
+static int compare(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+int do_export(int argc, char *argv[]) {
+  if (argc == 1 || (argc == 2 && strcmp(argv[1], "-p") == 0)) {
+    // sorted, in a form the shell reads back
+    const char *entry, **list = NULL;
+    int pos = 0, flags, n = 0, cap = 0;
+    while ((entry = var_next(&pos, &flags))) {
+      if (!(flags & VAR_EXPORT))
+        continue;
+      if (n == cap) {
+        cap = cap ? cap * 2 : 64;
+        list = realloc(list, cap * sizeof(char *));
+      }
+      list[n++] = entry;
+    }
+    if (n)
+      qsort(list, n, sizeof(char *), compare);
+    for (int i = 0; i < n; i++) {
+      const char *eq = strchr(list[i], '=');
+      if (!eq) {
+        printf("export %s\n", list[i]);
+        continue;
+      }
+      printf("export %.*s=\"", (int)(eq - list[i]), list[i]);
+      for (const char *p = eq + 1; *p; p++) {
+        if (strchr("\"\\$`", *p))
+          putchar('\\');
+        putchar(*p);
+      }
+      puts("\"");
+    }
+    free(list);
+    return written("export");
+  }
+
+  int status = 0;
+  for (int i = 1; i < argc; i++) {
+    const char *eq = strchr(argv[i], '=');
+    size_t len = eq ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+    if (!is_name(argv[i], len)) {
+      errorf("export: '%s': not a valid identifier\n", argv[i]);
+      status = 1;
+    } else if (eq) {
+      var_assign(argv[i], VAR_EXPORT);
+    } else {
+      var_export(argv[i]);
+    }
+  }
+  return status;
+}
+
+int do_unset(int argc, char *argv[]) {
+  int status = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!is_name(argv[i], strlen(argv[i]))) {
+      errorf("unset: '%s': not a valid identifier\n", argv[i]);
+      status = 1;
+    } else {
+      var_unset(argv[i]);
+    }
+  }
+  return status;
+}
+
+// stdin as read takes it: a byte at a time from a pipe or a terminal, so
+// that nothing after the line is consumed, and by blocks from a file, whose
+// offset is set back to the end of the line afterwards
+struct input_t {
+  char buf[256];
+  int len;
+  int pos;
+  int seekable;
+};
+
+// return next byte of stdin, -1 at its end
+static int read_byte(struct input_t *in) {
+  if (in->pos == in->len) {
+    ssize_t n;
+    do {
+      n = read(STDIN_FILENO, in->buf, in->seekable ? sizeof(in->buf) : 1);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+      return -1;
+    in->len = n;
+    in->pos = 0;
+  }
+  return (unsigned char)in->buf[in->pos++];
+}
+
+// line being read, with a mark on every byte a backslash protected
+struct line_t {
+  char *buf;
+  char *quoted;
+  size_t len;
+  size_t cap;
+};
+
+static void append(struct line_t *l, int c, int quoted) {
+  if (l->len == l->cap) {
+    l->cap = l->cap ? l->cap * 2 : 128;
+    l->buf = realloc(l->buf, l->cap);
+    l->quoted = realloc(l->quoted, l->cap);
+    if (!l->buf || !l->quoted) {
+      errorf("read: out of memory\n");
+      exit(1);
+    }
+  }
+  l->buf[l->len] = c;
+  l->quoted[l->len++] = quoted;
+}
+
+static void set_var(const char *name, const char *s, size_t len) {
+  char *value = strndup(s, len);
+  var_set(name, value, 0);
+  free(value);
+}
+
+int do_read(int argc, char *argv[]) {
+  int raw = 0, i;
+  const char *prompt = NULL;
+  for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    if (strcmp(argv[i], "--") == 0) {
+      i++;
+      break;
+    } else if (strcmp(argv[i], "-r") == 0) {
+      raw = 1;
+    } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      prompt = argv[++i];
+    } else {
+      errorf("read: usage: read [-r] [-p prompt] [name...]\n");
+      return 2;
+    }
+  }
+  char **names = argv + i;
+  int nnames = argc - i;
+  for (i = 0; i < nnames; i++) {
+    if (!is_name(names[i], strlen(names[i]))) {
+      errorf("read: '%s': not a valid identifier\n", names[i]);
+      return 1;
+    }
+  }
+
+  if (prompt && isatty(STDIN_FILENO))
+    errorf("%s", prompt);
+
+  // a backslash protects the next byte from splitting, and joins the next
+  // line to this one if it is a newline
+  struct input_t in = {.seekable = lseek(STDIN_FILENO, 0, SEEK_CUR) >= 0};
+  struct line_t l = {NULL, NULL, 0, 0};
+  int eof = 0, c;
+  for (;;) {
+    if ((c = read_byte(&in)) < 0) {
+      eof = 1;
+      break;
+    }
+    if (c == '\n')
+      break;
+    if (c == '\\' && !raw) {
+      if ((c = read_byte(&in)) < 0) {
+        eof = 1;
+        break;
+      }
+      if (c != '\n')
+        append(&l, c, 1);
+      continue;
+    }
+    append(&l, c, 0);
+  }
+  if (in.seekable && in.pos < in.len)
+    lseek(STDIN_FILENO, in.pos - in.len, SEEK_CUR);
+
+  // fields are split at IFS, the last name takes the rest of the line
+  const char *ifs = var_get("IFS");
+  if (!ifs)
+    ifs = " \t\n";
+#define IS_IFS(i) (!l.quoted[i] && l.buf[i] && strchr(ifs, l.buf[i]))
+#define IS_BLANK(i) (IS_IFS(i) && strchr(" \t\n", l.buf[i]))
+  size_t pos = 0;
+  if (nnames == 0)
+    set_var("REPLY", l.buf, l.len);
+  for (i = 0; i < nnames; i++) {
+    while (pos < l.len && IS_BLANK(pos))
+      pos++;
+    size_t start = pos;
+    if (i == nnames - 1) {
+      size_t end = l.len;
+      while (end > start && IS_BLANK(end - 1))
+        end--;
+      set_var(names[i], l.buf + start, end - start);
+      break;
+    }
+    while (pos < l.len && !IS_IFS(pos))
+      pos++;
+    set_var(names[i], l.buf + start, pos - start);
+    // one delimiter goes with the blanks around it
+    while (pos < l.len && IS_BLANK(pos))
+      pos++;
+    if (pos < l.len && IS_IFS(pos))
+      pos++;
+  }
+#undef IS_IFS
+#undef IS_BLANK
+
+  free(l.buf);
+  free(l.quoted);
+  return eof;
+}
+
+int do_let(int argc, char *argv[]) {
+  long value = 0;
+  for (int i = 1; i < argc; i++) {
+    if (arith_eval(argv[i], strlen(argv[i]), &value) < 0)
+      return 1;
+  }
+  return value == 0;
+}
@@ -232,6 +232,18 @@ static void sio_ltoa(long v, char s[], int b) {
   sio_reverse(s);
 }
 
+/* sio_ultoa - Convert unsigned long to base b string */
+static void sio_ultoa(unsigned long v, char s[], int b) {
+  int c, i = 0;
+
+  do {
+    s[i++] = ((c = (v % b)) < 10) ? c + '0' : c - 10 + 'a';
+  } while ((v /= b) > 0);
+
+  s[i] = '\0';
+  sio_reverse(s);
+}
+
 /* sio_strlen - Return length of string (from K&R) */
 static size_t sio_strlen(char s[]) {
   int i = 0;
@@ -263,6 +275,84 @@ void sio_error(char s[]) /* Put error message and exit */
   sio_puts(s);
   _exit(1); // line:csapp:sioexit
 }
+
+/*
+ * sio_vsnprintf - Format into buf like vsnprintf, for %d %i %u %x %s %c %p
+ * and %%, with an optional l or z size. Output beyond size - 1 bytes is cut
+ * off and buf is always terminated. Returns the length of the result.
+ */
+ssize_t sio_vsnprintf(char *buf, size_t size, const char *fmt, va_list ap) {
+  size_t n = 0;
+  char num[128];
+
+  if (size == 0)
+    return 0;
+
+  for (const char *p = fmt; *p; p++) {
+    const char *s = num;
+    if (*p != '%') {
+      num[0] = *p;
+      num[1] = '\0';
+    } else {
+      int lng = 0;
+      p++;
+      if (*p == 'l' || *p == 'z') {
+        lng = 1;
+        p++;
+      }
+      switch (*p) {
+      case 'd':
+      case 'i':
+        sio_ltoa(lng ? va_arg(ap, long) : va_arg(ap, int), num, 10);
+        break;
+      case 'u':
+        sio_ultoa(lng ? va_arg(ap, unsigned long) : va_arg(ap, unsigned), num,
+                  10);
+        break;
+      case 'x':
+        sio_ultoa(lng ? va_arg(ap, unsigned long) : va_arg(ap, unsigned), num,
+                  16);
+        break;
+      case 'p':
+        num[0] = '0';
+        num[1] = 'x';
+        sio_ultoa((unsigned long)va_arg(ap, void *), num + 2, 16);
+        break;
+      case 'c':
+        num[0] = (char)va_arg(ap, int);
+        num[1] = '\0';
+        break;
+      case 's':
+        if ((s = va_arg(ap, char *)) == NULL)
+          s = "(null)";
+        break;
+      case '\0':
+        p--; /* lone % at the end */
+        /* fall through */
+      default:
+        num[0] = '%';
+        num[1] = '\0';
+        break;
+      }
+    }
+    while (*s && n < size - 1)
+      buf[n++] = *s++;
+  }
+
+  buf[n] = '\0';
+  return n;
+}
+
+ssize_t sio_printf(const char *fmt, ...) /* Put formatted message */
+{
+  char buf[MAXLINE];
+  va_list ap;
+
+  va_start(ap, fmt);
+  ssize_t n = sio_vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  return write(STDOUT_FILENO, buf, n);
+}
 /* $end siopublic */
 
 /*******************************
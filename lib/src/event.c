@@ -0,0 +1,212 @@
+#define _GNU_SOURCE
+#include "event.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#define MAXREADY 64
+
+static int epoll_fd = -1;
+static int signal_fd = -1;
+static sigset_t prev_mask;
+
+// events returned by the last epoll_wait and not handed out yet
+static struct epoll_event ready[MAXREADY];
+static int nready = 0;
+static int nextready = 0;
+static long woke = 0; /* CLOCK_MONOTONIC ns epoll_wait returned them */
+
+// the data of an event is the pid of the child and its pidfd, or pid 0 for
+// the signalfd
+static uint64_t pack(pid_t pid, int fd) {
+  return (uint64_t)(uint32_t)fd << 32 | (uint32_t)pid;
+}
+
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+int event_init(const sigset_t *signals) {
+  if (epoll_fd >= 0)
+    return 0;
+
+  sigprocmask(SIG_BLOCK, signals, &prev_mask);
+  if ((signal_fd = signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC)) < 0 ||
+      (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    int olderrno = errno;
+    event_close();
+    errno = olderrno;
+    return -1;
+  }
+
+  struct epoll_event ev = {.events = EPOLLIN, .data.u64 = pack(0, signal_fd)};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev) < 0) {
+    int olderrno = errno;
+    event_close();
+    errno = olderrno;
+    return -1;
+  }
+  return 0;
+}
+
+void event_close(void) {
+  if (signal_fd >= 0)
+    close(signal_fd);
+  if (epoll_fd >= 0)
+    close(epoll_fd);
+  signal_fd = -1;
+  epoll_fd = -1;
+  nready = nextready = 0;
+  sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+}
+
+int event_active(void) {
+  return epoll_fd >= 0;
+}
+
+const sigset_t *event_sigmask(void) {
+  return &prev_mask;
+}
+
+int event_watch(pid_t pid, int pidfd) {
+  if (pidfd < 0 && (pidfd = syscall(SYS_pidfd_open, pid, 0)) < 0)
+    return -1;
+
+  struct epoll_event ev = {.events = EPOLLIN, .data.u64 = pack(pid, pidfd)};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pidfd, &ev) < 0) {
+    int olderrno = errno;
+    close(pidfd);
+    errno = olderrno;
+    return -1;
+  }
+  return 0;
+}
+
+// parse the value of field in the contents of /proc/pid/io
+static long iofield(const char *buf, const char *field) {
+  size_t len = strlen(field);
+  for (const char *p = buf; *p;) {
+    if (strncmp(p, field, len) == 0 && p[len] == ':') {
+      long v = 0;
+      for (p += len + 1; *p == ' '; p++)
+        ;
+      for (; *p >= '0' && *p <= '9'; p++)
+        v = v * 10 + (*p - '0');
+      return v;
+    }
+    while (*p && *p++ != '\n')
+      ;
+  }
+  return 0;
+}
+
+int event_procio(pid_t pid, long *rbytes, long *wbytes) {
+  // no stdio here, this runs in signal handlers too
+  char path[32] = "/proc/";
+  char digits[16];
+  int n = 0, len = 6;
+  do {
+    digits[n++] = '0' + pid % 10;
+  } while ((pid /= 10) > 0);
+  while (n > 0)
+    path[len++] = digits[--n];
+  memcpy(path + len, "/io", 4);
+
+  char buf[512];
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  ssize_t got = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (got <= 0)
+    return -1;
+  buf[got] = '\0';
+
+  *rbytes = iofield(buf, "rchar");
+  *wbytes = iofield(buf, "wchar");
+  return 0;
+}
+
+// reap the child behind a readable pidfd, which is closed afterwards
+// return 1 if ev is filled, 0 if someone else has reaped the child
+static int reap(struct event_t *ev, pid_t pid, int pidfd) {
+  siginfo_t info;
+  memset(&info, 0, sizeof(info));
+  memset(&ev->rusage, 0, sizeof(ev->rusage));
+  ev->rbytes = ev->wbytes = 0;
+  // the counters of a zombie are still there, and the pidfd being readable
+  // means it is one
+  event_procio(pid, &ev->rbytes, &ev->wbytes);
+  // the waitid of libc does not return the resource usage
+  int rc = syscall(SYS_waitid, P_PIDFD, pidfd, &info, WEXITED | WNOHANG,
+                   &ev->rusage);
+  if (rc == 0 && info.si_pid == 0)
+    return 0; /* spurious wakeup, the pidfd stays */
+  ev->reaped = now();
+  close(pidfd);
+  if (rc < 0)
+    return 0;
+
+  ev->type = EVENT_EXIT;
+  ev->pid = pid;
+  switch (info.si_code) {
+  case CLD_EXITED:
+    ev->status = W_EXITCODE(info.si_status, 0);
+    break;
+  case CLD_DUMPED:
+    ev->status = info.si_status | WCOREFLAG;
+    break;
+  default:
+    ev->status = info.si_status;
+    break;
+  }
+  return 1;
+}
+
+int event_next(struct event_t *ev, int timeout) {
+  for (;;) {
+    while (nextready < nready) {
+      uint64_t data = ready[nextready].data.u64;
+      pid_t pid = (pid_t)(uint32_t)data;
+      int fd = (int)(data >> 32);
+
+      if (pid == 0) {
+        // leave the signalfd in place until it is drained
+        struct signalfd_siginfo info;
+        if (read(fd, &info, sizeof(info)) == sizeof(info)) {
+          ev->type = EVENT_SIGNAL;
+          ev->signo = info.ssi_signo;
+          ev->notified = woke;
+          return 1;
+        }
+        nextready++;
+        continue;
+      }
+
+      nextready++;
+      ev->notified = woke;
+      if (reap(ev, pid, fd))
+        return 1;
+    }
+
+    nready = epoll_wait(epoll_fd, ready, MAXREADY, timeout);
+    nextready = 0;
+    woke = now();
+    if (nready < 0) {
+      nready = 0;
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (nready == 0)
+      return 0;
+  }
+}
@@ -0,0 +1,866 @@
+#include "expand.h"
+#include "arith.h"
+#include "match.h"
+#include "pathglob.h"
+#include "var.h"
+#include <stdio.h>
+#include <string.h>
+
+// the word being expanded, and the field under way
+struct state_t {
+  struct expand_t *x;
+  struct fields_t *fields; /* NULL if the word is not split */
+  char *buf;
+  size_t len;
+  size_t cap;
+  int have;                /* a field is under way, even if it is empty */
+  int none;                /* "$@" expanded to nothing */
+  int split;               /* literal text is split too, as in ${v-a b} */
+  int pattern;             /* quoted text is escaped to match literally */
+  int glob;                /* fields are patterns of paths as well */
+  int meta;                /* the field has a '*', '?' or '[' not quoted */
+  int escaped;             /* and a backslash put in front of a byte */
+  const char *ifs;
+};
+
+void fields_add(struct fields_t *fields, struct arena_t *arena, char *field) {
+  if (fields->n == fields->cap) {
+    int cap = fields->cap ? fields->cap * 2 : 8;
+    char **v = arena_alloc(arena, cap * sizeof(char *));
+    if (fields->n)
+      memcpy(v, fields->v, fields->n * sizeof(char *));
+    fields->v = v;
+    fields->cap = cap;
+  }
+  fields->v[fields->n++] = field;
+}
+
+static void put(struct state_t *st, const char *s, size_t n) {
+  if (st->len + n + 1 > st->cap) {
+    size_t cap = st->cap ? st->cap * 2 : 64;
+    while (cap < st->len + n + 1)
+      cap *= 2;
+    char *buf = arena_alloc(st->x->arena, cap);
+    memcpy(buf, st->buf, st->len);
+    st->buf = buf;
+    st->cap = cap;
+  }
+  memcpy(st->buf + st->len, s, n);
+  st->len += n;
+  st->have = 1;
+}
+
+// end the field under way, which is replaced by the paths it matches if it
+// is a pattern that matches any
+static void field(struct state_t *st) {
+  struct arena_t *arena = st->x->arena;
+  char *s = arena_strndup(arena, st->buf ? st->buf : "", st->len);
+  char **paths;
+  int n = st->meta ? pathglob(arena, s, st->len, &paths) : 0;
+  for (int i = 0; i < n; i++)
+    fields_add(st->fields, arena, paths[i]);
+  if (n == 0 && st->escaped) {
+    // take the escapes of the pattern off again
+    char *to = s;
+    for (const char *from = s; *from; from++) {
+      if (*from == '\\' && from[1])
+        from++;
+      *to++ = *from;
+    }
+    *to = '\0';
+  }
+  if (n == 0)
+    fields_add(st->fields, arena, s);
+  st->len = 0;
+  st->have = 0;
+  st->meta = 0;
+  st->escaped = 0;
+}
+
+// add text that was not quoted, where a '*', '?' or '[' makes the field a
+// pattern of paths
+static void put_unquoted(struct state_t *st, const char *s, size_t n) {
+  if (!st->glob) {
+    put(st, s, n);
+    return;
+  }
+  put(st, s, 0);
+  for (size_t i = 0; i < n; i++) {
+    if (s[i] == '*' || s[i] == '?' || s[i] == '[') {
+      st->meta = 1;
+    } else if (s[i] == '\\') {
+      put(st, "\\", 1);
+      st->escaped = 1;
+    }
+    put(st, s + i, 1);
+  }
+}
+
+// add the result of an unquoted expansion, split at IFS. Blanks of IFS
+// around a field are dropped, any other character of it ends a field even if
+// the field is empty.
+static void put_split(struct state_t *st, const char *s, size_t n) {
+  if (!st->fields) {
+    put(st, s, n);
+    return;
+  }
+  int blank = 0; /* the last delimiter was a blank */
+  for (size_t i = 0; i < n; i++) {
+    if (!s[i] || !strchr(st->ifs, s[i])) {
+      size_t j = i;
+      while (j < n && s[j] && !strchr(st->ifs, s[j]))
+        j++;
+      put_unquoted(st, s + i, j - i);
+      i = j - 1;
+      blank = 0;
+    } else if (s[i] == ' ' || s[i] == '\t' || s[i] == '\n') {
+      if (st->have)
+        field(st);
+      blank = 1;
+    } else {
+      if (st->have || !blank)
+        field(st);
+      blank = 0;
+    }
+  }
+}
+
+// add text that was quoted, or was escaped by a backslash
+static void put_quoted(struct state_t *st, const char *s, size_t n) {
+  if (!st->pattern && !st->glob) {
+    put(st, s, n);
+    return;
+  }
+  put(st, s, 0);
+  for (size_t i = 0; i < n; i++) {
+    if (strchr("*?[]\\", s[i])) {
+      put(st, "\\", 1);
+      st->escaped = 1;
+    }
+    put(st, s + i, 1);
+  }
+}
+
+// add what an expansion produced
+static void put_value(struct state_t *st, const char *s, size_t n,
+                      int quoted) {
+  if (quoted)
+    put_quoted(st, s, n);
+  else if (st->pattern)
+    put(st, s, n);
+  else
+    put_split(st, s, n);
+}
+
+// add unquoted text of the word itself
+static void put_literal(struct state_t *st, const char *s, size_t n) {
+  if (st->split)
+    put_value(st, s, n, 0);
+  else
+    put_unquoted(st, s, n);
+}
+
+static const char *param_error(const char *s, int len, const char *msg) {
+  errorf("%.*s: %s\n", len, s, msg);
+  return NULL;
+}
+
+// add the n strings of v the way $@ or $* adds the positional parameters,
+// unquoted or in double quotes
+static void put_list(struct state_t *st, char which, int quoted, char **v,
+                     int n) {
+  if (n == 0) {
+    st->none = which == '@' && quoted;
+    return;
+  }
+
+  // "$*" is one field, the parameters joined by the first character of IFS,
+  // and so is any of them where words are not split
+  char sep = *st->ifs;
+  for (int i = 0; i < n; i++) {
+    if (quoted)
+      put_quoted(st, v[i], strlen(v[i]));
+    else
+      put_split(st, v[i], strlen(v[i]));
+    if (i == n - 1)
+      break;
+    if ((quoted && which == '*') || !st->fields) {
+      if (sep)
+        put(st, &sep, 1);
+    } else if (quoted || st->have) {
+      field(st);
+    }
+  }
+}
+
+static void put_params(struct state_t *st, char which, int quoted) {
+  struct expand_t *x = st->x;
+  int n = x->nparams > 0 ? x->nparams - 1 : 0;
+  put_list(st, which, quoted, x->params + 1, n);
+}
+
+// return value of the parameter of len bytes at name, a variable, a
+// positional or a special one, NULL if it is not set
+static const char *lookup(struct state_t *st, const char *name, int len,
+                          char *num) {
+  struct expand_t *x = st->x;
+  if (name[0] >= '0' && name[0] <= '9') {
+    int n = 0;
+    for (int i = 0; i < len; i++)
+      n = n * 10 + name[i] - '0';
+    return n < x->nparams ? x->params[n] : NULL;
+  }
+  if (len == 1 && name[0] == '?') {
+    snprintf(num, 24, "%d", x->status);
+    return num;
+  }
+  if (len == 1 && name[0] == '$') {
+    snprintf(num, 24, "%d", (int)x->pid);
+    return num;
+  }
+  if (len == 1 && name[0] == '#') {
+    snprintf(num, 24, "%d", x->nparams > 0 ? x->nparams - 1 : 0);
+    return num;
+  }
+  if (len == 1 && (name[0] == '@' || name[0] == '*')) {
+    // as one string, which an operator works on, they are "$*"
+    if (x->nparams <= 1)
+      return NULL;
+    struct state_t all = {.x = x, .ifs = st->ifs};
+    put_params(&all, '*', 1);
+    return arena_strndup(x->arena, all.buf ? all.buf : "", all.len);
+  }
+  return var_getn(name, len);
+}
+
+// return length of the parameter name at s, 0 if there is none
+static int param_len(const char *s, const char *end) {
+  if (s == end)
+    return 0;
+  if (strchr("?$#@*", *s))
+    return 1;
+  if (*s >= '0' && *s <= '9')
+    return 1;
+  return var_namelen(s, end - s);
+}
+
+// return length of the parameter name at s in braces, where a positional
+// parameter may have more than one digit
+static int brace_len(const char *s, const char *end) {
+  int n = param_len(s, end);
+  if (n == 1 && *s >= '0' && *s <= '9') {
+    while (s + n < end && s[n] >= '0' && s[n] <= '9')
+      n++;
+  }
+  return n;
+}
+
+// return the ')' that closes the '(' at s, NULL if there is none
+static const char *paren_end(const char *s, const char *end) {
+  int depth = 0;
+  for (; s < end; s++) {
+    if (*s == '(')
+      depth++;
+    else if (*s == ')' && --depth == 0)
+      return s;
+  }
+  return NULL;
+}
+
+// return the '`' that closes the one at s, NULL if there is none
+static const char *backquote_end(const char *s, const char *end) {
+  for (s++; s < end && *s != '`'; s++) {
+    if (*s == '\\' && s + 1 < end)
+      s++;
+  }
+  return s < end ? s : NULL;
+}
+
+static const char *command_end(const char *s, const char *end);
+
+// return first byte from s on that is one of stop and is not quoted, escaped
+// or in a parameter of its own, end if there is none
+static const char *scan(const char *s, const char *end, const char *stop) {
+  size_t nstop = strlen(stop);
+  while (s < end && !memchr(stop, *s, nstop)) {
+    if (*s == '\\') {
+      s += 2;
+    } else if (*s == '\'') {
+      const char *close = memchr(s + 1, '\'', end - s - 1);
+      s = close ? close + 1 : end;
+    } else if (*s == '"') {
+      for (s++; s < end && *s != '"'; s++) {
+        if (*s == '\\') {
+          s++;
+        } else if (*s == '$' && s + 1 < end && s[1] == '{') {
+          if ((s = scan(s + 2, end, "}")) == end)
+            return end;
+        } else if (*s == '$' && s + 1 < end && s[1] == '(') {
+          if (!(s = command_end(s + 1, end)))
+            return end;
+        } else if (*s == '`') {
+          if (!(s = backquote_end(s, end)))
+            return end;
+        }
+      }
+      s++;
+    } else if (*s == '$' && s + 1 < end && s[1] == '{') {
+      s = scan(s + 2, end, "}") + 1;
+    } else if (*s == '$' && s + 1 < end && s[1] == '(') {
+      const char *close = command_end(s + 1, end);
+      s = close ? close + 1 : end;
+    } else if (*s == '`') {
+      const char *close = backquote_end(s, end);
+      s = close ? close + 1 : end;
+    } else {
+      s++;
+    }
+  }
+  return s < end ? s : end;
+}
+
+// return the ')' that closes the command substitution whose '(' is at s,
+// NULL if there is none. Parentheses may be quoted in the command.
+static const char *command_end(const char *s, const char *end) {
+  int depth = 1;
+  for (s++; (s = scan(s, end, "()")) < end; s++) {
+    if (*s == '(')
+      depth++;
+    else if (--depth == 0)
+      return s;
+  }
+  return NULL;
+}
+
+static int walk(struct state_t *st, const char *s, const char *end,
+                int quoted);
+
+// return the text from s to end expanded to one string, which is a pattern
+// if pattern is set. NULL after reporting an error.
+static char *expand_sub(struct state_t *st, const char *s, const char *end,
+                        int pattern) {
+  struct state_t sub = {.x = st->x, .pattern = pattern, .ifs = st->ifs};
+  if (walk(&sub, s, end, 0) < 0)
+    return NULL;
+  return arena_strndup(st->x->arena, sub.buf ? sub.buf : "", sub.len);
+}
+
+// expand the word of an operator like ${name-word} in the place of the
+// parameter, split like the value of a parameter if it is not quoted
+static int put_word(struct state_t *st, const char *s, const char *end,
+                    int quoted) {
+  int split = st->split;
+  st->split = !quoted;
+  int r = walk(st, s, end, quoted);
+  st->split = split;
+  return r;
+}
+
+// set *from and *to to the range of ${name:offset:length} in n bytes or
+// parameters, from the text after the colon to close. Offset and length are
+// arithmetic, a negative offset counts from the end and a negative length is
+// where to stop before it.
+// return 0 on success, -1 after reporting an error
+static int range(struct state_t *st, const char *s, const char *close,
+                 long n, long *from, long *to, const char *at, int whole) {
+  const char *sep = scan(s, close, ":");
+  char *offset = expand_sub(st, s, sep, 0);
+  char *length = sep < close ? expand_sub(st, sep + 1, close, 0) : NULL;
+  if (!offset || (sep < close && !length))
+    return -1;
+  if (arith_eval(offset, strlen(offset), from) < 0 ||
+      (length && arith_eval(length, strlen(length), to) < 0))
+    return -1;
+  if (*from < 0)
+    *from += n;
+  if (*from < 0 || *from > n) {
+    *from = *to = 0;
+    return 0;
+  }
+  if (!length)
+    *to = n;
+  else if (*to < 0)
+    *to += n;
+  else
+    *to = *from + *to < n ? *from + *to : n;
+  if (*to < *from) {
+    param_error(at, whole, "substring expression < 0");
+    return -1;
+  }
+  return 0;
+}
+
+// an operator that edits a value with a pattern, which is compiled once for
+// every value it edits
+struct edit_t {
+  char op;                 /* '#', '%' or '/' */
+  int mode;                /* '#' and '%': the longest match. '/': 0 for
+                              the first match, '/' every one, '#' a prefix
+                              and '%' a suffix */
+  struct match_t *m;
+  const char *repl;
+};
+
+// replace what m matches in the len bytes at s with repl
+static void replace(struct state_t *out, const char *s, size_t len,
+                    const struct match_t *m, int mode, const char *repl) {
+  size_t nrepl = strlen(repl);
+  if (mode == '#') {
+    long n = match_prefix(m, s, len, 1);
+    if (n >= 0) {
+      put(out, repl, nrepl);
+      s += n;
+      len -= n;
+    }
+    put(out, s, len);
+    return;
+  }
+  if (mode == '%') {
+    long n = match_suffix(m, s, len, 1);
+    if (n >= 0) {
+      put(out, s, n);
+      put(out, repl, nrepl);
+    } else {
+      put(out, s, len);
+    }
+    return;
+  }
+
+  // an empty pattern matches nothing
+  size_t done = 0;
+  for (size_t i = 0; m->nsteps > 0 && i < len;) {
+    // a match can only start where the literal the pattern starts with does
+    if (m->nprefix) {
+      const char *p = memchr(s + i, m->prefix[0], len - i);
+      if (!p)
+        break;
+      i = p - s;
+    }
+    long n = match_prefix(m, s + i, len - i, 1);
+    if (n <= 0) {
+      i++;
+      continue;
+    }
+    put(out, s + done, i - done);
+    put(out, repl, nrepl);
+    done = i += n;
+    if (mode != '/')
+      break;
+  }
+  put(out, s + done, len - done);
+}
+
+// set up e from the operator at op, up to close
+// return 0 on success, -1 after reporting an error
+static int edit_init(struct state_t *st, struct edit_t *e, const char *op,
+                     const char *close) {
+  const char *p = op + 1;
+  const char *sep = close;
+  *e = (struct edit_t){.op = *op, .repl = ""};
+  if (*op == '/') {
+    if (p < close && strchr("/#%", *p))
+      e->mode = *p++;
+    sep = scan(p, close, "/");
+    if (sep < close && !(e->repl = expand_sub(st, sep + 1, close, 0)))
+      return -1;
+  } else if (p < close && *p == *op) {
+    e->mode = 1;
+    p++;
+  }
+  char *pattern = expand_sub(st, p, sep, 1);
+  if (!pattern)
+    return -1;
+  e->m = match_compile(st->x->arena, pattern, strlen(pattern));
+  return 0;
+}
+
+// return the len bytes at s edited by e, allocated in the arena
+static char *edit(struct state_t *st, const struct edit_t *e, const char *s,
+                  size_t len) {
+  struct state_t out = {.x = st->x};
+  put(&out, s, 0);
+  if (e->op == '/') {
+    replace(&out, s, len, e->m, e->mode, e->repl);
+  } else {
+    long cut = e->op == '#' ? match_prefix(e->m, s, len, e->mode)
+                            : match_suffix(e->m, s, len, e->mode);
+    if (cut >= 0 && e->op == '#') {
+      s += cut;
+      len -= cut;
+    } else if (cut >= 0) {
+      len = cut;
+    }
+    put(&out, s, len);
+  }
+  out.buf[out.len] = '\0';
+  return out.buf;
+}
+
+// expand the parameter in braces after the '$' at s, which may have an
+// operator
+// return end of the parameter, NULL after reporting an error
+static const char *brace(struct state_t *st, const char *s, const char *end,
+                         int quoted) {
+  struct expand_t *x = st->x;
+  char num[24];
+  const char *at = s - 1;
+  const char *close = scan(s + 1, end, "}");
+  if (close == end)
+    return param_error(at, end - at, "bad substitution");
+  const char *name = s + 1;
+  const char *next = close + 1;
+  int whole = next - at;
+
+  // ${#name} is the length of the value
+  if (name[0] == '#' && name + 1 < close &&
+      brace_len(name + 1, close) == close - name - 1) {
+    const char *value = lookup(st, name + 1, close - name - 1, num);
+    if (close - name == 2 && (name[1] == '@' || name[1] == '*'))
+      snprintf(num, sizeof(num), "%d", x->nparams > 0 ? x->nparams - 1 : 0);
+    else
+      snprintf(num, sizeof(num), "%zu", value ? strlen(value) : 0);
+    put_value(st, num, strlen(num), quoted);
+    return next;
+  }
+
+  int len = brace_len(name, close);
+  if (len == 0)
+    return param_error(at, whole, "bad substitution");
+  const char *op = name + len;
+  if (op == close) {
+    if (len == 1 && (name[0] == '@' || name[0] == '*')) {
+      put_params(st, name[0], quoted);
+    } else {
+      const char *value = lookup(st, name, len, num);
+      if (value)
+        put_value(st, value, strlen(value), quoted);
+    }
+    return next;
+  }
+
+  const char *value = lookup(st, name, len, num);
+  int colon = *op == ':';
+  char c = colon ? op[1] : op[0];
+  if (colon && op + 1 == close)
+    return param_error(at, whole, "bad substitution");
+
+  // ${name-word} ${name=word} ${name?word} ${name+word}, where the colon
+  // makes an empty value count as unset
+  if (strchr("-=?+", c)) {
+    const char *word = op + colon + 1;
+    int unset = !value || (colon && !*value);
+    if (c == '+') {
+      if (!unset && put_word(st, word, close, quoted) < 0)
+        return NULL;
+    } else if (!unset) {
+      put_value(st, value, strlen(value), quoted);
+    } else if (c == '-') {
+      if (put_word(st, word, close, quoted) < 0)
+        return NULL;
+    } else if (c == '=') {
+      if (var_namelen(name, len) != (size_t)len)
+        return param_error(at, whole, "cannot assign in this way");
+      char *v = expand_sub(st, word, close, 0);
+      if (!v)
+        return NULL;
+      var_set(arena_strndup(x->arena, name, len), v, 0);
+      put_value(st, v, strlen(v), quoted);
+    } else {
+      char *msg = word < close ? expand_sub(st, word, close, 0) : NULL;
+      if (word < close && !msg)
+        return NULL;
+      return param_error(name, len, msg ? msg : "parameter null or not set");
+    }
+    return next;
+  }
+
+  // the operators below work on each of $@ and $*
+  struct expand_t *list = len == 1 && (name[0] == '@' || name[0] == '*')
+                              ? x : NULL;
+  if (!value)
+    value = "";
+  long n = strlen(value);
+
+  // ${name:offset} ${name:offset:length}, which take parameters out of $@
+  if (colon) {
+    long from, to;
+    if (range(st, op + 1, close, list ? x->nparams : n, &from, &to, at,
+              whole) < 0)
+      return NULL;
+    if (list) {
+      // $0 comes first if the offset is 0
+      put_list(st, name[0], quoted, x->params + from, to - from);
+    } else {
+      put_value(st, value + from, to - from, quoted);
+    }
+    return next;
+  }
+
+  // ${name#pattern} ${name##pattern} ${name%pattern} ${name%%pattern} take
+  // away the shortest or the longest prefix or suffix that matches.
+  // ${name/pattern/string} replaces the first match, ${name//...} every one,
+  // ${name/#...} a prefix and ${name/%...} a suffix.
+  if (c == '#' || c == '%' || c == '/') {
+    struct edit_t e;
+    if (edit_init(st, &e, op, close) < 0)
+      return NULL;
+    if (list) {
+      int count = x->nparams > 0 ? x->nparams - 1 : 0;
+      char **v = arena_alloc(x->arena, (count + 1) * sizeof(char *));
+      for (int i = 0; i < count; i++)
+        v[i] = edit(st, &e, x->params[i + 1], strlen(x->params[i + 1]));
+      put_list(st, name[0], quoted, v, count);
+    } else {
+      char *edited = edit(st, &e, value, n);
+      put_value(st, edited, strlen(edited), quoted);
+    }
+    return next;
+  }
+  return param_error(at, whole, "bad substitution");
+}
+
+// expand the arithmetic $((expression)) whose first '(' is at s
+// return end of it, NULL after reporting an error
+static const char *arith(struct state_t *st, const char *s, const char *end,
+                         int quoted) {
+  const char *close = paren_end(s, end);
+  if (!close || close - s < 3 || close[-1] != ')')
+    return param_error(s - 1, end - s + 1, "missing ')'");
+
+  // parameters in the expression are expanded before it is evaluated, an
+  // expression without any is evaluated as it is in the source
+  const char *text = s + 2;
+  size_t len = close - 1 - text;
+  if (memchr(text, '$', len) || memchr(text, '\'', len) ||
+      memchr(text, '"', len) || memchr(text, '\\', len)) {
+    if (!(text = expand_sub(st, text, close - 1, 0)))
+      return NULL;
+    len = strlen(text);
+  }
+  long value;
+  if (arith_eval(text, len, &value) < 0)
+    return NULL;
+  char num[24];
+  snprintf(num, sizeof(num), "%ld", value);
+  put_value(st, num, strlen(num), quoted);
+  return close + 1;
+}
+
+// run the command of len bytes at text and add what it writes, without the
+// newlines it ends with. Its status is $? from then on.
+// return 0 on success, -1 after reporting an error
+static int command(struct state_t *st, const char *text, size_t len,
+                   int quoted) {
+  struct expand_t *x = st->x;
+  if (!x->command)
+    return 0;
+  char *out = NULL;
+  size_t n = 0;
+  int status = x->command(x, text, len, &out, &n);
+  if (status < 0)
+    return -1;
+  x->status = status;
+  while (n > 0 && out[n - 1] == '\n')
+    n--;
+  put_value(st, n ? out : "", n, quoted);
+  return 0;
+}
+
+// run the command $(...) whose '(' is at s
+// return end of it, NULL after reporting an error
+static const char *subst(struct state_t *st, const char *s, const char *end,
+                         int quoted) {
+  const char *close = command_end(s, end);
+  if (!close)
+    return param_error(s - 1, end - s + 1, "missing ')'");
+  if (command(st, s + 1, close - s - 1, quoted) < 0)
+    return NULL;
+  return close + 1;
+}
+
+// run the command in backquotes at s, where a backslash escapes '$', '`' and
+// '\\', and '"' as well in double quotes
+// return end of the backquotes, NULL after reporting an error
+static const char *backquote(struct state_t *st, const char *s,
+                             const char *end, int quoted) {
+  const char *close = backquote_end(s, end);
+  if (!close)
+    return param_error(s, end - s, "missing '`'");
+
+  char *text = arena_alloc(st->x->arena, close - s);
+  size_t len = 0;
+  for (s++; s < close; s++) {
+    if (*s == '\\' && s + 1 < close &&
+        (strchr("$`\\", s[1]) || (quoted && s[1] == '"')))
+      s++;
+    text[len++] = *s;
+  }
+  if (command(st, text, len, quoted) < 0)
+    return NULL;
+  return close + 1;
+}
+
+// start the command of the <(...) or >(...) at s and add the path the
+// command line reads or writes it through, which is not split
+// return end of it, NULL after reporting an error
+static const char *process(struct state_t *st, const char *s,
+                           const char *end) {
+  const char *close = command_end(s + 1, end);
+  if (!close)
+    return param_error(s, end - s, "missing ')'");
+  struct expand_t *x = st->x;
+  if (x->process) {
+    char *path = x->process(x, s + 2, close - s - 2, *s == '>');
+    if (!path)
+      return NULL;
+    put(st, path, strlen(path));
+  }
+  return close + 1;
+}
+
+// expand the parameter after a '$' at s
+// return end of the parameter, NULL after reporting an error
+static const char *dollar(struct state_t *st, const char *s, const char *end,
+                          int quoted) {
+  char num[24];
+  if (s < end && *s == '{')
+    return brace(st, s, end, quoted);
+  if (s + 1 < end && s[0] == '(' && s[1] == '(')
+    return arith(st, s, end, quoted);
+  if (s < end && *s == '(')
+    return subst(st, s, end, quoted);
+
+  int len = param_len(s, end);
+  if (len == 0) {
+    // a '$' that starts no parameter is itself
+    put(st, "$", 1);
+    return s;
+  }
+  if (len == 1 && (*s == '@' || *s == '*')) {
+    put_params(st, *s, quoted);
+    return s + 1;
+  }
+  const char *value = lookup(st, s, len, num);
+  if (value)
+    put_value(st, value, strlen(value), quoted);
+  return s + len;
+}
+
+// expand the text from s to end, as if it were in double quotes if quoted
+// is set
+// return 0 on success, -1 after reporting an error
+static int walk(struct state_t *st, const char *s, const char *end,
+                int quoted) {
+  while (s < end) {
+    if (*s == '\'') {
+      const char *close = memchr(s + 1, '\'', end - s - 1);
+      if (!close)
+        close = end;
+      put_quoted(st, s + 1, close - s - 1);
+      s = close < end ? close + 1 : end;
+    } else if (*s == '"') {
+      put_quoted(st, s, 0);
+      for (s++; s < end && *s != '"';) {
+        // in double quotes a backslash only escapes what is special there
+        if (*s == '\\' && s + 1 < end && strchr("\"\\$`\n", s[1])) {
+          if (s[1] != '\n')
+            put_quoted(st, s + 1, 1);
+          s += 2;
+        } else if (*s == '$') {
+          if (!(s = dollar(st, s + 1, end, 1)))
+            return -1;
+        } else if (*s == '`') {
+          if (!(s = backquote(st, s, end, 1)))
+            return -1;
+        } else {
+          const char *plain = s++;
+          while (s < end && *s != '"' && *s != '\\' && *s != '$' &&
+                 *s != '`')
+            s++;
+          put_quoted(st, plain, s - plain);
+        }
+      }
+      if (s < end)
+        s++;
+    } else if (*s == '\\') {
+      if (++s == end)
+        break;
+      if (*s != '\n')
+        put_quoted(st, s, 1);
+      s++;
+    } else if (*s == '$') {
+      if (!(s = dollar(st, s + 1, end, quoted)))
+        return -1;
+    } else if (*s == '`') {
+      if (!(s = backquote(st, s, end, quoted)))
+        return -1;
+    } else if (!quoted && (*s == '<' || *s == '>') && s + 1 < end &&
+               s[1] == '(') {
+      if (!(s = process(st, s, end)))
+        return -1;
+    } else {
+      const char *plain = s++;
+      while (s < end && *s != '\'' && *s != '"' && *s != '\\' && *s != '$' &&
+             *s != '`' && *s != '<' && *s != '>')
+        s++;
+      if (quoted)
+        put_quoted(st, plain, s - plain);
+      else
+        put_literal(st, plain, s - plain);
+    }
+  }
+  return 0;
+}
+
+// IFS is copied, an expansion may set it
+static void start(struct state_t *st) {
+  const char *ifs = var_get("IFS");
+  st->ifs = ifs ? arena_strndup(st->x->arena, ifs, strlen(ifs)) : " \t\n";
+}
+
+int expand_fields(struct expand_t *x, const char *text, int len,
+                  struct fields_t *fields) {
+  struct state_t st = {.x = x, .fields = fields, .glob = x->glob};
+  start(&st);
+  if (walk(&st, text, text + len, 0) < 0)
+    return -1;
+  // "$@" of no parameters is no field, even in quotes
+  if (st.have && !(st.none && st.len == 0))
+    field(&st);
+  return 0;
+}
+
+char *expand_str(struct expand_t *x, const char *text, int len) {
+  struct state_t st = {.x = x};
+  start(&st);
+  if (walk(&st, text, text + len, 0) < 0)
+    return NULL;
+  return arena_strndup(x->arena, st.buf ? st.buf : "", st.len);
+}
+
+char *expand_heredoc(struct expand_t *x, const char *text, int len) {
+  struct state_t st = {.x = x};
+  start(&st);
+  const char *s = text, *end = text + len;
+  while (s < end) {
+    // quotes are text, a backslash escapes only what it does in double
+    // quotes
+    if (*s == '\\' && s + 1 < end && strchr("\\$`\n", s[1])) {
+      if (s[1] != '\n')
+        put(&st, s + 1, 1);
+      s += 2;
+    } else if (*s == '$') {
+      if (!(s = dollar(&st, s + 1, end, 1)))
+        return NULL;
+    } else if (*s == '`') {
+      if (!(s = backquote(&st, s, end, 0)))
+        return NULL;
+    } else {
+      const char *plain = s++;
+      while (s < end && *s != '\\' && *s != '$' && *s != '`')
+        s++;
+      put(&st, plain, s - plain);
+    }
+  }
+  return arena_strndup(x->arena, st.buf ? st.buf : "", st.len);
+}
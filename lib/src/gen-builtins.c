@@ -0,0 +1,125 @@
+// gen-builtins list dir: write dir/builtin-ids.h, the ids of the builtins of
+// list, and dir/builtin-table.h, their names and a perfect hash of them.
+// The table has a power of two of slots, at least twice the builtins, and
+// the seed of the hash is searched until every name has a slot of its own.
+#define GEN_BUILTINS
+#include "builtin.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAXBUILTINS 256
+#define MAXTRIES 1000000
+
+static char names[MAXBUILTINS][32];
+static char ids[MAXBUILTINS][32];
+static int nnames = 0;
+
+// return 0 if list can be read, -1 otherwise
+static int read_list(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return -1;
+  }
+  char line[128];
+  int lineno = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineno++;
+    char name[32], id[32] = "";
+    if (line[0] == '#' || sscanf(line, "%31s %31s", name, id) < 1)
+      continue;
+    if (nnames == MAXBUILTINS) {
+      fprintf(stderr, "%s:%d: too many builtins\n", path, lineno);
+      fclose(f);
+      return -1;
+    }
+    if (!id[0]) {
+      for (int i = 0; name[i]; i++)
+        id[i] = toupper((unsigned char)name[i]);
+      id[strlen(name)] = '\0';
+    }
+    strcpy(names[nnames], name);
+    strcpy(ids[nnames], id);
+    nnames++;
+  }
+  fclose(f);
+  return 0;
+}
+
+// return 1 if seed gives every name its own of nslots slots, filling slots
+static int try_seed(unsigned long seed, short *slots, int nslots) {
+  for (int i = 0; i < nslots; i++)
+    slots[i] = -1;
+  for (int i = 0; i < nnames; i++) {
+    int slot = builtin_hash(names[i], seed) & (nslots - 1);
+    if (slots[slot] >= 0)
+      return 0;
+    slots[slot] = i;
+  }
+  return 1;
+}
+
+static FILE *create(const char *dir, const char *name) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE *f = fopen(path, "w");
+  if (!f)
+    perror(path);
+  return f;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s list dir\n", argv[0]);
+    return 1;
+  }
+  if (read_list(argv[1]) < 0)
+    return 1;
+
+  static short slots[MAXBUILTINS * 8];
+  int nslots = 1;
+  while (nslots < 2 * nnames)
+    nslots *= 2;
+  unsigned long seed = 0;
+  while (!try_seed(seed, slots, nslots)) {
+    if (++seed == MAXTRIES) {
+      nslots *= 2;
+      seed = 0;
+    }
+  }
+
+  // code compiled against one list must not be taken for another one
+  unsigned long digest = 0;
+  for (int i = 0; i < nnames; i++)
+    digest = builtin_hash(names[i], digest);
+
+  FILE *f = create(argv[2], "builtin-ids.h");
+  if (!f)
+    return 1;
+  fprintf(f, "// generated by gen-builtins from builtins.txt, do not edit\n");
+  fprintf(f, "#pragma once\n\nenum {\n");
+  for (int i = 0; i < nnames; i++)
+    fprintf(f, "  BUILTIN_%s,\n", ids[i]);
+  fprintf(f, "  NBUILTINS\n};\n\n");
+  fprintf(f, "#define BUILTIN_DIGEST 0x%08lxu\n", digest & 0xffffffffUL);
+  fclose(f);
+
+  f = create(argv[2], "builtin-table.h");
+  if (!f)
+    return 1;
+  fprintf(f, "// generated by gen-builtins from builtins.txt, do not edit\n");
+  fprintf(f, "#pragma once\n\n");
+  fprintf(f, "#define BUILTIN_SEED %luUL\n", seed);
+  fprintf(f, "#define BUILTIN_SLOTS %d\n\n", nslots);
+  fprintf(f, "static const char *const builtin_names[NBUILTINS] = {\n");
+  for (int i = 0; i < nnames; i++)
+    fprintf(f, "    \"%s\",\n", names[i]);
+  fprintf(f, "};\n\n");
+  fprintf(f, "static const short builtin_slots[BUILTIN_SLOTS] = {\n");
+  for (int i = 0; i < nslots; i++)
+    fprintf(f, "    %d,\n", slots[i]);
+  fprintf(f, "};\n");
+  fclose(f);
+  return 0;
+}
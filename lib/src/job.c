@@ -1,151 +1,538 @@
 #include "job.h"
+#include "siolog.h"
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
-static int nextJID = 1;
+#define WORDBITS 64
+#define MININDEX 32 /* initial capacity of an index */
+#define MINPOOL 4096 /* initial capacity of the cmdline pool */
 
-int getNextJID() {
-  return nextJID;
+/* Job ids */
+
+static void jid_init(struct jidmap_t *map) {
+  memset(map->free, 0xff, sizeof(map->free));
+  memset(map->summary, 0xff, sizeof(map->summary));
+  map->free[0] &= ~(uint64_t)1; /* 0 is no job id */
+}
+
+// return lowest free jid, 0 if all of them are in use
+static int jid_peek(struct jidmap_t *map) {
+  for (int s = 0; s < MAXJID / 64 / 64; s++) {
+    if (map->summary[s]) {
+      int w = s * 64 + __builtin_ctzll(map->summary[s]);
+      return w * 64 + __builtin_ctzll(map->free[w]);
+    }
+  }
+  return 0;
+}
+
+static int jid_alloc(struct jidmap_t *map) {
+  int jid = jid_peek(map);
+  if (jid) {
+    int w = jid / 64;
+    map->free[w] &= ~((uint64_t)1 << (jid % 64));
+    if (map->free[w] == 0)
+      map->summary[w / 64] &= ~((uint64_t)1 << (w % 64));
+  }
+  return jid;
+}
+
+// constant time and allocation free, safe on the reaping path
+static void jid_release(struct jidmap_t *map, int jid) {
+  int w = jid / 64;
+  map->free[w] |= (uint64_t)1 << (jid % 64);
+  map->summary[w / 64] |= (uint64_t)1 << (w % 64);
+}
+
+int getNextJID(struct joblist_t *jobs) {
+  return jid_peek(&jobs->freejids);
+}
+
+/* Job index: linear probing over a power of two table, kept at most half
+ * full. Deletion shifts the following entries back instead of leaving
+ * tombstones, so a lookup never scans more than one cluster. */
+
+static unsigned int hashid(int key) {
+  return (unsigned int)key * 2654435761u; /* Knuth's multiplicative hash */
+}
+
+static void index_init(struct jobindex_t *ix, int size) {
+  ix->keys = calloc(size, sizeof(int));
+  ix->jobs = calloc(size, sizeof(struct job_t *));
+  ix->size = size;
+  ix->used = 0;
+}
+
+static int index_find(struct jobindex_t *ix, int key) {
+  unsigned int mask = ix->size - 1;
+  for (unsigned int i = hashid(key) & mask; ix->keys[i] != 0;
+       i = (i + 1) & mask) {
+    if (ix->keys[i] == key) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static struct job_t *index_get(struct jobindex_t *ix, int key) {
+  int i = index_find(ix, key);
+  return i < 0 ? NULL : ix->jobs[i];
+}
+
+// the index must have room, see index_reserve
+static void index_put(struct jobindex_t *ix, int key, struct job_t *job) {
+  unsigned int mask = ix->size - 1;
+  unsigned int i = hashid(key) & mask;
+  while (ix->keys[i] != 0 && ix->keys[i] != key)
+    i = (i + 1) & mask;
+  if (ix->keys[i] == 0)
+    ix->used++;
+  ix->keys[i] = key;
+  ix->jobs[i] = job;
+}
+
+// make room for n more keys, never called while reaping
+static void index_reserve(struct jobindex_t *ix, int n) {
+  if ((ix->used + n) * 2 <= ix->size)
+    return;
+
+  int size = ix->size;
+  while ((ix->used + n) * 2 > size)
+    size *= 2;
+
+  struct jobindex_t old = *ix;
+  index_init(ix, size);
+  for (int i = 0; i < old.size; i++) {
+    if (old.keys[i] != 0)
+      index_put(ix, old.keys[i], old.jobs[i]);
+  }
+  free(old.keys);
+  free(old.jobs);
+}
+
+static void index_del(struct jobindex_t *ix, int key) {
+  int i = index_find(ix, key);
+  if (i < 0)
+    return;
+
+  unsigned int mask = ix->size - 1;
+  unsigned int hole = i;
+  for (unsigned int j = (hole + 1) & mask; ix->keys[j] != 0;
+       j = (j + 1) & mask) {
+    // an entry may fill the hole only if its home is not within (hole, j]
+    unsigned int home = hashid(ix->keys[j]) & mask;
+    if (((j - home) & mask) >= ((j - hole) & mask)) {
+      ix->keys[hole] = ix->keys[j];
+      ix->jobs[hole] = ix->jobs[j];
+      hole = j;
+    }
+  }
+  ix->keys[hole] = 0;
+  ix->jobs[hole] = NULL;
+  ix->used--;
+}
+
+/* Command line pool: every entry is a header followed by the NUL terminated
+ * string, padded to 8 bytes. Entries move when the pool is compacted or
+ * reallocated, and the header tells which job to update. */
+
+struct strhdr_t {
+  size_t len; /* length of the string */
+  int slot;   /* slot of the job, -1 once the job is deleted */
+};
+
+static size_t entrysize(size_t len) {
+  return (sizeof(struct strhdr_t) + len + 1 + 7) & ~(size_t)7;
+}
+
+// move live entries to the front of the pool and repoint their jobs
+static void pool_compact(struct joblist_t *jobs) {
+  struct strpool_t *pool = &jobs->cmdlines;
+  size_t to = 0;
+  for (size_t from = 0; from < pool->used;) {
+    struct strhdr_t *hdr = (struct strhdr_t *)(pool->buf + from);
+    size_t n = entrysize(hdr->len);
+    if (hdr->slot >= 0) {
+      if (to != from)
+        memmove(pool->buf + to, hdr, n);
+      hdr = (struct strhdr_t *)(pool->buf + to);
+      jobs->slots[hdr->slot]->cmdline = (char *)(hdr + 1);
+      to += n;
+    }
+    from += n;
+  }
+  pool->used = to;
+  pool->garbage = 0;
+}
+
+static int pool_resize(struct joblist_t *jobs, size_t size) {
+  struct strpool_t *pool = &jobs->cmdlines;
+  char *buf = realloc(pool->buf, size);
+  if (!buf)
+    return FAILURE;
+  pool->buf = buf;
+  pool->size = size;
+  return SUCCESS;
+}
+
+// return copy of s owned by the job in slot, NULL if out of memory
+static char *pool_add(struct joblist_t *jobs, int slot, const char *s) {
+  struct strpool_t *pool = &jobs->cmdlines;
+  size_t len = strlen(s);
+  size_t n = entrysize(len);
+
+  if (pool->used + n > pool->size) {
+    // squeeze out garbage once it is worth a pass, otherwise grow
+    if (pool->garbage * 2 >= pool->used)
+      pool_compact(jobs);
+    if (pool->used + n > pool->size) {
+      size_t size = pool->size ? pool->size : MINPOOL;
+      while (pool->used + n > size)
+        size *= 2;
+      if (pool_resize(jobs, size) == FAILURE)
+        return NULL;
+      pool_compact(jobs);
+    } else if (pool->used + n < pool->size / 4 && pool->size > MINPOOL) {
+      // give memory back after a burst of jobs
+      char *old = pool->buf;
+      if (pool_resize(jobs, pool->size / 2) == SUCCESS && pool->buf != old)
+        pool_compact(jobs);
+    }
+  }
+
+  struct strhdr_t *hdr = (struct strhdr_t *)(pool->buf + pool->used);
+  hdr->len = len;
+  hdr->slot = slot;
+  memcpy(hdr + 1, s, len + 1);
+  pool->used += n;
+  return (char *)(hdr + 1);
+}
+
+// allocation free, safe on the reaping path
+static void pool_release(struct joblist_t *jobs, char *s) {
+  struct strhdr_t *hdr = (struct strhdr_t *)s - 1;
+  hdr->slot = -1;
+  jobs->cmdlines.garbage += entrysize(hdr->len);
+}
+
+/* State bitmaps: bit i of states[s] is set if slot i holds a job in state
+ * s. UNDEF marks free slots. */
+
+static void setbit(uint64_t *map, int i) {
+  map[i / WORDBITS] |= (uint64_t)1 << (i % WORDBITS);
+}
+
+static void clearbit(uint64_t *map, int i) {
+  map[i / WORDBITS] &= ~((uint64_t)1 << (i % WORDBITS));
+}
+
+static uint64_t liveword(struct joblist_t *jobs, int w) {
+  return jobs->states[FG][w] | jobs->states[BG][w] | jobs->states[ST][w];
+}
+
+static void growslots(struct joblist_t *jobs, int nslots) {
+  int oldwords = jobs->nslots / WORDBITS;
+  int nwords = nslots / WORDBITS;
+
+  jobs->slots = realloc(jobs->slots, nslots * sizeof(struct job_t *));
+  memset(jobs->slots + jobs->nslots, 0,
+         (nslots - jobs->nslots) * sizeof(struct job_t *));
+  for (int s = 0; s < STATE_SIZE; s++) {
+    jobs->states[s] = realloc(jobs->states[s], nwords * sizeof(uint64_t));
+    memset(jobs->states[s] + oldwords, s == UNDEF ? 0xff : 0,
+           (nwords - oldwords) * sizeof(uint64_t));
+  }
+  jobs->nslots = nslots;
+}
+
+void initjobs(struct joblist_t *jobs) {
+  memset(jobs, 0, sizeof(struct joblist_t));
+  growslots(jobs, INITJOBS);
+  jid_init(&jobs->freejids);
+  index_init(&jobs->pids, MININDEX);
+  index_init(&jobs->jids, MININDEX);
 }
 
-void initjobs(struct job_t *jobs) {
-  for (int i = 0; i < MAXJOBS; i++) {
-    clearjob(&jobs[i]);
+void freejobs(struct joblist_t *jobs) {
+  for (int i = 0; i < jobs->nslots; i++) {
+    if (jobs->slots[i]) {
+      free(jobs->slots[i]->procs);
+      free(jobs->slots[i]);
+    }
   }
+  free(jobs->slots);
+  free(jobs->cmdlines.buf);
+  for (int s = 0; s < STATE_SIZE; s++)
+    free(jobs->states[s]);
+  free(jobs->pids.keys);
+  free(jobs->pids.jobs);
+  free(jobs->jids.keys);
+  free(jobs->jids.jobs);
+  memset(jobs, 0, sizeof(struct joblist_t));
 }
 
+// the procs buffer stays with the slot, so reaping never has to free memory
 void clearjob(struct job_t *job) {
   job->pid = 0;
   job->jid = 0;
   job->state = UNDEF;
-  job->cmdline[0] = '\0';
+  job->nprocs = 0;
+  job->nlive = 0;
+  job->cmdline = NULL;
+}
+
+struct job_t *nextjob(struct joblist_t *jobs, struct job_t *prev) {
+  int start = prev ? prev->slot + 1 : 0;
+  int nwords = jobs->nslots / WORDBITS;
+
+  for (int w = start / WORDBITS; w < nwords; w++) {
+    uint64_t live = liveword(jobs, w);
+    if (w == start / WORDBITS)
+      live &= ~(uint64_t)0 << (start % WORDBITS);
+    if (live)
+      return jobs->slots[w * WORDBITS + __builtin_ctzll(live)];
+  }
+  return NULL;
 }
 
 // return max job id in the job list
-int maxJID(struct job_t *jobs) {
+int maxJID(struct joblist_t *jobs) {
   int rc = 0;
-  for (int i = 0; i < MAXJOBS; i++) {
-    if (jobs[i].jid > rc) {
-      rc = jobs[i].jid;
+  for (struct job_t *job = nextjob(jobs, NULL); job;
+       job = nextjob(jobs, job)) {
+    if (job->jid > rc) {
+      rc = job->jid;
     }
   }
   return rc;
 }
 
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline) {
-  if (pid < 1) {
-    fprintf(stderr, "error: pid < 1\n");
-    return FAILURE;
+static int freeslot(struct joblist_t *jobs) {
+  int nwords = jobs->nslots / WORDBITS;
+  for (int w = 0; w < nwords; w++) {
+    if (jobs->states[UNDEF][w])
+      return w * WORDBITS + __builtin_ctzll(jobs->states[UNDEF][w]);
   }
 
-  for (int i = 0; i < MAXJOBS; i++) {
-    if (jobs[i].pid == 0) {
-      jobs[i] = (struct job_t){.pid = pid, .state = state, .jid = nextJID++};
+  int slot = jobs->nslots;
+  growslots(jobs, jobs->nslots * 2);
+  return slot;
+}
 
-      if (nextJID > MAXJID)
-        nextJID = 1;
-      strcpy(jobs[i].cmdline, cmdline);
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+int addjob(struct joblist_t *jobs, pid_t pid, int state, char *cmdline) {
+  return addjobv(jobs, &pid, 1, state, cmdline);
+}
+
+int addjobv(struct joblist_t *jobs, pid_t *pids, int npids, int state,
+            char *cmdline) {
+  for (int i = 0; i < npids; i++) {
+    if (pids[i] < 1) {
+      errorf("error: pid < 1\n");
+      return FAILURE;
+    }
+  }
 
-      if (verbose) {
-        printf("Added job [%d] %d %s\n", jobs[i].jid, jobs[i].pid,
-               jobs[i].cmdline);
-      }
+  if (getNextJID(jobs) == 0) {
+    printf("Tried to create too many jobs\n");
+    return FAILURE;
+  }
 
-      return SUCCESS;
+  int slot = freeslot(jobs);
+  struct job_t *job = jobs->slots[slot];
+  if (!job) {
+    job = calloc(1, sizeof(struct job_t));
+    if (!job) {
+      errorf("error: out of memory\n");
+      return FAILURE;
     }
+    job->slot = slot;
+    jobs->slots[slot] = job;
   }
 
-  printf("Tried to create too many jobs\n");
-  return FAILURE;
+  if (job->maxprocs < npids) {
+    struct proc_t *procs = realloc(job->procs, npids * sizeof(struct proc_t));
+    if (!procs) {
+      errorf("error: out of memory\n");
+      return FAILURE;
+    }
+    job->procs = procs;
+    job->maxprocs = npids;
+  }
+
+  if ((job->cmdline = pool_add(jobs, slot, cmdline)) == NULL) {
+    errorf("error: out of memory\n");
+    return FAILURE;
+  }
+
+  job->pid = pids[0];
+  job->state = UNDEF;
+  job->jid = jid_alloc(&jobs->freejids);
+  job->nprocs = npids;
+  job->nlive = npids;
+  job->usage = (struct usage_t){0};
+  job->start = now();
+  job->end = 0;
+  job->timed = 0;
+
+  index_reserve(&jobs->pids, npids);
+  index_reserve(&jobs->jids, 1);
+  for (int i = 0; i < npids; i++) {
+    job->procs[i] = (struct proc_t){.pid = pids[i]};
+    index_put(&jobs->pids, pids[i], job);
+  }
+  index_put(&jobs->jids, job->jid, job);
+  setjobstate(jobs, job, state);
+  jobs->njobs++;
+
+  if (verbose) {
+    siolog_printf("Added job [%d] %d %s\n", job->jid, job->pid,
+                  job->cmdline);
+  }
+
+  return SUCCESS;
 }
 
-int deletejob(struct job_t *jobs, pid_t pid) {
+int deletejob(struct joblist_t *jobs, pid_t pid) {
   if (pid < 1) {
-    fprintf(stderr, "error: pid < 1\n");
+    errorf("error: pid < 1\n");
     return FAILURE;
   }
 
-  for (int i = 0; i < MAXJOBS; i++) {
-    if (jobs[i].pid == pid) {
-      clearjob(&jobs[i]);
-      // update nextJID available
-      nextJID = maxJID(jobs) + 1;
-      return SUCCESS;
-    }
+  struct job_t *job = index_get(&jobs->pids, pid);
+  if (!job)
+    return FAILURE;
+
+  for (int i = 0; i < job->nprocs; i++) {
+    index_del(&jobs->pids, job->procs[i].pid);
   }
+  index_del(&jobs->jids, job->jid);
+  jid_release(&jobs->freejids, job->jid);
+  pool_release(jobs, job->cmdline);
+  setjobstate(jobs, job, UNDEF);
+  clearjob(job);
+  jobs->njobs--;
+  return SUCCESS;
+}
+
+void setjobstate(struct joblist_t *jobs, struct job_t *job, int state) {
+  clearbit(jobs->states[job->state], job->slot);
+  setbit(jobs->states[state], job->slot);
 
-  return FAILURE;
+  if (jobs->fg == job)
+    jobs->fg = NULL;
+  if (state == FG)
+    jobs->fg = job;
+  job->state = state;
 }
 
-pid_t fgPID(struct job_t *jobs) {
-  for (int i = 0; i < MAXJOBS; i++) {
-    if (jobs[i].state == FG) {
-      return jobs[i].pid;
+int reapmember(struct job_t *job, pid_t pid, int status) {
+  for (int i = 0; i < job->nprocs; i++) {
+    struct proc_t *proc = &job->procs[i];
+    if (proc->pid == pid && !proc->reaped) {
+      proc->status = status;
+      proc->reaped = 1;
+      if (--job->nlive == 0)
+        job->end = now();
+      break;
     }
   }
-  return 0;
+  return job->nlive;
+}
+
+void addusage(struct job_t *job, const struct rusage *ru, long rbytes,
+              long wbytes) {
+  struct usage_t *u = &job->usage;
+  u->utime += ru->ru_utime.tv_sec * 1000000L + ru->ru_utime.tv_usec;
+  u->stime += ru->ru_stime.tv_sec * 1000000L + ru->ru_stime.tv_usec;
+  if (ru->ru_maxrss > u->maxrss)
+    u->maxrss = ru->ru_maxrss;
+  u->nvcsw += ru->ru_nvcsw;
+  u->nivcsw += ru->ru_nivcsw;
+  u->rbytes += rbytes;
+  u->wbytes += wbytes;
+}
+
+int formatusage(char *buf, size_t size, struct job_t *job) {
+  struct usage_t *u = &job->usage;
+  long wall = (job->end ? job->end : now()) - job->start;
+  return siolog_snprintf(buf, size,
+                         "real %ldms user %ldms sys %ldms maxrss %ldKB "
+                         "csw %ld/%ld read %ldB written %ldB",
+                         wall / 1000000, u->utime / 1000, u->stime / 1000,
+                         u->maxrss, u->nvcsw, u->nivcsw, u->rbytes, u->wbytes);
 }
 
-struct job_t *getjobPID(struct job_t *jobs, pid_t pid) {
+pid_t fgPID(struct joblist_t *jobs) {
+  return jobs->fg ? jobs->fg->pid : 0;
+}
+
+struct job_t *getjobPID(struct joblist_t *jobs, pid_t pid) {
   if (pid < 1)
     return NULL;
 
-  for (int i = 0; i < MAXJOBS; i++) {
-    if (jobs[i].pid == pid) {
-      return &jobs[i];
-    }
-  }
-
-  return NULL;
+  return index_get(&jobs->pids, pid);
 }
 
-struct job_t *getjobJID(struct job_t *jobs, int jid) {
+struct job_t *getjobJID(struct joblist_t *jobs, int jid) {
   if (jid < 1)
     return NULL;
 
-  for (int i = 0; i < MAXJOBS; i++) {
-    if (jobs[i].jid == jid) {
-      return &jobs[i];
-    }
-  }
-
-  return NULL;
+  return index_get(&jobs->jids, jid);
 }
 
-int PID2JID(struct job_t *jobs, pid_t pid) {
+int PID2JID(struct joblist_t *jobs, pid_t pid) {
   if (pid < 1) {
     return 0;
   }
 
-  for (int i = 0; i < MAXJOBS; i++) {
-    if (jobs[i].pid == pid) {
-      return jobs[i].jid;
+  struct job_t *job = index_get(&jobs->pids, pid);
+  return job ? job->jid : 0;
+}
+
+void listjobs(struct joblist_t *jobs) {
+  for (struct job_t *job = nextjob(jobs, NULL); job;
+       job = nextjob(jobs, job)) {
+    printf("[%d] (%d) ", job->jid, job->pid);
+    switch (job->state) {
+    case BG:
+      printf("Running ");
+      break;
+    case FG:
+      printf("Foreground ");
+      break;
+    case ST:
+      printf("Stopped ");
+      break;
+    default:
+      errorf("listjobs: Internal error: job[%d].state=%d ",
+             job->slot, job->state);
     }
-  }
 
-  return 0;
+    printf("%s\n", job->cmdline);
+  }
 }
 
-void listjobs(struct job_t *jobs) {
-  for (int i = 0; i < MAXJOBS; i++) {
-    if (jobs[i].pid != 0) {
-      printf("[%d] (%d) ", jobs[i].jid, jobs[i].pid);
-      switch (jobs[i].state) {
-      case BG:
-        printf("Running ");
-        break;
-      case FG:
-        printf("Foreground ");
-        break;
-      case ST:
-        printf("Stopped ");
-        break;
-      default:
-        fprintf(stderr, "listjobs: Internal error: job[%d].state=%d ", i,
-                jobs[i].state);
-      }
-
-      printf("%s\n", jobs[i].cmdline);
+void listjobsl(struct joblist_t *jobs) {
+  char usage[MAXLINE];
+  for (struct job_t *job = nextjob(jobs, NULL); job;
+       job = nextjob(jobs, job)) {
+    static const char *states[STATE_SIZE] = {
+        [UNDEF] = "Undefined", [FG] = "Foreground", [BG] = "Running",
+        [ST] = "Stopped"};
+    printf("[%d] (%d) %s %s\n", job->jid, job->pid, states[job->state],
+           job->cmdline);
+    for (int i = 0; i < job->nprocs; i++) {
+      struct proc_t *proc = &job->procs[i];
+      printf("    %d %s\n", proc->pid, proc->reaped ? "done" : "running");
     }
+    formatusage(usage, sizeof(usage), job);
+    printf("    %s\n", usage);
   }
 }
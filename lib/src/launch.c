@@ -0,0 +1,362 @@
+#define _GNU_SOURCE
+#include "launch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#define CLONE_STACK_SIZE (64 * 1024)
+
+int launch_backend = LAUNCH_VFORK;
+int launch_timing = 0;
+
+static const char *backend_names[LAUNCH_SIZE] = {
+    [LAUNCH_FORK] = "fork",
+    [LAUNCH_VFORK] = "vfork",
+    [LAUNCH_POSIX_SPAWN] = "posix_spawn",
+    [LAUNCH_CLONE] = "clone",
+};
+
+static struct launch_stat_t stats[LAUNCH_SIZE];
+
+// state shared between the shell and a child that borrows its memory
+struct child_t {
+  struct launch_t *spec;
+  const sigset_t *sigmask;
+  volatile int err;    /* errno of the failure, written by the child */
+  volatile int failed; /* index of the failed action, -1 for exec */
+  int pidfd;           /* pidfd of the child, -1 if none */
+  struct timespec forked; /* the child was created, set by launch_fork */
+};
+
+int launch_parse_backend(const char *name) {
+  for (int i = 0; i < LAUNCH_SIZE; i++) {
+    if (strcmp(name, backend_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const char *launch_backend_name(int backend) {
+  if (backend < 0 || backend >= LAUNCH_SIZE)
+    return NULL;
+  return backend_names[backend];
+}
+
+const struct launch_stat_t *launch_stats(int backend) {
+  if (backend < 0 || backend >= LAUNCH_SIZE)
+    return NULL;
+  return &stats[backend];
+}
+
+static const char *launch_path(struct launch_t *spec) {
+  return spec->path ? spec->path : spec->argv[0];
+}
+
+int launch_apply(const struct launch_action_t *actions, int nactions,
+                 int *failed) {
+  for (int i = 0; i < nactions; i++) {
+    const struct launch_action_t *act = &actions[i];
+    int fd;
+    *failed = i;
+
+    switch (act->type) {
+    case LAUNCH_DUP2:
+      if (act->src == act->fd) {
+        // already in place, only make it survive exec
+        int flags = fcntl(act->fd, F_GETFD);
+        if (flags < 0 || fcntl(act->fd, F_SETFD, flags & ~FD_CLOEXEC) < 0)
+          return errno;
+      } else if (dup2(act->src, act->fd) < 0) {
+        return errno;
+      }
+      break;
+    case LAUNCH_OPEN:
+      // the file is close-on-exec until it lands on its descriptor
+      if ((fd = open(act->path, act->flags | O_CLOEXEC, act->mode)) < 0)
+        return errno;
+      if (fd == act->fd) {
+        if (fcntl(fd, F_SETFD, 0) < 0)
+          return errno;
+      } else {
+        int rc = dup2(fd, act->fd);
+        close(fd);
+        if (rc < 0)
+          return errno;
+      }
+      break;
+    }
+  }
+
+  *failed = -1;
+  return 0;
+}
+
+// runs in the child between fork and exec, return errno of the failure
+static int child_exec(struct child_t *child) {
+  struct launch_t *spec = child->spec;
+
+  // the shell's handlers must not run in a child sharing its memory
+  if (spec->sigdefault) {
+    struct sigaction dfl;
+    memset(&dfl, 0, sizeof(dfl));
+    dfl.sa_handler = SIG_DFL;
+    for (int sig = 1; sig < NSIG; sig++) {
+      if (sigismember(spec->sigdefault, sig) == 1)
+        sigaction(sig, &dfl, NULL);
+    }
+  }
+
+  int err, failed;
+  if (setpgid(0, spec->pgid) < 0)
+    return errno;
+  if ((err = launch_apply(spec->actions, spec->nactions, &failed)) != 0) {
+    child->failed = failed;
+    return err;
+  }
+  sigprocmask(SIG_SETMASK, child->sigmask, NULL);
+
+  // exec through the cached descriptor without walking the path again. A
+  // script cannot be run this way since its interpreter would have to open
+  // the close-on-exec descriptor, so fall back to the path. An action may
+  // have replaced the descriptor as well.
+  int execfd = spec->execfd;
+  for (int i = 0; i < spec->nactions; i++) {
+    if (spec->actions[i].fd == execfd)
+      execfd = 0;
+  }
+  if (execfd > 0) {
+    execveat(execfd, "", spec->argv, spec->envp, AT_EMPTY_PATH);
+    if (errno != ENOENT)
+      return errno;
+  }
+  execve(launch_path(spec), spec->argv, spec->envp);
+  return errno;
+}
+
+static int clone_entry(void *arg) {
+  struct child_t *child = arg;
+  child->err = child_exec(child);
+  return 127;
+}
+
+// a child that failed to exec has not been seen by anyone yet, reap it here
+static pid_t reap_failed(pid_t pid, int err) {
+  waitpid(pid, NULL, 0);
+  errno = err;
+  return -1;
+}
+
+static pid_t launch_fork(struct child_t *child) {
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) < 0)
+    return -1;
+
+  pid_t pid = fork();
+  clock_gettime(CLOCK_MONOTONIC, &child->forked);
+  if (pid == 0) {
+    // report the failure through the pipe, a successful exec closes it
+    int report[2];
+    report[0] = child_exec(child);
+    report[1] = child->failed;
+    write(fds[1], report, sizeof(report));
+    _exit(127);
+  }
+  close(fds[1]);
+  if (pid < 0) {
+    close(fds[0]);
+    return -1;
+  }
+
+  // the close-on-exec pipe reaches end of file once the child has exec'd
+  int report[2];
+  ssize_t n;
+  while ((n = read(fds[0], report, sizeof(report))) < 0 && errno == EINTR)
+    ;
+  close(fds[0]);
+  if (n == sizeof(report)) {
+    child->failed = report[1];
+    return reap_failed(pid, report[0]);
+  }
+  return pid;
+}
+
+static pid_t launch_vfork(struct child_t *child) {
+  pid_t pid = vfork();
+  if (pid == 0) {
+    child->err = child_exec(child);
+    _exit(127);
+  }
+  if (pid > 0 && child->err)
+    return reap_failed(pid, child->err);
+  return pid;
+}
+
+static pid_t launch_clone(struct child_t *child) {
+  // CLONE_VFORK suspends the shell until exec, so one stack is enough
+  static char *stack = NULL;
+  if (!stack) {
+    stack = mmap(NULL, CLONE_STACK_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+      stack = NULL;
+      return -1;
+    }
+  }
+
+  int flags = CLONE_VM | CLONE_VFORK | SIGCHLD;
+  if (child->spec->pidfd)
+    flags |= CLONE_PIDFD;
+  pid_t pid = clone(clone_entry, stack + CLONE_STACK_SIZE, flags, child,
+                    &child->pidfd);
+  if (pid < 0 && errno == EINVAL && (flags & CLONE_PIDFD)) {
+    // a kernel without CLONE_PIDFD, launch() opens the pidfd instead
+    child->pidfd = -1;
+    pid = clone(clone_entry, stack + CLONE_STACK_SIZE, flags & ~CLONE_PIDFD,
+                child);
+  }
+  if (pid > 0 && child->err) {
+    if (child->pidfd >= 0)
+      close(child->pidfd);
+    child->pidfd = -1;
+    return reap_failed(pid, child->err);
+  }
+  return pid;
+}
+
+static pid_t launch_posix_spawn(struct child_t *child) {
+  struct launch_t *spec = child->spec;
+  posix_spawnattr_t attr;
+  posix_spawn_file_actions_t actions;
+  short flags = POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK;
+  pid_t pid;
+  int rc;
+
+  if ((rc = posix_spawnattr_init(&attr)) != 0) {
+    errno = rc;
+    return -1;
+  }
+  if (spec->sigdefault) {
+    flags |= POSIX_SPAWN_SETSIGDEF;
+    posix_spawnattr_setsigdefault(&attr, spec->sigdefault);
+  }
+  posix_spawnattr_setflags(&attr, flags);
+  posix_spawnattr_setpgroup(&attr, spec->pgid);
+  posix_spawnattr_setsigmask(&attr, child->sigmask);
+
+  posix_spawn_file_actions_init(&actions);
+  for (int i = 0; i < spec->nactions; i++) {
+    const struct launch_action_t *act = &spec->actions[i];
+    switch (act->type) {
+    case LAUNCH_DUP2:
+      posix_spawn_file_actions_adddup2(&actions, act->src, act->fd);
+      break;
+    case LAUNCH_OPEN:
+      posix_spawn_file_actions_addopen(&actions, act->fd, act->path,
+                                       act->flags, act->mode);
+      break;
+    }
+  }
+
+  // posix_spawn cannot exec a descriptor, it always takes the path
+  rc = posix_spawn(&pid, launch_path(spec), &actions, &attr, spec->argv,
+                   spec->envp);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  if (rc != 0) {
+    errno = rc;
+    return -1;
+  }
+  return pid;
+}
+
+static long elapsed_ns(const struct timespec *start,
+                       const struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) * 1000000000L +
+         (end->tv_nsec - start->tv_nsec);
+}
+
+static void record(int backend, pid_t pid, long ns) {
+  struct launch_stat_t *st = &stats[backend];
+  if (st->count == 0 || ns < st->min_ns)
+    st->min_ns = ns;
+  if (ns > st->max_ns)
+    st->max_ns = ns;
+  st->total_ns += ns;
+  st->count++;
+
+  if (launch_timing) {
+    printf("launch: %s (%d) %ld ns\n", backend_names[backend], pid, ns);
+  }
+}
+
+pid_t launch(struct launch_t *spec) {
+  int backend = launch_backend;
+  struct timespec start, end;
+  sigset_t mask_all, prev_all;
+  pid_t pid;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // no handler may run in a child that borrows the shell's memory, and none
+  // may reap the child before it is known to have exec'd
+  sigfillset(&mask_all);
+  sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
+
+  struct child_t child = {
+      .spec = spec,
+      .sigmask = spec->sigmask ? spec->sigmask : &prev_all,
+      .err = 0,
+      .failed = -1,
+      .pidfd = -1,
+      .forked = {0, 0},
+  };
+
+  switch (backend) {
+  case LAUNCH_FORK:
+    pid = launch_fork(&child);
+    break;
+  case LAUNCH_POSIX_SPAWN:
+    pid = launch_posix_spawn(&child);
+    break;
+  case LAUNCH_CLONE:
+    pid = launch_clone(&child);
+    break;
+  case LAUNCH_VFORK:
+  default:
+    backend = LAUNCH_VFORK;
+    pid = launch_vfork(&child);
+    break;
+  }
+
+  int olderrno = errno;
+  struct timespec execed;
+  clock_gettime(CLOCK_MONOTONIC, &execed);
+  if (child.forked.tv_sec == 0 && child.forked.tv_nsec == 0)
+    child.forked = execed;
+  spec->forked = child.forked.tv_sec * 1000000000L + child.forked.tv_nsec;
+  spec->execed = execed.tv_sec * 1000000000L + execed.tv_nsec;
+  spec->failed = child.failed;
+  if (spec->pidfd) {
+    // only the caller reaps the child, so its pid cannot be reused yet
+    if (pid > 0 && child.pidfd < 0)
+      child.pidfd = syscall(SYS_pidfd_open, pid, 0);
+    *spec->pidfd = child.pidfd;
+  }
+  sigprocmask(SIG_SETMASK, &prev_all, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if (pid > 0)
+    record(backend, pid, elapsed_ns(&start, &end));
+  errno = olderrno;
+  return pid;
+}
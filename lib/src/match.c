@@ -0,0 +1,228 @@
+#include "match.h"
+#include <ctype.h>
+#include <string.h>
+
+static const struct {
+  const char *name;
+  int (*is)(int);
+} classes[] = {
+    {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank},
+    {"cntrl", iscntrl}, {"digit", isdigit}, {"graph", isgraph},
+    {"lower", islower}, {"print", isprint}, {"punct", ispunct},
+    {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit},
+};
+
+static void add(unsigned char *set, unsigned char c) {
+  set[c >> 3] |= 1 << (c & 7);
+}
+
+static int has(const unsigned char *set, unsigned char c) {
+  return set[c >> 3] & (1 << (c & 7));
+}
+
+// fill set from the bracket expression after the '[' at p
+// return end of the expression, NULL if it has no ']'
+static const char *bracket(const char *p, const char *end,
+                           unsigned char *set) {
+  int invert = p < end && (*p == '!' || *p == '^');
+  if (invert)
+    p++;
+  // a ']' first is a member
+  const char *start = p;
+  while (p < end && (*p != ']' || p == start)) {
+    if (*p == '[' && p + 1 < end && p[1] == ':') {
+      const char *close = p + 2;
+      while (close + 1 < end && !(close[0] == ':' && close[1] == ']'))
+        close++;
+      if (close + 1 < end) {
+        for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+          if (strlen(classes[i].name) == (size_t)(close - p - 2) &&
+              memcmp(classes[i].name, p + 2, close - p - 2) == 0) {
+            for (int c = 0; c < 256; c++) {
+              if (classes[i].is(c))
+                add(set, c);
+            }
+          }
+        }
+        p = close + 2;
+        continue;
+      }
+    }
+    unsigned char lo = *p++;
+    if (lo == '\\' && p < end)
+      lo = *p++;
+    unsigned char hi = lo;
+    if (p + 1 < end && *p == '-' && p[1] != ']') {
+      hi = *++p;
+      if (hi == '\\' && p + 1 < end)
+        hi = *++p;
+      p++;
+    }
+    for (int c = lo; c <= hi; c++)
+      add(set, c);
+  }
+  if (p == end)
+    return NULL;
+  if (invert) {
+    for (int i = 0; i < 32; i++)
+      set[i] = ~set[i];
+  }
+  return p + 1;
+}
+
+struct match_t *match_compile(struct arena_t *arena, const char *pattern,
+                              size_t len) {
+  struct match_t *m = arena_alloc(arena, sizeof(struct match_t));
+  // a step per byte at most, and the literals take no more than the pattern
+  struct step_t *steps = arena_alloc(arena, (len + 1) * sizeof(*steps));
+  char *lits = arena_alloc(arena, len + 1);
+  size_t nlits = 0;
+  int n = 0;
+  *m = (struct match_t){.steps = steps, .prefix = "", .suffix = ""};
+
+  const char *p = pattern, *end = pattern + len;
+  while (p < end) {
+    if (*p == '*') {
+      while (p < end && *p == '*')
+        p++;
+      steps[n++] = (struct step_t){.type = STEP_STAR};
+      m->nstars++;
+      continue;
+    }
+    if (*p == '?') {
+      p++;
+      steps[n++] = (struct step_t){.type = STEP_ANY, .len = 1};
+      m->minlen++;
+      continue;
+    }
+    if (*p == '[') {
+      unsigned char *set = arena_alloc(arena, 32);
+      memset(set, 0, 32);
+      const char *next = bracket(p + 1, end, set);
+      if (next) {
+        p = next;
+        steps[n++] = (struct step_t){.type = STEP_SET, .len = 1, .set = set};
+        m->minlen++;
+        continue;
+      }
+    }
+    if (*p == '\\' && p + 1 < end)
+      p++;
+    // bytes in a row join the literal of the last step
+    if (n == 0 || steps[n - 1].type != STEP_LIT)
+      steps[n++] = (struct step_t){.type = STEP_LIT, .lit = lits + nlits};
+    lits[nlits++] = *p++;
+    steps[n - 1].len++;
+    m->minlen++;
+  }
+  m->nsteps = n;
+
+  if (n > 0 && steps[0].type == STEP_LIT) {
+    m->prefix = steps[0].lit;
+    m->nprefix = steps[0].len;
+    m->first = 1;
+  }
+  if (m->nstars && steps[n - 1].type == STEP_LIT) {
+    m->suffix = steps[n - 1].lit;
+    m->nsuffix = steps[n - 1].len;
+  }
+  return m;
+}
+
+int match_isliteral(const struct match_t *m) {
+  return m->nsteps == 0 || (m->nsteps == 1 && m->steps[0].type == STEP_LIT);
+}
+
+// return first place at or after s where the literal of step is, NULL if it
+// is not before end
+static const char *find(const struct step_t *step, const char *s,
+                        const char *end) {
+  while (end - s >= (long)step->len) {
+    s = memchr(s, step->lit[0], end - s - step->len + 1);
+    if (!s)
+      return NULL;
+    if (memcmp(s, step->lit, step->len) == 0)
+      return s;
+    s++;
+  }
+  return NULL;
+}
+
+int match(const struct match_t *m, const char *s, size_t len) {
+  if (len < m->minlen || (!m->nstars && len != m->minlen))
+    return 0;
+  if (memcmp(s, m->prefix, m->nprefix) != 0 ||
+      memcmp(s + len - m->nsuffix, m->suffix, m->nsuffix) != 0)
+    return 0;
+
+  // only the last star is ever taken back: a later one can stretch as far as
+  // any earlier one could have
+  const struct step_t *steps = m->steps;
+  const char *p = s + m->nprefix, *end = s + len;
+  const char *restart = NULL;
+  int i = m->first, star = -1;
+  for (;;) {
+    if (i == m->nsteps) {
+      if (p == end)
+        return 1;
+    } else if (steps[i].type == STEP_STAR) {
+      star = ++i;
+      if (i == m->nsteps)
+        return 1;
+      restart = p;
+      if (steps[i].type == STEP_LIT) {
+        if (!(p = restart = find(&steps[i], p, end)))
+          return 0;
+      }
+      continue;
+    } else if ((size_t)(end - p) >= steps[i].len) {
+      const struct step_t *step = &steps[i];
+      if (step->type == STEP_ANY ||
+          (step->type == STEP_SET && has(step->set, *p)) ||
+          (step->type == STEP_LIT && !memcmp(p, step->lit, step->len))) {
+        p += step->len;
+        i++;
+        continue;
+      }
+    }
+    // let the last star take one byte more
+    if (star < 0 || restart == end)
+      return 0;
+    p = ++restart;
+    i = star;
+    if (steps[i].type == STEP_LIT) {
+      if (!(p = restart = find(&steps[i], p, end)))
+        return 0;
+    }
+  }
+}
+
+long match_prefix(const struct match_t *m, const char *s, size_t len,
+                  int longest) {
+  if (len < m->minlen || memcmp(s, m->prefix, m->nprefix) != 0)
+    return -1;
+  // a pattern without stars has one length it can match
+  if (!m->nstars)
+    return match(m, s, m->minlen) ? (long)m->minlen : -1;
+  for (size_t i = m->minlen; i <= len; i++) {
+    size_t n = longest ? len - (i - m->minlen) : i;
+    if (match(m, s, n))
+      return n;
+  }
+  return -1;
+}
+
+long match_suffix(const struct match_t *m, const char *s, size_t len,
+                  int longest) {
+  if (len < m->minlen)
+    return -1;
+  if (!m->nstars)
+    return match(m, s + len - m->minlen, m->minlen) ? (long)(len - m->minlen)
+                                                     : -1;
+  for (size_t i = m->minlen; i <= len; i++) {
+    size_t n = longest ? len - (i - m->minlen) : i;
+    if (match(m, s + len - n, n))
+      return len - n;
+  }
+  return -1;
+}
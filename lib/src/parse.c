@@ -0,0 +1,748 @@
+#include "parse.h"
+#include <stdio.h>
+#include <string.h>
+
+/* tokens */
+enum {
+  TOK_WORD,
+  TOK_IONUM,    /* digits right before a redirection operator */
+  TOK_NEWLINE,
+  TOK_EOF,
+  TOK_ERROR,    /* the lexer has set the error message */
+  TOK_AND_IF,   /* && */
+  TOK_OR_IF,    /* || */
+  TOK_PIPE,     /* | */
+  TOK_AMP,      /* & */
+  TOK_SEMI,     /* ; */
+  TOK_LESS,     /* < */
+  TOK_GREAT,    /* > */
+  TOK_DGREAT,   /* >> */
+  TOK_LESSAND,  /* <& */
+  TOK_GREATAND, /* >& */
+  TOK_DLESS,    /* << */
+  TOK_DLESSDASH, /* <<- */
+  TOK_TLESS,    /* <<< */
+};
+
+struct token_t {
+  int type;
+  const char *text;
+  int len;
+  int flags; /* TOK_WORD: WORD_QUOTED, WORD_ESCAPED, WORD_EXPAND */
+  int line;  /* line the token starts on */
+};
+
+// a here-document whose body starts after the newline that ends its line
+struct heredoc_t {
+  struct redir_t *redir; /* target is the delimiter until the body is read */
+  int strip;             /* <<-: tabs that start a line are removed */
+  struct heredoc_t *next;
+};
+
+// state of one parse_next call, with one token of lookahead
+struct ctx_t {
+  struct parser_t *p;
+  struct token_t tok;
+  int peeked;       /* 1 if tok has been read but not consumed */
+  int failed;       /* 1 once p->error is set */
+  const char *last; /* end of the last consumed token */
+  struct heredoc_t *docs; /* here-documents waiting for their bodies */
+  struct heredoc_t **lastdoc;
+};
+
+void parser_init(struct parser_t *p, struct arena_t *arena, const char *src,
+                 size_t len) {
+  p->arena = arena;
+  p->pos = src;
+  p->end = src + len;
+  p->line = 1;
+  p->errline = 0;
+  p->error[0] = '\0';
+  p->more = (struct pending_t){0, '\0', 0, 0, ""};
+}
+
+/* classes of the bytes that end or change the scan of a word */
+enum {
+  C_BLANK = 1,
+  C_END = 2,
+  C_QUOTE = 4,
+  C_ESCAPE = 8,
+  C_DOLLAR = 16,
+  C_GLOB = 32,
+};
+
+// a table keeps the scan of plain words down to one load per byte
+static const unsigned char cls[256] = {
+    [' '] = C_BLANK | C_END, ['\t'] = C_BLANK | C_END, ['\n'] = C_END,
+    ['|'] = C_END,           ['&'] = C_END,            [';'] = C_END,
+    ['<'] = C_END,           ['>'] = C_END,            ['\''] = C_QUOTE,
+    ['"'] = C_QUOTE,         ['\\'] = C_ESCAPE,         ['$'] = C_DOLLAR,
+    ['`'] = C_DOLLAR,        ['*'] = C_GLOB,           ['?'] = C_GLOB,
+    ['['] = C_GLOB,
+};
+
+static int isdigits(const char *s, int len) {
+  for (int i = 0; i < len; i++) {
+    if (s[i] < '0' || s[i] > '9')
+      return 0;
+  }
+  return len > 0;
+}
+
+// errors are always about the token in the lookahead
+static int fail(struct ctx_t *c, const char *msg) {
+  if (!c->failed) {
+    snprintf(c->p->error, sizeof(c->p->error), "%s", msg);
+    c->p->errline = c->tok.line;
+  }
+  c->failed = 1;
+  return TOK_ERROR;
+}
+
+// a syntax error at the end of the source, which more of it may fix
+static int failend(struct ctx_t *c, const char *msg) {
+  c->p->more.incomplete = 1;
+  return fail(c, msg);
+}
+
+static int skipbrace(struct parser_t *p, const char **q);
+static int skipparen(struct parser_t *p, const char **q);
+
+// skip the quoted part of a word that starts at *q, or a command in
+// backquotes, adding WORD_EXPAND to flags if there are parameters or
+// commands in double quotes
+// return 0 if the quote is not closed
+static int skipquote(struct parser_t *p, const char **q, int *flags) {
+  char quote = *(*q)++;
+  while (*q < p->end && **q != quote) {
+    if (quote != '\'' && **q == '\\' && *q + 1 < p->end) {
+      (*q)++;
+    } else if (quote == '"' && **q == '`') {
+      *flags |= WORD_EXPAND;
+      if (!skipquote(p, q, flags))
+        return 0;
+      continue;
+    } else if (quote == '"' && **q == '$') {
+      *flags |= WORD_EXPAND;
+      if (*q + 1 < p->end && (*q)[1] == '{') {
+        if (!skipbrace(p, q))
+          return 0;
+        continue;
+      }
+      if (*q + 1 < p->end && (*q)[1] == '(') {
+        if (!skipparen(p, q))
+          return 0;
+        continue;
+      }
+    }
+    if (**q == '\n')
+      p->line++;
+    (*q)++;
+  }
+  if (*q == p->end) {
+    p->more.close = quote;
+    return 0;
+  }
+  (*q)++;
+  return 1;
+}
+
+// skip a parameter in braces that starts at the '$' at *q. The word of an
+// operator in it may have quotes and parameters of its own.
+// return 0 if the brace is not closed
+static int skipbrace(struct parser_t *p, const char **q) {
+  int flags = 0;
+  *q += 2;
+  while (*q < p->end && **q != '}') {
+    if (**q == '\'' || **q == '"') {
+      if (!skipquote(p, q, &flags))
+        return 0;
+      continue;
+    }
+    if (**q == '$' && *q + 1 < p->end && (*q)[1] == '{') {
+      if (!skipbrace(p, q))
+        return 0;
+      continue;
+    }
+    if (**q == '$' && *q + 1 < p->end && (*q)[1] == '(') {
+      if (!skipparen(p, q))
+        return 0;
+      continue;
+    }
+    if (**q == '`') {
+      if (!skipquote(p, q, &flags))
+        return 0;
+      continue;
+    }
+    if (**q == '\\' && *q + 1 < p->end)
+      (*q)++;
+    if (**q == '\n')
+      p->line++;
+    (*q)++;
+  }
+  if (*q == p->end) {
+    p->more.close = '}';
+    return 0;
+  }
+  (*q)++;
+  return 1;
+}
+
+// skip a command substitution, a process substitution or an arithmetic
+// expansion that starts at the '$', '<' or '>' at *q, up to the ')' that
+// closes its first '('. Parentheses in quotes do not count.
+// return 0 if it is not closed
+static int skipparen(struct parser_t *p, const char **q) {
+  int depth = 0;
+  int flags = 0;
+  for ((*q)++; *q < p->end; (*q)++) {
+    if (**q == '\'' || **q == '"' || **q == '`') {
+      if (!skipquote(p, q, &flags))
+        return 0;
+      (*q)--;
+    } else if (**q == '\\' && *q + 1 < p->end) {
+      if (*++(*q) == '\n')
+        p->line++;
+    } else if (**q == '(') {
+      depth++;
+    } else if (**q == ')' && --depth == 0) {
+      (*q)++;
+      return 1;
+    } else if (**q == '\n') {
+      p->line++;
+    }
+  }
+  p->more.close = ')';
+  return 0;
+}
+
+// read the bodies of the here-documents of the line that just ended, each
+// up to a line that is its delimiter or to the end of the source. The body
+// is expanded like text in double quotes, with its quotes left as they are,
+// unless the delimiter has quotes or escapes.
+static void heredocs(struct ctx_t *c) {
+  struct parser_t *p = c->p;
+  for (struct heredoc_t *d = c->docs; d; d = d->next) {
+    struct word_t *target = &d->redir->target;
+    const char *delim = word_str(p->arena, target);
+    size_t ndelim = strlen(delim);
+    int literal = target->flags & (WORD_QUOTED | WORD_ESCAPED);
+
+    const char *body = p->pos, *end = p->end;
+    while (p->pos < p->end) {
+      const char *line = p->pos, *s = line;
+      const char *eol = memchr(line, '\n', p->end - line);
+      if (!eol)
+        eol = p->end;
+      p->pos = eol < p->end ? eol + 1 : eol;
+      p->line += eol < p->end;
+      if (d->strip) {
+        while (s < eol && *s == '\t')
+          s++;
+      }
+      if ((size_t)(eol - s) == ndelim && memcmp(s, delim, ndelim) == 0) {
+        end = line;
+        break;
+      }
+    }
+    // the first body the source ends in is what more lines are checked for
+    if (end == p->end && !p->more.incomplete) {
+      p->more.incomplete = 1;
+      p->more.strip = d->strip;
+      p->more.ndelim = ndelim < sizeof(p->more.delim) ? (int)ndelim : -1;
+      if (p->more.ndelim > 0)
+        memcpy(p->more.delim, delim, ndelim);
+    }
+
+    // <<- needs a copy without the tabs
+    int len = end - body;
+    if (d->strip) {
+      char *text = arena_alloc(p->arena, len + 1);
+      len = 0;
+      int start = 1; /* at the start of a line, in its tabs */
+      for (const char *s = body; s < end; s++) {
+        if (start && *s == '\t')
+          continue;
+        start = *s == '\n';
+        text[len++] = *s;
+      }
+      body = text;
+    }
+    int flags = 0;
+    for (int i = 0; !literal && i < len && !flags; i++) {
+      if (body[i] == '$' || body[i] == '`' || body[i] == '\\')
+        flags = WORD_EXPAND;
+    }
+    *target = (struct word_t){body, len, flags, NULL};
+  }
+  c->docs = NULL;
+  c->lastdoc = &c->docs;
+}
+
+static void lex(struct ctx_t *c, struct token_t *tok) {
+  struct parser_t *p = c->p;
+
+  // blanks, escaped newlines and comments separate tokens
+  for (;;) {
+    while (p->pos < p->end && (cls[(unsigned char)*p->pos] & C_BLANK))
+      p->pos++;
+    if (p->pos + 1 < p->end && p->pos[0] == '\\' && p->pos[1] == '\n') {
+      p->pos += 2;
+      p->line++;
+      p->more.incomplete = p->pos == p->end;
+      continue;
+    }
+    if (p->pos < p->end && *p->pos == '#') {
+      while (p->pos < p->end && *p->pos != '\n')
+        p->pos++;
+    }
+    break;
+  }
+
+  const char *s = p->pos;
+  *tok = (struct token_t){.text = s, .len = 1, .line = p->line};
+  if (s == p->end) {
+    tok->type = TOK_EOF;
+    tok->len = 0;
+    if (c->docs)
+      heredocs(c);
+    return;
+  }
+
+  char next = s + 1 < p->end ? s[1] : '\0';
+  tok->type = TOK_ERROR;
+  // <(...) and >(...) are words
+  int process = (*s == '<' || *s == '>') && next == '(';
+  switch (process ? '\0' : *s) {
+  case '\n':
+    p->line++;
+    tok->type = TOK_NEWLINE;
+    break;
+  case '|':
+    tok->type = next == '|' ? TOK_OR_IF : TOK_PIPE;
+    break;
+  case '&':
+    tok->type = next == '&' ? TOK_AND_IF : TOK_AMP;
+    break;
+  case ';':
+    tok->type = TOK_SEMI;
+    break;
+  case '<':
+    if (next == '<') {
+      char third = s + 2 < p->end ? s[2] : '\0';
+      tok->type = third == '<'   ? TOK_TLESS
+                  : third == '-' ? TOK_DLESSDASH
+                                 : TOK_DLESS;
+      tok->len = tok->type == TOK_DLESS ? 2 : 3;
+    } else {
+      tok->type = next == '&' ? TOK_LESSAND : TOK_LESS;
+    }
+    break;
+  case '>':
+    tok->type = next == '>'   ? TOK_DGREAT
+                : next == '&' ? TOK_GREATAND
+                              : TOK_GREAT;
+    break;
+  }
+  if (tok->type != TOK_ERROR) {
+    if (tok->type == TOK_OR_IF || tok->type == TOK_AND_IF ||
+        tok->type == TOK_LESSAND || tok->type == TOK_DGREAT ||
+        tok->type == TOK_GREATAND)
+      tok->len = 2;
+    p->pos += tok->len;
+    if (tok->type == TOK_NEWLINE && c->docs)
+      heredocs(c);
+    return;
+  }
+
+  tok->type = TOK_WORD;
+  const char *q = s;
+  const char *end = p->end;
+  if (process) {
+    tok->flags |= WORD_EXPAND;
+    if (!skipparen(p, &q)) {
+      p->pos = end;
+      tok->type = failend(c, "syntax error: missing ')'");
+      return;
+    }
+  }
+  for (;;) {
+    while (q < end && cls[(unsigned char)*q] == 0)
+      q++;
+    if (q == end || (cls[(unsigned char)*q] & C_END))
+      break;
+    if (cls[(unsigned char)*q] & C_QUOTE) {
+      tok->flags |= WORD_QUOTED;
+      if (!skipquote(p, &q, &tok->flags)) {
+        p->pos = q;
+        tok->type = failend(c, "syntax error: unterminated quote");
+        return;
+      }
+    } else if (*q == '`') {
+      tok->flags |= WORD_EXPAND;
+      if (!skipquote(p, &q, &tok->flags)) {
+        p->pos = end;
+        tok->type = failend(c, "syntax error: missing '`'");
+        return;
+      }
+    } else if (*q == '$') {
+      // a parameter in braces, arithmetic and commands may have blanks in
+      // them
+      tok->flags |= WORD_EXPAND;
+      if (q + 1 < end && q[1] == '{') {
+        if (!skipbrace(p, &q)) {
+          p->pos = end;
+          tok->type = failend(c, "syntax error: missing '}'");
+          return;
+        }
+      } else if (q + 1 < end && q[1] == '(') {
+        if (!skipparen(p, &q)) {
+          p->pos = end;
+          tok->type = failend(c, "syntax error: missing ')'");
+          return;
+        }
+      } else {
+        q++;
+      }
+    } else if (cls[(unsigned char)*q] & C_GLOB) {
+      tok->flags |= WORD_GLOB;
+      q++;
+    } else if (*q == '\\') {
+      tok->flags |= WORD_ESCAPED;
+      if (++q < p->end) {
+        if (*q == '\n') {
+          p->line++;
+          p->more.incomplete = q + 1 == p->end;
+        }
+        q++;
+      }
+    } else {
+      q++;
+    }
+  }
+  tok->len = q - s;
+  p->pos = q;
+
+  // digits right before a redirection are the descriptor it redirects
+  if (tok->flags == 0 && q < p->end && (*q == '<' || *q == '>') &&
+      isdigits(s, tok->len))
+    tok->type = TOK_IONUM;
+}
+
+static struct token_t *peek(struct ctx_t *c) {
+  if (!c->peeked) {
+    lex(c, &c->tok);
+    c->peeked = 1;
+  }
+  return &c->tok;
+}
+
+static void consume(struct ctx_t *c) {
+  peek(c);
+  if (c->tok.type != TOK_NEWLINE && c->tok.type != TOK_EOF)
+    c->last = c->tok.text + c->tok.len;
+  c->peeked = 0;
+}
+
+// newlines may follow an operator that needs more
+static void skipnewlines(struct ctx_t *c) {
+  while (peek(c)->type == TOK_NEWLINE)
+    consume(c);
+}
+
+static void *unexpected(struct ctx_t *c, struct token_t *tok) {
+  if (c->failed || tok->type == TOK_ERROR)
+    return NULL;
+  if (tok->type == TOK_EOF) {
+    failend(c, "syntax error: unexpected end of file");
+  } else if (tok->type == TOK_NEWLINE) {
+    fail(c, "syntax error near unexpected token 'newline'");
+  } else {
+    char msg[sizeof(c->p->error)];
+    snprintf(msg, sizeof(msg), "syntax error near unexpected token '%.*s'",
+             tok->len, tok->text);
+    fail(c, msg);
+  }
+  return NULL;
+}
+
+static int isredir(int type) {
+  return type == TOK_LESS || type == TOK_GREAT || type == TOK_DGREAT ||
+         type == TOK_LESSAND || type == TOK_GREATAND || type == TOK_DLESS ||
+         type == TOK_DLESSDASH || type == TOK_TLESS;
+}
+
+static struct redir_t *redirection(struct ctx_t *c) {
+  struct parser_t *p = c->p;
+  struct redir_t *redir = arena_alloc(p->arena, sizeof(struct redir_t));
+  redir->fd = -1;
+  redir->next = NULL;
+
+  struct token_t *tok = peek(c);
+  if (tok->type == TOK_IONUM) {
+    redir->fd = (int)strtol(tok->text, NULL, 10);
+    consume(c);
+    tok = peek(c);
+  }
+
+  int op = tok->type;
+  consume(c);
+  switch (op) {
+  case TOK_LESS:
+    redir->type = REDIR_IN;
+    break;
+  case TOK_GREAT:
+    redir->type = REDIR_OUT;
+    break;
+  case TOK_DGREAT:
+    redir->type = REDIR_APPEND;
+    break;
+  case TOK_DLESS:
+  case TOK_DLESSDASH:
+    redir->type = REDIR_HEREDOC;
+    break;
+  case TOK_TLESS:
+    redir->type = REDIR_HERESTRING;
+    break;
+  default:
+    redir->type = REDIR_DUP;
+    break;
+  }
+  if (redir->fd < 0)
+    redir->fd = op == TOK_GREAT || op == TOK_DGREAT || op == TOK_GREATAND;
+
+  tok = peek(c);
+  if (tok->type != TOK_WORD) {
+    if (tok->type != TOK_ERROR)
+      fail(c, "syntax error: redirection without a target");
+    return NULL;
+  }
+  if (redir->type == REDIR_DUP && !isdigits(tok->text, tok->len))
+    return unexpected(c, tok);
+  redir->target = (struct word_t){tok->text, tok->len, tok->flags, NULL};
+  consume(c);
+  if (redir->type == REDIR_HEREDOC) {
+    struct heredoc_t *doc = arena_alloc(p->arena, sizeof(struct heredoc_t));
+    *doc = (struct heredoc_t){redir, op == TOK_DLESSDASH, NULL};
+    *c->lastdoc = doc;
+    c->lastdoc = &doc->next;
+  }
+  return redir;
+}
+
+// return 1 if the word of len bytes at s is an assignment, name=value
+static int isassign(const char *s, int len) {
+  if (len == 0 || !(s[0] == '_' || (s[0] >= 'a' && s[0] <= 'z') ||
+                    (s[0] >= 'A' && s[0] <= 'Z')))
+    return 0;
+  for (int i = 1; i < len; i++) {
+    if (s[i] == '=')
+      return 1;
+    if (!(s[i] == '_' || (s[i] >= 'a' && s[i] <= 'z') ||
+          (s[i] >= 'A' && s[i] <= 'Z') || (s[i] >= '0' && s[i] <= '9')))
+      return 0;
+  }
+  return 0;
+}
+
+static struct cmd_t *command(struct ctx_t *c) {
+  struct parser_t *p = c->p;
+  struct cmd_t *cmd = arena_alloc(p->arena, sizeof(struct cmd_t));
+  memset(cmd, 0, sizeof(struct cmd_t));
+  struct word_t **assigns = &cmd->assigns;
+  struct word_t **words = &cmd->words;
+  struct redir_t **redirs = &cmd->redirs;
+
+  for (;;) {
+    struct token_t *tok = peek(c);
+    if (tok->type == TOK_WORD) {
+      // assignments are the words before the command name
+      struct word_t *word = arena_alloc(p->arena, sizeof(struct word_t));
+      *word = (struct word_t){tok->text, tok->len, tok->flags, NULL};
+      if (cmd->nwords == 0 && isassign(tok->text, tok->len)) {
+        *assigns = word;
+        assigns = &word->next;
+        cmd->nassigns++;
+      } else {
+        *words = word;
+        words = &word->next;
+        cmd->nwords++;
+      }
+      consume(c);
+    } else if (tok->type == TOK_IONUM || isredir(tok->type)) {
+      struct redir_t *redir = redirection(c);
+      if (!redir)
+        return NULL;
+      *redirs = redir;
+      redirs = &redir->next;
+      cmd->nredirs++;
+    } else {
+      break;
+    }
+  }
+
+  if (cmd->nwords == 0 && cmd->nredirs == 0 && cmd->nassigns == 0)
+    return unexpected(c, peek(c));
+  return cmd;
+}
+
+static struct node_t *newnode(struct ctx_t *c, int type, const char *text) {
+  struct node_t *node = arena_alloc(c->p->arena, sizeof(struct node_t));
+  memset(node, 0, sizeof(struct node_t));
+  node->type = type;
+  node->text = text;
+  return node;
+}
+
+static struct node_t *pipeline(struct ctx_t *c) {
+  struct node_t *node = newnode(c, NODE_PIPE, peek(c)->text);
+  struct cmd_t **cmds = &node->cmds;
+
+  for (;;) {
+    struct cmd_t *cmd = command(c);
+    if (!cmd)
+      return NULL;
+    *cmds = cmd;
+    cmds = &cmd->next;
+    node->ncmds++;
+
+    if (peek(c)->type != TOK_PIPE)
+      break;
+    consume(c);
+    skipnewlines(c);
+  }
+
+  node->len = c->last - node->text;
+  return node;
+}
+
+static struct node_t *and_or(struct ctx_t *c) {
+  struct node_t *left = pipeline(c);
+
+  while (left) {
+    int op = peek(c)->type;
+    if (op != TOK_AND_IF && op != TOK_OR_IF)
+      break;
+    consume(c);
+    skipnewlines(c);
+
+    struct node_t *right = pipeline(c);
+    if (!right)
+      return NULL;
+    struct node_t *node =
+        newnode(c, op == TOK_AND_IF ? NODE_AND : NODE_OR, left->text);
+    node->left = left;
+    node->right = right;
+    node->len = c->last - node->text;
+    left = node;
+  }
+  return left;
+}
+
+int parse_next(struct parser_t *p, struct node_t **list) {
+  struct ctx_t c = {.p = p};
+  c.lastdoc = &c.docs;
+  struct node_t **items = list;
+  *list = NULL;
+
+  struct token_t *tok = peek(&c);
+  if (tok->type == TOK_EOF)
+    return 0;
+
+  while (tok->type != TOK_NEWLINE && tok->type != TOK_EOF) {
+    struct node_t *node = and_or(&c);
+    if (!node)
+      goto error;
+    *items = node;
+    items = &node->next;
+
+    tok = peek(&c);
+    if (tok->type == TOK_SEMI || tok->type == TOK_AMP) {
+      if (tok->type == TOK_AMP) {
+        node->bg = 1;
+        node->len = tok->text + tok->len - node->text;
+      }
+      consume(&c);
+      tok = peek(&c);
+    } else if (tok->type != TOK_NEWLINE && tok->type != TOK_EOF) {
+      unexpected(&c, tok);
+      goto error;
+    }
+  }
+  consume(&c);
+  return 1;
+
+error:
+  // go on with the next line, unless the error is at its end already
+  if (!(c.peeked && (c.tok.type == TOK_NEWLINE || c.tok.type == TOK_EOF))) {
+    while (p->pos < p->end && *p->pos != '\n')
+      p->pos++;
+    if (p->pos < p->end) {
+      p->pos++;
+      p->line++;
+    }
+  }
+  *list = NULL;
+  return -1;
+}
+
+int word_istime(const struct word_t *word) {
+  return word && word->flags == 0 && word->len == 4 &&
+         strncmp(word->text, "time", 4) == 0;
+}
+
+int pending_check(const struct pending_t *more, const char *line,
+                  size_t len) {
+  if (more->ndelim) {
+    if (more->ndelim < 0)
+      return 1;
+    // a line of the body, which may be the delimiter, or the last line
+    if (len > 0 && line[len - 1] == '\n')
+      len--;
+    while (more->strip && len > 0 && *line == '\t') {
+      line++;
+      len--;
+    }
+    return len == (size_t)more->ndelim && memcmp(line, more->delim, len) == 0;
+  }
+  return !more->close || memchr(line, more->close, len) != NULL;
+}
+
+char *word_str(struct arena_t *arena, const struct word_t *word) {
+  if (word->flags == 0)
+    return arena_strndup(arena, word->text, word->len);
+
+  // the value is never longer than the word
+  char *buf = arena_alloc(arena, word->len + 1);
+  char *out = buf;
+  const char *s = word->text;
+  const char *end = s + word->len;
+  while (s < end) {
+    if (*s == '\'') {
+      for (s++; *s != '\''; s++)
+        *out++ = *s;
+      s++;
+    } else if (*s == '"') {
+      for (s++; *s != '"'; s++) {
+        // in double quotes a backslash only escapes what is special there
+        if (*s == '\\' && (s[1] == '"' || s[1] == '\\' || s[1] == '$' ||
+                           s[1] == '`' || s[1] == '\n')) {
+          if (*++s == '\n')
+            continue;
+        }
+        *out++ = *s;
+      }
+      s++;
+    } else if (*s == '\\') {
+      if (++s == end)
+        break;
+      if (*s != '\n')
+        *out++ = *s;
+      s++;
+    } else {
+      *out++ = *s++;
+    }
+  }
+  *out = '\0';
+  return buf;
+}
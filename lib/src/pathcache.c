@@ -0,0 +1,314 @@
+#define _GNU_SOURCE
+#include "pathcache.h"
+#include "var.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MINBUCKETS 64
+
+#define WATCH_MASK                                                             \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |           \
+   IN_DELETE_SELF | IN_MOVE_SELF)
+
+struct pathdir_t {
+  char *dir;   /* directory of PATH, "." for an empty component */
+  int wd;      /* inotify watch, -1 if the directory is not watched */
+  struct timespec mtime; /* used when inotify is not available */
+};
+
+static struct pathent_t **buckets = NULL;
+static int nbuckets = 0;
+static int nentries = 0;
+
+static char *pathvar = NULL; /* PATH the directories were parsed from */
+static struct pathdir_t *dirs = NULL;
+static int ndirs = 0;
+static int inotify_fd = -1;
+
+static unsigned long hash(const char *s) {
+  unsigned long h = 14695981039346656037UL; /* FNV-1a */
+  while (*s) {
+    h ^= (unsigned char)*s++;
+    h *= 1099511628211UL;
+  }
+  return h;
+}
+
+static void freeent(struct pathent_t *ent) {
+  if (ent->fd >= 0)
+    close(ent->fd);
+  free(ent->name);
+  free(ent->path);
+  free(ent);
+}
+
+void pathcache_clear(void) {
+  for (int i = 0; i < nbuckets; i++) {
+    struct pathent_t *ent = buckets[i];
+    while (ent) {
+      struct pathent_t *next = ent->next;
+      freeent(ent);
+      ent = next;
+    }
+    buckets[i] = NULL;
+  }
+  nentries = 0;
+}
+
+static void forget(const char *name) {
+  if (nbuckets == 0)
+    return;
+
+  struct pathent_t **pp = &buckets[hash(name) & (nbuckets - 1)];
+  for (; *pp; pp = &(*pp)->next) {
+    if (strcmp((*pp)->name, name) == 0) {
+      struct pathent_t *ent = *pp;
+      *pp = ent->next;
+      freeent(ent);
+      nentries--;
+      return;
+    }
+  }
+}
+
+static void freedirs(void) {
+  for (int i = 0; i < ndirs; i++) {
+    if (dirs[i].wd >= 0)
+      inotify_rm_watch(inotify_fd, dirs[i].wd);
+    free(dirs[i].dir);
+  }
+  free(dirs);
+  free(pathvar);
+  dirs = NULL;
+  ndirs = 0;
+  pathvar = NULL;
+}
+
+void pathcache_chdir(void) {
+  for (int i = 0; i < ndirs; i++) {
+    if (dirs[i].dir[0] != '/') {
+      // watches and entries of every directory are set up again
+      pathcache_clear();
+      freedirs();
+      return;
+    }
+  }
+}
+
+// split PATH into directories and watch each of them
+static void loaddirs(const char *path) {
+  freedirs();
+  pathvar = strdup(path);
+
+  int n = 1;
+  for (const char *p = path; *p; p++) {
+    if (*p == ':')
+      n++;
+  }
+  dirs = calloc(n, sizeof(struct pathdir_t));
+
+  const char *start = path;
+  for (;;) {
+    const char *end = strchrnul(start, ':');
+    struct pathdir_t *d = &dirs[ndirs++];
+    d->dir = end == start ? strdup(".") : strndup(start, end - start);
+    d->wd = -1;
+    if (inotify_fd >= 0)
+      d->wd = inotify_add_watch(inotify_fd, d->dir, WATCH_MASK);
+    if (d->wd < 0) {
+      struct stat st;
+      if (stat(d->dir, &st) == 0)
+        d->mtime = st.st_mtim;
+    }
+    if (*end == '\0')
+      break;
+    start = end + 1;
+  }
+}
+
+static int watched(int wd) {
+  for (int i = 0; i < ndirs; i++) {
+    if (dirs[i].wd == wd)
+      return 1;
+  }
+  return 0;
+}
+
+// drop entries that a change of PATH or of a directory may have made stale
+static void revalidate(void) {
+  const char *path = var_get("PATH");
+  if (!path)
+    path = "/usr/local/bin:/usr/bin:/bin";
+
+  if (inotify_fd < 0 && !pathvar)
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  if (!pathvar || strcmp(path, pathvar) != 0) {
+    pathcache_clear();
+    loaddirs(path);
+    return;
+  }
+
+  // a named event only concerns the entry of that name
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while (inotify_fd >= 0 && (len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + len;) {
+      struct inotify_event *ev = (struct inotify_event *)p;
+      p += sizeof(struct inotify_event) + ev->len;
+      // removing an old watch queues IN_IGNORED for it as well
+      if (!watched(ev->wd))
+        continue;
+      if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF |
+                      IN_MOVE_SELF)) {
+        // the directory itself is gone or events were lost, start over
+        pathcache_clear();
+        free(pathvar);
+        pathvar = NULL;
+      } else if (ev->len > 0) {
+        forget(ev->name);
+      }
+    }
+  }
+  if (!pathvar) {
+    loaddirs(path);
+    return;
+  }
+
+  // directories that could not be watched are checked by mtime
+  for (int i = 0; i < ndirs; i++) {
+    if (dirs[i].wd >= 0)
+      continue;
+    struct stat st;
+    struct timespec mtime = {0, 0};
+    if (stat(dirs[i].dir, &st) == 0)
+      mtime = st.st_mtim;
+    if (mtime.tv_sec != dirs[i].mtime.tv_sec ||
+        mtime.tv_nsec != dirs[i].mtime.tv_nsec) {
+      dirs[i].mtime = mtime;
+      pathcache_clear();
+    }
+  }
+}
+
+static void grow(void) {
+  int size = nbuckets ? nbuckets * 2 : MINBUCKETS;
+  struct pathent_t **table = calloc(size, sizeof(struct pathent_t *));
+
+  for (int i = 0; i < nbuckets; i++) {
+    struct pathent_t *ent = buckets[i];
+    while (ent) {
+      struct pathent_t *next = ent->next;
+      struct pathent_t **head = &table[hash(ent->name) & (size - 1)];
+      ent->next = *head;
+      *head = ent;
+      ent = next;
+    }
+  }
+
+  free(buckets);
+  buckets = table;
+  nbuckets = size;
+}
+
+// walk PATH for name, return a new entry which may be negative
+static struct pathent_t *resolve(const char *name) {
+  struct pathent_t *ent = malloc(sizeof(struct pathent_t));
+  *ent = (struct pathent_t){.name = strdup(name), .dir = -1, .fd = -1};
+
+  // candidates are built on the stack, only the one found is kept
+  char path[PATH_MAX];
+  size_t namelen = strlen(name);
+  for (int i = 0; i < ndirs; i++) {
+    size_t dirlen = strlen(dirs[i].dir);
+    if (dirlen + namelen + 2 > sizeof(path))
+      continue;
+    memcpy(path, dirs[i].dir, dirlen);
+    path[dirlen] = '/';
+    memcpy(path + dirlen + 1, name, namelen + 1);
+
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+        access(path, X_OK) == 0) {
+      ent->path = strdup(path);
+      ent->dir = i;
+      break;
+    }
+  }
+
+  return ent;
+}
+
+static void openfd(struct pathent_t *ent) {
+  if (ent->fd >= 0 || !ent->path)
+    return;
+
+  int fd = open(ent->path, O_PATH | O_CLOEXEC);
+  // never hand a standard descriptor to the exec path
+  if (fd >= 0 && fd <= STDERR_FILENO) {
+    close(fd);
+    fd = -1;
+  }
+  ent->fd = fd;
+}
+
+struct pathent_t *pathcache_lookup(const char *name) {
+  revalidate();
+
+  if (nbuckets == 0)
+    grow();
+
+  struct pathent_t *ent = buckets[hash(name) & (nbuckets - 1)];
+  while (ent && strcmp(ent->name, name) != 0)
+    ent = ent->next;
+
+  if (!ent) {
+    if (nentries >= nbuckets)
+      grow();
+    ent = resolve(name);
+    struct pathent_t **head = &buckets[hash(name) & (nbuckets - 1)];
+    ent->next = *head;
+    *head = ent;
+    nentries++;
+  }
+
+  if (++ent->hits >= PATHCACHE_HOT)
+    openfd(ent);
+
+  return ent->path ? ent : NULL;
+}
+
+struct pathent_t *pathcache_prewarm(const char *name) {
+  struct pathent_t *ent = pathcache_lookup(name);
+  if (ent)
+    openfd(ent);
+  return ent;
+}
+
+void pathcache_list(void) {
+  if (nentries == 0) {
+    printf("hash: hash table empty\n");
+    return;
+  }
+
+  printf("hits\tfd\tcommand\n");
+  for (int i = 0; i < nbuckets; i++) {
+    for (struct pathent_t *ent = buckets[i]; ent; ent = ent->next) {
+      if (ent->path) {
+        printf("%4ld\t%d\t%s\n", ent->hits, ent->fd, ent->path);
+      } else {
+        printf("%4ld\t-\t%s (not found)\n", ent->hits, ent->name);
+      }
+    }
+  }
+}
+
+int pathcache_size(void) {
+  return nentries;
+}
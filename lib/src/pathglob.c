@@ -0,0 +1,229 @@
+#define _GNU_SOURCE
+#include "pathglob.h"
+#include "match.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// entries of a directory are read this much at a time, so that one of 100k
+// files takes a few dozen system calls
+#define DIRBUF (256 * 1024)
+
+// strings this few are sorted by insertion
+#define RADIX_MIN 16
+
+/* an entry as getdents64 gives it */
+struct dirent64_t {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+/* a part of the pattern between slashes */
+struct part_t {
+  struct match_t *m; /* NULL if the part is a literal */
+  const char *lit;   /* the literal, without its escapes */
+  size_t nlit;
+  int dir;           /* a '/' follows, only directories match */
+};
+
+// paths growing as needed
+struct list_t {
+  char **v;
+  size_t n;
+  size_t cap;
+};
+
+struct glob_t {
+  struct arena_t *arena;
+  struct part_t *parts;
+  int nparts;
+  char *buf;           /* DIRBUF bytes for getdents64, allocated once */
+  struct list_t out;
+};
+
+static void add(struct arena_t *arena, struct list_t *list, char *path) {
+  if (list->n == list->cap) {
+    size_t cap = list->cap ? list->cap * 2 : 16;
+    char **v = arena_alloc(arena, cap * sizeof(char *));
+    if (list->n)
+      memcpy(v, list->v, list->n * sizeof(char *));
+    list->v = v;
+    list->cap = cap;
+  }
+  list->v[list->n++] = path;
+}
+
+// return path of the name of len bytes in the directory dir, with a '/'
+// after it if slash is set
+static char *join(struct arena_t *arena, const char *dir, size_t dirlen,
+                  const char *name, size_t len, int slash) {
+  char *path = arena_alloc(arena, dirlen + len + slash + 1);
+  memcpy(path, dir, dirlen);
+  memcpy(path + dirlen, name, len);
+  if (slash)
+    path[dirlen + len] = '/';
+  path[dirlen + len + slash] = '\0';
+  return path;
+}
+
+// return whether the entry d of the directory open as fd is a directory,
+// following a symbolic link
+static int isdir(int fd, const struct dirent64_t *d) {
+  if (d->d_type == DT_DIR)
+    return 1;
+  if (d->d_type != DT_LNK && d->d_type != DT_UNKNOWN)
+    return 0;
+  struct stat st;
+  return fstatat(fd, d->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+// add the paths under the directory dir, of dirlen bytes and "" for the
+// current one, that match the parts from i on
+static void walk(struct glob_t *g, const char *dir, size_t dirlen, int i) {
+  const struct part_t *part = &g->parts[i];
+  int last = i == g->nparts - 1;
+  struct stat st;
+
+  // a literal is looked for only once it is the last part, opening the
+  // directories under it tells whether it is there otherwise
+  if (!part->m) {
+    char *path =
+        join(g->arena, dir, dirlen, part->lit, part->nlit, part->dir);
+    size_t len = dirlen + part->nlit + part->dir;
+    if (!last)
+      walk(g, path, len, i + 1);
+    else if (part->dir ? stat(path, &st) == 0 && S_ISDIR(st.st_mode)
+                       : lstat(path, &st) == 0)
+      add(g->arena, &g->out, path);
+    return;
+  }
+
+  int fd = open(dirlen ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  const struct match_t *m = part->m;
+  int dots = m->nprefix > 0 && m->prefix[0] == '.';
+  // the buffer is read again by the parts under this one, the matches wait
+  struct list_t found = {NULL, 0, 0};
+  long n;
+  while ((n = syscall(SYS_getdents64, fd, g->buf, DIRBUF)) > 0) {
+    for (long off = 0; off < n;) {
+      const struct dirent64_t *d = (const struct dirent64_t *)(g->buf + off);
+      off += d->d_reclen;
+      const char *name = d->d_name;
+      if (name[0] == '.' &&
+          (!dots || name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        continue;
+      size_t len = strlen(name);
+      if (!match(m, name, len) || (part->dir && !isdir(fd, d)))
+        continue;
+      add(g->arena, last ? &g->out : &found,
+          join(g->arena, dir, dirlen, name, len, part->dir));
+    }
+  }
+  close(fd);
+
+  for (size_t j = 0; j < found.n; j++)
+    walk(g, found.v[j], strlen(found.v[j]), i + 1);
+}
+
+int pathglob(struct arena_t *arena, const char *pattern, size_t len,
+             char ***paths) {
+  struct glob_t g = {.arena = arena};
+  const char *p = pattern, *end = pattern + len;
+  int root = p < end && *p == '/';
+
+  // a part per slash at most, repeated slashes are one
+  int max = 1;
+  for (const char *s = p; s < end; s++)
+    max += *s == '/';
+  g.parts = arena_alloc(arena, max * sizeof(struct part_t));
+  int magic = 0;
+  while (p < end) {
+    while (p < end && *p == '/')
+      p++;
+    if (p == end)
+      break;
+    const char *slash = memchr(p, '/', end - p);
+    const char *stop = slash ? slash : end;
+    struct part_t *part = &g.parts[g.nparts++];
+    struct match_t *m = match_compile(arena, p, stop - p);
+    *part = (struct part_t){NULL, "", 0, slash != NULL};
+    if (!match_isliteral(m)) {
+      part->m = m;
+      magic = 1;
+    } else if (m->nsteps) {
+      part->lit = m->steps[0].lit;
+      part->nlit = m->steps[0].len;
+    }
+    p = stop;
+  }
+  if (!magic)
+    return 0;
+
+  g.buf = arena_alloc(arena, DIRBUF);
+  walk(&g, "/", root, 0);
+  pathglob_sort(arena, g.out.v, g.out.n);
+  *paths = g.out.v;
+  return (int)g.out.n;
+}
+
+// sort v by the bytes from depth on, which strings sharing a byte are then
+// sorted by in turn, with tmp as scratch
+static void radix(char **v, char **tmp, size_t n, size_t depth) {
+  for (;;) {
+    if (n < RADIX_MIN) {
+      for (size_t i = 1; i < n; i++) {
+        char *s = v[i];
+        size_t j = i;
+        for (; j > 0 && strcmp(v[j - 1] + depth, s + depth) > 0; j--)
+          v[j] = v[j - 1];
+        v[j] = s;
+      }
+      return;
+    }
+
+    unsigned count[256] = {0};
+    for (size_t i = 0; i < n; i++)
+      count[(unsigned char)v[i][depth]]++;
+    // a byte they all share, like that of the directory they are in, needs
+    // no moving
+    unsigned char first = v[0][depth];
+    if (count[first] == n && first != '\0') {
+      depth++;
+      continue;
+    }
+
+    unsigned pos[256];
+    unsigned sum = 0;
+    for (int b = 0; b < 256; b++) {
+      pos[b] = sum;
+      sum += count[b];
+    }
+    for (size_t i = 0; i < n; i++)
+      tmp[pos[(unsigned char)v[i][depth]]++] = v[i];
+    memcpy(v, tmp, n * sizeof(char *));
+
+    // strings that ended here are equal
+    size_t start = count[0];
+    for (int b = 1; b < 256; b++) {
+      if (count[b] > 1)
+        radix(v + start, tmp, count[b], depth + 1);
+      start += count[b];
+    }
+    return;
+  }
+}
+
+void pathglob_sort(struct arena_t *arena, char **v, size_t n) {
+  if (n < 2)
+    return;
+  char **tmp = n < RADIX_MIN ? NULL : arena_alloc(arena, n * sizeof(char *));
+  radix(v, tmp, n, 0);
+}
@@ -0,0 +1,96 @@
+#include "reader.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+void reader_init(struct reader_t *r, int fd) {
+  r->fd = fd;
+  r->buf = NULL;
+  r->size = 0;
+  r->start = 0;
+  r->end = 0;
+  r->eof = 0;
+}
+
+void reader_free(struct reader_t *r) {
+  free(r->buf);
+  reader_init(r, -1);
+}
+
+// make room behind the unread bytes, moving them to the front first and
+// growing the buffer only if a line does not fit in it
+static void makeroom(struct reader_t *r) {
+  if (r->start > 0) {
+    memmove(r->buf, r->buf + r->start, r->end - r->start);
+    r->end -= r->start;
+    r->start = 0;
+  }
+  if (r->end < r->size)
+    return;
+
+  size_t size = r->size ? r->size * 2 : READER_BUFSIZE;
+  char *buf = realloc(r->buf, size);
+  if (!buf) {
+    errorf("reader: out of memory\n");
+    exit(1);
+  }
+  r->buf = buf;
+  r->size = size;
+}
+
+// read once into the free part of the buffer, restarting after a signal
+// return number of bytes read, 0 at end of file, -1 on error
+static ssize_t fill(struct reader_t *r) {
+  ssize_t n;
+  do {
+    n = read(r->fd, r->buf + r->end, r->size - r->end);
+  } while (n < 0 && errno == EINTR);
+  if (n == 0)
+    r->eof = 1;
+  else if (n > 0)
+    r->end += n;
+  return n;
+}
+
+// hand out the next line with the keep bytes handed out before it in front
+// of it, which makeroom moves along with the unread ones
+static ssize_t next(struct reader_t *r, const char **line, size_t keep) {
+  r->start -= keep;
+  size_t scanned = r->start + keep; /* no newline before this */
+  for (;;) {
+    char *nl =
+        scanned < r->end ? memchr(r->buf + scanned, '\n', r->end - scanned)
+                         : NULL;
+    if (nl || (r->eof && r->end > r->start + keep)) {
+      // a last line without a newline ends at the end of the input
+      size_t len = nl ? (size_t)(nl + 1 - (r->buf + r->start))
+                      : r->end - r->start;
+      *line = r->buf + r->start;
+      r->start += len;
+      return len;
+    }
+    if (r->eof) {
+      *line = r->buf + r->start;
+      r->start += keep;
+      return 0;
+    }
+
+    scanned = r->end - r->start;
+    makeroom(r);
+    if (fill(r) < 0) {
+      *line = r->buf + r->start;
+      r->start += keep;
+      return -1;
+    }
+    scanned += r->start;
+  }
+}
+
+ssize_t reader_next(struct reader_t *r, const char **line) {
+  return next(r, line, 0);
+}
+
+ssize_t reader_extend(struct reader_t *r, const char **text, size_t len) {
+  return next(r, text, len);
+}
@@ -1,14 +1,120 @@
+#define _GNU_SOURCE
 #include "shell.h"
 #include "job.h"
+#include "launch.h"
+#include "builtin.h"
+#include "compile.h"
+#include "coreutils.h"
+#include "event.h"
+#include "expand.h"
+#include "parse.h"
+#include "pathcache.h"
+#include "siolog.h"
+#include "var.h"
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 
-static int argc;
-static char *argv[MAXARGS];
+// a command of a pipeline
+struct stage_t {
+  char **argv;                    /* arguments, redirections removed */
+  int argc;
+  struct launch_action_t *redirs; /* redirections in order */
+  int nredirs;
+  char **assigns;                 /* name=value for the command only */
+  int nassigns;
+};
+
+// memory of the command line being run, released once it is done
+static struct arena_t arena;
+
+// exit status of the last foreground pipeline, tested by && and ||
+static int last_status = 0;
+
+// set in the child shell running a background list like a && b &, whose
+// pipelines join its process group so that the job can be stopped as one
+static int subshell = 0;
+
+// print the resources of every job when it is done, set notify=on
+static int notify = 0;
+
+// positional parameters of the script being run, its path first
+static int nparams = 0;
+static char **params = NULL;
+
+// pid of the shell, which child shells keep as $$
+static pid_t shell_pid = 0;
+
+// report the allocations of every command, set allocstat=on
+static int allocstat = 0;
+
+// words with '*', '?' or '[' not quoted expand to the paths they match, set
+// glob=off passes them on as they are
+static int globbing = 1;
+
+// scripts are compiled before they are run and their code is kept, 1 in
+// memory and 2 in the cache directory as well, set compile=off|on|disk
+static int compiled = 1;
+
+// set once a child could not be watched through a pidfd, so that SIGCHLD
+// has to reap terminated children as well
+static int nopidfd = 0;
+
+// exit status of the last command substitution of the command being
+// expanded, which a command of assignments alone returns
+static int subst_status = 0;
+
+// output of command substitutions comes through a pipe this large, so that
+// a command seldom waits for the shell to read it
+#define SUBST_PIPE_SIZE (1 << 20)
+
+// the memfd builtins in command substitutions write to is emptied once it
+// holds this much
+#define CAPTURE_MAX (1 << 20)
+
+// processes of <(...) and >(...) started while the words of a pipeline are
+// expanded, which join its job, and the shell's ends of their pipes, which
+// its commands are given
+static pid_t *sub_pids = NULL;
+static int *sub_fds = NULL;
+static int nsubs = 0;
+static int capsubs = 0;
+
+// mask the shell had before the first of them was started, the handlers
+// are held off from reaping them until the job is added
+static sigset_t sub_mask;
+
+// memfds holding the here-documents and here-strings of the command line,
+// which its commands read, closed once they are launched
+static int *doc_fds = NULL;
+static int ndocs = 0;
+static int capdocs = 0;
+
+static int redirect_shell(struct stage_t *stage, int *saved);
+static void restore_shell(struct stage_t *stage, int *saved);
+static pid_t spawn_stage(struct stage_t *stage, pid_t pgid, int in, int out,
+                         const sigset_t *mask, const sigset_t *caught,
+                         int *pidfd, struct phases_t *phases);
+static void add_job(pid_t *pids, int npids, int state, char *cmdline,
+                    struct phases_t *phases);
+static int dispatch(int timeout);
+static int run_andor(struct node_t *node, long parsed);
+static void redir_error(const struct launch_action_t *act);
+static int substitute(struct expand_t *x, const char *text, int len,
+                      char **out, size_t *outlen);
+static char *process_sub(struct expand_t *x, const char *text, int len,
+                         int input);
+static void subs_finish(int first);
+static void docs_close(int first);
 
 // Wrapper for the sigaction function
 handler_t Signal(int signum, handler_t handler) {
@@ -22,19 +128,156 @@ handler_t Signal(int signum, handler_t handler) {
 }
 
 void sigquit_handler(int sig) {
-  printf("Terminating after receipt of SIGQUIT signal\n");
+  siolog_printf("Terminating after receipt of SIGQUIT signal\n");
   exit(1);
 }
 
+static long now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// print where the time of a timed job went, async-signal-safe
+static void report_time(struct job_t *job) {
+  struct phases_t *p = &job->phases;
+  char usage[MAXLINE];
+  formatusage(usage, sizeof(usage), job);
+  siolog_printf("time: parse %ldns spawn %ldns exec %ldns run %ldns "
+                "reap %ldns total %ldns\n    %s\n",
+                p->spawn - p->parse, p->forked - p->spawn,
+                p->execed - p->forked, p->notified - p->execed,
+                p->reaped - p->notified, p->reaped - p->parse, usage);
+}
+
+// a child was stopped or has terminated with the wait status in ev. A
+// terminated one comes with the resources it used.
+static void child_changed(const struct event_t *ev) {
+  pid_t pid = ev->pid;
+  int status = ev->status;
+
+  // a pipeline is one job, any of its processes leads to it
+  struct job_t *job = getjobPID(&jobs, pid);
+  int jid = job ? job->jid : 0;
+
+  // case 1 WUNTRACED: stop process that received SIGTSTP or SIGSTOP
+  // NOTE: different from what we do in stop_fg, we handle signals from other
+  // sources instead of shell-delivered signals, which is handled in stop_fg
+  if (WIFSTOPPED(status) &&
+      (WSTOPSIG(status) == SIGTSTP || WSTOPSIG(status) == SIGSTOP)) {
+    if (job && job->state != ST) {
+      // has not been catched
+      siolog_printf("sigchld_handler: Job [%d] (%d) stopped by signal %d\n",
+                    jid, job->pid, WSTOPSIG(status));
+      if (job->state == FG)
+        last_status = 128 + WSTOPSIG(status);
+      setjobstate(&jobs, job, ST);
+    }
+  }
+
+  // terminated voluntarily or forcibaly. The job is done only when every
+  // process of the pipeline has been reaped, and its status is the one of
+  // the last process.
+  if (!(WIFEXITED(status) || WIFSIGNALED(status)) || !job)
+    return;
+
+  int nlive = reapmember(job, pid, status);
+  addusage(job, &ev->rusage, ev->rbytes, ev->wbytes);
+  if (nlive == 0) {
+    pid_t pgid = job->pid;
+    status = job->procs[job->nprocs - 1].status;
+    if (job->state == FG)
+      last_status =
+          WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    if (job->timed) {
+      job->phases.notified = ev->notified;
+      job->phases.reaped = ev->reaped;
+      report_time(job);
+    }
+
+    if (notify) {
+      char usage[MAXLINE];
+      formatusage(usage, sizeof(usage), job);
+      siolog_printf("[%d] (%d) Done %s\n    %s\n", jid, pgid, job->cmdline,
+                    usage);
+    }
+
+    // case 2: reap termination processes
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+      // a child process is terminated by a SIGINT not from shell
+      // the job is gone already when it is handled in interrupt_fg
+      siolog_printf("sigchld_handler: Job [%d] (%d) terminated by signal %d\n",
+                    jid, pgid, WTERMSIG(status));
+    }
+
+    deletejob(&jobs, pgid);
+    if (verbose) {
+      siolog_printf("sigchld_handler: Job [%d] (%d) deleted\n", jid, pgid);
+      if (WIFEXITED(status)) {
+        siolog_printf(
+            "sigchld_handler: Job [%d] (%d) terminates OK (status %d)\n", jid,
+            pgid, WEXITSTATUS(status));
+      }
+    }
+  }
+}
+
+// suspend the foreground job by sending it a SIGTSTP
+static void stop_fg(int sig) {
+  struct job_t *stpjob = jobs.fg;
+  if (stpjob) {
+    // send SIGTSTP to foreground job's process grounp
+    kill(-stpjob->pid, SIGTSTP);
+    siolog_printf("sigtstp_handler: Job [%d] (%d) stopped by signal %d\n",
+                  stpjob->jid, stpjob->pid, sig);
+    last_status = 128 + sig;
+    setjobstate(&jobs, stpjob, ST);
+  }
+}
+
+// deliver SIGINT to the foreground job
+static void interrupt_fg(int sig) {
+  pid_t pid = fgPID(&jobs);
+  if (pid == 0)
+    return;
+  kill(-pid, SIGINT);
+  siolog_printf("sigint_handler: Job [%d] (%d) terminated by signal %d\n",
+                PID2JID(&jobs, pid), pid, sig);
+  last_status = 128 + sig;
+  deletejob(&jobs, pid);
+}
+
+// reap a child that terminated or stopped into ev, reading its I/O counters
+// while it is still a zombie. Async-signal-safe.
+// return pid of the child, 0 if there is none
+static pid_t reap_any(struct event_t *ev, long notified) {
+  siginfo_t info;
+  memset(&info, 0, sizeof(info));
+  if (waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WNOHANG | WNOWAIT) < 0 ||
+      info.si_pid == 0)
+    return 0;
+
+  memset(ev, 0, sizeof(*ev));
+  ev->type = EVENT_EXIT;
+  ev->notified = notified;
+  if (info.si_code == CLD_EXITED || info.si_code == CLD_KILLED ||
+      info.si_code == CLD_DUMPED)
+    event_procio(info.si_pid, &ev->rbytes, &ev->wbytes);
+  ev->pid = wait4(info.si_pid, &ev->status, WUNTRACED | WNOHANG, &ev->rusage);
+  ev->reaped = now();
+  return ev->pid > 0 ? ev->pid : 0;
+}
+
 // child processes may be terminated or stopped (WUNTRACED)
 void sigchld_handler(int sig) {
   if (verbose) {
-    printf("sigchld_handler: entering\n");
+    siolog_printf("sigchld_handler: entering\n");
   }
 
   int olderrno = errno;
-  pid_t pid;
-  int status;
+  long notified = now();
+  struct event_t ev;
   sigset_t mask_all, prev_all;
 
   sigfillset(&mask_all);
@@ -45,56 +288,15 @@ void sigchld_handler(int sig) {
   // WNOHANG: return when no zombie (terminated) process exist, allowing shell
   // main process to do some other stuff instead of waiting unterminated
   // processes.
-  while ((pid = waitpid(-1, &status, WUNTRACED | WNOHANG)) > 0) {
-    int jid = PID2JID(jobs, pid);
-
-    // case 1 WUNTRACED: stop process that received SIGTSTP or SIGSTOP
-    // NOTE: different from what we do in sigtstp_handler, we handle signals
-    // from other sources instead of shell-delivered signals, which is handled
-    // in sigtstp_handler
-    if (WIFSTOPPED(status) &&
-        (WSTOPSIG(status) == SIGTSTP || WSTOPSIG(status) == SIGSTOP)) {
-      struct job_t *stpjob = getjobPID(jobs, pid);
-      if (stpjob && stpjob->state != ST) {
-        // has not been catched
-        printf("sigchld_handler: Job [%d] (%d) stopped by signal %d\n",
-               PID2JID(jobs, pid), pid, WSTOPSIG(status));
-        stpjob->state = ST;
-      }
-    }
-
-    // case 2: reap termination processes
-    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
-      struct job_t *intjob = getjobPID(jobs, pid);
-      if (intjob)
-        // a child process is terminated by a SIGINT not from shell
-        // intjob == NULL when it is handled in sigint_handler
-        printf("sigchld_handler: Job [%d] (%d) terminated by signal %d\n",
-               PID2JID(jobs, pid), pid, WTERMSIG(status));
-    }
-
-    // terminated voluntarily or forcibaly
-    if (WIFEXITED(status) || WIFSIGNALED(status)) {
-      sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
-      // deletejob may be called twice when received SIGINT from user
-      deletejob(jobs, pid);
-      if (verbose) {
-        printf("sigchld_handler: Job [%d] (%d) deleted\n", jid, pid);
-      }
-      sigprocmask(SIG_SETMASK, &prev_all, NULL);
-    }
-
-    if (verbose) {
-      if (WIFEXITED(status)) {
-        printf("sigchld_handler: Job [%d] (%d) terminates OK (status %d)\n",
-               jid, pid, WEXITSTATUS(status));
-      }
-    }
+  while (reap_any(&ev, notified) > 0) {
+    sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
+    child_changed(&ev);
+    sigprocmask(SIG_SETMASK, &prev_all, NULL);
   }
 
   errno = olderrno;
   if (verbose) {
-    printf("sigchld_handler: exiting\n");
+    siolog_printf("sigchld_handler: exiting\n");
   }
 }
 
@@ -106,13 +308,7 @@ void sigtstp_handler(int sig) {
   sigfillset(&mask_all);
 
   sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
-  pid_t pid = fgPID(jobs);
-  // send SIGTSTP to foreground job's process grounp
-  kill(-pid, SIGTSTP);
-  printf("sigtstp_handler: Job [%d] (%d) stopped by signal %d\n",
-         PID2JID(jobs, pid), pid, sig);
-  struct job_t *stpjob = getjobPID(jobs, pid);
-  stpjob->state = ST;
+  stop_fg(sig);
   sigprocmask(SIG_SETMASK, &prev_all, NULL);
 
   errno = olderrno;
@@ -125,180 +321,1657 @@ void sigint_handler(int sig) {
   sigfillset(&mask_all);
 
   sigprocmask(SIG_BLOCK, &mask_all, &prev_all);
-  pid_t pid;
-  pid = fgPID(jobs);
-  if (pid == 0)
-    return;
-  kill(-pid, SIGINT);
-  printf("sigint_handler: Job [%d] (%d) terminated by signal %d\n",
-         PID2JID(jobs, pid), pid, sig);
-  deletejob(jobs, pid);
+  interrupt_fg(sig);
   sigprocmask(SIG_SETMASK, &prev_all, NULL);
 
   errno = olderrno;
 }
 
-void eval(char *cmdline) {
-  // initialize argv
-  for (int i = 0; i < MAXARGS; i++) {
-    argv[i] = NULL;
+int init_events(void) {
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTSTP);
+  sigaddset(&signals, SIGCHLD);
+  return event_init(&signals);
+}
+
+// stopped children are only reported by SIGCHLD, terminated ones come
+// through their pidfds unless some child could not get one
+static void collect_children(long notified) {
+  struct event_t ev;
+  if (nopidfd) {
+    while (reap_any(&ev, notified) > 0)
+      child_changed(&ev);
+    return;
+  }
+
+  siginfo_t info;
+  for (;;) {
+    memset(&info, 0, sizeof(info));
+    if (waitid(P_ALL, 0, &info, WSTOPPED | WNOHANG) < 0 || info.si_pid == 0)
+      break;
+    ev = (struct event_t){.pid = info.si_pid,
+                          .status = W_STOPCODE(info.si_status)};
+    child_changed(&ev);
+  }
+}
+
+// handle one event, waiting at most timeout ms for it
+// return 0 if there was none
+static int dispatch(int timeout) {
+  struct event_t ev;
+  if (event_next(&ev, timeout) <= 0)
+    return 0;
+
+  if (ev.type == EVENT_EXIT) {
+    child_changed(&ev);
+  } else if (ev.signo == SIGCHLD) {
+    collect_children(ev.notified);
+  } else if (ev.signo == SIGTSTP) {
+    stop_fg(ev.signo);
+  } else if (ev.signo == SIGINT) {
+    interrupt_fg(ev.signo);
   }
+  return 1;
+}
 
-  int is_bg = parseline(cmdline, argv);
-  if (argv[0] == NULL || strcmp(argv[0], "") == 0) {
-    // empty line
+void drain_events(void) {
+  // nothing can have happened without a job, which spares batch mode a
+  // system call per command
+  if (!event_active() || jobs.njobs == 0)
     return;
+  while (dispatch(0))
+    ;
+}
+
+// return flags a file of a redirection of type is opened with
+static int open_flags(int type) {
+  return type == REDIR_IN       ? O_RDONLY
+         : type == REDIR_APPEND ? O_WRONLY | O_CREAT | O_APPEND
+                                : O_WRONLY | O_CREAT | O_TRUNC;
+}
+
+// return the special parameters words are expanded with
+static struct expand_t expander(void) {
+  if (!shell_pid)
+    shell_pid = getpid();
+  return (struct expand_t){&arena,  last_status, shell_pid,  nparams,
+                           params,  substitute,  process_sub, globbing};
+}
+
+// store the signals the shell catches in caught, which are restored to
+// their default in a child before exec
+static void caught_signals(sigset_t *caught) {
+  sigemptyset(caught);
+  sigaddset(caught, SIGINT);
+  sigaddset(caught, SIGTSTP);
+  sigaddset(caught, SIGCHLD);
+  sigaddset(caught, SIGQUIT);
+}
+
+// hold off the handlers from reaping children until the shell knows them,
+// storing the mask its children are to start with in prev
+static void hold_sigchld(sigset_t *prev) {
+  if (event_active()) {
+    *prev = *event_sigmask();
+  } else if (nsubs) {
+    // held since the first <(...) or >(...) of the pipeline was started
+    *prev = sub_mask;
+  } else {
+    sigset_t mask_chld;
+    sigemptyset(&mask_chld);
+    sigaddset(&mask_chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask_chld, prev);
   }
+}
 
-  int is_builtin;
-  // if it is a builtin command
-  if ((is_builtin = builtin_cmd(argv)) == 1)
+// undo hold_sigchld, unless <(...) and >(...) still wait for their job
+static void release_sigchld(const sigset_t *prev) {
+  if (!event_active() && !nsubs)
+    sigprocmask(SIG_SETMASK, prev, NULL);
+}
+
+// return argv of fields, which it ends with a NULL, and their number in argc
+static char **fields_argv(struct fields_t *fields, int *argc) {
+  *argc = fields->n;
+  fields_add(fields, &arena, NULL);
+  return fields->v;
+}
+
+// return value of word, expanded unless it is plain, NULL if the expansion
+// failed
+static char *word_value(struct expand_t *x, const struct word_t *word) {
+  if (word->flags & WORD_EXPAND)
+    return expand_str(x, word->text, word->len);
+  return word_str(&arena, word);
+}
+
+// make act copy a sealed memfd holding text onto fd, for a here-document
+// or, with a newline after text, a here-string of type. The command reads it
+// like a file, without a process to feed a pipe or a file to remove.
+// return 0 on success, -1 after reporting an error
+static int here_doc(struct launch_action_t *act, int type, int fd,
+                    const char *text) {
+  *act = (struct launch_action_t){LAUNCH_DUP2, fd, fd};
+  if (ndocs == capdocs) {
+    int cap = capdocs ? capdocs * 2 : 4;
+    int *fdv = realloc(doc_fds, cap * sizeof(int));
+    if (!fdv) {
+      errorf("error: out of memory\n");
+      return -1;
+    }
+    doc_fds = fdv;
+    capdocs = cap;
+  }
+
+  // kept above the descriptors a command line redirects, so that a later
+  // redirection does not replace it before it is copied
+  int mfd = memfd_create("heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  int doc = mfd < 0 ? -1 : fcntl(mfd, F_DUPFD_CLOEXEC, 10);
+  if (mfd >= 0)
+    close(mfd);
+  if (doc < 0) {
+    errorf("here-document error: %s\n", strerror(errno));
+    return -1;
+  }
+  doc_fds[ndocs++] = doc;
+  const char *buf = text;
+  size_t len = strlen(text);
+  int newline = type == REDIR_HERESTRING;
+  while (len > 0 || newline) {
+    if (len == 0) {
+      buf = "\n";
+      len = 1;
+      newline = 0;
+    }
+    ssize_t n = write(doc, buf, len);
+    if (n < 0 && errno != EINTR) {
+      errorf("here-document error: %s\n", strerror(errno));
+      return -1;
+    }
+    if (n > 0) {
+      buf += n;
+      len -= n;
+    }
+  }
+  // the command gets the text as it is or does not run, the memfd is closed
+  // with the other ones of the line
+  if (fcntl(doc, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+    errorf("here-document error: %s\n", strerror(errno));
+    return -1;
+  }
+  lseek(doc, 0, SEEK_SET);
+  act->src = doc;
+  return 0;
+}
+
+// build the arguments, redirections and assignments of cmd into stage,
+// skipping the first skip words
+// return 0 on success, -1 if a word could not be expanded
+static int build_stage(struct stage_t *stage, const struct cmd_t *cmd,
+                       int skip) {
+  struct expand_t x = expander();
+  const struct word_t *word = cmd->words;
+  for (int i = 0; i < skip; i++)
+    word = word->next;
+
+  // a word with parameters or a pattern may expand to any number of fields
+  struct fields_t fields = {NULL, 0, 0};
+  for (; word; word = word->next) {
+    if (!(word->flags & (WORD_EXPAND | WORD_GLOB)))
+      fields_add(&fields, &arena, word_str(&arena, word));
+    else if (expand_fields(&x, word->text, word->len, &fields) < 0)
+      return -1;
+  }
+  stage->argv = fields_argv(&fields, &stage->argc);
+
+  stage->redirs =
+      arena_alloc(&arena, cmd->nredirs * sizeof(struct launch_action_t));
+  stage->nredirs = 0;
+  for (const struct redir_t *r = cmd->redirs; r; r = r->next) {
+    struct launch_action_t *act = &stage->redirs[stage->nredirs++];
+    if (r->type == REDIR_DUP) {
+      *act = (struct launch_action_t){LAUNCH_DUP2, r->fd,
+                                      (int)strtol(r->target.text, NULL, 10)};
+    } else if (r->type == REDIR_HEREDOC || r->type == REDIR_HERESTRING) {
+      const struct word_t *t = &r->target;
+      char *text = r->type == REDIR_HERESTRING ? word_value(&x, t)
+                   : t->flags & WORD_EXPAND
+                       ? expand_heredoc(&x, t->text, t->len)
+                       : arena_strndup(&arena, t->text, t->len);
+      if (!text || here_doc(act, r->type, r->fd, text) < 0)
+        return -1;
+    } else {
+      *act = (struct launch_action_t){.type = LAUNCH_OPEN,
+                                      .fd = r->fd,
+                                      .path = word_value(&x, &r->target),
+                                      .flags = open_flags(r->type),
+                                      .mode = 0666};
+      if (!act->path)
+        return -1;
+    }
+  }
+
+  stage->nassigns = cmd->nassigns;
+  stage->assigns = arena_alloc(&arena, cmd->nassigns * sizeof(char *));
+  int i = 0;
+  for (const struct word_t *a = cmd->assigns; a; a = a->next) {
+    if (!(stage->assigns[i++] = word_value(&x, a)))
+      return -1;
+  }
+  return 0;
+}
+
+// set the variables stage assigns for the time of a builtin, or for good if
+// it has no command
+// return previous values of the variables, "name" alone for those that were
+// not set, to restore with unassign
+static char **assign(struct stage_t *stage) {
+  if (stage->argc == 0) {
+    for (int i = 0; i < stage->nassigns; i++)
+      var_assign(stage->assigns[i], 0);
+    return NULL;
+  }
+
+  char **saved = arena_alloc(&arena, stage->nassigns * sizeof(char *));
+  for (int i = 0; i < stage->nassigns; i++) {
+    const char *a = stage->assigns[i];
+    size_t len = strchr(a, '=') - a;
+    const char *old = var_getn(a, len);
+    saved[i] = arena_alloc(&arena, len + (old ? strlen(old) + 1 : 0) + 1);
+    sprintf(saved[i], old ? "%.*s=%s" : "%.*s", (int)len, a, old);
+    var_assign(a, 0);
+  }
+  return saved;
+}
+
+static void unassign(struct stage_t *stage, char **saved) {
+  if (!saved)
     return;
+  for (int i = stage->nassigns - 1; i >= 0; i--) {
+    if (strchr(saved[i], '='))
+      var_assign(saved[i], 0);
+    else
+      var_unset(saved[i]);
+  }
+}
 
-  // if not, synchronize add and delete jobs
-  pid_t pid;
-  sigset_t mask_all, mask_one, prev_one;
+// run a builtin or lone redirections and assignments in the shell with the
+// redirections applied to it for the time of the command
+// return exit status of the command
+static int run_builtin(struct stage_t *stage, int builtin, int timed,
+                       struct phases_t *phases) {
+  int *saved = arena_alloc(&arena, stage->nredirs * sizeof(int));
+  phases->spawn = now();
+  last_status = 1;
+  if (redirect_shell(stage, saved) == 0) {
+    char **vars = assign(stage);
+    last_status = subst_status;
+    if (stage->argv[0])
+      last_status = builtin_cmd(builtin, stage->argc, stage->argv);
+    unassign(stage, vars);
+    restore_shell(stage, saved);
+  }
+  if (timed) {
+    long done = now();
+    siolog_printf("time: parse %ldns builtin %ldns total %ldns\n",
+                  phases->spawn - phases->parse, done - phases->spawn,
+                  done - phases->parse);
+  }
+  return last_status;
+}
+
+// run the stages of a pipeline, waiting for it unless bg is set. A single
+// stage is run in the shell if builtin is the id of a builtin or if it has no
+// command. text is the command line of the job, parsed when parsing of it
+// began.
+// return exit status of the pipeline, 0 for one in the background
+static int exec_pipeline(struct stage_t *stages, int nstages, int bg,
+                         int timed, int builtin, const char *text, int len,
+                         long parsed) {
+  struct phases_t phases = {.parse = parsed};
+  int i;
+
+  // a builtin is not a job, what it gave <(...) and >(...) is over with it
+  if (nstages == 1 && (builtin >= 0 || stages[0].argc == 0)) {
+    run_builtin(&stages[0], builtin, timed, &phases);
+    subs_finish(0);
+    docs_close(0);
+    return last_status;
+  }
+
+  // signals the shell catches must be restored to default in the child
+  sigset_t mask_all, prev_one, mask_caught;
+  caught_signals(&mask_caught);
+
+  // the event loop reaps children only when asked to, the handlers have to
+  // be held off until the job is added
+  int events = event_active();
   sigfillset(&mask_all);
-  sigemptyset(&mask_one);
-  sigaddset(&mask_one, SIGCHLD);
+  hold_sigchld(&prev_one);
 
-  // to make sure sigchld_handler triggered after job is added
-  // block SIGCHLD for parent process and child process
-  sigprocmask(SIG_BLOCK, &mask_one, &prev_one);
+  // every stage reads the pipe of the previous one and joins the process
+  // group of the first stage, or of the processes of <(...) and >(...) that
+  // lead the job. Pipes are close-on-exec, so a child keeps only the ends
+  // dup'd onto its stdin and stdout, and those of <(...) and >(...).
+  pid_t *pids = arena_alloc(&arena, (nsubs + nstages) * sizeof(pid_t));
+  int npids = nsubs;
+  if (nsubs)
+    memcpy(pids, sub_pids, nsubs * sizeof(pid_t));
+  for (i = 0; i < nsubs; i++)
+    fcntl(sub_fds[i], F_SETFD, 0);
+  int in = STDIN_FILENO;
+  // the main loop does not flush stdout in batch mode, what the shell has
+  // printed must come out before the output of the job
+  fflush(stdout);
+  phases.spawn = now();
+  for (i = 0; i < nstages; i++) {
+    int fds[2] = {-1, STDOUT_FILENO};
+    if (i < nstages - 1 && pipe2(fds, O_CLOEXEC) < 0) {
+      errorf("pipe error: %s\n", strerror(errno));
+      fds[0] = -1;
+      fds[1] = STDOUT_FILENO;
+    }
 
-  /* child process */
-  if ((pid = fork()) == 0) {
-    // give the child process a new gid to handle SIGINT correctly
-    setpgid(0, 0);
-    sigprocmask(SIG_SETMASK, &prev_one, NULL);
-    if (execve(argv[0], argv, environ) < 0) {
-      fprintf(stderr, "%s: Command not found\n", argv[0]);
-      exit(0);
+    int pidfd = -1;
+    // a child shell keeps its pipelines in its own group
+    pid_t pgid = subshell ? getpgrp() : npids ? pids[0] : 0;
+    pid_t pid = spawn_stage(&stages[i], pgid, in, fds[1], &prev_one,
+                            &mask_caught, events ? &pidfd : NULL, &phases);
+    if (pid > 0) {
+      pids[npids++] = pid;
+      if (events && event_watch(pid, pidfd) < 0)
+        nopidfd = 1;
     }
+
+    if (in != STDIN_FILENO)
+      close(in);
+    if (fds[1] != STDOUT_FILENO)
+      close(fds[1]);
+    in = fds[0];
+  }
+
+  for (i = 0; i < nsubs; i++)
+    close(sub_fds[i]);
+  docs_close(0);
+  if (npids == nsubs) {
+    subs_finish(0);
+    if (!events)
+      sigprocmask(SIG_SETMASK, &prev_one, NULL);
+    return last_status = 127;
   }
 
   /* shell process */
-  int p_state = is_bg ? BG : FG;
-  // replace '\n' with '\0'
-  cmdline[strlen(cmdline) - 1] = '\0';
-  // prevent any signal from interrupting the addjob routine
-  sigprocmask(SIG_BLOCK, &mask_all, NULL);
-  addjob(jobs, pid, p_state, cmdline);
-  // restore original mask state
-  sigprocmask(SIG_SETMASK, &prev_one, NULL);
+  int p_state = bg ? BG : FG;
+  char *cmdline = arena_strndup(&arena, text, len);
+  for (i = 0; events && i < nsubs; i++) {
+    if (event_watch(pids[i], -1) < 0)
+      nopidfd = 1;
+  }
+  nsubs = 0;
+  if (events) {
+    add_job(pids, npids, p_state, cmdline, timed ? &phases : NULL);
+  } else {
+    // prevent any signal from interrupting the addjob routine
+    sigprocmask(SIG_BLOCK, &mask_all, NULL);
+    add_job(pids, npids, p_state, cmdline, timed ? &phases : NULL);
+    // restore original mask state
+    sigprocmask(SIG_SETMASK, &prev_one, NULL);
+  }
+
+  if (bg)
+    return 0;
+  // the status is set when the job is done, stopped or interrupted
+  waitfg(pids[0]);
+  return last_status;
+}
+
+// run a pipeline, waiting for it unless it is in the background. parsed is
+// when parsing of its command line began.
+// return exit status of the pipeline, 0 for one in the background
+static int run_pipeline(struct node_t *node, long parsed) {
+  // time runs the rest of the pipeline and reports where its latency went
+  int timed = word_istime(node->cmds->words);
 
-  if (!is_bg) {
-    // not a backgroup request
-    waitfg(pid);
+  int nstages = node->ncmds;
+  struct stage_t *stages = arena_alloc(&arena, nstages * sizeof(struct stage_t));
+  subst_status = 0;
+  int i = 0;
+  for (const struct cmd_t *cmd = node->cmds; cmd; cmd = cmd->next, i++) {
+    if (build_stage(&stages[i], cmd, i == 0 ? timed : 0) < 0) {
+      subs_finish(0);
+      docs_close(0);
+      return last_status = 1;
+    }
+  }
+
+  // only a command that runs in the shell can do without a program
+  for (i = 0; nstages > 1 && i < nstages; i++) {
+    if (stages[i].argc == 0) {
+      printf("syntax error near unexpected token \'|\'\n");
+      subs_finish(0);
+      docs_close(0);
+      return last_status = 2;
+    }
   }
+
+  int builtin = -1;
+  if (nstages == 1 && stages[0].argc > 0)
+    builtin = builtin_find(stages[0].argv[0]);
+  return exec_pipeline(stages, nstages, node->bg, timed, builtin, node->text,
+                       node->len, parsed);
 }
 
-void waitfg(pid_t pid) {
-  // prevent SIGCHLD from being received at <=
-  // in that case, SIGCHLD won't be catched and it causes infinite loop
-  sigset_t mask_chld, prev_chld;
-  sigemptyset(&mask_chld);
-  sigaddset(&mask_chld, SIGCHLD);
+// run the pipelines of an and-or list as far as their statuses say
+// return exit status of the last pipeline run
+static int run_andor(struct node_t *node, long parsed) {
+  if (node->type == NODE_PIPE)
+    return run_pipeline(node, parsed);
 
-  sigprocmask(SIG_BLOCK, &mask_chld, &prev_chld);
-  while (fgPID(jobs)) {
-    // <=
-    sigsuspend(&prev_chld);
+  int status = run_andor(node->left, parsed);
+  if ((status == 0) == (node->type == NODE_AND))
+    status = run_andor(node->right, now());
+  return status;
+}
+
+// fork a child shell, which has no jobs of its own and takes the signals of
+// the job it runs in like any other process of it, in the process group
+// pgid (0 for a new group). Signals are left blocked in the shell, the mask
+// to restore is in *prev.
+// return pid of the child in the shell, 0 in the child, -1 on error
+static pid_t fork_shell(pid_t pgid, sigset_t *prev) {
+  int events = event_active();
+  sigset_t mask_all;
+  sigfillset(&mask_all);
+
+  // nothing buffered may be written twice
+  fflush(stdout);
+  siolog_flush();
+  sigprocmask(SIG_BLOCK, &mask_all, prev);
+  if (!shell_pid)
+    shell_pid = getpid();
+  pid_t pid = fork();
+  if (pid < 0) {
+    errorf("fork error: %s\n", strerror(errno));
+    sigprocmask(SIG_SETMASK, prev, NULL);
+    return -1;
   }
-  // restore mask
-  sigprocmask(SIG_SETMASK, &prev_chld, NULL);
 
-  if (verbose) {
-    printf("waitfg: Process (%d) no longer the foreground process\n", pid);
+  if (pid == 0) {
+    // the child waits for its pipelines with the handlers, and whatever was
+    // started for a pipeline of the shell is not its own
+    setpgid(0, pgid);
+    subshell = 1;
+    nsubs = 0;
+    Signal(SIGINT, SIG_DFL);
+    Signal(SIGTSTP, SIG_DFL);
+    Signal(SIGCHLD, sigchld_handler);
+    if (events) {
+      event_close();
+      *prev = *event_sigmask();
+    }
+    freejobs(&jobs);
+    initjobs(&jobs);
+    sigdelset(prev, SIGCHLD);
+    sigprocmask(SIG_SETMASK, prev, NULL);
+    return 0;
   }
+  setpgid(pid, pgid ? pgid : pid);
+  return pid;
 }
 
-// return 1 and execute builtin command immediately, and 0 otherwise
-int builtin_cmd(char *argv[]) {
-  // resolve builtin command if it is valid
-  if (strcmp(*argv, "quit") == 0 && argc == 1) {
-    exit(0);
-    return 1;
-  } else if (strcmp(*argv, "jobs") == 0 && argc == 1) {
-    listjobs(jobs);
-    return 1;
-  } else if ((strcmp(*argv, "fg") == 0 && argc == 2) ||
-             (strcmp(*argv, "bg") == 0 && argc == 2)) {
-    do_bgfg(argv);
-    return 1;
+// start a child shell for a list followed by &, which is one job in the
+// background like a pipeline would be. text is the command line of the job.
+// return 0 in the child, which runs the list and ends with exit_subshell, 1
+// in the shell
+static int fork_subshell(const char *text, int len) {
+  char *cmdline = arena_strndup(&arena, text, len);
+  sigset_t prev_all;
+  pid_t pid = fork_shell(0, &prev_all);
+  if (pid <= 0)
+    return pid < 0;
+
+  if (event_active() && event_watch(pid, -1) < 0)
+    nopidfd = 1;
+  add_job(&pid, 1, BG, cmdline, NULL);
+  sigprocmask(SIG_SETMASK, &prev_all, NULL);
+  return 1;
+}
+
+// end the child shell of a background list
+static void exit_subshell(int status) {
+  // exit() would also move the offset of a shared stdin back to what the
+  // child has read of it
+  fflush(stdout);
+  siolog_flush();
+  _exit(status);
+}
+
+// run an and-or list followed by & in a child shell
+static void run_subshell(struct node_t *node, long parsed) {
+  if (fork_subshell(node->text, node->len) == 0)
+    exit_subshell(run_andor(node, parsed));
+}
+
+// parse and run the commands of src, a script called name or the command
+// line if name is NULL. With more, a command that src ends inside of is left
+// for more input, with what it waits for in *more.
+// return number of bytes of src used, all of them unless a command is left
+static size_t run_source(const char *name, const char *src, size_t len,
+                         struct pending_t *more) {
+  struct parser_t parser;
+  struct node_t *list;
+  int rc;
+
+  // every complete command is parsed and run before the next one is read
+  struct arena_mark_t mark = arena_mark(&arena);
+  long nallocs = arena.nallocs;
+  long nmallocs = arena.nmallocs;
+  parser_init(&parser, &arena, src, len);
+  long parsed = now();
+  const char *start = parser.pos;
+  while ((rc = parse_next(&parser, &list)) != 0) {
+    if (more && parser.more.incomplete) {
+      *more = parser.more;
+      arena_release(&arena, mark);
+      return start - src;
+    }
+    if (rc < 0) {
+      if (name)
+        printf("%s: line %d: %s\n", name, parser.errline, parser.error);
+      else
+        printf("%s\n", parser.error);
+      last_status = 2;
+    }
+    for (struct node_t *node = list; node; node = node->next) {
+      if (node->bg && node->type != NODE_PIPE)
+        run_subshell(node, parsed);
+      else
+        run_andor(node, parsed);
+      parsed = now();
+    }
+    arena_release(&arena, mark);
+
+    // a warm arena serves a command like the last one without malloc
+    if (list && allocstat) {
+      printf("alloc: %ld allocations, %ld mallocs, %zu bytes reserved\n",
+             arena.nallocs - nallocs, arena.nmallocs - nmallocs,
+             arena.reserved);
+    }
+    nallocs = arena.nallocs;
+    nmallocs = arena.nmallocs;
+
+    // a script does not come back to the main loop between its commands
+    if (name) {
+      drain_events();
+      siolog_flush();
+    }
+    start = parser.pos;
+  }
+  return len;
+}
+
+// read fd to its end into the arena, in a buffer of size bytes at first
+// return what was read, its length in *len
+static char *read_all(int fd, size_t size, size_t *len) {
+  char *buf = arena_alloc(&arena, size);
+  size_t n = 0;
+  for (;;) {
+    if (n == size) {
+      char *bigger = arena_alloc(&arena, size * 2);
+      memcpy(bigger, buf, n);
+      buf = bigger;
+      size *= 2;
+    }
+    ssize_t r = read(fd, buf + n, size - n);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      break;
+    n += r;
+  }
+  *len = n;
+  return buf;
+}
+
+// return exit status of the child pid, which is waited for
+static int wait_status(pid_t pid) {
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR)
+      return 127;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// return a pipe for the output of a command substitution in fds, -1 after
+// reporting an error
+static int subst_pipe(int fds[2]) {
+  if (pipe2(fds, O_CLOEXEC) < 0) {
+    errorf("pipe error: %s\n", strerror(errno));
+    return -1;
+  }
+  fcntl(fds[1], F_SETPIPE_SZ, SUBST_PIPE_SIZE);
+  return 0;
+}
+
+// run a builtin in the shell with what it writes to stdout kept in memory:
+// fd 1 is pointed at a memfd while it runs, which has no pipe to fill. Only
+// builtins without BUILTIN_STATE get here, like echo, printf or test, whose
+// words are expanded before they run, so none of them captures again and one
+// memfd serves them all, each capture reading on from where the last ended.
+// return exit status of the builtin
+static int capture_builtin(struct stage_t *stage, int builtin, char **out,
+                           size_t *outlen) {
+  static int fd = -1;
+  static off_t start; /* end of what the last capture wrote */
+  if (fd < 0) {
+    if ((fd = memfd_create("subst", MFD_CLOEXEC)) < 0) {
+      errorf("memfd_create error: %s\n", strerror(errno));
+      return -1;
+    }
+    start = 0;
+  }
+  // what stdout holds already goes where stdout went
+  fflush(stdout);
+  int saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+  dup2(fd, STDOUT_FILENO);
+  struct phases_t phases = {0};
+  int status = run_builtin(stage, builtin, 0, &phases);
+  fflush(stdout);
+  if (saved >= 0) {
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+  } else {
+    close(STDOUT_FILENO);
+  }
+
+  off_t end = lseek(fd, 0, SEEK_CUR);
+  size_t len = end > start ? end - start : 0;
+  char *buf = arena_alloc(&arena, len + 1);
+  size_t got = 0;
+  while (got < len) {
+    ssize_t n = pread(fd, buf + got, len - got, start + got);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    got += n;
+  }
+  buf[got] = '\0';
+  *out = buf;
+  *outlen = got;
+
+  if (end > CAPTURE_MAX && ftruncate(fd, 0) == 0)
+    end = lseek(fd, 0, SEEK_SET);
+  if (end >= 0) {
+    start = end;
+  } else {
+    close(fd);
+    fd = -1;
   }
+  return status;
+}
 
+// read the file of $(<file)
+// return 0, 1 if the file cannot be read
+static int capture_file(const char *path, char **out, size_t *outlen) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    errorf("%s: %s\n", path, strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return 1;
+  }
+  *out = read_all(fd, st.st_size + 1, outlen);
+  close(fd);
   return 0;
 }
 
-// TODO: continue the process as a foreground job or a background job
-void do_bgfg(char *argv[]) {
-  char *cmd = (char *)malloc(strlen(argv[0]) + 1);
-  strcpy(cmd, argv[0]);
+// start the program of stage with its output into a pipe, and read it
+// return exit status of the program
+static int capture_program(struct stage_t *stage, char **out,
+                           size_t *outlen) {
+  int fds[2];
+  if (subst_pipe(fds) < 0)
+    return -1;
+
+  // as for a pipeline, the child is not reaped by the handlers
+  sigset_t prev, caught;
+  caught_signals(&caught);
+  hold_sigchld(&prev);
+
+  fflush(stdout);
+  struct phases_t phases = {0};
+  pid_t pid = spawn_stage(stage, subshell ? getpgrp() : 0, STDIN_FILENO,
+                          fds[1], &prev, &caught, NULL, &phases);
+  close(fds[1]);
+  int status = 127;
+  if (pid > 0) {
+    *out = read_all(fds[0], 4096, outlen);
+    status = wait_status(pid);
+  }
+  close(fds[0]);
+  release_sigchld(&prev);
+  return status;
+}
+
+// run a command in a child shell with its output into a pipe, and read it.
+// The child runs stage with builtin if it is not NULL, the commands of len
+// bytes at text otherwise.
+// return exit status of the child
+static int capture_shell(struct stage_t *stage, int builtin,
+                         const char *text, int len, char **out,
+                         size_t *outlen) {
+  int fds[2];
+  if (subst_pipe(fds) < 0)
+    return -1;
+
+  sigset_t prev;
+  pid_t pid = fork_shell(0, &prev);
+  if (pid == 0) {
+    close(fds[0]);
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[1]);
+    if (stage) {
+      struct phases_t phases = {0};
+      exit_subshell(run_builtin(stage, builtin, 0, &phases));
+    }
+    run_source(NULL, text, len, NULL);
+    exit_subshell(last_status);
+  }
+
+  close(fds[1]);
+  int status = -1;
+  if (pid > 0) {
+    // the child is waited for here, not by the handlers
+    sigset_t mask_chld = prev;
+    sigaddset(&mask_chld, SIGCHLD);
+    sigprocmask(SIG_SETMASK, &mask_chld, NULL);
+    *out = read_all(fds[0], 4096, outlen);
+    status = wait_status(pid);
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+  }
+  close(fds[0]);
+  return status;
+}
+
+// return the pipeline of the commands of len bytes at text, parsed into the
+// arena, if they are one simple command to run in the foreground, NULL
+// otherwise
+static struct node_t *simple_command(const char *text, int len) {
+  struct parser_t parser;
+  struct node_t *list, *node = NULL;
+  int rc;
+  parser_init(&parser, &arena, text, len);
+  while ((rc = parse_next(&parser, &list)) != 0) {
+    if (rc < 0 || (list && (node || list->next)))
+      return NULL;
+    if (list)
+      node = list;
+  }
+  if (!node || node->type != NODE_PIPE || node->bg || node->ncmds != 1)
+    return NULL;
+  // time reports where the latency of a pipeline went, see run_pipeline
+  if (word_istime(node->cmds->words))
+    return NULL;
+  return node;
+}
+
+// run the command of a $(...) or `...` for expand, see command_t. A simple
+// command is expanded once, in the shell: a builtin that leaves the shell as
+// it is runs in it with its output kept in memory, $(<file) reads the file
+// and a program is started with its output into a pipe, without a child
+// shell. Anything else runs in a child shell.
+static int substitute(struct expand_t *x, const char *text, int len,
+                      char **out, size_t *outlen) {
+  *out = NULL;
+  *outlen = 0;
+  struct node_t *node = simple_command(text, len);
+  int status;
+  struct stage_t stage;
+  int builtin = -1;
+  int base = nsubs;
+  int docs = ndocs;
+  if (!node) {
+    status = capture_shell(NULL, -1, text, len, out, outlen);
+  } else if (build_stage(&stage, node->cmds, 0) < 0) {
+    status = 1;
+  } else {
+    if (stage.argc > 0)
+      builtin = builtin_find(stage.argv[0]);
+    const struct launch_action_t *r = stage.redirs;
+    for (int i = base; i < nsubs; i++)
+      fcntl(sub_fds[i], F_SETFD, 0);
+    if (builtin >= 0 && !(builtins[builtin].flags & BUILTIN_STATE) &&
+        stage.nredirs == 0)
+      status = capture_builtin(&stage, builtin, out, outlen);
+    else if (stage.argc == 0 && stage.nassigns == 0 && stage.nredirs == 1 &&
+             r->type == LAUNCH_OPEN && r->fd == STDIN_FILENO)
+      status = capture_file(r->path, out, outlen);
+    else if (stage.argc > 0 && builtin < 0)
+      status = capture_program(&stage, out, outlen);
+    else
+      status = capture_shell(&stage, builtin, text, len, out, outlen);
+  }
+  subs_finish(base);
+  docs_close(docs);
+  if (status >= 0)
+    subst_status = status;
+  return status;
+}
+
+// start the command of a <(...) or >(...) for expand, see process_t. It
+// joins the process group of the job, which the processes of the pipeline
+// join when they are launched. A program is launched with the pipe as its
+// stdin or stdout, anything else runs in a child shell.
+static char *process_sub(struct expand_t *x, const char *text, int len,
+                         int input) {
+  struct node_t *node = simple_command(text, len);
+  struct stage_t stage;
+  struct phases_t phases = {0};
+  int base = nsubs;
+  int docs = ndocs;
+  if (node && build_stage(&stage, node->cmds, 0) < 0) {
+    subs_finish(base);
+    docs_close(docs);
+    return NULL;
+  }
+  int builtin = node && stage.argc > 0 ? builtin_find(stage.argv[0]) : -1;
+
+  // the lists outlive the arena, which a command line releases
+  if (nsubs == capsubs) {
+    int cap = capsubs ? capsubs * 2 : 4;
+    pid_t *pids = realloc(sub_pids, cap * sizeof(pid_t));
+    if (pids)
+      sub_pids = pids;
+    int *fdv = pids ? realloc(sub_fds, cap * sizeof(int)) : NULL;
+    if (!fdv) {
+      errorf("error: out of memory\n");
+      subs_finish(base);
+      docs_close(docs);
+      return NULL;
+    }
+    sub_fds = fdv;
+    capsubs = cap;
+  }
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) < 0) {
+    errorf("pipe error: %s\n", strerror(errno));
+    subs_finish(base);
+    docs_close(docs);
+    return NULL;
+  }
+  int in = input ? fds[0] : STDIN_FILENO;
+  int out = input ? STDOUT_FILENO : fds[1];
+
+  sigset_t held, prev;
+  hold_sigchld(&held);
+  if (nsubs == 0)
+    sub_mask = held;
+  pid_t pgid = subshell ? getpgrp() : nsubs ? sub_pids[0] : 0;
+  pid_t pid;
+  if (node && stage.argc > 0 && builtin < 0) {
+    // what was started for the words of the program is its own
+    for (int i = base; i < nsubs; i++)
+      fcntl(sub_fds[i], F_SETFD, 0);
+    sigset_t caught;
+    caught_signals(&caught);
+    fflush(stdout);
+    pid = spawn_stage(&stage, pgid, in, out, &held, &caught, NULL, &phases);
+  } else if ((pid = fork_shell(pgid, &prev)) == 0) {
+    // the pipes of the others are for the command line only
+    for (int i = 0; i < base; i++)
+      close(sub_fds[i]);
+    dup2(input ? in : out, input ? STDIN_FILENO : STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    if (node)
+      exit_subshell(run_builtin(&stage, builtin, 0, &phases));
+    run_source(NULL, text, len, NULL);
+    exit_subshell(last_status);
+  } else if (pid > 0) {
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+  }
+
+  close(input ? in : out);
+  docs_close(docs);
+  int fd = input ? fds[1] : fds[0];
+  if (pid < 0) {
+    close(fd);
+    subs_finish(base);
+    release_sigchld(&held);
+    return NULL;
+  }
+  sub_pids[nsubs] = pid;
+  sub_fds[nsubs++] = fd;
+  char *path = arena_alloc(&arena, 24);
+  snprintf(path, 24, "/dev/fd/%d", fd);
+  return path;
+}
 
-  if (argc != 2) {
-    fprintf(stderr, "do_bgfg: expected 1 argument, but got %d\n", argc);
-    free(cmd);
+// close the ends of the pipes of <(...) and >(...) from first on that the
+// shell has, and wait for their processes, which the command line that was
+// to read or write them no longer does
+static void subs_finish(int first) {
+  if (nsubs <= first)
     return;
+  for (int i = first; i < nsubs; i++)
+    close(sub_fds[i]);
+  for (int i = first; i < nsubs; i++)
+    wait_status(sub_pids[i]);
+  nsubs = first;
+  release_sigchld(&sub_mask);
+}
+
+// close the memfds of here-documents from first on, which the commands that
+// read them have copied by now
+static void docs_close(int first) {
+  for (int i = first; i < ndocs; i++)
+    close(doc_fds[i]);
+  if (ndocs > first)
+    ndocs = first;
+}
+
+// the text of a string with CODE_EXPAND, to expand
+#define CODE_TEXT(str, off)                                                    \
+  (str) + ((off) & ~CODE_EXPAND), (int)strlen((str) + ((off) & ~CODE_EXPAND))
+
+// return value of a string of code with CODE_VAR, the text before its '$'
+// followed by the value of the variable after it
+static char *code_var(const char *str, uint32_t off) {
+  const char *text = str + (off & ~CODE_VAR);
+  const char *dollar = strchr(text, '$');
+  const char *value = var_get(dollar + 1);
+  size_t nprefix = dollar - text;
+  size_t len = value ? strlen(value) : 0;
+  char *s = arena_alloc(&arena, nprefix + len + 1);
+  memcpy(s, text, nprefix);
+  memcpy(s + nprefix, value ? value : "", len + 1);
+  return s;
+}
+
+// return value of a string of code, expanded if it has CODE_EXPAND, NULL if
+// the expansion failed
+static char *code_value(struct expand_t *x, const char *str, uint32_t off) {
+  if (off & CODE_EXPAND)
+    return expand_str(x, CODE_TEXT(str, off));
+  if (off & CODE_VAR)
+    return code_var(str, off);
+  return (char *)str + off;
+}
+
+// run the pipeline of OP_PIPE at *pc, moving *pc past it. Plain words and
+// paths are used where they are in the code.
+// return exit status of the pipeline, 0 for one in the background
+static int run_code_pipeline(const struct code_t *code, uint32_t *pc,
+                             long parsed) {
+  const uint32_t *op = code->code + *pc;
+  const char *str = code->strings;
+  int nstages = op[1];
+  int bg = op[2];
+  int timed = op[3];
+  int builtin = (int)op[4];
+  const char *text = str + op[5];
+  op += 6;
+
+  // the whole pipeline is read before an expansion can fail
+  struct expand_t x = expander();
+  int failed = 0;
+  struct stage_t *stages = arena_alloc(&arena, nstages * sizeof(struct stage_t));
+  subst_status = 0;
+  for (int i = 0; i < nstages; i++) {
+    struct stage_t *stage = &stages[i];
+    int nwords = *op++;
+    stage->nredirs = *op++;
+    stage->nassigns = *op++;
+    if (i == 0 && nwords > 0 && (*op & (CODE_EXPAND | CODE_VAR)))
+      builtin = -2;
+    struct fields_t fields = {NULL, 0, 0};
+    for (int j = 0; j < nwords; j++, op++) {
+      if (*op & CODE_VAR)
+        fields_add(&fields, &arena, code_var(str, *op));
+      else if (!(*op & CODE_EXPAND))
+        fields_add(&fields, &arena, (char *)str + *op);
+      else if (expand_fields(&x, CODE_TEXT(str, *op), &fields) < 0)
+        failed = 1;
+    }
+    stage->argv = fields_argv(&fields, &stage->argc);
+
+    stage->redirs =
+        arena_alloc(&arena, stage->nredirs * sizeof(struct launch_action_t));
+    for (int j = 0; j < stage->nredirs; j++, op += 3) {
+      if (op[0] == REDIR_DUP) {
+        stage->redirs[j] =
+            (struct launch_action_t){LAUNCH_DUP2, op[1], (int)op[2]};
+      } else if (op[0] == REDIR_HEREDOC || op[0] == REDIR_HERESTRING) {
+        // the body of a here-document is kept as it was written
+        const char *text = op[0] == REDIR_HEREDOC && (op[2] & CODE_EXPAND)
+                               ? expand_heredoc(&x, CODE_TEXT(str, op[2]))
+                               : code_value(&x, str, op[2]);
+        failed |= !text || here_doc(&stage->redirs[j], op[0], op[1], text) < 0;
+      } else {
+        const char *path = code_value(&x, str, op[2]);
+        failed |= !path;
+        stage->redirs[j] = (struct launch_action_t){.type = LAUNCH_OPEN,
+                                                    .fd = op[1],
+                                                    .path = path,
+                                                    .flags = open_flags(op[0]),
+                                                    .mode = 0666};
+      }
+    }
+
+    stage->assigns = arena_alloc(&arena, stage->nassigns * sizeof(char *));
+    for (int j = 0; j < stage->nassigns; j++, op++)
+      failed |= !(stage->assigns[j] = code_value(&x, str, *op));
+  }
+
+  *pc = op - code->code;
+  if (failed) {
+    subs_finish(0);
+    docs_close(0);
+    return last_status = 1;
+  }
+  // a command name with parameters is looked up once it is expanded
+  if (builtin == -2)
+    builtin = nstages == 1 && stages[0].argc > 0
+                  ? builtin_find(stages[0].argv[0])
+                  : -1;
+  return exec_pipeline(stages, nstages, bg, timed, builtin, text,
+                       strlen(text), parsed);
+}
+
+// run the code of a script called name from pc up to end
+// return exit status of the last pipeline run
+static int run_code(const char *name, const struct code_t *code, uint32_t pc,
+                    uint32_t end) {
+  const uint32_t *op = code->code;
+  const char *str = code->strings;
+  int status = last_status;
+
+  struct arena_mark_t mark = arena_mark(&arena);
+  long nallocs = arena.nallocs;
+  long nmallocs = arena.nmallocs;
+  long parsed = now();
+  while (pc < end) {
+    switch (op[pc]) {
+    case OP_PIPE:
+      status = run_code_pipeline(code, &pc, parsed);
+      parsed = now();
+      break;
+    case OP_AND:
+      pc = status == 0 ? pc + 2 : op[pc + 1];
+      break;
+    case OP_OR:
+      pc = status != 0 ? pc + 2 : op[pc + 1];
+      break;
+    case OP_SUBSHELL:
+      if (fork_subshell(str + op[pc + 2], strlen(str + op[pc + 2])) == 0)
+        exit_subshell(run_code(name, code, pc + 3, op[pc + 1]));
+      pc = op[pc + 1];
+      parsed = now();
+      break;
+    case OP_ERROR:
+      if (op[pc + 1])
+        printf("%s: line %d: %s\n", name, op[pc + 1], str + op[pc + 2]);
+      else
+        printf("%s\n", str + op[pc + 2]);
+      status = last_status = 2;
+      drain_events();
+      siolog_flush();
+      pc += 3;
+      break;
+    case OP_END:
+      arena_release(&arena, mark);
+      if (allocstat) {
+        printf("alloc: %ld allocations, %ld mallocs, %zu bytes reserved\n",
+               arena.nallocs - nallocs, arena.nmallocs - nmallocs,
+               arena.reserved);
+      }
+      nallocs = arena.nallocs;
+      nmallocs = arena.nmallocs;
+      drain_events();
+      siolog_flush();
+      parsed = now();
+      pc++;
+      break;
+    }
+  }
+  return status;
+}
+
+// builtins of compiled scripts are found by name, their arguments are
+// checked when they run
+static int resolve_builtin(char *argv[], int argc) {
+  return builtin_find(argv[0]);
+}
+
+size_t eval(const char *cmdline, size_t len, struct pending_t *more) {
+  return run_source(NULL, cmdline, len, more);
+}
+
+int source_file(const char *path, int argc, char *argv[]) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    errorf("%s: %s\n", path, strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return last_status = 1;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    errorf("%s: not a regular file\n", path);
+    close(fd);
+    return last_status = 1;
+  }
+
+  // a script compiled since it was last modified is not read again
+  struct code_t *code = compiled ? code_cache_get(path, &st) : NULL;
+
+  // otherwise it is parsed where it is mapped, words are slices of it
+  size_t len = st.st_size;
+  char *src = NULL;
+  if (!code && len > 0) {
+    src = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (src == MAP_FAILED) {
+      errorf("%s: %s\n", path, strerror(errno));
+      close(fd);
+      return last_status = 1;
+    }
+    madvise(src, len, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  if (compiled && !code) {
+    code = compile(src, len, resolve_builtin);
+    code_cache_put(path, &st, code);
   }
 
-  if (strcmp(cmd, "fg") != 0 && strcmp(cmd, "bg") != 0) {
-    fprintf(stderr, "do_bgfg: invalid command \'%s\'\n", cmd);
+  int saved_nparams = nparams;
+  char **saved_params = params;
+  nparams = argc;
+  params = argv;
+  last_status = 0;
+  if (code)
+    run_code(path, code, 0, code->ncode);
+  else
+    run_source(path, src, len, NULL);
+  nparams = saved_nparams;
+  params = saved_params;
+
+  if (code)
+    code_release(code);
+  if (src)
+    munmap(src, len);
+  return last_status;
+}
+
+// add the launched pipeline as a job, timed if phases is not NULL
+static void add_job(pid_t *pids, int npids, int state, char *cmdline,
+                    struct phases_t *phases) {
+  if (addjobv(&jobs, pids, npids, state, cmdline) == FAILURE || !phases)
     return;
+  struct job_t *job = getjobPID(&jobs, pids[0]);
+  job->timed = 1;
+  job->phases = *phases;
+}
+
+// start one stage of a pipeline reading from in and writing to out, in the
+// process group pgid (0 for a new group). A pidfd of the stage is stored in
+// pidfd unless it is NULL, and the times of its launch in phases.
+// return pid of the stage, -1 if it cannot be executed
+static pid_t spawn_stage(struct stage_t *stage, pid_t pgid, int in, int out,
+                         const sigset_t *mask, const sigset_t *caught,
+                         int *pidfd, struct phases_t *phases) {
+  char **argv = stage->argv;
+  if (!argv[0])
+    return -1;
+
+  // resolve the program through PATH unless a path is given
+  const char *path = argv[0];
+  int execfd = 0;
+  if (!strchr(argv[0], '/')) {
+    struct pathent_t *ent = pathcache_lookup(argv[0]);
+    if (!ent) {
+      errorf("%s: Command not found\n", argv[0]);
+      return -1;
+    }
+    path = ent->path;
+    if (ent->fd > 0)
+      execfd = ent->fd;
   }
 
+  // pipes first, so that redirections of the stage take precedence
+  struct launch_action_t *actions = arena_alloc(
+      &arena, (stage->nredirs + 2) * sizeof(struct launch_action_t));
+  int nactions = 0;
+  if (in != STDIN_FILENO)
+    actions[nactions++] = (struct launch_action_t){LAUNCH_DUP2, 0, in};
+  if (out != STDOUT_FILENO)
+    actions[nactions++] = (struct launch_action_t){LAUNCH_DUP2, 1, out};
+  for (int i = 0; i < stage->nredirs; i++)
+    actions[nactions++] = stage->redirs[i];
+
+  // give the child process a new gid to handle SIGINT correctly, and unblock
+  // SIGCHLD in it before exec
+  struct launch_t spec = {
+      .path = path,
+      .execfd = execfd,
+      .argv = argv,
+      .envp = stage->nassigns ? var_environ_with(&arena, stage->assigns,
+                                                 stage->nassigns)
+                              : var_environ(),
+      .pgid = pgid,
+      .sigmask = mask,
+      .sigdefault = caught,
+      .actions = actions,
+      .nactions = nactions,
+      .pidfd = pidfd,
+  };
+
+  pid_t pid = launch(&spec);
+  phases->forked = spec.forked;
+  phases->execed = spec.execed;
+  if (pid < 0) {
+    if (spec.failed >= 0)
+      redir_error(&actions[spec.failed]);
+    else
+      errorf("%s: Command not found\n", argv[0]);
+  }
+  return pid;
+}
+
+static void redir_error(const struct launch_action_t *act) {
+  if (act->type == LAUNCH_OPEN)
+    errorf("%s: %s\n", act->path, strerror(errno));
+  else
+    errorf("%d: %s\n", act->src, strerror(errno));
+}
+
+// apply the redirections of a stage to the shell itself, saving the
+// descriptors they replace
+// return 0 on success, -1 if a redirection fails
+static int redirect_shell(struct stage_t *stage, int *saved) {
+  if (stage->nredirs == 0)
+    return 0;
+
+  fflush(stdout);
+  for (int i = 0; i < stage->nredirs; i++) {
+    saved[i] = fcntl(stage->redirs[i].fd, F_DUPFD_CLOEXEC, 10);
+  }
+
+  int failed;
+  int err = launch_apply(stage->redirs, stage->nredirs, &failed);
+  if (err != 0) {
+    restore_shell(stage, saved);
+    errno = err;
+    redir_error(&stage->redirs[failed]);
+    return -1;
+  }
+  return 0;
+}
+
+// undo redirect_shell in reverse order
+static void restore_shell(struct stage_t *stage, int *saved) {
+  if (stage->nredirs == 0)
+    return;
+
+  fflush(stdout);
+  for (int i = stage->nredirs - 1; i >= 0; i--) {
+    int fd = stage->redirs[i].fd;
+    if (saved[i] >= 0) {
+      dup2(saved[i], fd);
+      close(saved[i]);
+    } else {
+      close(fd);
+    }
+  }
+}
+
+void waitfg(pid_t pid) {
+  if (event_active()) {
+    // sleep until an event changes the foreground job
+    while (fgPID(&jobs))
+      dispatch(-1);
+  } else {
+    // prevent SIGCHLD from being received at <=
+    // in that case, SIGCHLD won't be catched and it causes infinite loop
+    sigset_t mask_chld, prev_chld;
+    sigemptyset(&mask_chld);
+    sigaddset(&mask_chld, SIGCHLD);
+
+    sigprocmask(SIG_BLOCK, &mask_chld, &prev_chld);
+    while (fgPID(&jobs)) {
+      // <=
+      sigsuspend(&prev_chld);
+    }
+    // restore mask
+    sigprocmask(SIG_SETMASK, &prev_chld, NULL);
+  }
+
+  if (verbose) {
+    siolog_printf("waitfg: Process (%d) no longer the foreground process\n",
+                  pid);
+  }
+}
+
+// the registry of builtins, indexed by the ids gen-builtins made of
+// builtins.txt
+const struct builtin_t builtins[NBUILTINS] = {
+    [BUILTIN_QUIT] = {do_quit, 0, 0, BUILTIN_STATE, "", "exit the shell"},
+    [BUILTIN_JOBS] = {do_jobs, 0, 1, 0, "[-l]",
+                      "list jobs, with the pid of every process with -l"},
+    [BUILTIN_FG] = {do_fg, 1, 1, BUILTIN_JOBCTL | BUILTIN_STATE,
+                    "%jobid|pid", "continue a job in the foreground"},
+    [BUILTIN_BG] = {do_bg, 1, 1, BUILTIN_JOBCTL | BUILTIN_STATE,
+                    "%jobid|pid", "continue a job in the background"},
+    [BUILTIN_SET] = {do_set, 0, 1, BUILTIN_STATE, "[option=value]",
+                     "list shell options, or change one"},
+    [BUILTIN_HASH] = {do_hash, 0, -1, BUILTIN_STATE, "[-r] [name...]",
+                      "list the PATH cache, clear it, or resolve names"},
+    [BUILTIN_SOURCE] = {do_source, 1, -1, BUILTIN_STATE, "script [args...]",
+                        "run a script in this shell"},
+    [BUILTIN_HELP] = {do_help, 0, 1, 0, "[builtin]", "describe builtins"},
+    [BUILTIN_COMPGEN] = {do_compgen, 1, 2, 0, "-b [prefix]",
+                         "list builtins starting with prefix"},
+    [BUILTIN_ECHO] = {do_echo, 0, -1, 0, "[-neE] [arg...]",
+                      "write arguments, separated by spaces"},
+    [BUILTIN_PRINTF] = {do_printf, 1, -1, 0, "format [arg...]",
+                        "write arguments as format has them"},
+    [BUILTIN_TEST] = {do_test, 0, -1, 0, "[expr]",
+                      "evaluate a conditional expression"},
+    [BUILTIN_BRACKET] = {do_test, 0, -1, 0, "[expr] ]",
+                         "evaluate a conditional expression"},
+    [BUILTIN_TRUE] = {do_true, 0, -1, 0, "", "return success"},
+    [BUILTIN_FALSE] = {do_false, 0, -1, 0, "", "return failure"},
+    [BUILTIN_CD] = {do_cd, 0, 1, BUILTIN_STATE, "[dir|-]",
+                    "change the working directory"},
+    [BUILTIN_PWD] = {do_pwd, 0, 1, 0, "[-L|-P]",
+                     "print the working directory"},
+    [BUILTIN_EXPORT] = {do_export, 0, -1, BUILTIN_STATE,
+                        "[-p] [name[=value]...]",
+                        "pass variables to commands, or list them"},
+    [BUILTIN_UNSET] = {do_unset, 1, -1, BUILTIN_STATE, "name...",
+                       "remove variables"},
+    [BUILTIN_READ] = {do_read, 0, -1, BUILTIN_STATE,
+                      "[-r] [-p prompt] [name...]",
+                      "read a line into variables"},
+    [BUILTIN_LET] = {do_let, 1, -1, BUILTIN_STATE, "expression...",
+                     "evaluate arithmetic, fail if the last value is 0"},
+};
+
+int builtin_cmd(int builtin, int argc, char *argv[]) {
+  const struct builtin_t *b = &builtins[builtin];
+  int nargs = argc - 1;
+  if (nargs < b->minargs || (b->maxargs >= 0 && nargs > b->maxargs)) {
+    printf("%s: usage: %s%s%s\n", argv[0], argv[0], *b->usage ? " " : "",
+           b->usage);
+    return 2;
+  }
+  if ((b->flags & BUILTIN_JOBCTL) && subshell) {
+    printf("%s: no job control\n", argv[0]);
+    return 1;
+  }
+  return b->run(argc, argv);
+}
+
+int do_quit(int argc, char *argv[]) {
+  exit(0);
+}
+
+int do_jobs(int argc, char *argv[]) {
+  if (argc == 1) {
+    listjobs(&jobs);
+  } else if (strcmp(argv[1], "-l") == 0) {
+    listjobsl(&jobs);
+  } else {
+    printf("jobs: usage: jobs %s\n", builtins[BUILTIN_JOBS].usage);
+    return 2;
+  }
+  return 0;
+}
+
+// return job given to fg or bg as a pid or %jobid, NULL if there is none
+static struct job_t *find_job(const char *cmd, const char *arg) {
   struct job_t *job;
   int num = 0;
   char *endptr = NULL;
-  char *p = argv[1];
+  const char *p = arg;
   if (*p == '%') {
     // handle jid
     p++;
     num = strtol(p, &endptr, 10);
     if (p == endptr) {
-      printf("%s: argument must be a PID or %%jobid\n", argv[0]);
-      return;
+      printf("%s: argument must be a PID or %%jobid\n", cmd);
+      return NULL;
     }
-    job = getjobJID(jobs, num);
-    if (!job) {
+    job = getjobJID(&jobs, num);
+    if (!job)
       printf("%%%d: No such job\n", num);
-      return;
-    }
   } else {
     // handle pid
     num = strtol(p, &endptr, 10);
     if (p == endptr) {
-      printf("%s: argument must be a PID or %%jobid\n", argv[0]);
-      return;
+      printf("%s: argument must be a PID or %%jobid\n", cmd);
+      return NULL;
     }
-    job = getjobPID(jobs, num);
-    if (!job) {
+    job = getjobPID(&jobs, num);
+    if (!job)
       printf("(%d): No such process\n", num);
-      return;
+  }
+  return job;
+}
+
+// continue a stopped or background job in the foreground
+int do_fg(int argc, char *argv[]) {
+  struct job_t *job = find_job(argv[0], argv[1]);
+  if (!job)
+    return 1;
+
+  // change ST/BG to FG
+  if (job->state == ST) {
+    kill(-(job->pid), SIGCONT);
+    setjobstate(&jobs, job, FG);
+  }
+  if (job->state == BG) {
+    setjobstate(&jobs, job, FG);
+  }
+  // the status is set when the job is done, stopped or interrupted
+  waitfg(job->pid);
+  return last_status;
+}
+
+// continue a stopped job in the background
+int do_bg(int argc, char *argv[]) {
+  struct job_t *job = find_job(argv[0], argv[1]);
+  if (!job)
+    return 1;
+
+  // change ST/BG to BG
+  if (job->state == ST) {
+    kill(-(job->pid), SIGCONT);
+    printf("[%d] (%d) %s\n", job->jid, job->pid, job->cmdline);
+    setjobstate(&jobs, job, BG);
+  }
+  return 0;
+}
+
+int do_source(int argc, char *argv[]) {
+  return source_file(argv[1], argc - 1, argv + 1);
+}
+
+// describe every builtin, or the one given
+int do_help(int argc, char *argv[]) {
+  if (argc == 2) {
+    int id = builtin_find(argv[1]);
+    if (id < 0) {
+      printf("help: no help topics match '%s'\n", argv[1]);
+      return 1;
     }
+    printf("%s%s%s\n    %s\n", argv[1], *builtins[id].usage ? " " : "",
+           builtins[id].usage, builtins[id].help);
+    return 0;
+  }
+
+  for (int id = 0; id < NBUILTINS; id++) {
+    char synopsis[64];
+    snprintf(synopsis, sizeof(synopsis), "%s %s", builtin_name(id),
+             builtins[id].usage);
+    printf("%-24s%s\n", synopsis, builtins[id].help);
   }
+  return 0;
+}
+
+// list the builtins starting with a prefix, one per line, for completion
+int do_compgen(int argc, char *argv[]) {
+  if (strcmp(argv[1], "-b") != 0) {
+    printf("compgen: usage: compgen %s\n", builtins[BUILTIN_COMPGEN].usage);
+    return 2;
+  }
+  const char *prefix = argc == 3 ? argv[2] : "";
+  int found = 0;
+  for (int id = builtin_complete(prefix, 0); id >= 0;
+       id = builtin_complete(prefix, id + 1)) {
+    printf("%s\n", builtin_name(id));
+    found = 1;
+  }
+  return found ? 0 : 1;
+}
 
-  // change process state and update job list
-  if (strcmp(cmd, "bg") == 0) {
-    // change ST/BG to BG
-    if (job->state == ST) {
-      kill(-(job->pid), SIGCONT);
-      printf("[%d] (%d) %s\n", job->jid, job->pid, job->cmdline);
-      job->state = BG;
+// return directory compiled scripts are kept in, $XDG_CACHE_HOME/mini-shell
+// or else ~/.cache/mini-shell, in buf
+static char *cache_dir(char *buf, size_t size) {
+  const char *xdg = var_get("XDG_CACHE_HOME");
+  const char *home = var_get("HOME");
+  if (xdg && *xdg)
+    snprintf(buf, size, "%s/mini-shell", xdg);
+  else
+    snprintf(buf, size, "%s/.cache/mini-shell", home ? home : "");
+  return buf;
+}
+
+// list shell options, or change one given as option=value
+int do_set(int argc, char *argv[]) {
+  if (argc == 1) {
+    printf("spawn=%s\n", launch_backend_name(launch_backend));
+    printf("spawnstat=%s\n", launch_timing ? "on" : "off");
+    printf("notify=%s\n", notify ? "on" : "off");
+    printf("allocstat=%s\n", allocstat ? "on" : "off");
+    printf("glob=%s\n", globbing ? "on" : "off");
+    printf("compile=%s\n", compiled == 2 ? "disk" : compiled ? "on" : "off");
+    for (int i = 0; i < LAUNCH_SIZE; i++) {
+      const struct launch_stat_t *st = launch_stats(i);
+      if (st->count > 0) {
+        printf("%s: %ld launches, avg %ld ns, min %ld ns, max %ld ns\n",
+               launch_backend_name(i), st->count, st->total_ns / st->count,
+               st->min_ns, st->max_ns);
+      }
     }
-  } else {
-    // change ST/BG to FG
-    if (job->state == ST) {
-      kill(-(job->pid), SIGCONT);
-      job->state = FG;
+    return 0;
+  }
+
+  // argv may be the strings of compiled code, which are never written
+  const char *value = strchr(argv[1], '=');
+  if (!value) {
+    printf("set: expected option=value\n");
+    return 1;
+  }
+  char option[32];
+  snprintf(option, sizeof(option), "%.*s", (int)(value - argv[1]), argv[1]);
+  value++;
+
+  if (strcmp(option, "spawn") == 0) {
+    int backend = launch_parse_backend(value);
+    if (backend < 0) {
+      printf("set: unknown spawn backend \'%s\'\n", value);
+      return 1;
+    }
+    launch_backend = backend;
+  } else if (strcmp(option, "spawnstat") == 0) {
+    if (strcmp(value, "on") == 0) {
+      launch_timing = 1;
+    } else if (strcmp(value, "off") == 0) {
+      launch_timing = 0;
+    } else {
+      printf("set: spawnstat must be on or off\n");
+      return 1;
+    }
+  } else if (strcmp(option, "notify") == 0) {
+    if (strcmp(value, "on") == 0) {
+      notify = 1;
+    } else if (strcmp(value, "off") == 0) {
+      notify = 0;
+    } else {
+      printf("set: notify must be on or off\n");
+      return 1;
+    }
+  } else if (strcmp(option, "allocstat") == 0) {
+    if (strcmp(value, "on") == 0) {
+      allocstat = 1;
+    } else if (strcmp(value, "off") == 0) {
+      allocstat = 0;
+    } else {
+      printf("set: allocstat must be on or off\n");
+      return 1;
     }
-    if (job->state == BG) {
-      job->state = FG;
+  } else if (strcmp(option, "glob") == 0) {
+    if (strcmp(value, "on") == 0) {
+      globbing = 1;
+    } else if (strcmp(value, "off") == 0) {
+      globbing = 0;
+    } else {
+      printf("set: glob must be on or off\n");
+      return 1;
     }
-    waitfg(job->pid);
+  } else if (strcmp(option, "compile") == 0) {
+    if (strcmp(value, "off") == 0) {
+      compiled = 0;
+      code_cache_clear();
+      code_cache_dir(NULL);
+    } else if (strcmp(value, "on") == 0) {
+      compiled = 1;
+      code_cache_dir(NULL);
+    } else if (strcmp(value, "disk") == 0) {
+      char dir[PATH_MAX];
+      if (code_cache_dir(cache_dir(dir, sizeof(dir))) < 0) {
+        printf("set: %s: %s\n", dir, strerror(errno));
+        return 1;
+      }
+      compiled = 2;
+    } else {
+      printf("set: compile must be off, on or disk\n");
+      return 1;
+    }
+  } else {
+    printf("set: unknown option \'%s\'\n", option);
+    return 1;
   }
+  return 0;
+}
 
-  free(cmd);
+// list the PATH cache, clear it (-r), or resolve the given names ahead
+int do_hash(int argc, char *argv[]) {
+  if (argc == 1) {
+    pathcache_list();
+    return 0;
+  }
+
+  if (strcmp(argv[1], "-r") == 0) {
+    pathcache_clear();
+    return 0;
+  }
+
+  int status = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!pathcache_prewarm(argv[i])) {
+      printf("hash: %s: not found\n", argv[i]);
+      status = 1;
+    }
+  }
+  return status;
 }
 
 /* Helper Functions */
@@ -307,6 +1980,7 @@ int parseline(const char *cmdline, char *argv[]) {
   static char buf[MAXLINE]; /* cache cmdline */
   char *p = buf;            /* pointer that traverse the buffer */
   int bg = 0;               /* 1 if it is a background command, 0 otherwise */
+  int argc;
 
   strcpy(buf, cmdline);
   // replace trailing \n with a space
@@ -360,15 +2034,18 @@ int parseline(const char *cmdline, char *argv[]) {
 }
 
 void usage(void) {
-  printf("Usage: shell [-hvp]\n");
+  printf("Usage: shell [-hvpta] [-s backend] [script [args...]]\n");
   printf("   -h   print this message\n");
   printf("   -v   print additional diagnostic information\n");
   printf("   -p   do not emit a command prompt\n");
+  printf("   -s   spawn backend: fork, vfork, posix_spawn or clone\n");
+  printf("   -t   report the latency of every launch\n");
+  printf("   -a   handle signals in asynchronous handlers, not the event loop\n");
   exit(1);
 }
 
 void unix_error(char *msg) {
-  fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+  errorf("%s: %s\n", msg, strerror(errno));
   exit(1);
 }
 
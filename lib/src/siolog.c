@@ -0,0 +1,96 @@
+#include "siolog.h"
+#include "csapp.h"
+#include <stdatomic.h>
+
+// a message is written by the one that reserved its slot, and handed to the
+// reader by setting ready
+struct slot_t {
+  atomic_int ready;
+  int len;
+  char buf[SIOLOG_SLOTSIZE];
+};
+
+static struct slot_t ring[SIOLOG_SLOTS];
+static atomic_ulong head = 0; /* next slot to reserve */
+static atomic_ulong tail = 0; /* next slot to read */
+static atomic_long dropped = 0;
+static long reported = 0; /* dropped messages already reported */
+
+void siolog_printf(const char *fmt, ...) {
+  // a handler may interrupt a writer between reserving and filling its
+  // slot, so a slot is claimed with compare and swap and never waited for
+  unsigned long h = atomic_load(&head);
+  do {
+    if (h - atomic_load(&tail) >= SIOLOG_SLOTS) {
+      atomic_fetch_add(&dropped, 1);
+      return;
+    }
+  } while (!atomic_compare_exchange_weak(&head, &h, h + 1));
+
+  struct slot_t *slot = &ring[h & (SIOLOG_SLOTS - 1)];
+  va_list ap;
+  va_start(ap, fmt);
+  slot->len = sio_vsnprintf(slot->buf, SIOLOG_SLOTSIZE, fmt, ap);
+  va_end(ap);
+  atomic_store_explicit(&slot->ready, 1, memory_order_release);
+}
+
+int siolog_snprintf(char *buf, size_t size, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int n = sio_vsnprintf(buf, size, fmt, ap);
+  va_end(ap);
+  return n;
+}
+
+void siolog_flush(void) {
+  char batch[4096];
+  size_t n = 0;
+
+  unsigned long t = atomic_load(&tail);
+  // an empty ring leaves stdout alone, batch mode relies on its buffering
+  if (!atomic_load_explicit(&ring[t & (SIOLOG_SLOTS - 1)].ready,
+                            memory_order_acquire) &&
+      atomic_load(&dropped) == reported)
+    return;
+
+  // keep the order with output the main path has already printed
+  fflush(stdout);
+
+  for (;;) {
+    struct slot_t *slot = &ring[t & (SIOLOG_SLOTS - 1)];
+    // the main path never waits for a slot it interrupted, it is read on
+    // the next flush
+    if (!atomic_load_explicit(&slot->ready, memory_order_acquire))
+      break;
+    if (n + slot->len > sizeof(batch)) {
+      rio_writen(STDOUT_FILENO, batch, n);
+      n = 0;
+    }
+    memcpy(batch + n, slot->buf, slot->len);
+    n += slot->len;
+    atomic_store(&slot->ready, 0);
+    atomic_store(&tail, ++t);
+  }
+
+  long lost = atomic_load(&dropped);
+  if (lost > reported) {
+    char msg[64];
+    int len = snprintf(msg, sizeof(msg), "siolog: %ld messages dropped\n",
+                       lost - reported);
+    if (n + len > sizeof(batch)) {
+      rio_writen(STDOUT_FILENO, batch, n);
+      n = 0;
+    }
+    memcpy(batch + n, msg, len);
+    n += len;
+    reported = lost;
+  }
+
+  if (n > 0)
+    rio_writen(STDOUT_FILENO, batch, n);
+}
+
+long siolog_dropped(void) {
+  return atomic_load(&dropped);
+}
@@ -0,0 +1,311 @@
+#include "var.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MINSLOTS 64
+#define MINGARBAGE (64 * 1024) /* bytes of old strings before any is freed */
+
+extern char **environ;
+
+struct var_t {
+  char *entry;       /* "name=value", or "name" if it has no value yet */
+  unsigned long hash;
+  size_t namelen;
+  int flags;         /* VAR_EXPORT */
+};
+
+// entry of a slot whose variable was unset, which lookups go on past
+static char tombstone[] = "";
+
+static struct var_t *slots = NULL;
+static size_t nslots = 0;  /* a power of two */
+static size_t nused = 0;   /* slots that are not empty, tombstones included */
+static size_t nlive = 0;
+
+// strings are never freed one by one. Once the ones that were replaced
+// outweigh the live ones, the live ones are copied to a new arena.
+static struct arena_t strings;
+static size_t live = 0;
+static size_t garbage = 0;
+
+static char **envp = NULL;
+static size_t envcap = 0;
+static int envstale = 1;   /* an exported variable changed since envp */
+
+static int imported = 0;
+
+static unsigned long hash(const char *s, size_t len) {
+  unsigned long h = 14695981039346656037UL; /* FNV-1a */
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211UL;
+  }
+  return h;
+}
+
+static int isset(const struct var_t *v) {
+  return v->entry && v->entry != tombstone;
+}
+
+// return slot of the variable name of len bytes, or the free slot it would
+// take. There is always an empty slot to end the probe.
+static struct var_t *lookup(const char *name, size_t len, unsigned long h) {
+  size_t mask = nslots - 1;
+  struct var_t *free = NULL;
+  for (size_t i = h & mask;; i = (i + 1) & mask) {
+    struct var_t *v = &slots[i];
+    if (!v->entry)
+      return free ? free : v;
+    if (v->entry == tombstone) {
+      if (!free)
+        free = v;
+    } else if (v->hash == h && v->namelen == len &&
+               memcmp(v->entry, name, len) == 0) {
+      return v;
+    }
+  }
+}
+
+// move the variables to a table of size slots, leaving the tombstones behind
+static void resize(size_t size) {
+  struct var_t *old = slots;
+  size_t nold = nslots;
+  slots = calloc(size, sizeof(struct var_t));
+  if (!slots) {
+    errorf("var: out of memory\n");
+    exit(1);
+  }
+  nslots = size;
+  nused = nlive;
+  for (size_t i = 0; i < nold; i++) {
+    if (isset(&old[i]))
+      *lookup(old[i].entry, old[i].namelen, old[i].hash) = old[i];
+  }
+  free(old);
+}
+
+static void compact(void) {
+  struct arena_t old = strings;
+  arena_init(&strings);
+  live = 0;
+  for (size_t i = 0; i < nslots; i++) {
+    if (isset(&slots[i])) {
+      size_t size = strlen(slots[i].entry) + 1;
+      char *entry = arena_alloc(&strings, size);
+      slots[i].entry = memcpy(entry, slots[i].entry, size);
+      live += size;
+    }
+  }
+  arena_free(&old);
+  garbage = 0;
+  envstale = 1;
+}
+
+// set the variable name of len bytes to value, or to no value if it is NULL
+static void put(const char *name, size_t len, const char *value, int flags) {
+  if ((nused + 1) * 4 > nslots * 3) {
+    size_t size = nslots;
+    while ((nlive + 1) * 2 > size)
+      size *= 2;
+    resize(size);
+  }
+
+  // the string is copied before the old one is let go, value may be in it
+  size_t vlen = value ? strlen(value) : 0;
+  size_t size = len + (value ? vlen + 1 : 0) + 1;
+  char *entry = arena_alloc(&strings, size);
+  memcpy(entry, name, len);
+  if (value) {
+    entry[len] = '=';
+    memcpy(entry + len + 1, value, vlen);
+  }
+  entry[size - 1] = '\0';
+
+  unsigned long h = hash(name, len);
+  struct var_t *v = lookup(name, len, h);
+  if (isset(v)) {
+    size_t oldsize = strlen(v->entry) + 1;
+    live -= oldsize;
+    garbage += oldsize;
+    flags |= v->flags;
+  } else {
+    if (!v->entry)
+      nused++;
+    nlive++;
+  }
+  *v = (struct var_t){entry, h, len, flags};
+  live += size;
+  if (flags & VAR_EXPORT)
+    envstale = 1;
+  if (garbage > MINGARBAGE && garbage > live)
+    compact();
+}
+
+// return whether the len bytes at name are all a variable name
+static int isname(const char *name, size_t len) {
+  return len > 0 && var_namelen(name, len) == len;
+}
+
+size_t var_namelen(const char *s, size_t len) {
+  if (len == 0 || !(isalpha((unsigned char)s[0]) || s[0] == '_'))
+    return 0;
+  size_t i = 1;
+  while (i < len && (isalnum((unsigned char)s[i]) || s[i] == '_'))
+    i++;
+  return i;
+}
+
+// the table starts out as the environment the shell was given
+static void import(void) {
+  if (imported)
+    return;
+  imported = 1;
+  arena_init(&strings);
+  resize(MINSLOTS);
+  for (char **e = environ; e && *e; e++) {
+    const char *eq = strchr(*e, '=');
+    if (eq && isname(*e, eq - *e))
+      put(*e, eq - *e, eq + 1, VAR_EXPORT);
+  }
+}
+
+static struct var_t *find(const char *name, size_t len) {
+  import();
+  struct var_t *v = lookup(name, len, hash(name, len));
+  return isset(v) ? v : NULL;
+}
+
+const char *var_getn(const char *name, size_t len) {
+  struct var_t *v = find(name, len);
+  if (!v || v->entry[len] != '=')
+    return NULL;
+  return v->entry + len + 1;
+}
+
+const char *var_get(const char *name) {
+  return var_getn(name, strlen(name));
+}
+
+int var_flags(const char *name) {
+  struct var_t *v = find(name, strlen(name));
+  return v ? v->flags : -1;
+}
+
+int var_set(const char *name, const char *value, int flags) {
+  size_t len = strlen(name);
+  if (!isname(name, len))
+    return -1;
+  import();
+  put(name, len, value, flags);
+  return 0;
+}
+
+int var_assign(const char *assignment, int flags) {
+  const char *eq = strchr(assignment, '=');
+  size_t len = eq ? eq - assignment : 0;
+  if (!eq || !isname(assignment, len))
+    return -1;
+  import();
+  put(assignment, len, eq + 1, flags);
+  return 0;
+}
+
+int var_export(const char *name) {
+  size_t len = strlen(name);
+  if (!isname(name, len))
+    return -1;
+  struct var_t *v = find(name, len);
+  if (!v) {
+    put(name, len, NULL, VAR_EXPORT);
+  } else if (!(v->flags & VAR_EXPORT)) {
+    v->flags |= VAR_EXPORT;
+    envstale = 1;
+  }
+  return 0;
+}
+
+void var_unset(const char *name) {
+  struct var_t *v = find(name, strlen(name));
+  if (!v)
+    return;
+  size_t size = strlen(v->entry) + 1;
+  live -= size;
+  garbage += size;
+  if (v->flags & VAR_EXPORT)
+    envstale = 1;
+  v->entry = tombstone;
+  nlive--;
+}
+
+const char *var_next(int *pos, int *flags) {
+  import();
+  for (; (size_t)*pos < nslots; (*pos)++) {
+    if (isset(&slots[*pos])) {
+      *flags = slots[*pos].flags;
+      return slots[(*pos)++].entry;
+    }
+  }
+  return NULL;
+}
+
+char **var_environ(void) {
+  import();
+  if (!envstale)
+    return envp;
+
+  size_t n = 0;
+  for (size_t i = 0; i < nslots; i++) {
+    struct var_t *v = &slots[i];
+    if (isset(v) && (v->flags & VAR_EXPORT) && v->entry[v->namelen] == '=') {
+      if (n + 1 >= envcap) {
+        envcap = envcap ? envcap * 2 : 64;
+        envp = realloc(envp, envcap * sizeof(char *));
+        if (!envp) {
+          errorf("var: out of memory\n");
+          exit(1);
+        }
+      }
+      envp[n++] = v->entry;
+    }
+  }
+  if (!envp) {
+    envcap = 1;
+    envp = malloc(sizeof(char *));
+  }
+  envp[n] = NULL;
+  envstale = 0;
+  return envp;
+}
+
+char **var_environ_with(struct arena_t *arena, char **assigns, int nassigns) {
+  char **base = var_environ();
+  size_t nbase = 0;
+  while (base[nbase])
+    nbase++;
+
+  // an exported variable the prefix assigns is left out by its entry, which
+  // is what base points to
+  const char **skip = arena_alloc(arena, nassigns * sizeof(char *));
+  for (int i = 0; i < nassigns; i++) {
+    const char *eq = strchr(assigns[i], '=');
+    struct var_t *v = find(assigns[i], eq - assigns[i]);
+    skip[i] = v && (v->flags & VAR_EXPORT) ? v->entry : NULL;
+  }
+
+  // the last assignment of a name comes first, which is the one getenv()
+  // finds
+  char **env = arena_alloc(arena, (nbase + nassigns + 1) * sizeof(char *));
+  size_t n = 0;
+  for (int i = nassigns - 1; i >= 0; i--)
+    env[n++] = assigns[i];
+  for (size_t i = 0; i < nbase; i++) {
+    int j = 0;
+    while (j < nassigns && skip[j] != base[i])
+      j++;
+    if (j == nassigns)
+      env[n++] = base[i];
+  }
+  env[n] = NULL;
+  return env;
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <string>
+
+extern "C" {
+#include <string.h>
+#include "arena.h"
+#include "parse.h"
+}
+
+class ArenaTest : public ::testing::Test {
+protected:
+  struct arena_t arena;
+
+  void SetUp() override { arena_init(&arena); }
+  void TearDown() override { arena_free(&arena); }
+
+  int nchunks() {
+    int n = 0;
+    for (struct chunk_t *c = arena.chunks; c; c = c->next)
+      n++;
+    return n;
+  }
+};
+
+TEST_F(ArenaTest, TestAlign) {
+  for (size_t size = 1; size < 100; size += 7) {
+    void *p = arena_alloc(&arena, size);
+    EXPECT_EQ((uintptr_t)p % 16, 0u);
+  }
+  EXPECT_STREQ(arena_strndup(&arena, "abcdef", 3), "abc");
+  EXPECT_EQ(arena.nallocs, 16);
+  EXPECT_EQ(arena.nmallocs, 1);
+  EXPECT_EQ(arena.reserved, (size_t)ARENA_CHUNK);
+}
+
+TEST_F(ArenaTest, TestRelease) {
+  struct arena_mark_t mark = arena_mark(&arena);
+  char *first = (char *)arena_alloc(&arena, 10);
+  char *big = (char *)arena_alloc(&arena, 3 * ARENA_CHUNK);
+  memset(big, 'x', 3 * ARENA_CHUNK);
+  struct chunk_t *chunks = arena.chunks;
+
+  // released memory is handed out again without new chunks
+  arena_release(&arena, mark);
+  EXPECT_EQ((char *)arena_alloc(&arena, 10), first);
+  arena_alloc(&arena, 3 * ARENA_CHUNK);
+  EXPECT_EQ(arena.chunks, chunks);
+  EXPECT_EQ(nchunks(), 2);
+  EXPECT_EQ(arena.nmallocs, 2);
+}
+
+TEST_F(ArenaTest, TestNestedMarks) {
+  char *a = (char *)arena_alloc(&arena, 100);
+  struct arena_mark_t outer = arena_mark(&arena);
+  char *b = (char *)arena_alloc(&arena, 100);
+  struct arena_mark_t inner = arena_mark(&arena);
+  for (int i = 0; i < 1000; i++)
+    arena_alloc(&arena, 64);
+
+  arena_release(&arena, inner);
+  EXPECT_NE((char *)arena_alloc(&arena, 100), b);
+  arena_release(&arena, outer);
+  EXPECT_EQ((char *)arena_alloc(&arena, 100), b);
+  EXPECT_NE(a, b);
+}
+
+TEST_F(ArenaTest, TestSteadyState) {
+  // parse the same script over and over like eval does, the arena stops
+  // asking malloc for memory after the first round
+  std::string script;
+  for (int i = 0; i < 200; i++)
+    script += "cat a b | grep -v 'x y' > out" + std::to_string(i) + " &\n";
+
+  long nmallocs = 0;
+  for (int round = 0; round < 5; round++) {
+    struct parser_t p;
+    struct node_t *list;
+    struct arena_mark_t mark = arena_mark(&arena);
+    parser_init(&p, &arena, script.data(), script.size());
+    long nallocs = arena.nallocs;
+    while (parse_next(&p, &list) > 0) {
+      for (struct word_t *w = list->cmds->words; w; w = w->next)
+        word_str(&arena, w);
+    }
+    EXPECT_GT(arena.nallocs, nallocs);
+    if (round > 0)
+      EXPECT_EQ(arena.nmallocs, nmallocs) << "round " << round;
+    nmallocs = arena.nmallocs;
+    arena_release(&arena, mark);
+  }
+  EXPECT_GT(nmallocs, 1);
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <climits>
+#include <string>
+
+extern "C" {
+#include "arith.h"
+#include "var.h"
+}
+
+static long eval(const std::string &expr) {
+  long value = -12345;
+  EXPECT_EQ(arith_eval(expr.data(), expr.size(), &value), 0) << expr;
+  return value;
+}
+
+static bool fails(const std::string &expr) {
+  long value;
+  return arith_eval(expr.data(), expr.size(), &value) < 0;
+}
+
+TEST(ArithTest, TestPrecedence) {
+  EXPECT_EQ(eval("1 + 2 * 3"), 7);
+  EXPECT_EQ(eval("(1 + 2) * 3"), 9);
+  EXPECT_EQ(eval("10 - 4 - 3"), 3);
+  EXPECT_EQ(eval("2 ** 3 ** 2"), 512);
+  EXPECT_EQ(eval("-2 ** 2"), 4);
+  EXPECT_EQ(eval("1 << 2 + 1"), 8);
+  EXPECT_EQ(eval("1 | 2 ^ 3 & 4"), 3);
+  EXPECT_EQ(eval("1 < 2 == 2 > 1"), 1);
+  EXPECT_EQ(eval("!0 + ~0 + -(-3)"), 3);
+  EXPECT_EQ(eval("1, 2, 3"), 3);
+  EXPECT_EQ(eval(""), 0);
+  EXPECT_EQ(eval("  42  "), 42);
+}
+
+TEST(ArithTest, TestConstants) {
+  EXPECT_EQ(eval("0x1F"), 31);
+  EXPECT_EQ(eval("017"), 15);
+  EXPECT_EQ(eval("0"), 0);
+  EXPECT_EQ(eval("2#1011"), 11);
+  EXPECT_EQ(eval("36#Zz"), 35 * 36 + 35);
+  EXPECT_EQ(eval("64#Z"), 61);
+  EXPECT_TRUE(fails("08"));
+  EXPECT_TRUE(fails("1a"));
+  EXPECT_TRUE(fails("65#1"));
+}
+
+TEST(ArithTest, TestDivision) {
+  EXPECT_EQ(eval("7 / 2"), 3);
+  EXPECT_EQ(eval("-7 / 2"), -3);
+  EXPECT_EQ(eval("-7 % 3"), -1);
+  EXPECT_TRUE(fails("1 / 0"));
+  EXPECT_TRUE(fails("1 % 0"));
+  // it wraps around instead of trapping
+  EXPECT_EQ(eval("(-9223372036854775807 - 1) / -1"), LONG_MIN);
+  EXPECT_EQ(eval("9223372036854775807 + 1"), LONG_MIN);
+  EXPECT_TRUE(fails("2 ** -1"));
+}
+
+TEST(ArithTest, TestLogic) {
+  EXPECT_EQ(eval("2 && 3"), 1);
+  EXPECT_EQ(eval("0 || 5"), 1);
+  EXPECT_EQ(eval("0 || 0"), 0);
+  // the right operand and the other branch do not run
+  var_unset("AT_X");
+  EXPECT_EQ(eval("0 && (AT_X = 1)"), 0);
+  EXPECT_EQ(eval("1 || (AT_X = 1)"), 1);
+  EXPECT_EQ(eval("1 ? 2 : (AT_X = 1)"), 2);
+  EXPECT_EQ(var_get("AT_X"), nullptr);
+  EXPECT_EQ(eval("0 ? 1 : 0 ? 2 : 3"), 3);
+  EXPECT_EQ(eval("(1 ? 2 : 3) + 1"), 3);
+  EXPECT_TRUE(fails("1 ? 2"));
+}
+
+TEST(ArithTest, TestVariables) {
+  var_set("AT_A", "5", 0);
+  var_unset("AT_U");
+  var_set("AT_E", "", 0);
+  EXPECT_EQ(eval("AT_A * 2 + AT_U + AT_E"), 10);
+  EXPECT_EQ(eval("AT_A++ + AT_A"), 11);
+  EXPECT_EQ(eval("--AT_A"), 5);
+  EXPECT_EQ(eval("AT_A = AT_B = 3"), 3);
+  EXPECT_STREQ(var_get("AT_B"), "3");
+  EXPECT_EQ(eval("AT_A += 4, AT_A <<= 1, AT_A %= 5"), 4);
+  EXPECT_STREQ(var_get("AT_A"), "4");
+  EXPECT_EQ(eval("AT_A == 4"), 1);
+
+  // a value that is not a number is an expression of its own
+  var_set("AT_C", "AT_A * 2", 0);
+  var_set("AT_N", " -7 ", 0);
+  EXPECT_EQ(eval("AT_C + AT_N"), 1);
+  var_set("AT_R", "AT_R + 1", 0);
+  EXPECT_TRUE(fails("AT_R"));
+
+  EXPECT_TRUE(fails("1 = 2"));
+  EXPECT_TRUE(fails("++1"));
+  EXPECT_TRUE(fails("(1 + 2"));
+  EXPECT_TRUE(fails("1 2"));
+  for (const char *name : {"AT_A", "AT_B", "AT_C", "AT_E", "AT_N", "AT_R"})
+    var_unset(name);
+}
+
+TEST(ArithTest, TestCache) {
+  var_set("AT_I", "0", 0);
+  eval("AT_I += 1");
+  int size = arith_cachesize();
+  // the same text runs again without being compiled again
+  for (int i = 0; i < 100; i++)
+    eval("AT_I += 1");
+  EXPECT_EQ(arith_cachesize(), size);
+  EXPECT_STREQ(var_get("AT_I"), "101");
+  eval("AT_I + 0");
+  EXPECT_EQ(arith_cachesize(), size + 1);
+
+  // an expression that does not compile is not kept
+  fails("1 +");
+  EXPECT_EQ(arith_cachesize(), size + 1);
+
+  // the cache is emptied once it fills up, and goes on working
+  for (int i = 0; i < 2000; i++)
+    eval(std::to_string(i) + " + AT_I");
+  EXPECT_LT(arith_cachesize(), 1024);
+  EXPECT_EQ(eval("AT_I += 1"), 102);
+  var_unset("AT_I");
+}
@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+#include <string>
+
+extern "C" {
+#include "builtin.h"
+}
+
+TEST(BuiltinTest, TestFind) {
+  // every builtin is found by its name
+  for (int id = 0; id < NBUILTINS; id++) {
+    EXPECT_EQ(builtin_find(builtin_name(id)), id) << builtin_name(id);
+  }
+  EXPECT_EQ(builtin_find("quit"), BUILTIN_QUIT);
+  EXPECT_EQ(builtin_find("fg"), BUILTIN_FG);
+  EXPECT_EQ(builtin_find("source"), BUILTIN_SOURCE);
+}
+
+TEST(BuiltinTest, TestNotFound) {
+  const char *names[] = {"", "q", "quitx", "QUIT", "f", "fgg", "ls",
+                         "/bin/ls", "source ", "jobs\n"};
+  for (const char *name : names)
+    EXPECT_EQ(builtin_find(name), -1) << name;
+
+  // a name hashing to the slot of a builtin is still told apart
+  for (int i = 0; i < 100000; i++) {
+    std::string name = "cmd" + std::to_string(i);
+    ASSERT_EQ(builtin_find(name.c_str()), -1) << name;
+  }
+}
+
+TEST(BuiltinTest, TestComplete) {
+  std::string found;
+  for (int id = builtin_complete("s", 0); id >= 0;
+       id = builtin_complete("s", id + 1))
+    found += std::string(builtin_name(id)) + " ";
+  EXPECT_EQ(found, "set source ");
+
+  int n = 0;
+  for (int id = builtin_complete("", 0); id >= 0;
+       id = builtin_complete("", id + 1))
+    n++;
+  EXPECT_EQ(n, NBUILTINS);
+  EXPECT_EQ(builtin_complete("zz", 0), -1);
+  EXPECT_EQ(builtin_complete("quit", 0), BUILTIN_QUIT);
+  EXPECT_EQ(builtin_complete("quit", BUILTIN_QUIT + 1), -1);
+}
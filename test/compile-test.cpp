@@ -0,0 +1,308 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "compile.h"
+#include "parse.h"
+}
+
+// the only builtin of the tests is set
+static int resolve(char *argv[], int argc) {
+  return strcmp(argv[0], "set") == 0 ? 7 : -1;
+}
+
+class CompileTest : public ::testing::Test {
+protected:
+  struct code_t *code = NULL;
+  uint32_t pc = 0;
+
+  void TearDown() override {
+    if (code)
+      code_release(code);
+  }
+
+  void compile(const std::string &src) {
+    code = ::compile(src.data(), src.size(), resolve);
+    pc = 0;
+  }
+
+  uint32_t next() {
+    EXPECT_LT(pc, code->ncode);
+    return code->code[pc++];
+  }
+
+  std::string str() { return code->strings + next(); }
+
+  // expect OP_PIPE with the given operands, leaving pc at its first stage
+  void expect_pipe(int nstages, int bg, int timed, int builtin,
+                   const std::string &text) {
+    EXPECT_EQ(next(), (uint32_t)OP_PIPE);
+    EXPECT_EQ(next(), (uint32_t)nstages);
+    EXPECT_EQ(next(), (uint32_t)bg);
+    EXPECT_EQ(next(), (uint32_t)timed);
+    EXPECT_EQ((int)next(), builtin);
+    EXPECT_EQ(str(), text);
+  }
+
+  // return words of the stage at pc, which has no redirections or
+  // assignments
+  std::vector<std::string> stage() {
+    int nwords = next();
+    EXPECT_EQ(next(), 0u);
+    EXPECT_EQ(next(), 0u);
+    std::vector<std::string> words;
+    for (int i = 0; i < nwords; i++)
+      words.push_back(str());
+    return words;
+  }
+};
+
+TEST_F(CompileTest, TestPipeline) {
+  compile("time echo 'a b'  \"c\" | cat >out 2>&1 <in\n");
+  expect_pipe(2, 0, 1, -1, "time echo 'a b'  \"c\" | cat >out 2>&1 <in");
+
+  // words are stored as their values, time is taken off
+  EXPECT_EQ(stage(), std::vector<std::string>({"echo", "a b", "c"}));
+  EXPECT_EQ(next(), 1u);
+  EXPECT_EQ(next(), 3u);
+  EXPECT_EQ(next(), 0u);
+  EXPECT_EQ(str(), "cat");
+  EXPECT_EQ(next(), (uint32_t)REDIR_OUT);
+  EXPECT_EQ(next(), 1u);
+  EXPECT_EQ(str(), "out");
+  EXPECT_EQ(next(), (uint32_t)REDIR_DUP);
+  EXPECT_EQ(next(), 2u);
+  EXPECT_EQ(next(), 1u);
+  EXPECT_EQ(next(), (uint32_t)REDIR_IN);
+  EXPECT_EQ(next(), 0u);
+  EXPECT_EQ(str(), "in");
+
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+  EXPECT_EQ(pc, code->ncode);
+}
+
+TEST_F(CompileTest, TestBuiltins) {
+  compile("set a=b\nsetx\n>file\ntime set\n\n# comment\n");
+  expect_pipe(1, 0, 0, 7, "set a=b");
+  stage();
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+  expect_pipe(1, 0, 0, -1, "setx");
+  stage();
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+  expect_pipe(1, 0, 0, -1, ">file");
+  pc += 6;
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+  expect_pipe(1, 0, 1, 7, "time set");
+  EXPECT_EQ(stage(), std::vector<std::string>({"set"}));
+
+  // blank lines and comments leave nothing behind
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+  EXPECT_EQ(pc, code->ncode);
+}
+
+TEST_F(CompileTest, TestExpand) {
+  compile("A=1 B=\"$x\" $cmd 'a' \"$b\" >$out\nset $x\n");
+  expect_pipe(1, 0, 0, -1, "A=1 B=\"$x\" $cmd 'a' \"$b\" >$out");
+  EXPECT_EQ(next(), 3u);
+  EXPECT_EQ(next(), 1u);
+  EXPECT_EQ(next(), 2u);
+
+  // words with parameters are kept as their text, to expand when they run,
+  // unless they are a variable that is not split, which is resolved
+  uint32_t w = next();
+  EXPECT_EQ(w & CODE_EXPAND, CODE_EXPAND);
+  EXPECT_STREQ(code->strings + (w & ~CODE_EXPAND), "$cmd");
+  EXPECT_EQ(str(), "a");
+  w = next();
+  EXPECT_EQ(w & CODE_VAR, CODE_VAR);
+  EXPECT_STREQ(code->strings + (w & ~CODE_VAR), "$b");
+  EXPECT_EQ(next(), (uint32_t)REDIR_OUT);
+  EXPECT_EQ(next(), 1u);
+  w = next();
+  EXPECT_EQ(w & CODE_VAR, CODE_VAR);
+  EXPECT_STREQ(code->strings + (w & ~CODE_VAR), "$out");
+  EXPECT_EQ(str(), "A=1");
+  w = next();
+  EXPECT_EQ(w & CODE_VAR, CODE_VAR);
+  EXPECT_STREQ(code->strings + (w & ~CODE_VAR), "B=$x");
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+
+  // a plain name is still resolved
+  expect_pipe(1, 0, 0, 7, "set $x");
+  EXPECT_EQ(next(), 2u);
+  pc += 4;
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+  EXPECT_EQ(pc, code->ncode);
+}
+
+TEST_F(CompileTest, TestVariables) {
+  compile("x --n=\"${n}\" \"$a\"b \"$1\" \"${a:-b}\" \"$a$b\" $a* >${f}\n");
+  // past the pipeline, its stage and x
+  pc += 10;
+  uint32_t w = next();
+  EXPECT_EQ(w & (CODE_VAR | CODE_EXPAND), CODE_VAR);
+  EXPECT_STREQ(code->strings + (w & ~CODE_VAR), "--n=$n");
+  // anything else after the variable, or more than a variable, is expanded
+  for (int i = 0; i < 5; i++)
+    EXPECT_EQ(next() & (CODE_VAR | CODE_EXPAND), CODE_EXPAND);
+  pc += 2;
+  w = next();
+  EXPECT_EQ(w & (CODE_VAR | CODE_EXPAND), CODE_VAR);
+  EXPECT_STREQ(code->strings + (w & ~CODE_VAR), "$f");
+}
+
+TEST_F(CompileTest, TestAndOr) {
+  // (a && b) || c
+  compile("a && b || c; d &\n");
+  expect_pipe(1, 0, 0, -1, "a");
+  stage();
+  EXPECT_EQ(next(), (uint32_t)OP_AND);
+  uint32_t and_target = next();
+  expect_pipe(1, 0, 0, -1, "b");
+  stage();
+
+  // a failing a jumps to the ||, which runs c
+  EXPECT_EQ(and_target, pc);
+  EXPECT_EQ(next(), (uint32_t)OP_OR);
+  uint32_t or_target = next();
+  expect_pipe(1, 0, 0, -1, "c");
+  stage();
+  EXPECT_EQ(or_target, pc);
+
+  expect_pipe(1, 1, 0, -1, "d &");
+  stage();
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+  EXPECT_EQ(pc, code->ncode);
+}
+
+TEST_F(CompileTest, TestSubshell) {
+  compile("a || b &\nc\n");
+  EXPECT_EQ(next(), (uint32_t)OP_SUBSHELL);
+  uint32_t end = next();
+  EXPECT_EQ(str(), "a || b &");
+
+  // the pipelines of the list run in the foreground of the child
+  expect_pipe(1, 0, 0, -1, "a");
+  stage();
+  EXPECT_EQ(next(), (uint32_t)OP_OR);
+  EXPECT_EQ(next(), end);
+  expect_pipe(1, 0, 0, -1, "b");
+  stage();
+  EXPECT_EQ(pc, end);
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+  expect_pipe(1, 0, 0, -1, "c");
+}
+
+TEST_F(CompileTest, TestErrors) {
+  // errors are reported when the code runs to them, in order
+  compile("a\nb | | c\ntime | d\ne\n");
+  expect_pipe(1, 0, 0, -1, "a");
+  stage();
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+  EXPECT_EQ(next(), (uint32_t)OP_ERROR);
+  EXPECT_EQ(next(), 2u);
+  EXPECT_EQ(str(), "syntax error near unexpected token '|'");
+
+  // an empty stage is known once time is taken off, it has no line
+  EXPECT_EQ(next(), (uint32_t)OP_ERROR);
+  EXPECT_EQ(next(), 0u);
+  EXPECT_EQ(str(), "syntax error near unexpected token '|'");
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+
+  expect_pipe(1, 0, 0, -1, "e");
+  stage();
+  EXPECT_EQ(next(), (uint32_t)OP_END);
+  EXPECT_EQ(pc, code->ncode);
+}
+
+class CodeCacheTest : public ::testing::Test {
+protected:
+  char dir[32] = "/tmp/compile-testXXXXXX";
+  std::string script;
+  struct stat st;
+
+  void SetUp() override {
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    script = std::string(dir) + "/script.sh";
+    write_script("echo a\necho b\n");
+  }
+
+  void TearDown() override {
+    code_cache_clear();
+    code_cache_dir(NULL);
+    std::string cmd = std::string("rm -rf ") + dir;
+    ASSERT_EQ(system(cmd.c_str()), 0);
+  }
+
+  // replace the script and stat it
+  void write_script(const std::string &src) {
+    FILE *f = fopen(script.c_str(), "w");
+    ASSERT_NE(f, nullptr);
+    fputs(src.c_str(), f);
+    fclose(f);
+    ASSERT_EQ(stat(script.c_str(), &st), 0);
+  }
+};
+
+TEST_F(CodeCacheTest, TestMemory) {
+  EXPECT_EQ(code_cache_get(script.c_str(), &st), nullptr);
+
+  std::string src = "echo a\necho b\n";
+  struct code_t *code = compile(src.data(), src.size(), resolve);
+  code_cache_put(script.c_str(), &st, code);
+  EXPECT_EQ(code->refs, 2);
+  EXPECT_EQ(code_cache_get(script.c_str(), &st), code);
+  EXPECT_EQ(code->refs, 3);
+  code_release(code);
+
+  // a modified script is compiled again, the old code lives on with the
+  // holders it has left
+  write_script("echo a\n");
+  EXPECT_EQ(code_cache_get(script.c_str(), &st), nullptr);
+  EXPECT_EQ(code->refs, 1);
+  code_release(code);
+}
+
+TEST_F(CodeCacheTest, TestDisk) {
+  std::string cache = std::string(dir) + "/cache/code";
+  ASSERT_EQ(code_cache_dir(cache.c_str()), 0);
+
+  std::string src = "a && b\nc | d >e\n";
+  struct code_t *code = compile(src.data(), src.size(), resolve);
+  code_cache_put(script.c_str(), &st, code);
+
+  // the code comes back from the file once memory is cleared
+  code_cache_clear();
+  struct code_t *loaded = code_cache_get(script.c_str(), &st);
+  ASSERT_NE(loaded, nullptr);
+  ASSERT_NE(loaded, code);
+  ASSERT_EQ(loaded->ncode, code->ncode);
+  ASSERT_EQ(loaded->nstrings, code->nstrings);
+  EXPECT_EQ(memcmp(loaded->code, code->code, code->ncode * sizeof(uint32_t)),
+            0);
+  EXPECT_EQ(memcmp(loaded->strings, code->strings, code->nstrings), 0);
+  code_release(loaded);
+  code_release(code);
+
+  // it is out of date once the script changes
+  code_cache_clear();
+  write_script("a && b\nc | d >e\nf\n");
+  EXPECT_EQ(code_cache_get(script.c_str(), &st), nullptr);
+
+  // and not taken for another file of the same path
+  src = "f\n";
+  code = compile(src.data(), src.size(), resolve);
+  code_cache_put(script.c_str(), &st, code);
+  code_release(code);
+  code_cache_clear();
+  struct stat other = st;
+  other.st_ino++;
+  EXPECT_EQ(code_cache_get(script.c_str(), &other), nullptr);
+  loaded = code_cache_get(script.c_str(), &st);
+  ASSERT_NE(loaded, nullptr);
+  code_release(loaded);
+}
@@ -0,0 +1,276 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "coreutils.h"
+#include "var.h"
+}
+
+class CoreutilsTest : public ::testing::Test {
+protected:
+  FILE *out;
+  int saved;
+
+  // capture stdout in a temporary file
+  void SetUp() override {
+    fflush(stdout);
+    out = tmpfile();
+    saved = dup(STDOUT_FILENO);
+    dup2(fileno(out), STDOUT_FILENO);
+  }
+
+  void TearDown() override {
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    fclose(out);
+  }
+
+  // return output since the last call
+  std::string output() {
+    fflush(stdout);
+    std::string s;
+    char buf[4096];
+    size_t n;
+    rewind(out);
+    while ((n = fread(buf, 1, sizeof(buf), out)) > 0)
+      s.append(buf, n);
+    ftruncate(fileno(out), 0);
+    rewind(out);
+    return s;
+  }
+
+  // run a builtin on args, the first being its name
+  int run(int (*fn)(int, char **), std::vector<std::string> args) {
+    std::vector<char *> argv;
+    for (auto &arg : args)
+      argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    return fn(argv.size() - 1, argv.data());
+  }
+
+  // run read with input as its stdin
+  int read_from(const std::string &input, std::vector<std::string> args) {
+    FILE *in = tmpfile();
+    fputs(input.c_str(), in);
+    fflush(in);
+    lseek(fileno(in), 0, SEEK_SET);
+    int saved_in = dup(STDIN_FILENO);
+    dup2(fileno(in), STDIN_FILENO);
+    int status = run(do_read, args);
+    dup2(saved_in, STDIN_FILENO);
+    close(saved_in);
+    fclose(in);
+    return status;
+  }
+};
+
+TEST_F(CoreutilsTest, TestEcho) {
+  EXPECT_EQ(run(do_echo, {"echo", "a", "b  c"}), 0);
+  EXPECT_EQ(output(), "a b  c\n");
+  run(do_echo, {"echo"});
+  EXPECT_EQ(output(), "\n");
+  run(do_echo, {"echo", "-n", "-e", "x\\ty"});
+  EXPECT_EQ(output(), "x\ty");
+  // escapes only with -e, \c ends everything
+  run(do_echo, {"echo", "a\\tb"});
+  EXPECT_EQ(output(), "a\\tb\n");
+  run(do_echo, {"echo", "-ne", "\\0101\\x42\\c", "C"});
+  EXPECT_EQ(output(), "AB");
+  // an option word with other letters is an argument
+  run(do_echo, {"echo", "-nx", "-", "--"});
+  EXPECT_EQ(output(), "-nx - --\n");
+}
+
+TEST_F(CoreutilsTest, TestPrintf) {
+  EXPECT_EQ(run(do_printf, {"printf", "%s=%d\\n", "a", "1", "b", "2"}), 0);
+  EXPECT_EQ(output(), "a=1\nb=2\n");
+  run(do_printf, {"printf", "[%5s|%-3d|%03x|%.2f|%c|%%]", "ab", "7", "255",
+                  "3.14159", "xyz"});
+  EXPECT_EQ(output(), "[   ab|7  |0ff|3.14|x|%]");
+  run(do_printf, {"printf", "%*d|%d|%s|", "4", "-2", "'A", "0x10"});
+  EXPECT_EQ(output(), "  -2|65|0x10|");
+  // missing arguments are empty or 0
+  run(do_printf, {"printf", "%s-%d\\n"});
+  EXPECT_EQ(output(), "-0\n");
+  run(do_printf, {"printf", "%b|%s", "a\\nb\\c", "never"});
+  EXPECT_EQ(output(), "a\nb");
+
+  EXPECT_EQ(run(do_printf, {"printf", "%d\\n", "12x"}), 1);
+  EXPECT_EQ(output(), "12\n");
+  EXPECT_EQ(run(do_printf, {"printf", "a%y"}), 1);
+  EXPECT_EQ(output(), "a");
+}
+
+TEST_F(CoreutilsTest, TestTest) {
+  EXPECT_EQ(run(do_test, {"test"}), 1);
+  EXPECT_EQ(run(do_test, {"test", "x"}), 0);
+  EXPECT_EQ(run(do_test, {"test", ""}), 1);
+  EXPECT_EQ(run(do_test, {"test", "-n", ""}), 1);
+  EXPECT_EQ(run(do_test, {"test", "-z", ""}), 0);
+  EXPECT_EQ(run(do_test, {"test", "!", "x"}), 1);
+  EXPECT_EQ(run(do_test, {"test", "a", "=", "a"}), 0);
+  EXPECT_EQ(run(do_test, {"test", "a", "!=", "a"}), 1);
+  EXPECT_EQ(run(do_test, {"test", "a", "<", "b"}), 0);
+  EXPECT_EQ(run(do_test, {"test", "10", "-gt", "9"}), 0);
+  EXPECT_EQ(run(do_test, {"test", " 3 ", "-le", "2"}), 1);
+  EXPECT_EQ(run(do_test, {"test", "-d", "/"}), 0);
+  EXPECT_EQ(run(do_test, {"test", "-f", "/"}), 1);
+  EXPECT_EQ(run(do_test, {"test", "-e", "/nonexistent"}), 1);
+  EXPECT_EQ(run(do_test, {"test", "/", "-ef", "/."}), 0);
+  // operators as operands
+  EXPECT_EQ(run(do_test, {"test", "-f", "=", "-f"}), 0);
+  EXPECT_EQ(run(do_test, {"test", "!", "=", "!"}), 0);
+  EXPECT_EQ(run(do_test, {"test", "(", "-z", ")"}), 0);
+
+  // more than 4 arguments go through the grammar, -a before -o
+  EXPECT_EQ(run(do_test, {"test", "1", "-eq", "2", "-o", "a", "=", "a"}), 0);
+  EXPECT_EQ(run(do_test, {"test", "x", "-o", "x", "-a", ""}), 0);
+  EXPECT_EQ(
+      run(do_test, {"test", "(", "x", "-o", "x", ")", "-a", ""}), 1);
+  EXPECT_EQ(run(do_test, {"test", "!", "(", "a", "=", "b", ")"}), 0);
+
+  EXPECT_EQ(run(do_test, {"[", "a", "=", "a", "]"}), 0);
+  EXPECT_EQ(run(do_test, {"[", "]"}), 1);
+  EXPECT_EQ(run(do_test, {"[", "a", "=", "a"}), 2);
+  EXPECT_EQ(run(do_test, {"test", "a", "-eq", "1"}), 2);
+  EXPECT_EQ(run(do_test, {"test", "(", "a", "-a", "b"}), 2);
+  EXPECT_EQ(run(do_test, {"test", "a", "b", "c", "d", "e"}), 2);
+  EXPECT_EQ(output(), "");
+}
+
+TEST_F(CoreutilsTest, TestTrueFalse) {
+  EXPECT_EQ(run(do_true, {"true", "ignored"}), 0);
+  EXPECT_EQ(run(do_false, {"false"}), 1);
+}
+
+TEST_F(CoreutilsTest, TestCdPwd) {
+  char start[4096];
+  ASSERT_NE(getcwd(start, sizeof(start)), nullptr);
+
+  EXPECT_EQ(run(do_cd, {"cd", "/"}), 0);
+  EXPECT_STREQ(var_get("PWD"), "/");
+  EXPECT_STREQ(var_get("OLDPWD"), start);
+  run(do_pwd, {"pwd"});
+  EXPECT_EQ(output(), "/\n");
+
+  // cd - goes back and prints where to
+  EXPECT_EQ(run(do_cd, {"cd", "-"}), 0);
+  EXPECT_EQ(output(), std::string(start) + "\n");
+  run(do_pwd, {"pwd", "-P"});
+  EXPECT_EQ(output(), std::string(start) + "\n");
+
+  EXPECT_EQ(run(do_cd, {"cd", "/nonexistent"}), 1);
+  EXPECT_EQ(run(do_pwd, {"pwd", "-x"}), 2);
+  EXPECT_EQ(output(), "");
+  char cwd[4096];
+  EXPECT_STREQ(getcwd(cwd, sizeof(cwd)), start);
+}
+
+TEST_F(CoreutilsTest, TestExport) {
+  EXPECT_EQ(run(do_export, {"export", "CU_A=1", "CU_B=x\"y"}), 0);
+  EXPECT_STREQ(var_get("CU_A"), "1");
+  EXPECT_EQ(run(do_export, {"export", "1x=2", "CU_C=3", "a-b"}), 1);
+  EXPECT_STREQ(var_get("CU_C"), "3");
+  EXPECT_EQ(var_get("1x"), nullptr);
+
+  EXPECT_EQ(var_flags("CU_A"), VAR_EXPORT);
+
+  // a variable set before is exported as it is, one set later when it is
+  var_set("CU_D", "4", 0);
+  EXPECT_EQ(run(do_export, {"export", "CU_D", "CU_E"}), 0);
+  EXPECT_EQ(var_flags("CU_D"), VAR_EXPORT);
+  EXPECT_EQ(var_get("CU_E"), nullptr);
+  var_set("CU_E", "5", 0);
+  EXPECT_EQ(var_flags("CU_E"), VAR_EXPORT);
+
+  run(do_export, {"export", "-p"});
+  std::string listing = output();
+  EXPECT_NE(listing.find("export CU_A=\"1\"\nexport CU_B=\"x\\\"y\"\n"),
+            std::string::npos);
+  EXPECT_NE(listing.find("export CU_E=\"5\"\n"), std::string::npos);
+}
+
+TEST_F(CoreutilsTest, TestUnset) {
+  var_set("CU_U", "1", VAR_EXPORT);
+  EXPECT_EQ(run(do_unset, {"unset", "CU_U", "CU_NONE"}), 0);
+  EXPECT_EQ(var_flags("CU_U"), -1);
+  EXPECT_EQ(run(do_unset, {"unset", "1x"}), 1);
+}
+
+TEST_F(CoreutilsTest, TestLet) {
+  EXPECT_EQ(run(do_let, {"let", "CU_I = 2", "CU_I *= 3"}), 0);
+  EXPECT_STREQ(var_get("CU_I"), "6");
+  // the status is that of the last value
+  EXPECT_EQ(run(do_let, {"let", "CU_I - 6"}), 1);
+  EXPECT_EQ(run(do_let, {"let", "CU_I--", "CU_I"}), 0);
+  EXPECT_STREQ(var_get("CU_I"), "5");
+  EXPECT_EQ(run(do_let, {"let", "CU_I / 0"}), 1);
+  var_unset("CU_I");
+}
+
+TEST_F(CoreutilsTest, TestRead) {
+  EXPECT_EQ(read_from("  one  two three  \nnext\n", {"read", "A", "B"}), 0);
+  EXPECT_STREQ(var_get("A"), "one");
+  EXPECT_STREQ(var_get("B"), "two three");
+
+  // fields beyond the line are empty
+  EXPECT_EQ(read_from("x\n", {"read", "A", "B"}), 0);
+  EXPECT_STREQ(var_get("A"), "x");
+  EXPECT_STREQ(var_get("B"), "");
+
+  // a backslash protects from splitting and continues lines, but not with -r
+  EXPECT_EQ(read_from("a\\ b c\\\nd\n", {"read", "A", "B"}), 0);
+  EXPECT_STREQ(var_get("A"), "a b");
+  EXPECT_STREQ(var_get("B"), "cd");
+  EXPECT_EQ(read_from("a\\ b\n", {"read", "-r"}), 0);
+  EXPECT_STREQ(var_get("REPLY"), "a\\ b");
+
+  // a last line without a newline is read, with status 1
+  EXPECT_EQ(read_from("last", {"read", "A"}), 1);
+  EXPECT_STREQ(var_get("A"), "last");
+
+  var_set("IFS", ":", 0);
+  EXPECT_EQ(read_from("a::b:c\n", {"read", "A", "B", "C"}), 0);
+  EXPECT_STREQ(var_get("A"), "a");
+  EXPECT_STREQ(var_get("B"), "");
+  EXPECT_STREQ(var_get("C"), "b:c");
+  var_unset("IFS");
+
+  EXPECT_EQ(read_from("", {"read", "1x"}), 1);
+}
+
+TEST_F(CoreutilsTest, TestReadLeavesRest) {
+  // only the line is consumed, whatever reads stdin next gets the rest
+  FILE *in = tmpfile();
+  fputs("first\nsecond\n", in);
+  fflush(in);
+  lseek(fileno(in), 0, SEEK_SET);
+  int saved_in = dup(STDIN_FILENO);
+  dup2(fileno(in), STDIN_FILENO);
+  EXPECT_EQ(run(do_read, {"read", "A"}), 0);
+  char buf[16] = "";
+  EXPECT_EQ(read(STDIN_FILENO, buf, sizeof(buf) - 1), 7);
+  EXPECT_STREQ(buf, "second\n");
+  fclose(in);
+
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  write(fds[1], "one\ntwo\n", 8);
+  close(fds[1]);
+  dup2(fds[0], STDIN_FILENO);
+  EXPECT_EQ(run(do_read, {"read", "A"}), 0);
+  EXPECT_STREQ(var_get("A"), "one");
+  memset(buf, 0, sizeof(buf));
+  EXPECT_EQ(read(STDIN_FILENO, buf, sizeof(buf) - 1), 4);
+  EXPECT_STREQ(buf, "two\n");
+  dup2(saved_in, STDIN_FILENO);
+  close(saved_in);
+  close(fds[0]);
+}
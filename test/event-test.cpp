@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include "event.h"
+}
+
+class EventTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGCHLD);
+    ASSERT_EQ(event_init(&signals), 0);
+  }
+
+  void TearDown() override { event_close(); }
+
+  // return pid of a child that exits with code after ms milliseconds
+  pid_t child(int code, int ms) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      usleep(ms * 1000);
+      _exit(code);
+    }
+    return pid;
+  }
+};
+
+TEST_F(EventTest, TestTimeout) {
+  struct event_t ev;
+  EXPECT_TRUE(event_active());
+  EXPECT_EQ(event_next(&ev, 0), 0);
+  EXPECT_EQ(event_next(&ev, 10), 0);
+}
+
+TEST_F(EventTest, TestSignal) {
+  struct event_t ev;
+  raise(SIGUSR1);
+  ASSERT_EQ(event_next(&ev, 1000), 1);
+  EXPECT_EQ(ev.type, EVENT_SIGNAL);
+  EXPECT_EQ(ev.signo, SIGUSR1);
+  EXPECT_EQ(event_next(&ev, 0), 0);
+}
+
+TEST_F(EventTest, TestChildExit) {
+  pid_t pid = child(3, 0);
+  ASSERT_GT(pid, 0);
+  ASSERT_EQ(event_watch(pid, -1), 0);
+
+  // SIGCHLD comes as well, the exit is what counts
+  struct event_t ev;
+  do {
+    ASSERT_EQ(event_next(&ev, 5000), 1);
+  } while (ev.type != EVENT_EXIT);
+  EXPECT_EQ(ev.pid, pid);
+  EXPECT_TRUE(WIFEXITED(ev.status));
+  EXPECT_EQ(WEXITSTATUS(ev.status), 3);
+  // reaped by the event loop already
+  EXPECT_EQ(waitpid(pid, NULL, WNOHANG), -1);
+}
+
+TEST_F(EventTest, TestChildUsage) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  pid_t pid = fork();
+  if (pid == 0) {
+    // burn some CPU and write a known amount
+    char buf[1000] = {0};
+    for (int i = 0; i < 10; i++)
+      write(fds[1], buf, sizeof(buf));
+    for (volatile long i = 0; i < 50000000; i++)
+      ;
+    _exit(0);
+  }
+  close(fds[1]);
+  ASSERT_EQ(event_watch(pid, -1), 0);
+
+  char buf[20000];
+  while (read(fds[0], buf, sizeof(buf)) > 0)
+    ;
+  close(fds[0]);
+
+  struct event_t ev;
+  do {
+    ASSERT_EQ(event_next(&ev, 5000), 1);
+  } while (ev.type != EVENT_EXIT);
+  EXPECT_EQ(ev.pid, pid);
+  EXPECT_GE(ev.wbytes, 10000);
+  EXPECT_GT(ev.rusage.ru_maxrss, 0);
+  EXPECT_GT(ev.rusage.ru_utime.tv_sec * 1000000 + ev.rusage.ru_utime.tv_usec,
+            0);
+}
+
+TEST_F(EventTest, TestChildKilled) {
+  pid_t pid = child(0, 10000);
+  ASSERT_GT(pid, 0);
+  ASSERT_EQ(event_watch(pid, -1), 0);
+  kill(pid, SIGKILL);
+
+  struct event_t ev;
+  do {
+    ASSERT_EQ(event_next(&ev, 5000), 1);
+  } while (ev.type != EVENT_EXIT);
+  EXPECT_EQ(ev.pid, pid);
+  EXPECT_TRUE(WIFSIGNALED(ev.status));
+  EXPECT_EQ(WTERMSIG(ev.status), SIGKILL);
+}
+
+TEST_F(EventTest, TestManyChildren) {
+  const int n = 50;
+  pid_t pids[n];
+  for (int i = 0; i < n; i++) {
+    pid_t pid = child(i, i % 5);
+    ASSERT_GT(pid, 0);
+    ASSERT_EQ(event_watch(pid, -1), 0);
+    pids[i] = pid;
+  }
+
+  // every child is reported exactly once
+  int seen = 0;
+  struct event_t ev;
+  while (seen < n) {
+    ASSERT_EQ(event_next(&ev, 5000), 1);
+    if (ev.type != EVENT_EXIT)
+      continue;
+    for (int i = 0; i < n; i++) {
+      if (pids[i] == ev.pid) {
+        EXPECT_EQ(WEXITSTATUS(ev.status), i);
+        pids[i] = 0;
+        seen++;
+      }
+    }
+  }
+  EXPECT_EQ(waitpid(-1, NULL, WNOHANG), -1);
+}
@@ -0,0 +1,306 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <stdlib.h>
+#include "expand.h"
+#include "var.h"
+}
+
+class ExpandTest : public ::testing::Test {
+protected:
+  struct arena_t arena;
+  struct expand_t x;
+  char *params[4] = {(char *)"sh", (char *)"a b", (char *)"", (char *)"c"};
+
+  void SetUp() override {
+    arena_init(&arena);
+    x = {&arena, 3, 42, 4, params, NULL, NULL};
+    var_unset("IFS");
+  }
+
+  void TearDown() override {
+    var_unset("IFS");
+    arena_free(&arena);
+  }
+
+  std::vector<std::string> fields(const char *text) {
+    struct fields_t f = {};
+    EXPECT_EQ(expand_fields(&x, text, strlen(text), &f), 0) << text;
+    return std::vector<std::string>(f.v, f.v + f.n);
+  }
+
+  std::string str(const char *text) {
+    char *s = expand_str(&x, text, strlen(text));
+    return s ? s : "(error)";
+  }
+
+  std::string doc(const char *text) {
+    char *s = expand_heredoc(&x, text, strlen(text));
+    return s ? s : "(error)";
+  }
+};
+
+typedef std::vector<std::string> strings_t;
+
+TEST_F(ExpandTest, TestQuotes) {
+  EXPECT_EQ(fields("plain"), strings_t({"plain"}));
+  EXPECT_EQ(fields("'a $b'\"c\\\"\\x\"\\ d"), strings_t({"a $bc\"\\x d"}));
+  EXPECT_EQ(fields("''"), strings_t({""}));
+  EXPECT_EQ(fields("\"\""), strings_t({""}));
+  EXPECT_EQ(fields("a\\$b"), strings_t({"a$b"}));
+  EXPECT_EQ(fields("$ a$"), strings_t({"$ a$"}));
+}
+
+TEST_F(ExpandTest, TestVariables) {
+  var_set("ET_A", "1", 0);
+  var_set("ET_S", "  x  y ", 0);
+  EXPECT_EQ(fields("$ET_A"), strings_t({"1"}));
+  EXPECT_EQ(fields("${ET_A}b$ET_A.c"), strings_t({"1b1.c"}));
+  EXPECT_EQ(fields("$ET_Ab"), strings_t());
+  EXPECT_EQ(fields("$ET_NONE"), strings_t());
+  EXPECT_EQ(fields("\"$ET_NONE\""), strings_t({""}));
+  EXPECT_EQ(fields("$ET_S"), strings_t({"x", "y"}));
+  EXPECT_EQ(fields("<$ET_S>"), strings_t({"<", "x", "y", ">"}));
+  EXPECT_EQ(fields("\"$ET_S\""), strings_t({"  x  y "}));
+  EXPECT_EQ(str("$ET_S"), "  x  y ");
+  var_unset("ET_A");
+  var_unset("ET_S");
+}
+
+TEST_F(ExpandTest, TestIFS) {
+  var_set("ET_V", "a:b::c: d ", 0);
+  var_set("IFS", ": ", 0);
+  EXPECT_EQ(fields("$ET_V"), strings_t({"a", "b", "", "c", "d"}));
+  var_set("IFS", "", 0);
+  EXPECT_EQ(fields("$ET_V"), strings_t({"a:b::c: d "}));
+  var_unset("ET_V");
+}
+
+TEST_F(ExpandTest, TestSpecial) {
+  EXPECT_EQ(fields("$? $$ $#"), strings_t({"3 42 3"}));
+  EXPECT_EQ(fields("$0$3${1}"), strings_t({"shca", "b"}));
+  EXPECT_EQ(fields("$9"), strings_t());
+  EXPECT_EQ(fields("$10"), strings_t({"a", "b0"}));
+  EXPECT_EQ(fields("${10}"), strings_t());
+}
+
+TEST_F(ExpandTest, TestParams) {
+  EXPECT_EQ(fields("\"$@\""), strings_t({"a b", "", "c"}));
+  EXPECT_EQ(fields("<\"$@\">"), strings_t({"<a b", "", "c>"}));
+  EXPECT_EQ(fields("$@"), strings_t({"a", "b", "c"}));
+  EXPECT_EQ(fields("\"$*\""), strings_t({"a b  c"}));
+  var_set("IFS", ",", 0);
+  EXPECT_EQ(fields("\"$*\""), strings_t({"a b,,c"}));
+  EXPECT_EQ(str("$@"), "a b,,c");
+
+  // no parameters, no field, even in quotes
+  x.nparams = 1;
+  EXPECT_EQ(fields("\"$@\""), strings_t());
+  EXPECT_EQ(fields("\"$*\""), strings_t({""}));
+  EXPECT_EQ(fields("x\"$@\""), strings_t({"x"}));
+}
+
+TEST_F(ExpandTest, TestDefaults) {
+  var_set("ET_E", "", 0);
+  EXPECT_EQ(fields("${ET_U-a  b}"), strings_t({"a", "b"}));
+  EXPECT_EQ(fields("\"${ET_U-a  b}\""), strings_t({"a  b"}));
+  EXPECT_EQ(fields("${ET_U-\"a  b\"}"), strings_t({"a  b"}));
+  EXPECT_EQ(fields("${ET_E-x}"), strings_t());
+  EXPECT_EQ(fields("${ET_E:-x}"), strings_t({"x"}));
+  EXPECT_EQ(fields("${ET_E+x}${ET_E:+y}${ET_U+z}"), strings_t({"x"}));
+  EXPECT_EQ(fields("${1:+$3}"), strings_t({"c"}));
+  EXPECT_EQ(fields("${ET_U:-${ET_U2:-\"}\"}}"), strings_t({"}"}));
+
+  EXPECT_EQ(fields("${ET_N:=1 2}"), strings_t({"1", "2"}));
+  EXPECT_STREQ(var_get("ET_N"), "1 2");
+  EXPECT_EQ(fields("${ET_N:=3}"), strings_t({"1", "2"}));
+
+  struct fields_t f = {};
+  EXPECT_EQ(expand_fields(&x, "${ET_E:?}", 9, &f), -1);
+  EXPECT_EQ(expand_fields(&x, "${9=x}", 6, &f), -1);
+  EXPECT_EQ(fields("${ET_E?}"), strings_t());
+  var_unset("ET_E");
+  var_unset("ET_N");
+}
+
+TEST_F(ExpandTest, TestLength) {
+  var_set("ET_L", "hello", 0);
+  EXPECT_EQ(str("${#ET_L} ${#ET_U} ${#1} ${#} ${#@}"), "5 0 3 3 3");
+  var_unset("ET_L");
+}
+
+TEST_F(ExpandTest, TestSubstring) {
+  var_set("ET_S", "abcdef", 0);
+  EXPECT_EQ(str("${ET_S:2} ${ET_S:1:3} ${ET_S: -2} ${ET_S:1:-1}"),
+            "cdef bcd ef bcde");
+  EXPECT_EQ(str("[${ET_S:9}][${ET_S: -9}][${ET_S::2}]"), "[][][ab]");
+  EXPECT_EQ(fields("${@:2}"), strings_t({"c"}));
+  EXPECT_EQ(fields("\"${@:1:2}\""), strings_t({"a b", ""}));
+  EXPECT_EQ(fields("\"${@:0:1}\""), strings_t({"sh"}));
+  EXPECT_EQ(str("${ET_S:4:-3}"), "(error)");
+  // offset and length are arithmetic
+  var_set("ET_N", "2", 0);
+  EXPECT_EQ(str("${ET_S:ET_U} ${ET_S:1+1:ET_N} ${ET_S:$ET_N*2}"),
+            "abcdef cd ef");
+  EXPECT_EQ(str("${ET_S:1/0}"), "(error)");
+  var_unset("ET_N");
+  var_unset("ET_S");
+}
+
+TEST_F(ExpandTest, TestTrim) {
+  var_set("ET_F", "/usr/lib/libc.so.6", 0);
+  EXPECT_EQ(str("${ET_F##*/} ${ET_F#*/} ${ET_F%/*} ${ET_F%%.*}"),
+            "libc.so.6 usr/lib/libc.so.6 /usr/lib /usr/lib/libc");
+  EXPECT_EQ(str("${ET_F#x} ${ET_F%.[0-9]}"),
+            "/usr/lib/libc.so.6 /usr/lib/libc.so");
+  // a quoted pattern matches itself
+  var_set("ET_P", "*.so*", 0);
+  EXPECT_EQ(str("${ET_F%$ET_P}|${ET_F%\"$ET_P\"}|${ET_F#\"/usr\"}"),
+            "/usr/lib/libc|/usr/lib/libc.so.6|/lib/libc.so.6");
+  var_set("ET_P", "a*b", 0);
+  EXPECT_EQ(str("${ET_P#a\\*} ${ET_P#'a*'}"), "b b");
+  EXPECT_EQ(fields("\"${@%b}\""), strings_t({"a ", "", "c"}));
+  var_unset("ET_F");
+  var_unset("ET_P");
+}
+
+TEST_F(ExpandTest, TestReplace) {
+  var_set("ET_R", "a-b-c", 0);
+  EXPECT_EQ(str("${ET_R/-/+} ${ET_R//-/+} ${ET_R//-} ${ET_R/#a/x}"),
+            "a+b-c a+b+c abc x-b-c");
+  EXPECT_EQ(str("${ET_R/%c/x} ${ET_R/%b/x} ${ET_R//[ac]/_} ${ET_R/*/y}"),
+            "a-b-x a-b-c _-b-_ y");
+  EXPECT_EQ(str("${ET_R/#/>} ${ET_R//} ${ET_R//\\-/\\/}"),
+            ">a-b-c a-b-c a/b/c");
+  EXPECT_EQ(fields("${ET_R//-/ }"), strings_t({"a", "b", "c"}));
+  EXPECT_EQ(fields("\"${@// /_}\""), strings_t({"a_b", "", "c"}));
+  var_unset("ET_R");
+}
+
+TEST_F(ExpandTest, TestArithmetic) {
+  var_set("ET_I", "4", 0);
+  EXPECT_EQ(fields("$((ET_I * 2))"), strings_t({"8"}));
+  EXPECT_EQ(fields("x$(( (1 + 2) * $ET_I ))y"), strings_t({"x12y"}));
+  EXPECT_EQ(fields("\"$((ET_I += 1))\""), strings_t({"5"}));
+  EXPECT_STREQ(var_get("ET_I"), "5");
+  EXPECT_EQ(fields("$(( \"$ET_I\" - 1 ))$(( ${#ET_I} ))"), strings_t({"41"}));
+  // the result is split like any other
+  var_set("IFS", "0", 0);
+  EXPECT_EQ(fields("$((101))"), strings_t({"1", "1"}));
+  EXPECT_EQ(str("$((1 +))"), "(error)");
+  var_unset("ET_I");
+}
+
+// a shell that writes the command back in brackets, with newlines after it,
+// and returns its length
+static int echo_command(struct expand_t *x, const char *text, int len,
+                        char **out, size_t *outlen) {
+  std::string s = "[" + std::string(text, len) + "]\n\n";
+  *out = arena_strndup(x->arena, s.data(), s.size());
+  *outlen = s.size();
+  return len;
+}
+
+TEST_F(ExpandTest, TestCommand) {
+  x.command = echo_command;
+  // the output is split, without the newlines it ends with
+  EXPECT_EQ(fields("$(a b)"), strings_t({"[a", "b]"}));
+  EXPECT_EQ(fields("\"x$(a  b)\""), strings_t({"x[a  b]"}));
+  // and its status is $?
+  EXPECT_EQ(fields("$(abcd)$?"), strings_t({"[abcd]4"}));
+  EXPECT_EQ(x.status, 4);
+  // parentheses may be quoted in the command, or nested
+  EXPECT_EQ(fields("\"$(echo ')' \"(\")\""),
+            strings_t({"[echo ')' \"(\"]"}));
+  EXPECT_EQ(fields("\"$(a $(b) c)\""), strings_t({"[a $(b) c]"}));
+  EXPECT_EQ(fields("${ET_UNSET:-\"$(a)\"}"), strings_t({"[a]"}));
+  EXPECT_EQ(str("$(a"), "(error)");
+
+  // a backslash in backquotes escapes '$', '`' and '\\', and '"' in double
+  // quotes
+  EXPECT_EQ(fields("`a \\`b\\` \\$c \\d`"),
+            strings_t({"[a", "`b`", "$c", "\\d]"}));
+  EXPECT_EQ(fields("\"`say \\\"hi\\\"`\""), strings_t({"[say \"hi\"]"}));
+  EXPECT_EQ(str("`a"), "(error)");
+
+  // without a shell a command writes nothing
+  x.command = NULL;
+  EXPECT_EQ(fields("a$(b)"), strings_t({"a"}));
+}
+
+// a shell that names the pipe of a process after the direction and the
+// length of its command
+static char *fd_process(struct expand_t *x, const char *text, int len,
+                        int input) {
+  std::string s = "/dev/fd/" + std::to_string(input) + std::to_string(len);
+  return arena_strndup(x->arena, s.data(), s.size());
+}
+
+TEST_F(ExpandTest, TestProcess) {
+  x.process = fd_process;
+  // the path is one field, whatever IFS is
+  var_set("IFS", "/", 0);
+  EXPECT_EQ(fields("<(a b)"), strings_t({"/dev/fd/03"}));
+  EXPECT_EQ(fields(">(echo ')')"), strings_t({"/dev/fd/18"}));
+  var_unset("IFS");
+  // quoted it is text
+  EXPECT_EQ(fields("\"<(a)\""), strings_t({"<(a)"}));
+  EXPECT_EQ(fields("a<b>c"), strings_t({"a<b>c"}));
+  EXPECT_EQ(str("<(a"), "(error)");
+}
+
+TEST_F(ExpandTest, TestHeredoc) {
+  var_set("ET_A", "a  b", 0);
+  // nothing is split, and quotes are text
+  EXPECT_EQ(doc("$ET_A \"$1\" '$2'\n"), "a  b \"a b\" ''\n");
+  // a backslash escapes what it does in double quotes, and a newline
+  EXPECT_EQ(doc("\\$ET_A \\\\ \\\" \\x a\\\nb"), "$ET_A \\ \\\" \\x ab");
+  x.command = echo_command;
+  EXPECT_EQ(doc("$(a  b) `c`"), "[a  b] [c]");
+  EXPECT_EQ(doc("${ET_A"), "(error)");
+  var_unset("ET_A");
+}
+
+TEST_F(ExpandTest, TestGlob) {
+  char dir[] = "/tmp/expandglobXXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  std::string d = dir;
+  for (const char *name : {"/b.c", "/a.c", "/a*c"})
+    close(open((d + name).c_str(), O_CREAT | O_WRONLY, 0644));
+  var_set("ET_D", dir, 0);
+  var_set("ET_P", "*.c", 0);
+  var_set("ET_B", "\\?", 0);
+  x.glob = 1;
+
+  EXPECT_EQ(fields("$ET_D/a*"), strings_t({d + "/a*c", d + "/a.c"}));
+  EXPECT_EQ(fields("$ET_D/$ET_P"), strings_t({d + "/a.c", d + "/b.c"}));
+  // what is quoted matches itself, and a pattern that matches nothing stays
+  EXPECT_EQ(fields("\"$ET_D\"/a'*'c"), strings_t({d + "/a*c"}));
+  EXPECT_EQ(fields("$ET_D/\\*.c"), strings_t({d + "/*.c"}));
+  EXPECT_EQ(fields("\"$ET_D/*\""), strings_t({d + "/*"}));
+  EXPECT_EQ(fields("$ET_D/*.h"), strings_t({d + "/*.h"}));
+  EXPECT_EQ(fields("$ET_D/$ET_B"), strings_t({d + "/\\?"}));
+  EXPECT_EQ(fields("["), strings_t({"["}));
+  // nor are assignments and redirections paths
+  EXPECT_EQ(str("$ET_D/*.c"), d + "/*.c");
+
+  x.glob = 0;
+  EXPECT_EQ(fields("$ET_D/*.c"), strings_t({d + "/*.c"}));
+  var_unset("ET_D");
+  var_unset("ET_P");
+  var_unset("ET_B");
+  system(("rm -rf " + d).c_str());
+}
+
+TEST_F(ExpandTest, TestBadSubstitution) {
+  struct fields_t f = {};
+  EXPECT_EQ(expand_fields(&x, "${a b}", 6, &f), -1);
+  EXPECT_EQ(expand_fields(&x, "${a:}", 5, &f), -1);
+  EXPECT_EQ(expand_fields(&x, "${a!}", 5, &f), -1);
+  EXPECT_EQ(expand_fields(&x, "${}", 3, &f), -1);
+  EXPECT_EQ(expand_fields(&x, "${1a}", 5, &f), -1);
+  EXPECT_EQ(str("\"${a\""), "(error)");
+}
@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 extern "C" {
 #include <stdlib.h>
@@ -9,13 +12,14 @@ extern "C" {
 class JobTest: public ::testing::Test {
 protected:
 
-  struct job_t jobs[MAXJOBS]; /* job list */
+  struct joblist_t joblist; /* job list */
+  struct joblist_t *jobs = &joblist;
 
   void SetUp() override {
     initjobs(jobs);
   }
 
-  void TearDown() override {}
+  void TearDown() override { freejobs(jobs); }
 };
 
 TEST_F(JobTest, TestInitialization) {
@@ -25,7 +29,7 @@ TEST_F(JobTest, TestInitialization) {
   addjob(jobs, 12, FG, ccmd1);
 
   struct job_t *job = getjobPID(jobs, 12);
-  EXPECT_EQ(job->jid, getNextJID() - 1);
+  EXPECT_EQ(job->jid, getNextJID(jobs) - 1);
   EXPECT_EQ(job->pid, 12);
   EXPECT_EQ(job->state, FG);
   // EXPECT_EQ(job->cmdline, "tail -f &");  // address comparison, not c string compare
@@ -39,5 +43,210 @@ TEST_F(JobTest, TestAddJobs) {
   addjob(jobs, 2, BG, ccmd1);
   addjob(jobs, 3, FG, ccmd1);
   addjob(jobs, 4, BG, ccmd1);
-  EXPECT_EQ(getNextJID(), 5);  // jobs is a global value
+  EXPECT_EQ(getNextJID(jobs), 4);  // every job list has its own job ids
+}
+
+TEST_F(JobTest, TestPipelineJob) {
+  char cmd[] = "cat | sort | uniq";
+  pid_t pids[] = {20, 21, 22};
+  addjobv(jobs, pids, 3, BG, cmd);
+
+  // every member leads to the same job, led by the first process
+  struct job_t *job = getjobPID(jobs, 22);
+  ASSERT_NE(job, nullptr);
+  EXPECT_EQ(job->pid, 20);
+  EXPECT_EQ(job->nprocs, 3);
+  EXPECT_EQ(getjobPID(jobs, 21), job);
+  EXPECT_EQ(PID2JID(jobs, 21), job->jid);
+
+  EXPECT_EQ(reapmember(job, 21, 0), 2);
+  EXPECT_EQ(reapmember(job, 21, 0), 2); // reaped once only
+  EXPECT_EQ(reapmember(job, 20, 0), 1);
+  EXPECT_EQ(reapmember(job, 22, 1 << 8), 0);
+  EXPECT_TRUE(job->procs[2].reaped);
+  EXPECT_EQ(job->procs[2].status, 1 << 8);
+
+  deletejob(jobs, 22);
+  EXPECT_EQ(getjobPID(jobs, 20), nullptr);
+}
+
+TEST_F(JobTest, TestManyJobs) {
+  char cmd[] = "sleep 100 &";
+  const int n = 5000;
+  for (int i = 0; i < n; i++) {
+    ASSERT_EQ(addjob(jobs, 1000 + i, BG, cmd), SUCCESS);
+  }
+  EXPECT_EQ(jobs->njobs, n);
+  EXPECT_GE(jobs->nslots, n);
+
+  struct job_t *job = getjobPID(jobs, 1000 + 1234);
+  ASSERT_NE(job, nullptr);
+  EXPECT_EQ(getjobJID(jobs, job->jid), job);
+
+  // delete every other job, the rest must stay reachable through the indexes
+  for (int i = 0; i < n; i += 2) {
+    ASSERT_EQ(deletejob(jobs, 1000 + i), SUCCESS);
+  }
+  EXPECT_EQ(jobs->njobs, n / 2);
+  for (int i = 0; i < n; i++) {
+    struct job_t *job = getjobPID(jobs, 1000 + i);
+    if (i % 2 == 0) {
+      EXPECT_EQ(job, nullptr);
+    } else {
+      ASSERT_NE(job, nullptr);
+      EXPECT_EQ(job->pid, 1000 + i);
+      EXPECT_EQ(getjobJID(jobs, job->jid), job);
+    }
+  }
+
+  int count = 0;
+  for (struct job_t *job = nextjob(jobs, NULL); job; job = nextjob(jobs, job))
+    count++;
+  EXPECT_EQ(count, n / 2);
+}
+
+TEST_F(JobTest, TestForegroundJob) {
+  char cmd[] = "vi";
+  EXPECT_EQ(fgPID(jobs), 0);
+  addjob(jobs, 30, BG, cmd);
+  addjob(jobs, 31, FG, cmd);
+  EXPECT_EQ(fgPID(jobs), 31);
+
+  setjobstate(jobs, getjobPID(jobs, 31), ST);
+  EXPECT_EQ(fgPID(jobs), 0);
+  setjobstate(jobs, getjobPID(jobs, 30), FG);
+  EXPECT_EQ(fgPID(jobs), 30);
+  deletejob(jobs, 30);
+  EXPECT_EQ(fgPID(jobs), 0);
+}
+
+TEST_F(JobTest, TestLowestFreeJID) {
+  char cmd[] = "sleep 1 &";
+  for (int i = 1; i <= 5; i++)
+    addjob(jobs, 100 + i, BG, cmd);
+  deletejob(jobs, 102);
+  deletejob(jobs, 104);
+  EXPECT_EQ(getNextJID(jobs), 2);
+  addjob(jobs, 200, BG, cmd);
+  EXPECT_EQ(getjobPID(jobs, 200)->jid, 2);
+  addjob(jobs, 201, BG, cmd);
+  EXPECT_EQ(getjobPID(jobs, 201)->jid, 4);
+  EXPECT_EQ(getNextJID(jobs), 6);
+}
+
+TEST_F(JobTest, TestJIDExhaustion) {
+  char cmd[] = "sleep 1 &";
+  for (int i = 1; i < MAXJID; i++)
+    ASSERT_EQ(addjob(jobs, i, BG, cmd), SUCCESS);
+  EXPECT_EQ(getNextJID(jobs), 0);
+  EXPECT_EQ(addjob(jobs, MAXJID, BG, cmd), FAILURE);
+
+  // a released id is handed out again, never one still in use
+  deletejob(jobs, 777);
+  ASSERT_EQ(addjob(jobs, MAXJID, BG, cmd), SUCCESS);
+  EXPECT_EQ(getjobPID(jobs, MAXJID)->jid, 777);
+}
+
+TEST_F(JobTest, TestJIDChurn) {
+  char cmd[] = "sleep 1 &";
+  std::set<int> freejids;
+  std::vector<pid_t> live;
+  for (int jid = 1; jid < 512; jid++)
+    freejids.insert(jid);
+
+  // random add/delete cycles against a reference set of free ids
+  unsigned int seed = 42;
+  pid_t nextpid = 1;
+  for (int i = 0; i < 2000000; i++) {
+    seed = seed * 1103515245 + 12345;
+    if (live.size() < 256 && (live.empty() || (seed >> 16) % 2 == 0)) {
+      ASSERT_EQ(addjob(jobs, nextpid, BG, cmd), SUCCESS);
+      int jid = getjobPID(jobs, nextpid)->jid;
+      ASSERT_EQ(jid, *freejids.begin());
+      freejids.erase(freejids.begin());
+      live.push_back(nextpid++);
+    } else {
+      size_t k = (seed >> 8) % live.size();
+      pid_t pid = live[k];
+      freejids.insert(getjobPID(jobs, pid)->jid);
+      ASSERT_EQ(deletejob(jobs, pid), SUCCESS);
+      live[k] = live.back();
+      live.pop_back();
+    }
+  }
+  EXPECT_EQ(getNextJID(jobs), *freejids.begin());
+}
+
+TEST_F(JobTest, TestUsage) {
+  char cmd[] = "make | tee log";
+  pid_t pids[] = {30, 31};
+  addjobv(jobs, pids, 2, BG, cmd);
+  struct job_t *job = getjobPID(jobs, 30);
+  EXPECT_GT(job->start, 0);
+  EXPECT_EQ(job->end, 0);
+
+  struct rusage ru;
+  memset(&ru, 0, sizeof(ru));
+  ru.ru_utime.tv_sec = 1;
+  ru.ru_stime.tv_usec = 2500;
+  ru.ru_maxrss = 4000;
+  ru.ru_nvcsw = 3;
+  reapmember(job, 30, 0);
+  addusage(job, &ru, 100, 10);
+  EXPECT_EQ(job->end, 0);
+
+  // times and counters add up, the peak resident set is the largest one
+  ru.ru_maxrss = 1000;
+  reapmember(job, 31, 0);
+  addusage(job, &ru, 50, 5);
+  EXPECT_GE(job->end, job->start);
+  EXPECT_EQ(job->usage.utime, 2000000);
+  EXPECT_EQ(job->usage.stime, 5000);
+  EXPECT_EQ(job->usage.maxrss, 4000);
+  EXPECT_EQ(job->usage.nvcsw, 6);
+  EXPECT_EQ(job->usage.rbytes, 150);
+  EXPECT_EQ(job->usage.wbytes, 15);
+
+  char buf[256];
+  formatusage(buf, sizeof(buf), job);
+  EXPECT_NE(strstr(buf, "user 2000ms sys 5ms maxrss 4000KB csw 6/0 "
+                        "read 150B written 15B"),
+            nullptr);
+
+  // a reused slot starts from scratch
+  deletejob(jobs, 30);
+  addjob(jobs, 32, BG, cmd);
+  EXPECT_EQ(getjobPID(jobs, 32)->usage.utime, 0);
+}
+
+TEST_F(JobTest, TestLongCmdline) {
+  std::string cmd(100000, 'x');
+  cmd += " &";
+  ASSERT_EQ(addjob(jobs, 1, BG, &cmd[0]), SUCCESS);
+  EXPECT_EQ(std::string(getjobPID(jobs, 1)->cmdline), cmd);
+}
+
+TEST_F(JobTest, TestCmdlineChurn) {
+  std::map<pid_t, std::string> live;
+
+  // command lines of every length, so the pool both grows and compacts
+  unsigned int seed = 7;
+  pid_t nextpid = 1;
+  for (int i = 0; i < 200000; i++) {
+    seed = seed * 1103515245 + 12345;
+    if (live.size() < 200 && (live.empty() || (seed >> 16) % 2 == 0)) {
+      std::string cmd((seed >> 4) % 3000, 'a' + nextpid % 26);
+      ASSERT_EQ(addjob(jobs, nextpid, BG, &cmd[0]), SUCCESS);
+      live[nextpid++] = cmd;
+    } else {
+      auto it = live.begin();
+      std::advance(it, (seed >> 8) % live.size());
+      ASSERT_EQ(deletejob(jobs, it->first), SUCCESS);
+      live.erase(it);
+    }
+    if (i % 1000 == 0) {
+      for (auto &it : live)
+        ASSERT_EQ(std::string(getjobPID(jobs, it.first)->cmdline), it.second);
+    }
+  }
 }
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include <string>
+
+extern "C" {
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include "launch.h"
+}
+
+extern "C" char **environ;
+
+class LaunchTest : public ::testing::TestWithParam<int> {
+protected:
+  void SetUp() override { launch_backend = GetParam(); }
+
+  void TearDown() override { launch_backend = LAUNCH_VFORK; }
+};
+
+TEST_P(LaunchTest, TestExitStatus) {
+  char path[] = "/bin/sh";
+  char flag[] = "-c";
+  char script[] = "exit 3";
+  char *argv[] = {path, flag, script, NULL};
+  struct launch_t spec = {.argv = argv, .envp = environ};
+
+  pid_t pid = launch(&spec);
+  ASSERT_GT(pid, 0);
+  int status;
+  EXPECT_EQ(waitpid(pid, &status, 0), pid);
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 3);
+}
+
+TEST_P(LaunchTest, TestNewProcessGroup) {
+  char path[] = "/bin/sh";
+  char flag[] = "-c";
+  char script[] = "sleep 1";
+  char *argv[] = {path, flag, script, NULL};
+  struct launch_t spec = {.argv = argv, .envp = environ, .pgid = 0};
+
+  pid_t pid = launch(&spec);
+  ASSERT_GT(pid, 0);
+  EXPECT_EQ(getpgid(pid), pid);
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+}
+
+TEST_P(LaunchTest, TestCommandNotFound) {
+  char path[] = "/no/such/program";
+  char *argv[] = {path, NULL};
+  struct launch_t spec = {.argv = argv, .envp = environ};
+
+  EXPECT_EQ(launch(&spec), -1);
+  EXPECT_EQ(errno, ENOENT);
+  // the failed child has been reaped already
+  EXPECT_EQ(waitpid(-1, NULL, WNOHANG), -1);
+}
+
+TEST_P(LaunchTest, TestRedirection) {
+  char tmpl[] = "/tmp/launchXXXXXX";
+  int fd = mkstemp(tmpl);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  char path[] = "/bin/sh";
+  char flag[] = "-c";
+  char script[] = "echo out; echo err >&2";
+  char *argv[] = {path, flag, script, NULL};
+  struct launch_action_t actions[2] = {
+      {.type = LAUNCH_OPEN, .fd = 1, .path = tmpl,
+       .flags = O_WRONLY | O_TRUNC, .mode = 0666},
+      {.type = LAUNCH_DUP2, .fd = 2, .src = 1},
+  };
+  struct launch_t spec = {.argv = argv, .envp = environ, .actions = actions,
+                          .nactions = 2};
+
+  pid_t pid = launch(&spec);
+  ASSERT_GT(pid, 0);
+  waitpid(pid, NULL, 0);
+
+  char buf[64] = {0};
+  fd = open(tmpl, O_RDONLY);
+  EXPECT_EQ(read(fd, buf, sizeof(buf)), 8);
+  EXPECT_STREQ(buf, "out\nerr\n");
+  close(fd);
+  unlink(tmpl);
+}
+
+TEST_P(LaunchTest, TestFailedAction) {
+  char path[] = "/bin/true";
+  char *argv[] = {path, NULL};
+  struct launch_action_t actions[1] = {
+      {.type = LAUNCH_OPEN, .fd = 0, .path = "/no/such/file",
+       .flags = O_RDONLY},
+  };
+  struct launch_t spec = {.argv = argv, .envp = environ, .actions = actions,
+                          .nactions = 1};
+
+  EXPECT_EQ(launch(&spec), -1);
+  EXPECT_EQ(errno, ENOENT);
+  if (GetParam() != LAUNCH_POSIX_SPAWN)
+    EXPECT_EQ(spec.failed, 0);
+}
+
+TEST_P(LaunchTest, TestPidfd) {
+  char path[] = "/bin/sh";
+  char flag[] = "-c";
+  char script[] = "exit 5";
+  char *argv[] = {path, flag, script, NULL};
+  int pidfd = -2;
+  struct launch_t spec = {.argv = argv, .envp = environ, .pidfd = &pidfd};
+
+  pid_t pid = launch(&spec);
+  ASSERT_GT(pid, 0);
+  ASSERT_GE(pidfd, 0);
+  siginfo_t info;
+  ASSERT_EQ(waitid((idtype_t)P_PIDFD, pidfd, &info, WEXITED), 0);
+  EXPECT_EQ(info.si_pid, pid);
+  EXPECT_EQ(info.si_status, 5);
+  close(pidfd);
+
+  // no pidfd is left behind by a child that cannot be executed
+  char missing[] = "/no/such/program";
+  char *argv2[] = {missing, NULL};
+  spec.argv = argv2;
+  EXPECT_EQ(launch(&spec), -1);
+  EXPECT_EQ(pidfd, -1);
+}
+
+TEST_P(LaunchTest, TestTimes) {
+  char path[] = "/bin/true";
+  char *argv[] = {path, NULL};
+  struct launch_t spec = {.argv = argv, .envp = environ};
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  long start = ts.tv_sec * 1000000000L + ts.tv_nsec;
+  pid_t pid = launch(&spec);
+  ASSERT_GT(pid, 0);
+  waitpid(pid, NULL, 0);
+
+  // the child is created before its exec is seen
+  EXPECT_GE(spec.forked, start);
+  EXPECT_GE(spec.execed, spec.forked);
+}
+
+TEST_P(LaunchTest, TestStats) {
+  long before = launch_stats(GetParam())->count;
+  char path[] = "/bin/true";
+  char *argv[] = {path, NULL};
+  struct launch_t spec = {.argv = argv, .envp = environ};
+
+  pid_t pid = launch(&spec);
+  ASSERT_GT(pid, 0);
+  waitpid(pid, NULL, 0);
+  EXPECT_EQ(launch_stats(GetParam())->count, before + 1);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, LaunchTest,
+                         ::testing::Values(LAUNCH_FORK, LAUNCH_VFORK,
+                                           LAUNCH_POSIX_SPAWN, LAUNCH_CLONE));
+
+TEST(LaunchBackendTest, TestParseBackend) {
+  EXPECT_EQ(launch_parse_backend("posix_spawn"), LAUNCH_POSIX_SPAWN);
+  EXPECT_EQ(launch_parse_backend("clone"), LAUNCH_CLONE);
+  EXPECT_EQ(launch_parse_backend("spoon"), -1);
+  EXPECT_STREQ(launch_backend_name(LAUNCH_FORK), "fork");
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <string>
+
+extern "C" {
+#include "match.h"
+}
+
+class MatchTest : public ::testing::Test {
+protected:
+  struct arena_t arena;
+
+  void SetUp() override { arena_init(&arena); }
+  void TearDown() override { arena_free(&arena); }
+
+  struct match_t *compile(const std::string &pattern) {
+    return match_compile(&arena, pattern.data(), pattern.size());
+  }
+
+  bool matches(const std::string &pattern, const std::string &s) {
+    return match(compile(pattern), s.data(), s.size());
+  }
+};
+
+TEST_F(MatchTest, TestLiteral) {
+  EXPECT_TRUE(matches("", ""));
+  EXPECT_FALSE(matches("", "a"));
+  EXPECT_TRUE(matches("abc", "abc"));
+  EXPECT_FALSE(matches("abc", "abd"));
+  EXPECT_FALSE(matches("abc", "abcd"));
+  EXPECT_TRUE(matches("a\\*c", "a*c"));
+  EXPECT_FALSE(matches("a\\*c", "abc"));
+  EXPECT_TRUE(match_isliteral(compile("a\\?b")));
+  EXPECT_FALSE(match_isliteral(compile("a?b")));
+}
+
+TEST_F(MatchTest, TestStar) {
+  EXPECT_TRUE(matches("*", ""));
+  EXPECT_TRUE(matches("*", "anything"));
+  EXPECT_TRUE(matches("*.c", "main.c"));
+  EXPECT_FALSE(matches("*.c", "main.h"));
+  EXPECT_TRUE(matches("lib*.so*", "libfoo.so.1"));
+  EXPECT_TRUE(matches("a*b*c", "abc"));
+  EXPECT_TRUE(matches("a*b*c", "aXbYbZc"));
+  EXPECT_FALSE(matches("a*b*c", "aXbYbZ"));
+  // the literal after a star has to be found again past a false start
+  EXPECT_TRUE(matches("*ab", "aab"));
+  EXPECT_TRUE(matches("*aab*x", "aaaabyaabx"));
+  EXPECT_TRUE(matches("a**b", "ab"));
+  EXPECT_FALSE(matches("a*a", "a"));
+}
+
+TEST_F(MatchTest, TestSets) {
+  EXPECT_TRUE(matches("?", "x"));
+  EXPECT_FALSE(matches("?", ""));
+  EXPECT_TRUE(matches("[abc]", "b"));
+  EXPECT_FALSE(matches("[abc]", "d"));
+  EXPECT_TRUE(matches("[a-c]x", "cx"));
+  EXPECT_TRUE(matches("[!a-c]", "d"));
+  EXPECT_FALSE(matches("[^a-c]", "a"));
+  EXPECT_TRUE(matches("[]]", "]"));
+  EXPECT_TRUE(matches("[a-]", "-"));
+  EXPECT_TRUE(matches("[[:digit:]][[:upper:]]", "1A"));
+  EXPECT_FALSE(matches("[[:digit:]]", "a"));
+  EXPECT_TRUE(matches("[\\]]", "]"));
+  // a '[' that is not closed is itself
+  EXPECT_TRUE(matches("[ab", "[ab"));
+  EXPECT_TRUE(matches("*[0-9].?", "file9.c"));
+}
+
+TEST_F(MatchTest, TestPrefixSuffix) {
+  std::string path = "/usr/local/lib/libfoo.so.1";
+  struct match_t *m = compile("*/");
+  EXPECT_EQ(match_prefix(m, path.data(), path.size(), 0), 1);
+  EXPECT_EQ(match_prefix(m, path.data(), path.size(), 1), 15);
+  m = compile(".*");
+  EXPECT_EQ(match_suffix(m, path.data(), path.size(), 0), 24);
+  EXPECT_EQ(match_suffix(m, path.data(), path.size(), 1), 21);
+  m = compile("/usr");
+  EXPECT_EQ(match_prefix(m, path.data(), path.size(), 1), 4);
+  EXPECT_EQ(match_suffix(m, path.data(), path.size(), 1), -1);
+  m = compile("x*");
+  EXPECT_EQ(match_prefix(m, path.data(), path.size(), 0), -1);
+  // the empty prefix or suffix matches a star
+  m = compile("*");
+  EXPECT_EQ(match_prefix(m, path.data(), path.size(), 0), 0);
+  EXPECT_EQ(match_suffix(m, path.data(), path.size(), 0), (long)path.size());
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+// runs the shell on commands fed to its stdin, the way a driver does
+class MyappTest : public ::testing::Test {
+protected:
+  // return what the shell prints, stdout and stderr as one, running input
+  std::string run(const std::string &input) {
+    int in[2], out[2];
+    EXPECT_EQ(pipe(in), 0);
+    EXPECT_EQ(pipe(out), 0);
+    pid_t pid = fork();
+    if (pid == 0) {
+      dup2(in[0], STDIN_FILENO);
+      dup2(out[1], STDOUT_FILENO);
+      close(in[0]);
+      close(in[1]);
+      close(out[0]);
+      close(out[1]);
+      execl(MYAPP, MYAPP, "-p", (char *)NULL);
+      _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    std::thread t([&] {
+      EXPECT_EQ(write(in[1], input.data(), input.size()),
+                (ssize_t)input.size());
+      close(in[1]);
+    });
+    std::string output;
+    char buf[4096];
+    for (ssize_t n; (n = read(out[0], buf, sizeof(buf))) > 0;)
+      output.append(buf, n);
+    close(out[0]);
+    t.join();
+    int status;
+    waitpid(pid, &status, 0);
+    return output;
+  }
+};
+
+TEST_F(MyappTest, TestQuoteLines) {
+  // a quote left open goes on with the next line
+  EXPECT_EQ(run("echo \"a\nb\"\necho 'c\n\nd'\n"), "a\nb\nc\n\nd\n");
+  EXPECT_EQ(run("echo \"open\n"), "syntax error: unterminated quote\n");
+}
+
+TEST_F(MyappTest, TestEscapedNewline) {
+  EXPECT_EQ(run("echo x \\\ny\necho z\\\nw\n"), "x y\nzw\n");
+  EXPECT_EQ(run("echo a |\ncat\necho b &&\n\necho c\n"), "a\nb\nc\n");
+}
+
+TEST_F(MyappTest, TestSubstitutionLines) {
+  EXPECT_EQ(run("echo $(echo p\necho q)\necho ${zz:-\nw}\n"), "p q\nw\n");
+  EXPECT_EQ(run("echo $((1 +\n2))\n"), "3\n");
+  EXPECT_EQ(run("echo $(echo p\n"), "syntax error: missing ')'\n");
+}
+
+TEST_F(MyappTest, TestHeredocLines) {
+  // the body is read from the lines after the command, never run
+  EXPECT_EQ(run("cat <<EOF\nhello\nEOF\necho done\n"), "hello\ndone\n");
+  EXPECT_EQ(run("cat <<A; cat <<-B\na\nA\n\tb\n\tB\n"), "a\nb\n");
+  EXPECT_EQ(run("cat <<EOF\nno end\n"), "no end\n");
+  // longer than what the read loop keeps of a delimiter
+  std::string delim(100, 'D');
+  EXPECT_EQ(run("cat <<" + delim + "\nx\n" + delim + "\necho y\n"),
+            "x\ny\n");
+}
+
+TEST_F(MyappTest, TestHeredocLarge) {
+  // a body of many lines is parsed once, not once for each of its lines
+  std::string body;
+  for (int i = 0; i < 100000; i++)
+    body += "key" + std::to_string(i) + " = value\n";
+  EXPECT_EQ(run("cat <<EOF\n" + body + "EOF\n"), body);
+}
+
+TEST_F(MyappTest, TestErrorOrder) {
+  // stdout is buffered in batch mode, the messages on stderr come after what
+  // the commands before them printed all the same
+  EXPECT_EQ(run("echo a; echo ${zz:?is unset}; echo b; cd /nonexist; echo c\n"),
+            "a\nzz: is unset\nb\ncd: /nonexist: No such file or directory\nc\n");
+  EXPECT_EQ(run("echo a\necho b >/nonexist/f\necho c; echo ${x!}\n"),
+            "a\n/nonexist/f: No such file or directory\nc\n${x!}: bad "
+            "substitution\n");
+}
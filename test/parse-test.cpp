@@ -0,0 +1,457 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <string.h>
+#include "arena.h"
+#include "parse.h"
+}
+
+class ParseTest : public ::testing::Test {
+protected:
+  struct arena_t arena;
+  struct parser_t parser;
+  std::string src;
+
+  void SetUp() override { arena_init(&arena); }
+  void TearDown() override { arena_free(&arena); }
+
+  void start(const std::string &s) {
+    src = s;
+    parser_init(&parser, &arena, src.data(), src.size());
+  }
+
+  // parse the only complete command of s
+  struct node_t *parse(const std::string &s) {
+    start(s);
+    struct node_t *list = NULL;
+    EXPECT_EQ(parse_next(&parser, &list), 1) << parser.error;
+    return list;
+  }
+
+  std::vector<std::string> words(const struct cmd_t *cmd) {
+    std::vector<std::string> v;
+    for (const struct word_t *w = cmd->words; w; w = w->next)
+      v.push_back(word_str(&arena, w));
+    return v;
+  }
+
+  std::string text(const struct node_t *node) {
+    return std::string(node->text, node->len);
+  }
+};
+
+TEST_F(ParseTest, TestWords) {
+  struct node_t *list = parse("  echo   a\tb  \n");
+  ASSERT_NE(list, nullptr);
+  EXPECT_EQ(list->type, NODE_PIPE);
+  EXPECT_EQ(list->bg, 0);
+  EXPECT_EQ(list->next, nullptr);
+  ASSERT_EQ(list->ncmds, 1);
+  EXPECT_EQ(words(list->cmds), std::vector<std::string>({"echo", "a", "b"}));
+  EXPECT_EQ(text(list), "echo   a\tb");
+
+  // words point into the source
+  const char *w = list->cmds->words->next->text;
+  EXPECT_TRUE(w >= src.data() && w < src.data() + src.size());
+}
+
+TEST_F(ParseTest, TestQuotes) {
+  struct node_t *list =
+      parse("echo 'a  b' \"c \\\" \\$ \\\\ \\x\" d\\ e f'g'\"h\" '' x#y");
+  ASSERT_NE(list, nullptr);
+  EXPECT_EQ(words(list->cmds),
+            std::vector<std::string>(
+                {"echo", "a  b", "c \" $ \\ \\x", "d e", "fgh", "", "x#y"}));
+  EXPECT_EQ(list->cmds->words->flags, 0);
+  EXPECT_EQ(list->cmds->words->next->flags, WORD_QUOTED);
+  EXPECT_EQ(list->cmds->words->next->next->next->flags, WORD_ESCAPED);
+
+  // patterns are marked unless quoted
+  list = parse("ls *.c 'a*' \\? b[ch] \"?\"x?");
+  const struct word_t *w = list->cmds->words->next;
+  EXPECT_EQ(w->flags, WORD_GLOB);
+  EXPECT_EQ(w->next->flags, WORD_QUOTED);
+  EXPECT_EQ(w->next->next->flags, WORD_ESCAPED);
+  EXPECT_EQ(w->next->next->next->flags, WORD_GLOB);
+  EXPECT_EQ(w->next->next->next->next->flags, WORD_QUOTED | WORD_GLOB);
+}
+
+TEST_F(ParseTest, TestParameters) {
+  struct node_t *list = parse("echo $a \"x $b\" '$c' \\$d ${e f}g $");
+  ASSERT_NE(list, nullptr);
+  // an escaped '$' starts no parameter
+  std::vector<int> flags;
+  for (const struct word_t *w = list->cmds->words; w; w = w->next)
+    flags.push_back(w->flags);
+  EXPECT_EQ(flags, std::vector<int>({0, WORD_EXPAND,
+                                     WORD_QUOTED | WORD_EXPAND, WORD_QUOTED,
+                                     WORD_ESCAPED, WORD_EXPAND,
+                                     WORD_EXPAND}));
+  // blanks in braces are part of the word
+  EXPECT_EQ(list->cmds->nwords, 7);
+  EXPECT_EQ(std::string(list->cmds->words->next->next->next->next->next->text,
+                        list->cmds->words->next->next->next->next->next->len),
+            "${e f}g");
+
+  // and so may the words of operators, with braces and quotes of their own
+  list = parse("echo ${a:-\"}\" ${b}}x \"${c#'\"'}\" y");
+  ASSERT_NE(list, nullptr);
+  EXPECT_EQ(list->cmds->nwords, 4);
+  EXPECT_EQ(std::string(list->cmds->words->next->text,
+                        list->cmds->words->next->len),
+            "${a:-\"}\" ${b}}x");
+
+  // arithmetic is one word too
+  list = parse("echo $(( (a + 1) * 2 ))x \"$((b ))\"");
+  ASSERT_NE(list, nullptr);
+  EXPECT_EQ(list->cmds->nwords, 3);
+  EXPECT_EQ(std::string(list->cmds->words->next->text,
+                        list->cmds->words->next->len),
+            "$(( (a + 1) * 2 ))x");
+
+  // and so are commands, with parentheses and blanks in quotes
+  list = parse("echo $(echo ')' \"(\")x `a b` \"`c d`\"");
+  ASSERT_NE(list, nullptr);
+  EXPECT_EQ(list->cmds->nwords, 4);
+  EXPECT_EQ(std::string(list->cmds->words->next->text,
+                        list->cmds->words->next->len),
+            "$(echo ')' \"(\")x");
+  flags.clear();
+  for (const struct word_t *w = list->cmds->words; w; w = w->next)
+    flags.push_back(w->flags);
+  EXPECT_EQ(flags, std::vector<int>({0, WORD_EXPAND, WORD_EXPAND,
+                                     WORD_QUOTED | WORD_EXPAND}));
+
+  // a process substitution is a word of its own, not a redirection
+  list = parse("diff <(sort a) >(wc -l) < <(cat b)");
+  ASSERT_NE(list, nullptr);
+  EXPECT_EQ(words(list->cmds),
+            std::vector<std::string>({"diff", "<(sort a)", ">(wc -l)"}));
+  ASSERT_EQ(list->cmds->nredirs, 1);
+  EXPECT_EQ(list->cmds->redirs->type, REDIR_IN);
+  EXPECT_EQ(std::string(list->cmds->redirs->target.text,
+                        list->cmds->redirs->target.len),
+            "<(cat b)");
+  EXPECT_EQ(list->cmds->words->next->flags, WORD_EXPAND);
+
+  struct node_t *bad = NULL;
+  start("cat <(echo\n");
+  EXPECT_EQ(parse_next(&parser, &bad), -1);
+  EXPECT_STREQ(parser.error, "syntax error: missing ')'");
+  start("echo $(echo \")\"\n");
+  EXPECT_EQ(parse_next(&parser, &bad), -1);
+  EXPECT_STREQ(parser.error, "syntax error: missing ')'");
+  start("echo `a\n");
+  EXPECT_EQ(parse_next(&parser, &bad), -1);
+  EXPECT_STREQ(parser.error, "syntax error: missing '`'");
+  start("echo $((1 + 2)\n");
+  EXPECT_EQ(parse_next(&parser, &bad), -1);
+  EXPECT_STREQ(parser.error, "syntax error: missing ')'");
+  start("echo ${a\nb\n");
+  EXPECT_EQ(parse_next(&parser, &bad), -1);
+  EXPECT_STREQ(parser.error, "syntax error: missing '}'");
+}
+
+TEST_F(ParseTest, TestAssignments) {
+  struct node_t *list = parse("A=1 _b=\"x y\" >out c=2 cmd d=3");
+  ASSERT_NE(list, nullptr);
+  const struct cmd_t *cmd = list->cmds;
+  ASSERT_EQ(cmd->nassigns, 3);
+  EXPECT_STREQ(word_str(&arena, cmd->assigns), "A=1");
+  EXPECT_STREQ(word_str(&arena, cmd->assigns->next), "_b=x y");
+  EXPECT_STREQ(word_str(&arena, cmd->assigns->next->next), "c=2");
+  EXPECT_EQ(cmd->nredirs, 1);
+  // after the command name they are arguments
+  EXPECT_EQ(words(cmd), std::vector<std::string>({"cmd", "d=3"}));
+
+  // a command may be assignments alone, which are not words
+  list = parse("x=1 y=");
+  ASSERT_NE(list, nullptr);
+  EXPECT_EQ(list->cmds->nassigns, 2);
+  EXPECT_EQ(list->cmds->nwords, 0);
+
+  // no name, no assignment
+  list = parse("=1 1x=2 'a'=3 a-b=4");
+  ASSERT_NE(list, nullptr);
+  EXPECT_EQ(list->cmds->nassigns, 0);
+  EXPECT_EQ(list->cmds->nwords, 4);
+}
+
+TEST_F(ParseTest, TestOperators) {
+  struct node_t *list = parse("a | b | c && d || e; f & g");
+  ASSERT_NE(list, nullptr);
+
+  // (a | b | c && d) || e
+  EXPECT_EQ(list->type, NODE_OR);
+  EXPECT_EQ(text(list), "a | b | c && d || e");
+  ASSERT_EQ(list->left->type, NODE_AND);
+  struct node_t *pipe = list->left->left;
+  ASSERT_EQ(pipe->type, NODE_PIPE);
+  EXPECT_EQ(pipe->ncmds, 3);
+  EXPECT_EQ(text(pipe), "a | b | c");
+  EXPECT_EQ(words(pipe->cmds->next->next), std::vector<std::string>({"c"}));
+  EXPECT_EQ(text(list->left->right), "d");
+  EXPECT_EQ(text(list->right), "e");
+
+  // f runs in the background, its text keeps the &
+  struct node_t *f = list->next;
+  ASSERT_NE(f, nullptr);
+  EXPECT_EQ(f->bg, 1);
+  EXPECT_EQ(text(f), "f &");
+  ASSERT_NE(f->next, nullptr);
+  EXPECT_EQ(f->next->bg, 0);
+  EXPECT_EQ(f->next->next, nullptr);
+}
+
+TEST_F(ParseTest, TestNewlines) {
+  start("a &&\n\n b |\n c\\\n d\n# comment\n\ne # trailing\n");
+  struct node_t *list;
+  ASSERT_EQ(parse_next(&parser, &list), 1);
+  ASSERT_EQ(list->type, NODE_AND);
+  EXPECT_EQ(list->right->ncmds, 2);
+  EXPECT_EQ(words(list->right->cmds->next),
+            std::vector<std::string>({"c", "d"}));
+
+  // a comment line and a blank line parse as nothing
+  ASSERT_EQ(parse_next(&parser, &list), 1);
+  EXPECT_EQ(list, nullptr);
+  ASSERT_EQ(parse_next(&parser, &list), 1);
+  EXPECT_EQ(list, nullptr);
+  ASSERT_EQ(parse_next(&parser, &list), 1);
+  EXPECT_EQ(words(list->cmds), std::vector<std::string>({"e"}));
+  EXPECT_EQ(parser.line, 9);
+  EXPECT_EQ(parse_next(&parser, &list), 0);
+}
+
+TEST_F(ParseTest, TestRedirections) {
+  struct node_t *list = parse("cmd <in a 2>err >>log b 1>&2 <&0 >out");
+  ASSERT_NE(list, nullptr);
+  struct cmd_t *cmd = list->cmds;
+  EXPECT_EQ(words(cmd), std::vector<std::string>({"cmd", "a", "b"}));
+  ASSERT_EQ(cmd->nredirs, 6);
+
+  struct {
+    int type, fd;
+    const char *target;
+  } want[] = {{REDIR_IN, 0, "in"},     {REDIR_OUT, 2, "err"},
+              {REDIR_APPEND, 1, "log"}, {REDIR_DUP, 1, "2"},
+              {REDIR_DUP, 0, "0"},      {REDIR_OUT, 1, "out"}};
+  struct redir_t *r = cmd->redirs;
+  for (auto &w : want) {
+    ASSERT_NE(r, nullptr);
+    EXPECT_EQ(r->type, w.type);
+    EXPECT_EQ(r->fd, w.fd);
+    EXPECT_EQ(std::string(word_str(&arena, &r->target)), w.target);
+    r = r->next;
+  }
+
+  // digits apart from the operator are an argument
+  list = parse("echo 2 >x");
+  EXPECT_EQ(words(list->cmds), std::vector<std::string>({"echo", "2"}));
+  EXPECT_EQ(list->cmds->redirs->fd, 1);
+
+  // a command may be made of redirections only
+  list = parse(">file");
+  EXPECT_EQ(list->cmds->nwords, 0);
+  EXPECT_EQ(list->cmds->nredirs, 1);
+}
+
+TEST_F(ParseTest, TestHeredocs) {
+  // bodies follow the line, in the order of their redirections
+  start("cat <<EOF 3<<-'END'; echo x <<<\"a $b\"\nline $x\nEOF\n\tx \"$y\"\n\tEND\n"
+        "next\n");
+  struct node_t *list = NULL;
+  ASSERT_EQ(parse_next(&parser, &list), 1) << parser.error;
+  ASSERT_NE(list, nullptr);
+  struct redir_t *r = list->cmds->redirs;
+  EXPECT_EQ(r->type, REDIR_HEREDOC);
+  EXPECT_EQ(r->fd, 0);
+  EXPECT_EQ(std::string(r->target.text, r->target.len), "line $x\n");
+  EXPECT_EQ(r->target.flags, WORD_EXPAND);
+  r = r->next;
+  EXPECT_EQ(r->fd, 3);
+  EXPECT_EQ(std::string(r->target.text, r->target.len), "x \"$y\"\n");
+  EXPECT_EQ(r->target.flags, 0);
+  r = list->next->cmds->redirs;
+  EXPECT_EQ(r->type, REDIR_HERESTRING);
+  EXPECT_EQ(std::string(word_str(&arena, &r->target)), "a $b");
+  EXPECT_EQ(text(list), "cat <<EOF 3<<-'END'");
+  EXPECT_EQ(parser.line, 6);
+
+  ASSERT_EQ(parse_next(&parser, &list), 1);
+  EXPECT_EQ(words(list->cmds), std::vector<std::string>({"next"}));
+
+  // the end of the source ends a body without its delimiter
+  list = parse("cat <<EOF\nlast");
+  EXPECT_EQ(std::string(list->cmds->redirs->target.text,
+                        list->cmds->redirs->target.len),
+            "last");
+  list = parse("cat <<EOF");
+  EXPECT_EQ(list->cmds->redirs->target.len, 0);
+}
+
+TEST_F(ParseTest, TestErrors) {
+  struct {
+    const char *src;
+    const char *error;
+  } cases[] = {
+      {"| a\n", "syntax error near unexpected token '|'"},
+      {"a || && b\n", "syntax error near unexpected token '&&'"},
+      {"a ; ; b\n", "syntax error near unexpected token ';'"},
+      {"a >\n", "syntax error: redirection without a target"},
+      {"a >& x\n", "syntax error near unexpected token 'x'"},
+      {"a |", "syntax error: unexpected end of file"},
+      {"echo \"abc\n", "syntax error: unterminated quote"},
+      {"echo 'abc", "syntax error: unterminated quote"},
+  };
+  for (auto &c : cases) {
+    struct node_t *list;
+    start(c.src);
+    EXPECT_EQ(parse_next(&parser, &list), -1) << c.src;
+    EXPECT_EQ(list, nullptr);
+    EXPECT_STREQ(parser.error, c.error) << c.src;
+  }
+
+  // the rest of a bad line is skipped, the next one parses
+  start("a | | b c\nd\n");
+  struct node_t *list;
+  EXPECT_EQ(parse_next(&parser, &list), -1);
+  EXPECT_EQ(parser.errline, 1);
+  ASSERT_EQ(parse_next(&parser, &list), 1);
+  EXPECT_EQ(words(list->cmds), std::vector<std::string>({"d"}));
+  EXPECT_EQ(parse_next(&parser, &list), 0);
+}
+
+TEST_F(ParseTest, TestErrorLine) {
+  // the line of the token the error is about, quotes may span lines
+  start("a\n\"b\nc\" ; ;\nd |\n\n");
+  struct node_t *list;
+  ASSERT_EQ(parse_next(&parser, &list), 1);
+  EXPECT_EQ(parse_next(&parser, &list), -1);
+  EXPECT_EQ(parser.errline, 3);
+  EXPECT_EQ(parse_next(&parser, &list), -1);
+  EXPECT_STREQ(parser.error, "syntax error: unexpected end of file");
+  EXPECT_EQ(parser.errline, 6);
+}
+
+TEST_F(ParseTest, TestTime) {
+  EXPECT_TRUE(word_istime(parse("time a | b\n")->cmds->words));
+  EXPECT_FALSE(word_istime(parse("'time' a\n")->cmds->words));
+  EXPECT_FALSE(word_istime(parse("timed a\n")->cmds->words));
+  EXPECT_FALSE(word_istime(parse("a time\n")->cmds->words));
+  EXPECT_FALSE(word_istime(NULL));
+}
+
+TEST_F(ParseTest, TestIncomplete) {
+  // parse s to its end
+  auto incomplete = [&](const std::string &s) {
+    start(s);
+    struct node_t *list;
+    while (parse_next(&parser, &list) != 0)
+      ;
+    return parser.more.incomplete;
+  };
+  EXPECT_TRUE(incomplete("echo \"a\n"));
+  EXPECT_TRUE(incomplete("echo 'a\n"));
+  EXPECT_TRUE(incomplete("echo x \\\n"));
+  EXPECT_TRUE(incomplete("echo x\\\n"));
+  EXPECT_TRUE(incomplete("echo $(a\n"));
+  EXPECT_TRUE(incomplete("echo ${a:-\n"));
+  EXPECT_TRUE(incomplete("echo `a\n"));
+  EXPECT_TRUE(incomplete("a |\n"));
+  EXPECT_TRUE(incomplete("a &&\n\n"));
+  EXPECT_TRUE(incomplete("cat <<EOF\n"));
+  EXPECT_TRUE(incomplete("cat <<EOF\nbody\n"));
+  // complete commands, and errors more lines do not fix
+  EXPECT_FALSE(incomplete("echo \"a\nb\"\n"));
+  EXPECT_FALSE(incomplete("echo x \\\ny\n"));
+  EXPECT_FALSE(incomplete("cat <<EOF\nbody\nEOF\n"));
+  EXPECT_FALSE(incomplete("echo a; ;\n"));
+  EXPECT_FALSE(incomplete("echo \\\\\n"));
+  EXPECT_FALSE(incomplete(""));
+}
+
+TEST_F(ParseTest, TestPending) {
+  // what the innermost construct left open waits for
+  auto close = [&](const std::string &s) {
+    start(s);
+    struct node_t *list;
+    while (parse_next(&parser, &list) != 0)
+      ;
+    EXPECT_TRUE(parser.more.incomplete) << s;
+    return parser.more.close;
+  };
+  EXPECT_EQ(close("echo \"a\n"), '"');
+  EXPECT_EQ(close("echo \"$(a '\n"), '\'');
+  EXPECT_EQ(close("echo $(a \"b\" (c)\n"), ')');
+  EXPECT_EQ(close("echo ${a:-`b`\n"), '}');
+  EXPECT_EQ(close("echo \"`a\n"), '`');
+  EXPECT_EQ(close("a |\n"), '\0');
+  EXPECT_EQ(close("echo x \\\n"), '\0');
+
+  struct pending_t more = {1, ')'};
+  EXPECT_FALSE(pending_check(&more, "a b\n", 4));
+  EXPECT_TRUE(pending_check(&more, "b)\n", 3));
+  more.close = '\0';
+  EXPECT_TRUE(pending_check(&more, "a b\n", 4));
+
+  // a here-document waits for its delimiter, the first of the line that is
+  // not there yet
+  start("cat <<A; cat <<-'B'\na\nA\nb\n");
+  struct node_t *list;
+  ASSERT_EQ(parse_next(&parser, &list), 1);
+  ASSERT_TRUE(parser.more.incomplete);
+  EXPECT_EQ(std::string(parser.more.delim, parser.more.ndelim), "B");
+  EXPECT_EQ(parser.more.strip, 1);
+  EXPECT_FALSE(pending_check(&parser.more, "b\n", 2));
+  EXPECT_FALSE(pending_check(&parser.more, "BB\n", 3));
+  EXPECT_TRUE(pending_check(&parser.more, "\t\tB\n", 4));
+  EXPECT_TRUE(pending_check(&parser.more, "B", 1));
+}
+
+TEST_F(ParseTest, TestNoNewline) {
+  struct node_t *list = parse("a b &");
+  ASSERT_NE(list, nullptr);
+  EXPECT_EQ(list->bg, 1);
+  EXPECT_EQ(parse_next(&parser, &list), 0);
+}
+
+TEST_F(ParseTest, TestLongLine) {
+  // far beyond the MAXLINE and MAXARGS of parseline
+  std::string line = "echo";
+  for (int i = 0; i < 100000; i++)
+    line += " arg" + std::to_string(i);
+  line += " | cat\n";
+
+  struct node_t *list = parse(line);
+  ASSERT_NE(list, nullptr);
+  ASSERT_EQ(list->ncmds, 2);
+  EXPECT_EQ(list->cmds->nwords, 100001);
+  EXPECT_EQ(std::string(word_str(&arena, list->cmds->words->next)), "arg0");
+  EXPECT_EQ(text(list).size(), line.size() - 1);
+}
+
+TEST_F(ParseTest, TestInterleaved) {
+  // parsers share nothing, so two sources can be read in turns
+  struct arena_t other;
+  arena_init(&other);
+  std::string a = "a1\na2\n", b = "b1; b2\nb3\n";
+  struct parser_t pa, pb;
+  parser_init(&pa, &arena, a.data(), a.size());
+  parser_init(&pb, &other, b.data(), b.size());
+
+  struct node_t *la, *lb;
+  ASSERT_EQ(parse_next(&pa, &la), 1);
+  ASSERT_EQ(parse_next(&pb, &lb), 1);
+  EXPECT_EQ(words(la->cmds)[0], "a1");
+  EXPECT_EQ(words(lb->next->cmds)[0], "b2");
+  ASSERT_EQ(parse_next(&pa, &la), 1);
+  ASSERT_EQ(parse_next(&pb, &lb), 1);
+  EXPECT_EQ(words(la->cmds)[0], "a2");
+  EXPECT_EQ(words(lb->cmds)[0], "b3");
+  EXPECT_EQ(parse_next(&pa, &la), 0);
+  EXPECT_EQ(parse_next(&pb, &lb), 0);
+  arena_free(&other);
+}
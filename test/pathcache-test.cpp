@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <string>
+
+extern "C" {
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "pathcache.h"
+#include "var.h"
+}
+
+class PathCacheTest : public ::testing::Test {
+protected:
+  char dir[32];
+
+  void SetUp() override {
+    strcpy(dir, "/tmp/pathcacheXXXXXX");
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    var_set("PATH", dir, VAR_EXPORT);
+    pathcache_clear();
+  }
+
+  void TearDown() override {
+    pathcache_clear();
+    std::string cmd = std::string("rm -rf ") + dir;
+    system(cmd.c_str());
+  }
+
+  void mkexec(const char *name) {
+    std::string path = std::string(dir) + "/" + name;
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY, 0755);
+    ASSERT_GE(fd, 0);
+    close(fd);
+  }
+};
+
+TEST_F(PathCacheTest, TestNegativeEntry) {
+  EXPECT_EQ(pathcache_lookup("minish-missing"), nullptr);
+  EXPECT_EQ(pathcache_size(), 1);
+  EXPECT_EQ(pathcache_lookup("minish-missing"), nullptr);
+  EXPECT_EQ(pathcache_size(), 1);
+}
+
+TEST_F(PathCacheTest, TestCreatedAfterNegativeEntry) {
+  EXPECT_EQ(pathcache_lookup("tool"), nullptr);
+  mkexec("tool");
+
+  struct pathent_t *ent = pathcache_lookup("tool");
+  ASSERT_NE(ent, nullptr);
+  EXPECT_EQ(std::string(ent->path), std::string(dir) + "/tool");
+}
+
+TEST_F(PathCacheTest, TestHotDescriptor) {
+  mkexec("tool");
+  struct pathent_t *ent = pathcache_lookup("tool");
+  ASSERT_NE(ent, nullptr);
+  EXPECT_EQ(ent->fd, -1);
+  ent = pathcache_lookup("tool");
+  EXPECT_GT(ent->fd, STDERR_FILENO);
+  EXPECT_EQ(ent->hits, PATHCACHE_HOT);
+}
+
+TEST_F(PathCacheTest, TestPrewarm) {
+  mkexec("tool");
+  struct pathent_t *ent = pathcache_prewarm("tool");
+  ASSERT_NE(ent, nullptr);
+  EXPECT_GT(ent->fd, STDERR_FILENO);
+}
+
+TEST_F(PathCacheTest, TestDeletedBinary) {
+  mkexec("tool");
+  ASSERT_NE(pathcache_lookup("tool"), nullptr);
+  std::string path = std::string(dir) + "/tool";
+  unlink(path.c_str());
+  EXPECT_EQ(pathcache_lookup("tool"), nullptr);
+}
+
+TEST_F(PathCacheTest, TestPathChange) {
+  mkexec("tool");
+  ASSERT_NE(pathcache_lookup("tool"), nullptr);
+  var_set("PATH", "/nonexistent", VAR_EXPORT);
+  EXPECT_EQ(pathcache_lookup("tool"), nullptr);
+  EXPECT_EQ(pathcache_size(), 1);
+}
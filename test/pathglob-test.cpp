@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "pathglob.h"
+}
+
+typedef std::vector<std::string> strings_t;
+
+class PathGlobTest : public ::testing::Test {
+protected:
+  struct arena_t arena;
+  char dir[32];
+
+  void SetUp() override {
+    arena_init(&arena);
+    strcpy(dir, "/tmp/pathglobXXXXXX");
+    ASSERT_NE(mkdtemp(dir), nullptr);
+  }
+
+  void TearDown() override {
+    std::string cmd = std::string("rm -rf ") + dir;
+    system(cmd.c_str());
+    arena_free(&arena);
+  }
+
+  void touch(const char *name) {
+    std::string path = std::string(dir) + "/" + name;
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY, 0644);
+    ASSERT_GE(fd, 0);
+    close(fd);
+  }
+
+  void mkdirs(const char *name) {
+    ASSERT_EQ(mkdir((std::string(dir) + "/" + name).c_str(), 0755), 0);
+  }
+
+  // paths that pattern matches under dir, without dir
+  strings_t glob(const std::string &pattern) {
+    std::string full = std::string(dir) + "/" + pattern;
+    char **paths;
+    int n = pathglob(&arena, full.data(), full.size(), &paths);
+    strings_t v;
+    for (int i = 0; i < n; i++)
+      v.push_back(paths[i] + strlen(dir) + 1);
+    return v;
+  }
+};
+
+TEST_F(PathGlobTest, TestNames) {
+  touch("b.c");
+  touch("a.c");
+  touch("ab.h");
+  touch(".hidden.c");
+  EXPECT_EQ(glob("*.c"), strings_t({"a.c", "b.c"}));
+  EXPECT_EQ(glob("?.c"), strings_t({"a.c", "b.c"}));
+  EXPECT_EQ(glob("[!a]*"), strings_t({"b.c"}));
+  EXPECT_EQ(glob("a*"), strings_t({"a.c", "ab.h"}));
+  EXPECT_EQ(glob("*.o"), strings_t());
+  // a name that starts with '.' needs a pattern that does, and "." and ".."
+  // match nothing
+  EXPECT_EQ(glob(".*"), strings_t({".hidden.c"}));
+  EXPECT_EQ(glob("\\*.c"), strings_t());
+}
+
+TEST_F(PathGlobTest, TestDirectories) {
+  mkdirs("src");
+  mkdirs("src/lib");
+  mkdirs("test");
+  touch("src/main.c");
+  touch("src/lib/util.c");
+  touch("test/main.c");
+  touch("file");
+  EXPECT_EQ(glob("*/"), strings_t({"src/", "test/"}));
+  EXPECT_EQ(glob("*/main.c"), strings_t({"src/main.c", "test/main.c"}));
+  EXPECT_EQ(glob("s*/*/*.c"), strings_t({"src/lib/util.c"}));
+  EXPECT_EQ(glob("src//*.c"), strings_t({"src/main.c"}));
+  EXPECT_EQ(glob("*/none.c"), strings_t());
+}
+
+TEST_F(PathGlobTest, TestLiteral) {
+  // a pattern without anything to match is not looked for
+  char **paths;
+  EXPECT_EQ(pathglob(&arena, "/", 1, &paths), 0);
+  EXPECT_EQ(pathglob(&arena, "[", 1, &paths), 0);
+  EXPECT_EQ(pathglob(&arena, "/tmp", 4, &paths), 0);
+}
+
+TEST_F(PathGlobTest, TestSort) {
+  std::vector<std::string> in;
+  for (int i = 0; i < 1000; i++)
+    in.push_back("dir/f" + std::to_string((i * 7919) % 1000));
+  in.push_back("dir/f");
+  in.push_back("dir/\xff");
+  in.push_back("dir/F");
+  std::vector<char *> v;
+  for (auto &s : in)
+    v.push_back(&s[0]);
+  pathglob_sort(&arena, v.data(), v.size());
+
+  std::vector<std::string> want(in);
+  std::sort(want.begin(), want.end());
+  EXPECT_EQ(std::vector<std::string>(v.begin(), v.end()), want);
+}
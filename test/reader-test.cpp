@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include <unistd.h>
+#include "reader.h"
+}
+
+class ReaderTest : public ::testing::Test {
+protected:
+  int fds[2];
+  struct reader_t r;
+
+  void SetUp() override {
+    ASSERT_EQ(pipe(fds), 0);
+    reader_init(&r, fds[0]);
+  }
+
+  void TearDown() override {
+    reader_free(&r);
+    close(fds[0]);
+    if (fds[1] >= 0)
+      close(fds[1]);
+  }
+
+  // write s and close the pipe, from a thread so that s may be larger than
+  // the pipe buffer
+  std::thread feed(const std::string &s) {
+    int fd = fds[1];
+    fds[1] = -1;
+    return std::thread([fd, s] {
+      for (size_t off = 0; off < s.size();) {
+        ssize_t n = write(fd, s.data() + off, s.size() - off);
+        ASSERT_GT(n, 0);
+        off += n;
+      }
+      close(fd);
+    });
+  }
+
+  std::string next() {
+    const char *line;
+    ssize_t n = reader_next(&r, &line);
+    EXPECT_GE(n, 0);
+    return n > 0 ? std::string(line, n) : std::string();
+  }
+};
+
+TEST_F(ReaderTest, TestLines) {
+  std::thread t = feed("one\n\ntwo three\nlast");
+  EXPECT_EQ(next(), "one\n");
+  EXPECT_EQ(next(), "\n");
+  EXPECT_EQ(next(), "two three\n");
+  // the last line needs no newline
+  EXPECT_EQ(next(), "last");
+  EXPECT_EQ(next(), "");
+  EXPECT_EQ(next(), "");
+  t.join();
+}
+
+TEST_F(ReaderTest, TestSlices) {
+  std::thread t = feed("a\nbb\nccc\n");
+  const char *a, *b;
+  ASSERT_EQ(reader_next(&r, &a), 2);
+  ASSERT_EQ(reader_next(&r, &b), 3);
+  // lines are handed out in place
+  EXPECT_EQ(b, a + 2);
+  EXPECT_EQ(b, r.buf + 2);
+  t.join();
+}
+
+TEST_F(ReaderTest, TestLongLine) {
+  // far longer than the buffer the reader starts with
+  std::string line(5 * READER_BUFSIZE + 17, 'x');
+  line += "\n";
+  std::thread t = feed("short\n" + line + "after\n");
+  EXPECT_EQ(next(), "short\n");
+  EXPECT_EQ(next(), line);
+  EXPECT_EQ(next(), "after\n");
+  EXPECT_EQ(next(), "");
+  EXPECT_GE(r.size, line.size());
+  t.join();
+}
+
+TEST_F(ReaderTest, TestManyLines) {
+  // lines cut by the end of the buffer are put together
+  std::string s;
+  for (int i = 0; i < 100000; i++)
+    s += "line " + std::to_string(i) + "\n";
+  std::thread t = feed(s);
+  int n = 0;
+  for (std::string l; !(l = next()).empty(); n++)
+    ASSERT_EQ(l, "line " + std::to_string(n) + "\n");
+  EXPECT_EQ(n, 100000);
+  EXPECT_EQ(r.size, (size_t)READER_BUFSIZE);
+  t.join();
+}
+
+TEST_F(ReaderTest, TestReadError) {
+  close(fds[1]);
+  fds[1] = -1;
+  struct reader_t bad;
+  reader_init(&bad, -1);
+  const char *line;
+  EXPECT_EQ(reader_next(&bad, &line), -1);
+  reader_free(&bad);
+}
+
+TEST_F(ReaderTest, TestExtend) {
+  std::thread t = feed("echo \"a\nb\"\nnext\n");
+  const char *text;
+  ASSERT_EQ(reader_next(&r, &text), 8);
+  // the next line is put behind the one handed out, in one slice
+  ASSERT_EQ(reader_extend(&r, &text, 8), 11);
+  EXPECT_EQ(std::string(text, 11), "echo \"a\nb\"\n");
+  EXPECT_EQ(next(), "next\n");
+  ASSERT_EQ(reader_next(&r, &text), 0);
+  EXPECT_EQ(reader_extend(&r, &text, 0), 0);
+  t.join();
+}
+
+TEST_F(ReaderTest, TestExtendLong) {
+  // the lines handed out move with the unread ones when the buffer is full
+  std::string s;
+  for (int i = 0; i < 20000; i++)
+    s += "line " + std::to_string(i) + "\n";
+  std::thread t = feed(s);
+  const char *text;
+  ssize_t len = reader_next(&r, &text);
+  for (ssize_t n; (n = reader_extend(&r, &text, len)) > 0;)
+    len = n;
+  EXPECT_EQ(std::string(text, len), s);
+  t.join();
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <string>
+
+extern "C" {
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "siolog.h"
+}
+
+class SiologTest : public ::testing::Test {
+protected:
+  FILE *out;
+  int saved;
+
+  // capture stdout in a temporary file
+  void SetUp() override {
+    siolog_flush();
+    fflush(stdout);
+    out = tmpfile();
+    saved = dup(STDOUT_FILENO);
+    dup2(fileno(out), STDOUT_FILENO);
+  }
+
+  void TearDown() override {
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    fclose(out);
+  }
+
+  std::string output() {
+    fflush(stdout);
+    std::string s;
+    char buf[4096];
+    size_t n;
+    rewind(out);
+    while ((n = fread(buf, 1, sizeof(buf), out)) > 0)
+      s.append(buf, n);
+    return s;
+  }
+};
+
+TEST_F(SiologTest, TestFormat) {
+  siolog_printf("%d %i %u %x %ld %c %s %s 100%%\n", -42, 7, 4000000000u, 255,
+                -1234567890123L, 'z', "str", (char *)NULL);
+  EXPECT_EQ(output(), "");
+  siolog_flush();
+  EXPECT_EQ(output(), "-42 7 4000000000 ff -1234567890123 z str (null) 100%\n");
+}
+
+TEST_F(SiologTest, TestOrderWithStdio) {
+  printf("first\n");
+  siolog_printf("second\n");
+  siolog_flush();
+  EXPECT_EQ(output(), "first\nsecond\n");
+}
+
+TEST_F(SiologTest, TestTruncate) {
+  std::string longer(SIOLOG_SLOTSIZE * 2, 'x');
+  siolog_printf("%s", longer.c_str());
+  siolog_flush();
+  EXPECT_EQ(output(), std::string(SIOLOG_SLOTSIZE - 1, 'x'));
+}
+
+TEST_F(SiologTest, TestDropWhenFull) {
+  long dropped = siolog_dropped();
+  for (int i = 0; i < SIOLOG_SLOTS + 10; i++)
+    siolog_printf("%d\n", i);
+  EXPECT_EQ(siolog_dropped() - dropped, 10);
+
+  siolog_flush();
+  std::string expect;
+  for (int i = 0; i < SIOLOG_SLOTS; i++)
+    expect += std::to_string(i) + "\n";
+  expect += "siolog: 10 messages dropped\n";
+  EXPECT_EQ(output(), expect);
+}
+
+static void handler(int sig) { siolog_printf("handler %d\n", sig); }
+
+TEST_F(SiologTest, TestSignalHandler) {
+  struct sigaction action, old;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handler;
+  sigaction(SIGUSR1, &action, &old);
+
+  // messages from a handler keep their place in the ring
+  siolog_printf("before\n");
+  raise(SIGUSR1);
+  siolog_printf("after\n");
+  sigaction(SIGUSR1, &old, NULL);
+
+  siolog_flush();
+  EXPECT_EQ(output(), "before\nhandler 10\nafter\n");
+}
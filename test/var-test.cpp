@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+
+extern "C" {
+#include <stdlib.h>
+#include "var.h"
+}
+
+static std::set<std::string> env_set(char **env) {
+  std::set<std::string> s;
+  for (; *env; env++)
+    s.insert(*env);
+  return s;
+}
+
+TEST(VarTest, TestSetGetUnset) {
+  EXPECT_EQ(var_get("VT_A"), nullptr);
+  EXPECT_EQ(var_flags("VT_A"), -1);
+  EXPECT_EQ(var_set("VT_A", "1", 0), 0);
+  EXPECT_STREQ(var_get("VT_A"), "1");
+  EXPECT_EQ(var_flags("VT_A"), 0);
+  EXPECT_STREQ(var_getn("VT_AB", 4), "1");
+
+  // flags are kept when the value changes
+  EXPECT_EQ(var_set("VT_A", "2", VAR_EXPORT), 0);
+  EXPECT_EQ(var_set("VT_A", "3", 0), 0);
+  EXPECT_STREQ(var_get("VT_A"), "3");
+  EXPECT_EQ(var_flags("VT_A"), VAR_EXPORT);
+
+  // a value may be set from the one it replaces
+  EXPECT_EQ(var_set("VT_A", var_get("VT_A"), 0), 0);
+  EXPECT_STREQ(var_get("VT_A"), "3");
+
+  var_unset("VT_A");
+  EXPECT_EQ(var_get("VT_A"), nullptr);
+  EXPECT_EQ(var_flags("VT_A"), -1);
+  var_unset("VT_A");
+
+  // set again after it was unset, it starts with no flags
+  EXPECT_EQ(var_set("VT_A", "", 0), 0);
+  EXPECT_STREQ(var_get("VT_A"), "");
+  EXPECT_EQ(var_flags("VT_A"), 0);
+}
+
+TEST(VarTest, TestNames) {
+  EXPECT_EQ(var_set("1x", "1", 0), -1);
+  EXPECT_EQ(var_set("a-b", "1", 0), -1);
+  EXPECT_EQ(var_set("", "1", 0), -1);
+  EXPECT_EQ(var_assign("=1", 0), -1);
+  EXPECT_EQ(var_assign("VT_N", 0), -1);
+  EXPECT_EQ(var_export("a b"), -1);
+  EXPECT_EQ(var_assign("_vt_n2=a=b", 0), 0);
+  EXPECT_STREQ(var_get("_vt_n2"), "a=b");
+
+  EXPECT_EQ(var_namelen("abc_1-x", 7), 5u);
+  EXPECT_EQ(var_namelen("abc", 2), 2u);
+  EXPECT_EQ(var_namelen("9a", 2), 0u);
+}
+
+TEST(VarTest, TestImport) {
+  // the environment the test was started with is there, exported
+  const char *path = getenv("PATH");
+  ASSERT_NE(path, nullptr);
+  EXPECT_STREQ(var_get("PATH"), path);
+  EXPECT_EQ(var_flags("PATH"), VAR_EXPORT);
+}
+
+TEST(VarTest, TestExportWithoutValue) {
+  EXPECT_EQ(var_export("VT_E"), 0);
+  EXPECT_EQ(var_get("VT_E"), nullptr);
+  EXPECT_EQ(var_flags("VT_E"), VAR_EXPORT);
+  EXPECT_EQ(env_set(var_environ()).count("VT_E"), 0u);
+
+  int pos = 0, flags;
+  const char *entry;
+  bool found = false;
+  while ((entry = var_next(&pos, &flags)))
+    found |= std::string(entry) == "VT_E";
+  EXPECT_TRUE(found);
+
+  var_set("VT_E", "x", 0);
+  EXPECT_EQ(env_set(var_environ()).count("VT_E=x"), 1u);
+  var_unset("VT_E");
+}
+
+TEST(VarTest, TestEnviron) {
+  var_set("VT_X", "1", VAR_EXPORT);
+  char **env = var_environ();
+  EXPECT_EQ(env_set(env).count("VT_X=1"), 1u);
+
+  // nothing exported changed, the same environment is given back
+  var_set("VT_LOCAL", "1", 0);
+  EXPECT_EQ(var_environ(), env);
+  EXPECT_EQ(env_set(var_environ()).count("VT_LOCAL=1"), 0u);
+
+  var_set("VT_X", "2", 0);
+  env = var_environ();
+  EXPECT_EQ(env_set(env).count("VT_X=1"), 0u);
+  EXPECT_EQ(env_set(env).count("VT_X=2"), 1u);
+
+  var_export("VT_LOCAL");
+  EXPECT_EQ(env_set(var_environ()).count("VT_LOCAL=1"), 1u);
+  var_unset("VT_LOCAL");
+  EXPECT_EQ(env_set(var_environ()).count("VT_LOCAL=1"), 0u);
+  var_unset("VT_X");
+}
+
+TEST(VarTest, TestEnvironWith) {
+  struct arena_t arena;
+  arena_init(&arena);
+  var_set("VT_W", "old", VAR_EXPORT);
+  var_set("VT_W2", "local", 0);
+
+  char a1[] = "VT_W=1", a2[] = "VT_W2=2", a3[] = "VT_W=3";
+  char *assigns[] = {a1, a2, a3};
+  char **env = var_environ_with(&arena, assigns, 3);
+  // the last assignment of a name is found first
+  EXPECT_STREQ(env[0], "VT_W=3");
+  std::set<std::string> s = env_set(env);
+  EXPECT_EQ(s.count("VT_W=old"), 0u);
+  EXPECT_EQ(s.count("VT_W2=2"), 1u);
+  EXPECT_EQ(s.count("VT_W2=local"), 0u);
+  EXPECT_EQ(s.size(), env_set(var_environ()).size() + 2);
+
+  // the variables themselves are left alone
+  EXPECT_STREQ(var_get("VT_W"), "old");
+  EXPECT_STREQ(var_get("VT_W2"), "local");
+  var_unset("VT_W");
+  var_unset("VT_W2");
+  arena_free(&arena);
+}
+
+TEST(VarTest, TestGrowAndCompact) {
+  char name[32], value[64];
+  for (int i = 0; i < 2000; i++) {
+    snprintf(name, sizeof(name), "VT_G%d", i);
+    snprintf(value, sizeof(value), "value %d", i);
+    ASSERT_EQ(var_set(name, value, i % 2 ? VAR_EXPORT : 0), 0);
+  }
+  // replacing values over and over leaves old strings to be compacted
+  std::string big(1000, 'x');
+  for (int round = 0; round < 200; round++)
+    var_set("VT_G7", (big + std::to_string(round)).c_str(), 0);
+  for (int i = 0; i < 2000; i += 2)
+    var_unset((std::string("VT_G") + std::to_string(i)).c_str());
+
+  for (int i = 0; i < 2000; i++) {
+    snprintf(name, sizeof(name), "VT_G%d", i);
+    snprintf(value, sizeof(value), "value %d", i);
+    if (i % 2 == 0)
+      EXPECT_EQ(var_get(name), nullptr) << name;
+    else if (i != 7)
+      EXPECT_STREQ(var_get(name), value) << name;
+  }
+  EXPECT_EQ(var_get("VT_G7"), big + "199");
+  std::set<std::string> s = env_set(var_environ());
+  EXPECT_EQ(s.count("VT_G1=value 1"), 1u);
+  EXPECT_EQ(s.count("VT_G7=" + big + "199"), 1u);
+  EXPECT_EQ(s.count("VT_G2=value 2"), 0u);
+}